@@ -23,6 +23,7 @@ ExternalProject_Add(
   -A Win32
   "-DBUILD_OUT_PREFIX=${BUILD_OUT_PREFIX}"
   -DWITH_ASAN=${WITH_ASAN}
+  -DWITH_TASK_LATENCY_TRACING=${WITH_TASK_LATENCY_TRACING}
   BUILD_COMMAND
   "${CMAKE_COMMAND}"
   --build "<BINARY_DIR>"
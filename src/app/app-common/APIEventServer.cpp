@@ -18,20 +18,15 @@
  * USA.
  */
 #include <OpenKneeboard/APIEventServer.hpp>
-#include <OpenKneeboard/Win32.hpp>
 
 #include <OpenKneeboard/config.hpp>
 #include <OpenKneeboard/dprint.hpp>
 #include <OpenKneeboard/final_release_deleter.hpp>
-#include <OpenKneeboard/json.hpp>
 #include <OpenKneeboard/scope_exit.hpp>
-#include <OpenKneeboard/task/resume_on_signal.hpp>
 #include <OpenKneeboard/tracing.hpp>
 
 #include <Windows.h>
 
-#include <thread>
-
 namespace OpenKneeboard {
 
 std::shared_ptr<APIEventServer> APIEventServer::Create() {
@@ -43,8 +38,22 @@ std::shared_ptr<APIEventServer> APIEventServer::Create() {
 OpenKneeboard::fire_and_forget APIEventServer::final_release(
   std::unique_ptr<APIEventServer> self) {
   TraceLoggingWrite(gTraceProvider, "APIEventServer::final_release()");
-  self->mStop.request_stop();
-  co_await std::move(self->mRunner).value();
+  self->mReaderThread.request_stop();
+  // The reader thread may have released the last reference, so don't join
+  // it from here
+  co_await winrt::resume_background();
+  if (self->mReaderThread.joinable()) {
+    self->mReaderThread.join();
+  }
+  const auto stats = self->GetStatistics();
+  dprint(
+    "APIEventServer: received {} events in {} batches; dispatched {}, "
+    "coalesced {}, {} invalid",
+    stats.mReceived,
+    stats.mBatches,
+    stats.mDispatched,
+    stats.mCoalesced,
+    stats.mInvalid);
   self = {};
   TraceLoggingWrite(gTraceProvider, "APIEventServer::~final_release()");
 }
@@ -55,8 +64,17 @@ APIEventServer::APIEventServer() {
 }
 
 void APIEventServer::Start() {
-  mStop = {};
-  mRunner = this->Run();
+  auto receiver = APIEventReceiver::Create(GetAPIEventTransportKind());
+  if (!receiver) {
+    return;
+  }
+  mReader = std::make_unique<APIEventBatchReader>(std::move(receiver));
+  // `Read()` blocks until there are events, or we're stopping, so this
+  // needs its own thread rather than a thread pool thread
+  mReaderThread = std::jthread {[this](std::stop_token stop) {
+    SetThreadDescription(GetCurrentThread(), L"APIEventServer Reader");
+    this->Run(stop);
+  }};
 }
 
 APIEventServer::~APIEventServer() {
@@ -64,15 +82,8 @@ APIEventServer::~APIEventServer() {
   dprint("{}", __FUNCTION__);
 }
 
-task<void> APIEventServer::Run() {
+void APIEventServer::Run(std::stop_token stop) {
   auto weak = weak_from_this();
-  auto stop = mStop.get_token();
-  const auto mailslot = Win32::CreateMailslot(
-    APIEvent::GetMailslotPath(), 0, MAILSLOT_WAIT_FOREVER, nullptr);
-  if (!mailslot) {
-    dprint("Failed to create APIEvent mailslot: {}", mailslot.error());
-    co_return;
-  }
 
   dprint("Started listening for API events");
   const scope_exit logOnExit([]() {
@@ -81,106 +92,55 @@ task<void> APIEventServer::Run() {
       std::uncaught_exceptions());
   });
 
-  const auto event
-    = Win32::or_throw::CreateEvent(nullptr, FALSE, FALSE, nullptr);
-
-  try {
-    while ((!stop.stop_requested())
-           && co_await RunSingle(weak, event.get(), mailslot->get())) {
-      // repeat!
+  while (!stop.stop_requested()) {
+    auto batch = mReader->Read(stop);
+    if (batch.empty()) {
+      continue;
     }
-  } catch (const winrt::hresult_canceled&) {
-    co_return;
+    auto self = weak.lock();
+    if (!self) {
+      dprint("Failed to acquire self");
+      return;
+    }
+    self->DispatchBatch(std::move(batch));
   }
-
-  co_return;
 }
 
-task<bool> APIEventServer::RunSingle(
-  std::weak_ptr<APIEventServer> instance,
-  HANDLE notifyEvent,
-  HANDLE mailslot) {
-  auto stop = instance.lock()->mStop.get_token();
-  OVERLAPPED overlapped {.hEvent = notifyEvent};
-
-  /* If there's no message yet, use this buffer size.
-   *
-   * If the buffer is too small, we'll have '0 bytes read',
-   * and loop into this function again.
-   *
-   * We'll then get a good result from GetMailslotInfo(),
-   * and allocate a correctly-sized buffer.
-   */
-  const constexpr DWORD DefaultBufferSize = 4096;
-  DWORD bufferSize {DefaultBufferSize};
-  if (
-    (!GetMailslotInfo(mailslot, nullptr, &bufferSize, nullptr, nullptr))
-    || bufferSize == MAILSLOT_NO_MESSAGE) {
-    bufferSize = DefaultBufferSize;
-  }
-
-  std::vector<char> buffer(bufferSize);
-  DWORD bytesRead {};
-  const auto readFileResult = ReadFile(
-    mailslot,
-    buffer.data(),
-    static_cast<DWORD>(buffer.size()),
-    &bytesRead,
-    &overlapped);
-  const auto readFileError = GetLastError();
-  if ((!readFileResult) && readFileError != ERROR_IO_PENDING) {
-    dprint("APIEvent ReadFile failed: {}", GetLastError());
-    co_return true;
-  }
-
-  TraceLoggingWrite(gTraceProvider, "APIEventServer::RunSingle()/Wait");
-  co_await resume_on_signal(notifyEvent, stop);
-  if (stop.stop_requested()) {
-    co_return false;
-  }
-  GetOverlappedResult(mailslot, &overlapped, &bytesRead, TRUE);
-
-  if (bytesRead == 0) {
-    dprint("Read 0-byte APIEvent message");
-    co_return true;
-  }
-
-  auto self = instance.lock();
-  if (!self) {
-    dprint("Failed to acquire self");
-    co_return false;
-  }
-
-  self->DispatchEvent({buffer.data(), bytesRead});
-  co_return true;
+APIEventServer::Statistics APIEventServer::GetStatistics() const {
+  const auto reader
+    = mReader ? mReader->GetStatistics() : APIEventBatchReader::Statistics {};
+  return {
+    .mReceived = reader.mReceived,
+    .mDispatched = mDispatched.load(std::memory_order_relaxed),
+    .mCoalesced = reader.mCoalesced,
+    .mInvalid = reader.mInvalid,
+    .mBatches = reader.mBatches,
+  };
 }
 
-OpenKneeboard::fire_and_forget APIEventServer::DispatchEvent(
-  std::string_view ref) {
+OpenKneeboard::fire_and_forget APIEventServer::DispatchBatch(
+  std::vector<APIEvent> events) {
+  if (events.empty()) {
+    co_return;
+  }
   const auto stayingAlive = shared_from_this();
-  const std::string buffer(ref);
-  auto event = APIEvent::Unserialize(buffer);
 
   co_await mUIThread;
   OPENKNEEBOARD_TraceLoggingCoro(
-    "APIEvent", TraceLoggingValue(event.name.c_str(), "Name"));
-  if (event.name != APIEvent::EVT_MULTI_EVENT) {
-    this->evAPIEvent.Emit(event);
-    co_return;
-  }
-
-  std::vector<std::tuple<std::string, std::string>> events;
-  events = nlohmann::json::parse(event.value);
-  auto dq = DispatcherQueue::GetForCurrentThread();
-  for (auto&& [name, value]: events) {
-    OPENKNEEBOARD_TraceLoggingCoro(
-      "APIEvent/Multi", TraceLoggingValue(name.c_str(), "Name"));
-    this->evAPIEvent.Emit({name, value});
-    // Re-enter event loop, even if not switching threads
-    co_await wil::resume_foreground(dq);
+    "APIEventServer::DispatchBatch()",
+    TraceLoggingValue(events.size(), "Count"));
+
+  // Emitted back-to-back: handlers only queue work, e.g.
+  // `KneeboardState::OnAPIEvent()`, and yielding here would let a later
+  // batch's events run before the rest of this one
+  for (const auto& event: events) {
+    {
+      OPENKNEEBOARD_TraceLoggingScope(
+        "APIEvent", TraceLoggingValue(event.name.c_str(), "Name"));
+      this->evAPIEvent.Emit(event);
+    }
+    mDispatched.fetch_add(1, std::memory_order_relaxed);
   }
-
-  co_return;
 }
 
 }// namespace OpenKneeboard
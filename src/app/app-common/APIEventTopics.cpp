@@ -0,0 +1,97 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#include <OpenKneeboard/APIEventTopics.hpp>
+
+#include <OpenKneeboard/dprint.hpp>
+
+#include <algorithm>
+
+namespace OpenKneeboard {
+
+APIEventTopics::APIEventTopics() = default;
+APIEventTopics::~APIEventTopics() = default;
+
+Event<APIEvent>& APIEventTopics::GetTopic(std::string_view name) {
+  const auto it = std::ranges::find(
+    mTopics, name, [](const auto& topic) { return topic->mName; });
+  if (it != mTopics.end()) {
+    return (*it)->mEvent;
+  }
+
+  auto& topic = *mTopics.emplace_back(new Topic {std::string {name}});
+  if (name.ends_with('/')) {
+    mPrefixTopics.push_back(&topic);
+    return topic.mEvent;
+  }
+
+  const auto id = APIEventRegistry::Intern(name);
+  if (id == APIEventTypeID::Inline) [[unlikely]] {
+    // The registry is full; treat it like a prefix that must match exactly,
+    // so subscribers still work, just slower
+    dprint.Warning("Couldn't intern API event topic '{}'", name);
+    mPrefixTopics.push_back(&topic);
+    return topic.mEvent;
+  }
+  mNameTopics.Add(name, &topic);
+  return topic.mEvent;
+}
+
+void APIEventTopics::Emit(const APIEvent& event) {
+  const auto id = (event.typeID == APIEventTypeID::Inline)
+    ? APIEventRegistry::Find(event.name)
+    : event.typeID;
+
+  bool routed = false;
+  if (const auto topic = mNameTopics.Find(id)) {
+    this->Emit(**topic, event);
+    routed = true;
+  }
+
+  for (const auto topic: mPrefixTopics) {
+    const auto matches = topic->mName.ends_with('/')
+      ? event.name.starts_with(topic->mName)
+      : (event.name == topic->mName);
+    if (matches) {
+      this->Emit(*topic, event);
+      routed = true;
+    }
+  }
+
+  if (!routed) {
+    ++mUnrouted;
+  }
+}
+
+void APIEventTopics::Emit(Topic& topic, const APIEvent& event) {
+  ++topic.mEmitted;
+  topic.mDelivered += topic.mEvent.GetHandlerCount();
+  topic.mEvent.Emit(event);
+}
+
+APIEventTopics::Statistics APIEventTopics::GetStatistics() const {
+  Statistics ret {.mUnrouted = mUnrouted};
+  ret.mTopics.reserve(mTopics.size());
+  for (const auto& topic: mTopics) {
+    ret.mTopics.push_back({topic->mName, topic->mEmitted, topic->mDelivered});
+  }
+  return ret;
+}
+
+}// namespace OpenKneeboard
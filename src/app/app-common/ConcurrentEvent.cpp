@@ -0,0 +1,91 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#include <OpenKneeboard/ConcurrentEvent.hpp>
+
+#include <OpenKneeboard/scope_exit.hpp>
+#include <OpenKneeboard/tracing.hpp>
+
+#include <mutex>
+#include <vector>
+
+namespace OpenKneeboard {
+
+namespace {
+struct Registry {
+  std::mutex mMutex;
+  std::vector<std::weak_ptr<ConcurrentEventBase::Queue>> mQueues;
+
+  static auto& Get() {
+    static Registry sInstance;
+    return sInstance;
+  }
+};
+}// namespace
+
+ConcurrentEventBase::Queue::~Queue() = default;
+
+void ConcurrentEventBase::Register(const std::shared_ptr<Queue>& queue) {
+  auto& registry = Registry::Get();
+  std::unique_lock lock(registry.mMutex);
+  registry.mQueues.push_back(queue);
+}
+
+void ConcurrentEventBase::RecordDropped(
+  std::source_location location) noexcept {
+  TraceLoggingWrite(
+    gTraceProvider,
+    "ConcurrentEvent::Emit()/Dropped",
+    OPENKNEEBOARD_TraceLoggingSourceLocation(location));
+}
+
+void ConcurrentEventBase::DrainAll() {
+  OPENKNEEBOARD_TraceLoggingScope("ConcurrentEventBase::DrainAll()");
+  // Reused between calls, so that we don't allocate every frame
+  static std::vector<std::shared_ptr<Queue>> sQueues;
+  // Handlers can't drain recursively; they're already being called in order
+  static bool sDraining = false;
+  if (sDraining) {
+    return;
+  }
+  sDraining = true;
+  const scope_exit notDraining([]() { sDraining = false; });
+
+  {
+    auto& registry = Registry::Get();
+    std::unique_lock lock(registry.mMutex);
+    std::erase_if(registry.mQueues, [](const auto& weak) {
+      auto queue = weak.lock();
+      if (!queue) {
+        return true;
+      }
+      sQueues.push_back(std::move(queue));
+      return false;
+    });
+  }
+
+  // Handlers may create or destroy events, so don't hold the lock while
+  // calling them
+  const scope_exit clearQueues([]() { sQueues.clear(); });
+  for (const auto& queue: sQueues) {
+    queue->Drain();
+  }
+}
+
+}// namespace OpenKneeboard
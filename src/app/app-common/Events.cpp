@@ -21,16 +21,20 @@
 
 #include <OpenKneeboard/dprint.hpp>
 #include <OpenKneeboard/fatal.hpp>
-#include <OpenKneeboard/scope_exit.hpp>
 
-#include <queue>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <optional>
 
 namespace OpenKneeboard {
 
-static uint64_t sNextUniqueID = 0x1234abcdui64 << 32;
+// Atomic as `ConcurrentEvent` handlers - and their tokens - can be created
+// on any thread
+static std::atomic_uint64_t sNextUniqueID {uint64_t {0x1234abcd} << 32};
 
 uint64_t _UniqueIDImpl::GetAndIncrementNextValue() {
-  return sNextUniqueID++;
+  return sNextUniqueID.fetch_add(1, std::memory_order_relaxed);
 }
 
 EventReceiver::EventReceiver() {
@@ -78,10 +82,63 @@ void EventReceiver::RemoveEventListener(EventHandlerToken token) {
 
 namespace {
 struct EmitterQueueItem {
-  std::function<void()> mEmitter;
+  EventHandler<> mEmitter;
   std::source_location mEnqueuedFrom;
 };
 
+/** A FIFO queue of emitters, stored in-place in a fixed-size ring buffer.
+ *
+ * If the ring buffer is full, further items go to a heap-allocated overflow
+ * queue until it is drained.
+ */
+class EmitterQueue final {
+ public:
+  static constexpr std::size_t RingCapacity = 64;
+
+  void Push(EmitterQueueItem item) {
+    // If anything is in the overflow queue, new items must go after it
+    if (mRingSize < RingCapacity && mOverflow.empty()) {
+      mRing[(mRingHead + mRingSize) % RingCapacity] = std::move(item);
+      ++mRingSize;
+    } else {
+      mOverflow.push_back(std::move(item));
+      ++mStatistics.mOverflowCount;
+    }
+    mStatistics.mPeakDepth = std::max(mStatistics.mPeakDepth, this->GetDepth());
+  }
+
+  std::optional<EmitterQueueItem> Pop() {
+    if (mRingSize > 0) {
+      std::optional<EmitterQueueItem> ret {std::move(mRing[mRingHead])};
+      mRingHead = (mRingHead + 1) % RingCapacity;
+      --mRingSize;
+      return ret;
+    }
+    if (!mOverflow.empty()) {
+      std::optional<EmitterQueueItem> ret {std::move(mOverflow.front())};
+      mOverflow.pop_front();
+      return ret;
+    }
+    return std::nullopt;
+  }
+
+  std::size_t GetDepth() const noexcept {
+    return mRingSize + mOverflow.size();
+  }
+
+  EventDelay::Statistics GetStatistics() const noexcept {
+    return mStatistics;
+  }
+
+ private:
+  std::array<EmitterQueueItem, RingCapacity> mRing;
+  std::size_t mRingHead {0};
+  std::size_t mRingSize {0};
+  std::deque<EmitterQueueItem> mOverflow;
+
+  EventDelay::Statistics mStatistics;
+};
+
 struct GlobalData {
   bool StartEvent() {
     mEventCount.fetch_add(1);
@@ -96,6 +153,7 @@ struct GlobalData {
     this->Sub1();
   }
 
+#ifdef _WIN32
   void Shutdown(HANDLE event) {
     mShutdownEvent = event;
     if (mShuttingDown.test_and_set()) {
@@ -104,6 +162,7 @@ struct GlobalData {
 
     this->Sub1();
   }
+#endif
 
   static auto& Get() {
     static GlobalData sInstance;
@@ -118,13 +177,17 @@ struct GlobalData {
       if (!mShuttingDown.test()) [[unlikely]] {
         fatal("Event count = 0, but not shutting down");
       }
+#ifdef _WIN32
       SetEvent(mShutdownEvent);
+#endif
     }
   }
 
   std::atomic_uint64_t mEventCount {1};
   std::atomic_flag mShuttingDown;
+#ifdef _WIN32
   HANDLE mShutdownEvent {};
+#endif
 };
 
 struct ThreadData {
@@ -135,55 +198,58 @@ struct ThreadData {
     return sInstance;
   }
 
-  void EmitOrEnqueue(const EmitterQueueItem& item) noexcept {
-    auto& globals = GlobalData::Get();
-    if (!globals.StartEvent()) {
-      return;
-    }
-    if (mDelayDepth > 0) {
-      mEmitterQueue.push(item);
-      return;
-    }
-
-    item.mEmitter();
-    globals.FinishEvent();
+  void Enqueue(EmitterQueueItem item) {
+    mEmitterQueue.Push(std::move(item));
   }
 
   void Flush() noexcept {
     auto& globals = GlobalData::Get();
-    while (!mEmitterQueue.empty()) {
-      auto item = mEmitterQueue.front();
-      mEmitterQueue.pop();
-      item.mEmitter();
+    while (auto item = mEmitterQueue.Pop()) {
+      item->mEmitter();
       globals.FinishEvent();
     }
   }
 
+  std::size_t GetQueueDepth() const noexcept {
+    return mEmitterQueue.GetDepth();
+  }
+
+  EventDelay::Statistics GetStatistics() const noexcept {
+    return mEmitterQueue.GetStatistics();
+  }
+
  private:
   ThreadData() = default;
 
-  std::queue<EmitterQueueItem> mEmitterQueue;
+  EmitterQueue mEmitterQueue;
 };
 
 }// namespace
 
+#ifdef _WIN32
 void EventBase::Shutdown(HANDLE event) {
   GlobalData::Get().Shutdown(event);
 }
+#endif
 
-void EventBase::InvokeOrEnqueue(
-  std::function<void()> func,
-  std::source_location location) {
-  EventsTraceLoggingThreadActivity activity;
-  TraceLoggingWriteStart(
-    activity,
-    "EventBase::InvokeOrEnqueue()",
-    OPENKNEEBOARD_TraceLoggingSourceLocation(location));
-  const scope_exit tlStop(
-    [&]() { TraceLoggingWriteStop(activity, "EventBase::InvokeOrEnqueue()"); });
+EventBase::InvokeKind EventBase::BeginInvoke() noexcept {
+  if (!GlobalData::Get().StartEvent()) {
+    return InvokeKind::Drop;
+  }
+  if (ThreadData::Get().mDelayDepth > 0) {
+    return InvokeKind::Enqueue;
+  }
+  return InvokeKind::Immediate;
+}
 
-  auto& queue = ThreadData::Get();
-  queue.EmitOrEnqueue({func, location});
+void EventBase::EndInvoke() noexcept {
+  GlobalData::Get().FinishEvent();
+}
+
+void EventBase::Enqueue(
+  EventHandler<> func,
+  std::source_location location) {
+  ThreadData::Get().Enqueue({std::move(func), location});
 }
 
 EventDelay::EventDelay(std::source_location source) : mSourceLocation(source) {
@@ -199,6 +265,7 @@ EventDelay::EventDelay(std::source_location source) : mSourceLocation(source) {
 EventDelay::~EventDelay() {
   auto& queue = ThreadData::Get();
   const auto count = --queue.mDelayDepth;
+  const auto queued = queue.GetQueueDepth();
   if (!count) {
     queue.Flush();
   }
@@ -206,8 +273,14 @@ EventDelay::~EventDelay() {
     mActivity,
     "EventDelay",
     TraceLoggingValue(queue.mDelayDepth, "Depth"),
+    TraceLoggingValue(queued, "QueuedCalls"),
+    TraceLoggingValue(queue.GetStatistics().mPeakDepth, "PeakQueuedCalls"),
     OPENKNEEBOARD_TraceLoggingSourceLocation(mSourceLocation));
   return;
 }
 
+EventDelay::Statistics EventDelay::GetStatistics() noexcept {
+  return ThreadData::Get().GetStatistics();
+}
+
 }// namespace OpenKneeboard
@@ -86,6 +86,18 @@ task<void> FilesystemWatcher::Run() {
   }
 }
 
+void FilesystemWatcher::EmitModified() {
+  if (evFilesystemModifiedEvent.Emit(mPath)) {
+    return;
+  }
+  // The queue is full of undelivered notifications for `mPath`; handlers
+  // re-read the path when they get one, so those also cover this change.
+  TraceLoggingWrite(
+    gTraceProvider,
+    "FilesystemWatcher::EmitModified()/Coalesced",
+    TraceLoggingValue(mPath.c_str(), "Path"));
+}
+
 OpenKneeboard::fire_and_forget FilesystemWatcher::OnContentsChanged() {
   const auto weak = weak_from_this();
 
@@ -93,7 +105,7 @@ OpenKneeboard::fire_and_forget FilesystemWatcher::OnContentsChanged() {
     if (
       (!std::filesystem::exists(mPath))
       || std::filesystem::is_directory(mPath)) {
-      this->evFilesystemModifiedEvent.EnqueueForContext(mOwnerThread, mPath);
+      this->EmitModified();
       co_return;
     }
   } catch (const std::filesystem::filesystem_error& e) {
@@ -131,7 +143,7 @@ OpenKneeboard::fire_and_forget FilesystemWatcher::OnContentsChanged() {
         mPath,
         static_cast<uint32_t>(e.code().value()),
         e.what());
-      this->evFilesystemModifiedEvent.EnqueueForContext(mOwnerThread, mPath);
+      this->EmitModified();
       co_return;
     }
     if (lastWriteTime == mLastWriteTime) {
@@ -170,7 +182,7 @@ OpenKneeboard::fire_and_forget FilesystemWatcher::OnContentsChanged() {
     }
 
     mLastWriteTime = lastWriteTime;
-    this->evFilesystemModifiedEvent.EnqueueForContext(mOwnerThread, mPath);
+    this->EmitModified();
     co_return;
   }
 }
@@ -37,6 +37,7 @@
 #include <OpenKneeboard/scope_exit.hpp>
 #include <OpenKneeboard/tracing.hpp>
 
+#include <chrono>
 #include <mutex>
 #include <ranges>
 
@@ -77,7 +78,8 @@ static SHM::ConsumerPattern GetConsumerPatternForGame(
 
 void InterprocessRenderer::SubmitFrame(
   const std::vector<SHM::LayerConfig>& shmLayers,
-  uint64_t inputLayerID) noexcept {
+  uint64_t inputLayerID,
+  std::chrono::steady_clock::time_point beginRenderTime) noexcept {
   if (!mSHM) {
     return;
   }
@@ -101,7 +103,7 @@ void InterprocessRenderer::SubmitFrame(
   const std::unique_lock shmLock(mSHM);
   TraceLoggingWriteTagged(activity, "AcquireSHMLock/stop");
 
-  auto ipcTextureInfo = mSHM.BeginFrame();
+  auto ipcTextureInfo = mSHM.BeginFrame(beginRenderTime);
   auto destResources
     = this->GetIPCTextureResources(ipcTextureInfo.mTextureIndex, mCanvasSize);
 
@@ -120,6 +122,8 @@ void InterprocessRenderer::SubmitFrame(
       OPENKNEEBOARD_TraceLoggingScope("CopyFromCanvas/FenceOut");
       check_hresult(ctx->Signal(fence, ipcTextureInfo.mFenceOut));
     }
+    this->WaitForFrameReady(
+      ipcTextureInfo.mTextureIndex, ipcTextureInfo.mFenceOut);
   }
 
   SHM::Config config {
@@ -282,11 +286,58 @@ OpenKneeboard::fire_and_forget InterprocessRenderer::final_release(
   co_await it->mOwnerThread;
 }
 
+void InterprocessRenderer::WaitForFrameReady(
+  uint8_t textureIndex,
+  LONG64 fenceValue) noexcept {
+  auto& it = mFrameReadyWaits.at(textureIndex);
+  if (!it.mWait) [[unlikely]] {
+    return;
+  }
+
+  it.mFenceValue.store(fenceValue, std::memory_order_release);
+  const auto fence = mIPCSwapchain.at(textureIndex).mFence.get();
+  // Telemetry only: not worth failing the frame for
+  if (const auto hr = fence->SetEventOnCompletion(fenceValue, it.mEvent.get());
+      FAILED(hr)) [[unlikely]] {
+    dprint.Warning(
+      "SetEventOnCompletion() for frame ready time failed: {:#x}",
+      static_cast<uint32_t>(hr));
+    return;
+  }
+  SetThreadpoolWait(it.mWait, it.mEvent.get(), nullptr);
+}
+
+void CALLBACK InterprocessRenderer::OnFrameReady(
+  PTP_CALLBACK_INSTANCE,
+  void* context,
+  PTP_WAIT,
+  TP_WAIT_RESULT result) {
+  const auto now = std::chrono::steady_clock::now();
+  if (result != WAIT_OBJECT_0) {
+    return;
+  }
+  // The destructor waits for this callback before tearing anything down
+  const auto it = static_cast<FrameReadyWait*>(context);
+  it->mRenderer->mSHM.SetFrameReadyTime(
+    it->mTextureIndex, it->mFenceValue.load(std::memory_order_acquire), now);
+}
+
 std::mutex InterprocessRenderer::sSingleInstance;
 
 InterprocessRenderer::InterprocessRenderer(const audited_ptr<DXResources>& dxr)
   : mInstanceLock(sSingleInstance), mDXR(dxr), mSHM(dxr->mAdapterLUID) {
   dprint(__FUNCTION__);
+  for (uint8_t i = 0; i < mFrameReadyWaits.size(); ++i) {
+    auto& it = mFrameReadyWaits.at(i);
+    it.mRenderer = this;
+    it.mTextureIndex = i;
+    it.mEvent = winrt::handle {CreateEventW(nullptr, FALSE, FALSE, nullptr)};
+    if (!it.mEvent) {
+      dprint.Warning("Failed to create frame ready event: {}", GetLastError());
+      continue;
+    }
+    it.mWait = CreateThreadpoolWait(&OnFrameReady, &it, nullptr);
+  }
 }
 
 void InterprocessRenderer::Initialize(KneeboardState* kneeboard) {
@@ -305,6 +356,14 @@ void InterprocessRenderer::Initialize(KneeboardState* kneeboard) {
 InterprocessRenderer::~InterprocessRenderer() {
   dprint(__FUNCTION__);
   this->RemoveAllEventListeners();
+  for (auto& it: mFrameReadyWaits) {
+    if (!it.mWait) {
+      continue;
+    }
+    SetThreadpoolWait(it.mWait, nullptr, nullptr);
+    WaitForThreadpoolWaitCallbacks(it.mWait, /* cancel pending = */ TRUE);
+    CloseThreadpoolWait(it.mWait);
+  }
   {
     // SHM::Writer's destructor will do this, but let's make sure to
     // tear it down before the vtable and other members go - especially
@@ -365,6 +424,7 @@ task<void> InterprocessRenderer::RenderNow() noexcept {
   OPENKNEEBOARD_TraceLoggingScopedActivity(
     activity, "InterprocessRenderer::RenderNow()");
 
+  const auto beginRenderTime = std::chrono::steady_clock::now();
   const auto renderInfos = mKneeboard->GetViewRenderInfo();
   const auto layerCount = renderInfos.size();
 
@@ -398,6 +458,7 @@ task<void> InterprocessRenderer::RenderNow() noexcept {
   std::vector<SHM::LayerConfig> shmLayers;
   shmLayers.reserve(layerCount);
   uint64_t inputLayerID = 0;
+  decltype(mContentGenerations) contentGenerations;
 
   for (uint8_t i = 0; i < layerCount; ++i) {
     const auto bounds = Spriting::GetRect(i, layerCount);
@@ -408,10 +469,24 @@ task<void> InterprocessRenderer::RenderNow() noexcept {
 
     mCanvas->SetActiveIdentity(i);
 
-    shmLayers.push_back(co_await this->RenderLayer(renderInfo, bounds));
+    auto shmLayer = co_await this->RenderLayer(renderInfo, bounds);
+
+    // We still repaint every layer, but consumers can skip the ones that
+    // haven't changed
+    const auto it = mContentGenerations.find(shmLayer.mLayerID);
+    if (
+      it == mContentGenerations.end()
+      || it->second != renderInfo.mContentGeneration) {
+      shmLayer.mDirtyRect = {bounds.mOffset, renderInfo.mFullSize};
+    }
+    contentGenerations.emplace(
+      shmLayer.mLayerID, renderInfo.mContentGeneration);
+
+    shmLayers.push_back(shmLayer);
   }
 
-  this->SubmitFrame(shmLayers, inputLayerID);
+  mContentGenerations = std::move(contentGenerations);
+  this->SubmitFrame(shmLayers, inputLayerID, beginRenderTime);
 }
 
 void InterprocessRenderer::OnGameChanged(
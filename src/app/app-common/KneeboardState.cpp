@@ -29,6 +29,7 @@
 #include <OpenKneeboard/KneeboardView.hpp>
 #include <OpenKneeboard/OpenXRMode.hpp>
 #include <OpenKneeboard/PluginStore.hpp>
+#include <OpenKneeboard/SHM/APIEventMetrics.hpp>
 #include <OpenKneeboard/SHM/ActiveConsumers.hpp>
 #include <OpenKneeboard/SteamVRKneeboard.hpp>
 #include <OpenKneeboard/TabView.hpp>
@@ -43,11 +44,29 @@
 #include <OpenKneeboard/final_release_deleter.hpp>
 #include <OpenKneeboard/scope_exit.hpp>
 
+#include <OpenKneeboard/task/latency.hpp>
+#include <OpenKneeboard/task/thread_pool.hpp>
+
 #include <algorithm>
+#include <functional>
 #include <string>
+#include <utility>
 
 namespace OpenKneeboard {
 
+// `OrderedEventQueue` cost estimates are per key; these keep API events and
+// user actions apart, and from events that don't have a key
+static OrderedEventQueue::CostKey GetOrderedEventCostKey(APIEventTypeID id) {
+  return 1 + static_cast<OrderedEventQueue::CostKey>(std::to_underlying(id));
+}
+
+static OrderedEventQueue::CostKey GetOrderedEventCostKey(UserAction action) {
+  constexpr OrderedEventQueue::CostKey FirstUserActionKey = 0x1'0000 + 1;
+  static_assert(sizeof(APIEventTypeID) == sizeof(uint16_t));
+  return FirstUserActionKey
+    + static_cast<OrderedEventQueue::CostKey>(std::to_underlying(action));
+}
+
 task<std::shared_ptr<KneeboardState>> KneeboardState::Create(
   HWND hwnd,
   audited_ptr<DXResources> dxr) {
@@ -114,8 +133,10 @@ task<void> KneeboardState::Init() {
 
   mDirectInput = DirectInputAdapter::Create(mHwnd, mSettings.mDirectInput);
   AddEventListener(mDirectInput->evUserActionEvent, [this](auto action) {
-    this->EnqueueOrderedEvent(
-      std::bind_front(&KneeboardState::PostUserAction, this, action));
+    mOrderedEventQueue.Push(
+      OrderedEventPriority::Interactive,
+      std::bind_front(&KneeboardState::PostUserAction, this, action),
+      GetOrderedEventCostKey(action));
   });
   AddEventListener(
     mDirectInput->evSettingsChangedEvent,
@@ -143,6 +164,70 @@ OpenKneeboard::fire_and_forget KneeboardState::final_release(
   self->RemoveAllEventListeners();
   co_await self->ReleaseExclusiveResources();
 
+  const auto apiEventStats = self->evAPIEvent.GetStatistics();
+  dprint(
+    "KneeboardState: {} API events had no subscribers",
+    apiEventStats.mUnrouted);
+  for (const auto& topic: apiEventStats.mTopics) {
+    dprint(
+      "KneeboardState: API event topic '{}': emitted {}, delivered {}",
+      topic.mTopic,
+      topic.mEmitted,
+      topic.mDelivered);
+  }
+
+  for (const auto& [priority, name]: {
+         std::pair {OrderedEventPriority::Interactive, "interactive"},
+         std::pair {OrderedEventPriority::State, "state"},
+         std::pair {OrderedEventPriority::Bulk, "bulk"},
+       }) {
+    const auto stats = self->mOrderedEventQueue.GetStatistics(priority);
+    if (stats.mCount == 0) {
+      continue;
+    }
+    using std::chrono::duration_cast;
+    using us = std::chrono::microseconds;
+    dprint(
+      "KneeboardState: {} {} ordered events; cost mean {} max {}; wait mean "
+      "{} max {}; deferred {} times",
+      stats.mCount,
+      name,
+      duration_cast<us>(stats.mTotalCost / stats.mCount),
+      duration_cast<us>(stats.mMaxCost),
+      duration_cast<us>(stats.mTotalWait / stats.mCount),
+      duration_cast<us>(stats.mMaxWait),
+      stats.mDeferred);
+  }
+
+  const auto pool = ThreadPool::GetBackground();
+  const auto poolStats = pool->GetStatistics();
+  dprint(
+    "KneeboardState: background thread pool: {} workers ({} for IO), {} "
+    "steals",
+    pool->GetThreadCount(),
+    pool->GetMaxIOWorkers(),
+    poolStats.mSteals);
+  for (const auto& [priority, name]: {
+         std::pair {TaskPriority::RenderPrep, "render prep"},
+         std::pair {TaskPriority::IO, "IO"},
+         std::pair {TaskPriority::BulkParse, "bulk parse"},
+       }) {
+    const auto& stats = poolStats.at(priority);
+    if (stats.mPosted == 0) {
+      continue;
+    }
+    using std::chrono::duration_cast;
+    using us = std::chrono::microseconds;
+    dprint(
+      "KneeboardState: {} {} thread pool items; wait mean {} max {}; peak "
+      "depth {}",
+      stats.mResumed,
+      name,
+      duration_cast<us>(stats.GetMeanWait()),
+      duration_cast<us>(stats.mMaxWait),
+      stats.mPeakDepth);
+  }
+
   // Implied, but let's get some perf tracing on the member's destructors
   self = {};
   TraceLoggingWrite(gTraceProvider, "KneeboardState::~final_release()");
@@ -189,6 +274,9 @@ std::vector<ViewRenderInfo> KneeboardState::GetViewRenderInfo() const {
         contentSize, fullLocation, contentLocation, mSettings.mViews.mViews),
       .mFullSize = layoutSize,
       .mIsActiveForInput = (i == mInputViewIndex),
+      // Both are monotonic, so the sum changes if either does
+      .mContentGeneration
+      = view->GetContentGeneration() + mRepaintAllGeneration,
     });
 
     TraceLoggingWriteTagged(
@@ -411,6 +499,38 @@ void KneeboardState::OnGameChangedEvent(
   this->evGameChangedEvent.Emit(processID, game);
 }
 
+static OrderedEventPriority GetOrderedEventPriority(APIEventTypeID typeID) {
+  using enum APIEventTypeID;
+  switch (typeID) {
+    case RemoteUserAction:
+    case SetTabByID:
+    case SetTabByName:
+    case SetTabByIndex:
+    case SetProfileByGUID:
+    case SetProfileByName:
+    case SetBrightness:
+    case PluginTabCustomAction:
+    case OKBExecutableLaunched:
+      return OrderedEventPriority::Interactive;
+    case MultiEvent:
+    case DCSAircraft:
+    case DCSInstallPath:
+    case DCSMission:
+    case DCSMissionTime:
+    case DCSOrigin:
+    case DCSSelfData:
+    case DCSMessage:
+    case DCSSavedGamesPath:
+    case DCSSimulationStart:
+    case DCSTerrain:
+      return OrderedEventPriority::State;
+    case Inline:
+      break;
+  }
+  // Unknown, or registered at runtime
+  return OrderedEventPriority::Bulk;
+}
+
 void KneeboardState::OnAPIEvent(APIEvent ev) noexcept {
   if (winrt::apartment_context() != mUIThread) {
     dprint("API event in wrong thread!");
@@ -418,12 +538,26 @@ void KneeboardState::OnAPIEvent(APIEvent ev) noexcept {
   }
   TroubleshootingStore::Get()->OnAPIEvent(ev);
 
-  mOrderedEventQueue.push(
-    std::bind_front(&KneeboardState::ProcessAPIEvent, this, ev));
+  if (ev.typeID == APIEventTypeID::Inline) {
+    ev.typeID = APIEventRegistry::Find(ev.name);
+  }
+
+  const auto priority = GetOrderedEventPriority(ev.typeID);
+  const auto costKey = GetOrderedEventCostKey(ev.typeID);
+  mOrderedEventQueue.Push(
+    priority,
+    std::bind_front(
+      &KneeboardState::ProcessAPIEvent,
+      this,
+      std::move(ev),
+      std::chrono::steady_clock::now()),
+    costKey);
 }
 
-void KneeboardState::EnqueueOrderedEvent(std::function<task<void>()> event) {
-  mOrderedEventQueue.push(event);
+void KneeboardState::EnqueueOrderedEvent(
+  OrderedEventPriority priority,
+  std::function<task<void>()> event) {
+  mOrderedEventQueue.Push(priority, std::move(event));
 }
 
 task<void> KneeboardState::FlushOrderedEventQueue(
@@ -434,13 +568,14 @@ task<void> KneeboardState::FlushOrderedEventQueue(
     co_await winrt::resume_on_signal(mQueueFlushedEvent.get());
     co_return;
   }
-  if (mOrderedEventQueue.empty()) {
+  if (mOrderedEventQueue.IsEmpty()) {
     OPENKNEEBOARD_TraceLoggingWrite(
       "KneeboardState::FlushOrderedEventQueue()/Empty");
     co_return;
   }
   OPENKNEEBOARD_TraceLoggingCoro(
     "KneeboardState::FlushOrderedEventQueue()/Flush");
+  SHM::APIEventMetrics::RecordBacklog(mOrderedEventQueue.GetSize());
 
   mFlushingQueue = true;
 
@@ -450,158 +585,198 @@ task<void> KneeboardState::FlushOrderedEventQueue(
     mFlushingQueue = false;
   });
 
-  size_t processed = 0;
-  while (std::chrono::steady_clock::now() < stopAt
-         && !mOrderedEventQueue.empty()) {
-    auto it = std::move(mOrderedEventQueue.front());
-    mOrderedEventQueue.pop();
-    co_await it();
-    ++processed;
+  co_await mOrderedEventQueue.Flush(stopAt);
+}
+
+task<void> KneeboardState::ProcessAPIEvent(
+  APIEvent ev,
+  std::chrono::steady_clock::time_point queuedAt) noexcept {
+  // Events with runtime-registered IDs are recorded together, as their IDs
+  // are only meaningful within this process
+  const auto metricsTypeID = GetBuiltinAPIEventName(ev.typeID).empty()
+    ? APIEventTypeID::Inline
+    : ev.typeID;
+  const auto startedAt = std::chrono::steady_clock::now();
+  scope_exit recordMetrics([=]() {
+    const auto now = std::chrono::steady_clock::now();
+    SHM::APIEventMetrics::RecordHandlerCost(metricsTypeID, now - startedAt);
+    SHM::APIEventMetrics::RecordProcessingLatency(now - queuedAt);
+  });
+
+  using Handler = task<void> (KneeboardState::*)(APIEvent);
+  static const auto sHandlers = []() {
+    APIEventHandlerTable<Handler> ret;
+    ret.Add(
+      APIEvent::EVT_REMOTE_USER_ACTION, &KneeboardState::OnRemoteUserAction);
+    ret.Add(
+      APIEvent::EVT_PLUGIN_TAB_CUSTOM_ACTION,
+      &KneeboardState::OnPluginTabCustomAction);
+    ret.Add(APIEvent::EVT_SET_TAB_BY_ID, &KneeboardState::OnSetTabByID);
+    ret.Add(APIEvent::EVT_SET_TAB_BY_NAME, &KneeboardState::OnSetTabByName);
+    ret.Add(APIEvent::EVT_SET_TAB_BY_INDEX, &KneeboardState::OnSetTabByIndex);
+    ret.Add(
+      APIEvent::EVT_SET_PROFILE_BY_GUID, &KneeboardState::OnSetProfileByGUID);
+    ret.Add(
+      APIEvent::EVT_SET_PROFILE_BY_NAME, &KneeboardState::OnSetProfileByName);
+    ret.Add(APIEvent::EVT_SET_BRIGHTNESS, &KneeboardState::OnSetBrightness);
+    ret.Add(
+      APIEvent::EVT_DUMP_TASK_LATENCY, &KneeboardState::OnDumpTaskLatency);
+    return ret;
+  }();
+
+  if (const auto handler = sHandlers.Find(ev.typeID)) {
+    co_await std::invoke(*handler, this, std::move(ev));
+    co_return;
   }
 
-  OPENKNEEBOARD_TraceLoggingWrite(
-    "KneeboardState::FlushOrderedEventQueue()/Stats",
-    TraceLoggingValue(processed, "Processed"),
-    TraceLoggingValue(mOrderedEventQueue.size(), "Remaining"));
+  this->evAPIEvent.Emit(ev);
 }
 
-task<void> KneeboardState::ProcessAPIEvent(APIEvent ev) noexcept {
-  const auto tabs = mTabsList->GetTabs();
-
-  if (ev.name == APIEvent::EVT_REMOTE_USER_ACTION) {
+task<void> KneeboardState::OnRemoteUserAction(APIEvent ev) {
 #define IT(ACTION) \
   if (ev.value == #ACTION) { \
     co_await PostUserAction(UserAction::ACTION); \
     co_return; \
   }
-    OPENKNEEBOARD_USER_ACTIONS
+  OPENKNEEBOARD_USER_ACTIONS
 #undef IT
+
+  this->evAPIEvent.Emit(ev);
+}
+
+task<void> KneeboardState::OnPluginTabCustomAction(APIEvent ev) {
+  const auto parsed = ev.ParsedValue<PluginTabCustomActionEvent>();
+  const auto receiver = this->GetActiveViewForGlobalInput();
+  if (receiver) {
+    receiver->PostCustomAction(parsed.mActionID, parsed.mExtraData);
   }
+  co_return;
+}
 
-  if (ev.name == APIEvent::EVT_PLUGIN_TAB_CUSTOM_ACTION) {
-    const auto parsed = ev.ParsedValue<PluginTabCustomActionEvent>();
-    const auto receiver = this->GetActiveViewForGlobalInput();
-    if (receiver) {
-      receiver->PostCustomAction(parsed.mActionID, parsed.mExtraData);
-    }
+task<void> KneeboardState::OnSetTabByID(APIEvent ev) {
+  const auto parsed = ev.ParsedValue<SetTabByIDEvent>();
+  winrt::guid guid;
+  try {
+    guid = winrt::guid {parsed.mID};
+  } catch (const std::invalid_argument&) {
+    dprint("Failed to set tab by ID: '{}' is not a valid GUID", parsed.mID);
     co_return;
   }
-
-  if (ev.name == APIEvent::EVT_SET_TAB_BY_ID) {
-    const auto parsed = ev.ParsedValue<SetTabByIDEvent>();
-    winrt::guid guid;
-    try {
-      guid = winrt::guid {parsed.mID};
-    } catch (const std::invalid_argument&) {
-      dprint("Failed to set tab by ID: '{}' is not a valid GUID", parsed.mID);
-      co_return;
-    }
-    const auto tab = std::ranges::find_if(
-      tabs, [guid](const auto& tab) { return tab->GetPersistentID() == guid; });
-    if (tab == tabs.end()) {
-      dprint(
-        "Asked to switch to tab with ID '{}', but can't find it", parsed.mID);
-      co_return;
-    }
-    this->SetCurrentTab(*tab, parsed);
+  const auto tabs = mTabsList->GetTabs();
+  const auto tab = std::ranges::find_if(
+    tabs, [guid](const auto& tab) { return tab->GetPersistentID() == guid; });
+  if (tab == tabs.end()) {
+    dprint(
+      "Asked to switch to tab with ID '{}', but can't find it", parsed.mID);
     co_return;
   }
+  this->SetCurrentTab(*tab, parsed);
+  co_return;
+}
 
-  if (ev.name == APIEvent::EVT_SET_TAB_BY_NAME) {
-    const auto parsed = ev.ParsedValue<SetTabByNameEvent>();
-    const auto tab = std::ranges::find_if(tabs, [parsed](const auto& tab) {
-      return parsed.mName == tab->GetTitle();
-    });
-    if (tab == tabs.end()) {
-      dprint(
-        "Asked to switch to tab with name '{}', but can't find it",
-        parsed.mName);
-      co_return;
-    }
-    this->SetCurrentTab(*tab, parsed);
+task<void> KneeboardState::OnSetTabByName(APIEvent ev) {
+  const auto parsed = ev.ParsedValue<SetTabByNameEvent>();
+  const auto tabs = mTabsList->GetTabs();
+  const auto tab = std::ranges::find_if(tabs, [parsed](const auto& tab) {
+    return parsed.mName == tab->GetTitle();
+  });
+  if (tab == tabs.end()) {
+    dprint(
+      "Asked to switch to tab with name '{}', but can't find it", parsed.mName);
     co_return;
   }
+  this->SetCurrentTab(*tab, parsed);
+  co_return;
+}
 
-  if (ev.name == APIEvent::EVT_SET_TAB_BY_INDEX) {
-    const auto parsed = ev.ParsedValue<SetTabByIndexEvent>();
-    if (parsed.mIndex >= tabs.size()) {
-      dprint(
-        "Asked to switch to tab index {}, but there aren't that many tabs",
-        parsed.mIndex);
-      co_return;
-    }
-    this->SetCurrentTab(tabs.at(parsed.mIndex), parsed);
+task<void> KneeboardState::OnSetTabByIndex(APIEvent ev) {
+  const auto parsed = ev.ParsedValue<SetTabByIndexEvent>();
+  const auto tabs = mTabsList->GetTabs();
+  if (parsed.mIndex >= tabs.size()) {
+    dprint(
+      "Asked to switch to tab index {}, but there aren't that many tabs",
+      parsed.mIndex);
     co_return;
   }
+  this->SetCurrentTab(tabs.at(parsed.mIndex), parsed);
+  co_return;
+}
 
+task<void> KneeboardState::OnSetProfileByGUID(APIEvent ev) {
   using Profile = ProfileSettings::Profile;
-  if (ev.name == APIEvent::EVT_SET_PROFILE_BY_GUID) {
-    const auto parsed = ev.ParsedValue<SetProfileByGUIDEvent>();
-    if (!mProfiles.mEnabled) {
-      dprint("Asked to switch profiles, but profiles are disabled");
-    }
-    const winrt::guid guid {parsed.mGUID};
-    auto it = std::ranges::find(mProfiles.mProfiles, guid, &Profile::mGuid);
-    if (it == mProfiles.mProfiles.end()) {
-      dprint(
-        "Asked to switch to profile with GUID {}, but it doesn't exist", guid);
-      co_return;
-    }
-    ProfileSettings newSettings(mProfiles);
-    newSettings.mActiveProfile = guid;
-    co_await this->SetProfileSettings(newSettings);
+  const auto parsed = ev.ParsedValue<SetProfileByGUIDEvent>();
+  if (!mProfiles.mEnabled) {
+    dprint("Asked to switch profiles, but profiles are disabled");
+  }
+  const winrt::guid guid {parsed.mGUID};
+  auto it = std::ranges::find(mProfiles.mProfiles, guid, &Profile::mGuid);
+  if (it == mProfiles.mProfiles.end()) {
+    dprint(
+      "Asked to switch to profile with GUID {}, but it doesn't exist", guid);
     co_return;
   }
+  ProfileSettings newSettings(mProfiles);
+  newSettings.mActiveProfile = guid;
+  co_await this->SetProfileSettings(newSettings);
+}
 
-  if (ev.name == APIEvent::EVT_SET_PROFILE_BY_NAME) {
-    const auto parsed = ev.ParsedValue<SetProfileByNameEvent>();
-    if (!mProfiles.mEnabled) {
-      dprint("Asked to switch profiles, but profiles are disabled");
-    }
-    auto it
-      = std::ranges::find(mProfiles.mProfiles, parsed.mName, &Profile::mName);
-    if (it == mProfiles.mProfiles.end()) {
-      dprint(
-        "Asked to switch to profile with ID '{}', but it doesn't exist",
-        parsed.mName);
-      co_return;
-    }
-    ProfileSettings newSettings(mProfiles);
-    newSettings.mActiveProfile = it->mGuid;
-    co_await this->SetProfileSettings(newSettings);
+task<void> KneeboardState::OnSetProfileByName(APIEvent ev) {
+  using Profile = ProfileSettings::Profile;
+  const auto parsed = ev.ParsedValue<SetProfileByNameEvent>();
+  if (!mProfiles.mEnabled) {
+    dprint("Asked to switch profiles, but profiles are disabled");
+  }
+  auto it
+    = std::ranges::find(mProfiles.mProfiles, parsed.mName, &Profile::mName);
+  if (it == mProfiles.mProfiles.end()) {
+    dprint(
+      "Asked to switch to profile with ID '{}', but it doesn't exist",
+      parsed.mName);
     co_return;
   }
+  ProfileSettings newSettings(mProfiles);
+  newSettings.mActiveProfile = it->mGuid;
+  co_await this->SetProfileSettings(newSettings);
+}
 
-  if (ev.name == APIEvent::EVT_SET_BRIGHTNESS) {
-    const auto parsed = ev.ParsedValue<SetBrightnessEvent>();
-    auto& tint = this->mSettings.mUI.mTint;
-    tint.mEnabled = true;
-    switch (parsed.mMode) {
-      case SetBrightnessEvent::Mode::Absolute:
-        if (parsed.mBrightness < 0 || parsed.mBrightness > 1) {
-          dprint(
-            "Requested absolute brightness '{}' is outside of range 0 to 1",
-            parsed.mBrightness);
-          co_return;
-        }
-        tint.mBrightness = parsed.mBrightness;
-        break;
-      case SetBrightnessEvent::Mode::Relative:
-        if (parsed.mBrightness < -1 || parsed.mBrightness > 1) {
-          dprint(
-            "Requested relative brightness '{}' is outside of range -1 to 1",
-            parsed.mBrightness);
-          co_return;
-        }
-        tint.mBrightness
-          = std::clamp(tint.mBrightness + parsed.mBrightness, 0.0f, 1.0f);
-        break;
-    }
-    this->SaveSettings();
-    co_return;
+task<void> KneeboardState::OnSetBrightness(APIEvent ev) {
+  const auto parsed = ev.ParsedValue<SetBrightnessEvent>();
+  auto& tint = this->mSettings.mUI.mTint;
+  tint.mEnabled = true;
+  switch (parsed.mMode) {
+    case SetBrightnessEvent::Mode::Absolute:
+      if (parsed.mBrightness < 0 || parsed.mBrightness > 1) {
+        dprint(
+          "Requested absolute brightness '{}' is outside of range 0 to 1",
+          parsed.mBrightness);
+        co_return;
+      }
+      tint.mBrightness = parsed.mBrightness;
+      break;
+    case SetBrightnessEvent::Mode::Relative:
+      if (parsed.mBrightness < -1 || parsed.mBrightness > 1) {
+        dprint(
+          "Requested relative brightness '{}' is outside of range -1 to 1",
+          parsed.mBrightness);
+        co_return;
+      }
+      tint.mBrightness
+        = std::clamp(tint.mBrightness + parsed.mBrightness, 0.0f, 1.0f);
+      break;
   }
+  this->SaveSettings();
+  co_return;
+}
 
-  this->evAPIEvent.Emit(ev);
+task<void> KneeboardState::OnDumpTaskLatency(APIEvent) {
+  if constexpr (TaskLatencyTracing) {
+    TaskLatencyTracker::DumpStatistics();
+  } else {
+    dprint(
+      "Ignoring {}: this build does not have task latency tracing",
+      APIEvent::EVT_DUMP_TASK_LATENCY);
+  }
+  co_return;
 }
 
 void KneeboardState::SetCurrentTab(
@@ -844,8 +1019,10 @@ void KneeboardState::StartTabletInput() {
   AddEventListener(
     mTabletInput->evDeviceConnectedEvent, this->evInputDevicesChangedEvent);
   AddEventListener(mTabletInput->evUserActionEvent, [this](auto action) {
-    this->EnqueueOrderedEvent(
-      std::bind_front(&KneeboardState::PostUserAction, this, action));
+    mOrderedEventQueue.Push(
+      OrderedEventPriority::Interactive,
+      std::bind_front(&KneeboardState::PostUserAction, this, action),
+      GetOrderedEventCostKey(action));
   });
   AddEventListener(
     mTabletInput->evSettingsChangedEvent,
@@ -955,6 +1132,11 @@ bool KneeboardState::IsRepaintNeeded() const {
 void KneeboardState::SetRepaintNeeded() {
   OPENKNEEBOARD_TraceLoggingWrite("KneeboardState::SetRepaintNeeded()");
   mNeedsRepaint = true;
+  ++mRepaintAllGeneration;
+}
+
+void KneeboardState::SetViewRepaintNeeded() {
+  mNeedsRepaint = true;
 }
 
 void KneeboardState::Repainted() {
@@ -1048,7 +1230,7 @@ void KneeboardState::InitializeViews() {
 
     AddEventListener(
       view->evNeedsRepaintEvent,
-      std::bind_front(&KneeboardState::SetRepaintNeeded, this));
+      std::bind_front(&KneeboardState::SetViewRepaintNeeded, this));
   }
 
   bool viewChanged = false;
@@ -1073,7 +1255,7 @@ void KneeboardState::InitializeViews() {
         mAppWindowView->SetTabs(this->GetTabsList()->GetTabs());
         AddEventListener(
           mAppWindowView->evNeedsRepaintEvent,
-          std::bind_front(&KneeboardState::SetRepaintNeeded, this));
+          std::bind_front(&KneeboardState::SetViewRepaintNeeded, this));
         viewChanged = true;
       }
   }
@@ -66,6 +66,9 @@ KneeboardView::KneeboardView(
   }
   AddEventListener(this->evCurrentTabChangedEvent, this->evNeedsRepaintEvent);
   AddEventListener(this->evCursorEvent, this->evNeedsRepaintEvent);
+  AddEventListener(this->evNeedsRepaintEvent, [this]() {
+    ++mContentGeneration;
+  });
   AddEventListener(
     kneeboard->evSettingsChangedEvent,
     std::bind_front(&KneeboardView::UpdateUILayers, this));
@@ -123,6 +126,10 @@ std::string_view KneeboardView::GetName() const noexcept {
   return mName;
 }
 
+uint64_t KneeboardView::GetContentGeneration() const noexcept {
+  return mContentGeneration;
+}
+
 void KneeboardView::SetTabs(const std::vector<std::shared_ptr<ITab>>& tabs) {
   mThreadGuard.CheckThread();
 
@@ -0,0 +1,185 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#include <OpenKneeboard/OrderedEventQueue.hpp>
+
+#include <OpenKneeboard/fatal.hpp>
+#include <OpenKneeboard/tracing.hpp>
+
+#include <algorithm>
+#include <optional>
+#include <utility>
+
+namespace OpenKneeboard {
+
+namespace {
+int64_t ToMicroseconds(OrderedEventQueue::Clock::duration d) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+}// namespace
+
+OrderedEventQueue::OrderedEventQueue() = default;
+OrderedEventQueue::~OrderedEventQueue() = default;
+
+OrderedEventQueue::Class& OrderedEventQueue::GetClass(
+  OrderedEventPriority priority) {
+  return mClasses.at(std::to_underlying(priority));
+}
+
+const OrderedEventQueue::Class& OrderedEventQueue::GetClass(
+  OrderedEventPriority priority) const {
+  return mClasses.at(std::to_underlying(priority));
+}
+
+void OrderedEventQueue::Push(
+  OrderedEventPriority priority,
+  Event event,
+  CostKey costKey) {
+  GetClass(priority).mEntries.push_back(
+    {std::move(event), Clock::now(), costKey});
+}
+
+bool OrderedEventQueue::IsEmpty() const noexcept {
+  return std::ranges::all_of(
+    mClasses, [](const auto& it) { return it.mEntries.empty(); });
+}
+
+std::size_t OrderedEventQueue::GetSize() const noexcept {
+  std::size_t ret = 0;
+  for (const auto& it: mClasses) {
+    ret += it.mEntries.size();
+  }
+  return ret;
+}
+
+OrderedEventQueue::Statistics OrderedEventQueue::GetStatistics(
+  OrderedEventPriority priority) const {
+  return GetClass(priority).mStatistics;
+}
+
+OrderedEventPriority OrderedEventQueue::SelectNext(
+  Clock::time_point now) const {
+  // Oldest first if anything has waited too long...
+  std::optional<std::size_t> oldest;
+  for (std::size_t i = 0; i < ClassCount; ++i) {
+    const auto& entries = mClasses.at(i).mEntries;
+    if (entries.empty() || now - entries.front().mQueuedAt < MaxWait) {
+      continue;
+    }
+    if (
+      (!oldest)
+      || entries.front().mQueuedAt
+        < mClasses.at(*oldest).mEntries.front().mQueuedAt) {
+      oldest = i;
+    }
+  }
+  if (oldest) {
+    return static_cast<OrderedEventPriority>(*oldest);
+  }
+
+  // ... otherwise, by priority
+  for (std::size_t i = 0; i < ClassCount; ++i) {
+    if (!mClasses.at(i).mEntries.empty()) {
+      return static_cast<OrderedEventPriority>(i);
+    }
+  }
+  fatal("Called SelectNext() on an empty OrderedEventQueue");
+}
+
+task<void> OrderedEventQueue::Flush(Clock::time_point stopAt) {
+  {
+    const auto now = Clock::now();
+    const auto headWait = [now, this](OrderedEventPriority priority) {
+      const auto& entries = GetClass(priority).mEntries;
+      return entries.empty() ? 0
+                             : ToMicroseconds(now - entries.front().mQueuedAt);
+    };
+    OPENKNEEBOARD_TraceLoggingWrite(
+      "OrderedEventQueue::Flush()/Depth",
+      TraceLoggingValue(
+        GetClass(OrderedEventPriority::Interactive).mEntries.size(),
+        "Interactive"),
+      TraceLoggingValue(
+        GetClass(OrderedEventPriority::State).mEntries.size(), "State"),
+      TraceLoggingValue(
+        GetClass(OrderedEventPriority::Bulk).mEntries.size(), "Bulk"),
+      TraceLoggingValue(
+        headWait(OrderedEventPriority::Interactive), "InteractiveHeadWaitUs"),
+      TraceLoggingValue(
+        headWait(OrderedEventPriority::State), "StateHeadWaitUs"),
+      TraceLoggingValue(headWait(OrderedEventPriority::Bulk), "BulkHeadWaitUs"),
+      TraceLoggingValue(ToMicroseconds(stopAt - now), "BudgetUs"));
+  }
+
+  std::size_t processed = 0;
+  while (!this->IsEmpty()) {
+    const auto startedAt = Clock::now();
+    if (startedAt >= stopAt) {
+      break;
+    }
+
+    const auto priority = this->SelectNext(startedAt);
+    auto& klass = GetClass(priority);
+    // Zero if we haven't seen this kind of event yet. The map is node-based,
+    // so this stays valid if the event pushes more events.
+    auto& estimatedCost
+      = klass.mEstimatedCosts[klass.mEntries.front().mCostKey];
+    if (processed > 0 && startedAt + estimatedCost > stopAt) {
+      // Leave it for the start of the next flush, where it has the whole
+      // budget
+      ++klass.mStatistics.mDeferred;
+      OPENKNEEBOARD_TraceLoggingWrite(
+        "OrderedEventQueue::Flush()/Deferred",
+        TraceLoggingValue(std::to_underlying(priority), "Priority"),
+        TraceLoggingValue(klass.mEntries.front().mCostKey, "CostKey"),
+        TraceLoggingValue(ToMicroseconds(estimatedCost), "EstimatedCostUs"));
+      break;
+    }
+
+    auto entry = std::move(klass.mEntries.front());
+    klass.mEntries.pop_front();
+    co_await entry.mEvent();
+    ++processed;
+
+    const auto wait = startedAt - entry.mQueuedAt;
+    const auto cost = Clock::now() - startedAt;
+    // Exponential moving average, weighting the latest event by 1/8
+    estimatedCost += (cost - estimatedCost) / 8;
+
+    auto& stats = klass.mStatistics;
+    ++stats.mCount;
+    stats.mTotalCost += cost;
+    stats.mMaxCost = std::max(stats.mMaxCost, cost);
+    stats.mTotalWait += wait;
+    stats.mMaxWait = std::max(stats.mMaxWait, wait);
+
+    OPENKNEEBOARD_TraceLoggingWrite(
+      "OrderedEventQueue::Flush()/Event",
+      TraceLoggingValue(std::to_underlying(priority), "Priority"),
+      TraceLoggingValue(ToMicroseconds(wait), "WaitUs"),
+      TraceLoggingValue(ToMicroseconds(cost), "CostUs"));
+  }
+
+  OPENKNEEBOARD_TraceLoggingWrite(
+    "OrderedEventQueue::Flush()/Stats",
+    TraceLoggingValue(processed, "Processed"),
+    TraceLoggingValue(this->GetSize(), "Remaining"));
+}
+
+}// namespace OpenKneeboard
@@ -21,6 +21,7 @@
 #include <OpenKneeboard/FolderPageSource.hpp>
 
 #include <OpenKneeboard/dprint.hpp>
+#include <OpenKneeboard/task/when_all.hpp>
 
 #include <shims/nlohmann/json.hpp>
 
@@ -89,7 +90,9 @@ OpenKneeboard::fire_and_forget FolderPageSource::OnFileModified(
     co_return;
   }
   decltype(mContents) newContents;
-  bool modifiedOrNew = false;
+  // Creating a page source can be slow, so create them all concurrently
+  std::vector<std::pair<std::filesystem::path, DelegateInfo>> newFiles;
+  std::vector<task<std::shared_ptr<IPageSource>>> pending;
   for (const auto& entry:
        std::filesystem::recursive_directory_iterator(directory)) {
     if (!entry.is_regular_file()) {
@@ -106,11 +109,20 @@ OpenKneeboard::fire_and_forget FolderPageSource::OnFileModified(
       newContents[path].mModified = mtime;
       continue;
     }
-    auto delegate = co_await FilePageSource::Create(mDXR, mKneeboard, path);
-    if (delegate) {
-      modifiedOrNew = true;
-      newContents[path] = {mtime, delegate};
+    newFiles.push_back({path, {mtime}});
+    pending.push_back(FilePageSource::Create(mDXR, mKneeboard, path));
+  }
+
+  bool modifiedOrNew = false;
+  const auto created = co_await when_all(std::move(pending));
+  for (std::size_t i = 0; i < created.size(); ++i) {
+    if (!created.at(i)) {
+      continue;
     }
+    modifiedOrNew = true;
+    auto& [path, info] = newFiles.at(i);
+    info.mDelegate = created.at(i);
+    newContents[path] = std::move(info);
   }
 
   if (newContents.size() == mContents.size() && !modifiedOrNew) {
@@ -35,6 +35,7 @@
 #include <OpenKneeboard/final_release_deleter.hpp>
 #include <OpenKneeboard/format/filesystem.hpp>
 #include <OpenKneeboard/scope_exit.hpp>
+#include <OpenKneeboard/task/thread_pool.hpp>
 #include <OpenKneeboard/utf8.hpp>
 
 #include <shims/nlohmann/json.hpp>
@@ -252,7 +253,7 @@ task<void> PDFFilePageSource::ReloadNavigation(
     }
   }
 
-  co_await winrt::resume_background();
+  co_await ThreadPool::GetBackground()->Schedule(TaskPriority::BulkParse);
   auto stayingAlive = weak.lock();
   auto doc = weakDoc.lock();
   if (!(stayingAlive && doc && doc == mDocumentResources)) {
@@ -373,7 +374,7 @@ task<void> PDFFilePageSource::Reload() try {
   }
 
   // Do copy in a background thread so we're not hung up on antivirus
-  co_await winrt::resume_background();
+  co_await ThreadPool::GetBackground()->Schedule(TaskPriority::IO);
 
   auto self = weak.lock();
   {
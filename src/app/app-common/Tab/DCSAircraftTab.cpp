@@ -40,7 +40,7 @@ DCSAircraftTab::DCSAircraftTab(
   const winrt::guid& persistentID,
   std::string_view title)
   : TabBase(persistentID, title),
-    DCSTab(kbs),
+    DCSTab(kbs, {DCS::EVT_AIRCRAFT}),
     PageSourceWithDelegates(dxr, kbs),
     mDXR(dxr),
     mKneeboard(kbs),
@@ -73,7 +73,7 @@ OpenKneeboard::fire_and_forget DCSAircraftTab::OnAPIEvent(
   APIEvent event,
   std::filesystem::path installPath,
   std::filesystem::path savedGamesPath) {
-  if (event.name != DCS::EVT_AIRCRAFT) {
+  if (event.typeID != APIEventTypeID::DCSAircraft) {
     co_return;
   }
   if (event.value == mAircraft) {
@@ -45,7 +45,7 @@ DCSBriefingTab::DCSBriefingTab(
   KneeboardState* kbs,
   const winrt::guid& persistentID,
   std::string_view title)
-  : DCSTab(kbs),
+  : DCSTab(kbs, {DCS::EVT_MISSION, DCS::EVT_SELF_DATA, DCS::EVT_ORIGIN}),
     PageSourceWithDelegates(dxr, kbs),
     TabBase(persistentID, title),
     mKneeboard(kbs),
@@ -169,7 +169,7 @@ OpenKneeboard::fire_and_forget DCSBriefingTab::OnAPIEvent(
   std::filesystem::path installPath,
   std::filesystem::path) {
   mInstallationPath = installPath;
-  if (event.name == DCS::EVT_MISSION) {
+  if (event.typeID == APIEventTypeID::DCSMission) {
     const auto missionZip = this->ToAbsolutePath(event.value);
     if (missionZip.empty() || !std::filesystem::exists(missionZip)) {
       dprint("Briefing tab: mission '{}' does not exist", event.value);
@@ -189,13 +189,13 @@ OpenKneeboard::fire_and_forget DCSBriefingTab::OnAPIEvent(
   }
 
   auto state = mDCSState;
-  if (event.name == DCS::EVT_SELF_DATA) {
+  if (event.typeID == APIEventTypeID::DCSSelfData) {
     auto raw = nlohmann::json::parse(event.value);
     state.mCoalition = static_cast<DCSWorld::Coalition>(
       raw.at("CoalitionID").get<std::underlying_type_t<DCSWorld::Coalition>>()),
     state.mCountry = raw.at("Country");
     state.mAircraft = raw.at("Name");
-  } else if (event.name == DCS::EVT_ORIGIN) {
+  } else if (event.typeID == APIEventTypeID::DCSOrigin) {
     auto raw = nlohmann::json::parse(event.value);
     state.mOrigin = LatLong {
       .mLat = raw["latitude"],
@@ -41,7 +41,7 @@ DCSMissionTab::DCSMissionTab(
   const winrt::guid& persistentID,
   std::string_view title)
   : TabBase(persistentID, title),
-    DCSTab(kbs),
+    DCSTab(kbs, {DCS::EVT_MISSION, DCS::EVT_AIRCRAFT}),
     PageSourceWithDelegates(dxr, kbs),
     mDXR(dxr),
     mKneeboard(kbs),
@@ -114,7 +114,7 @@ OpenKneeboard::fire_and_forget DCSMissionTab::OnAPIEvent(
   APIEvent event,
   [[maybe_unused]] std::filesystem::path installPath,
   [[maybe_unused]] std::filesystem::path savedGamePath) {
-  if (event.name == DCS::EVT_MISSION) {
+  if (event.typeID == APIEventTypeID::DCSMission) {
     const auto missionZip = this->ToAbsolutePath(event.value);
     if (missionZip.empty() || !std::filesystem::exists(missionZip)) {
       dprint("MissionTab: mission '{}' does not exist", event.value);
@@ -130,7 +130,7 @@ OpenKneeboard::fire_and_forget DCSMissionTab::OnAPIEvent(
     co_return;
   }
 
-  if (event.name == DCS::EVT_AIRCRAFT) {
+  if (event.typeID == APIEventTypeID::DCSAircraft) {
     if (event.value == mAircraft) {
       co_return;
     }
@@ -61,7 +61,7 @@ DCSRadioLogTab::DCSRadioLogTab(
   std::string_view title,
   const nlohmann::json& config)
   : TabBase(persistentID, title),
-    DCSTab(kbs),
+    DCSTab(kbs, {DCS::EVT_SIMULATION_START, DCS::EVT_MESSAGE}),
     PageSourceWithDelegates(dxr, kbs),
     mPageSource(std::make_shared<PlainTextPageSource>(
       dxr,
@@ -132,7 +132,7 @@ OpenKneeboard::fire_and_forget DCSRadioLogTab::OnAPIEvent(
   std::filesystem::path installPath,
   std::filesystem::path savedGamesPath) {
   auto weak = weak_from_this();
-  if (event.name == DCS::EVT_SIMULATION_START) {
+  if (event.typeID == APIEventTypeID::DCSSimulationStart) {
     co_await mUIThread;
     auto self = weak.lock();
     if (!self) {
@@ -159,7 +159,7 @@ OpenKneeboard::fire_and_forget DCSRadioLogTab::OnAPIEvent(
     co_return;
   }
 
-  if (event.name != DCS::EVT_MESSAGE) {
+  if (event.typeID != APIEventTypeID::DCSMessage) {
     co_return;
   }
 
@@ -28,24 +28,64 @@ using DCS = OpenKneeboard::DCSWorld;
 
 namespace OpenKneeboard {
 
-DCSTab::DCSTab(KneeboardState* kbs) {
-  mAPIEventToken = AddEventListener(
-    kbs->evAPIEvent, [this](const APIEvent& ev) { this->OnAPIEvent(ev); });
+// The games library can't depend on the API event library, so the binary
+// packet IDs for DCS events are declared there by name
+static_assert(
+  GetBuiltinAPIEventName(APIEventTypeID::DCSAircraft) == DCS::EVT_AIRCRAFT);
+static_assert(
+  GetBuiltinAPIEventName(APIEventTypeID::DCSInstallPath)
+  == DCS::EVT_INSTALL_PATH);
+static_assert(
+  GetBuiltinAPIEventName(APIEventTypeID::DCSMission) == DCS::EVT_MISSION);
+static_assert(
+  GetBuiltinAPIEventName(APIEventTypeID::DCSMissionTime)
+  == DCS::EVT_MISSION_TIME);
+static_assert(
+  GetBuiltinAPIEventName(APIEventTypeID::DCSOrigin) == DCS::EVT_ORIGIN);
+static_assert(
+  GetBuiltinAPIEventName(APIEventTypeID::DCSSelfData) == DCS::EVT_SELF_DATA);
+static_assert(
+  GetBuiltinAPIEventName(APIEventTypeID::DCSMessage) == DCS::EVT_MESSAGE);
+static_assert(
+  GetBuiltinAPIEventName(APIEventTypeID::DCSSavedGamesPath)
+  == DCS::EVT_SAVED_GAMES_PATH);
+static_assert(
+  GetBuiltinAPIEventName(APIEventTypeID::DCSSimulationStart)
+  == DCS::EVT_SIMULATION_START);
+static_assert(
+  GetBuiltinAPIEventName(APIEventTypeID::DCSTerrain) == DCS::EVT_TERRAIN);
+
+DCSTab::DCSTab(
+  KneeboardState* kbs,
+  std::initializer_list<std::string_view> eventNames) {
+  mAPIEventTokens.push_back(AddEventListener(
+    kbs->evAPIEvent.GetTopic(DCS::EVT_INSTALL_PATH),
+    [this](const APIEvent& ev) { this->OnInstallPathEvent(ev); }));
+  mAPIEventTokens.push_back(AddEventListener(
+    kbs->evAPIEvent.GetTopic(DCS::EVT_SAVED_GAMES_PATH),
+    [this](const APIEvent& ev) { this->OnSavedGamesPathEvent(ev); }));
+  for (const auto name: eventNames) {
+    mAPIEventTokens.push_back(AddEventListener(
+      kbs->evAPIEvent.GetTopic(name),
+      [this](const APIEvent& ev) { this->ForwardAPIEvent(ev); }));
+  }
 }
 
 DCSTab::~DCSTab() {
-  this->RemoveEventListener(mAPIEventToken);
+  for (const auto& token: mAPIEventTokens) {
+    this->RemoveEventListener(token);
+  }
 }
 
-void DCSTab::OnAPIEvent(const APIEvent& event) {
-  if (event.name == DCS::EVT_INSTALL_PATH) {
-    mInstallPath = std::filesystem::canonical(event.value);
-  }
+void DCSTab::OnInstallPathEvent(const APIEvent& event) {
+  mInstallPath = std::filesystem::canonical(event.value);
+}
 
-  if (event.name == DCS::EVT_SAVED_GAMES_PATH) {
-    mSavedGamesPath = std::filesystem::canonical(event.value);
-  }
+void DCSTab::OnSavedGamesPathEvent(const APIEvent& event) {
+  mSavedGamesPath = std::filesystem::canonical(event.value);
+}
 
+void DCSTab::ForwardAPIEvent(const APIEvent& event) {
   if (!(mInstallPath.empty() || mSavedGamesPath.empty())) {
     OnAPIEvent(event, mInstallPath, mSavedGamesPath);
   }
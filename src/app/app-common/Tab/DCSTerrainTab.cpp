@@ -40,7 +40,7 @@ DCSTerrainTab::DCSTerrainTab(
   const winrt::guid& persistentID,
   std::string_view title)
   : TabBase(persistentID, title),
-    DCSTab(kbs),
+    DCSTab(kbs, {DCS::EVT_TERRAIN}),
     PageSourceWithDelegates(dxr, kbs),
     mDXR(dxr),
     mKneeboard(kbs),
@@ -85,7 +85,7 @@ OpenKneeboard::fire_and_forget DCSTerrainTab::OnAPIEvent(
   APIEvent event,
   std::filesystem::path installPath,
   std::filesystem::path savedGamesPath) {
-  if (event.name != DCS::EVT_TERRAIN) {
+  if (event.typeID != APIEventTypeID::DCSTerrain) {
     co_return;
   }
   if (event.value == mTerrain) {
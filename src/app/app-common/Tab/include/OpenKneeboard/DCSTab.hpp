@@ -19,6 +19,7 @@
  */
 #pragma once
 
+#include <OpenKneeboard/APIEvent.hpp>
 #include <OpenKneeboard/DCSWorld.hpp>
 #include <OpenKneeboard/Events.hpp>
 #include <OpenKneeboard/ITab.hpp>
@@ -27,14 +28,20 @@
 #include <OpenKneeboard/utf8.hpp>
 
 #include <filesystem>
+#include <initializer_list>
+#include <string_view>
+#include <vector>
 
 namespace OpenKneeboard {
 
-struct APIEvent;
-
 class DCSTab : public virtual ITab, public virtual EventReceiver {
  public:
-  DCSTab(KneeboardState*);
+  /** `eventNames` are the events that are passed to the subclass.
+   *
+   * The tab only subscribes to these topics, and the install and saved games
+   * paths; it isn't called at all for other events.
+   */
+  DCSTab(KneeboardState*, std::initializer_list<std::string_view> eventNames);
   virtual ~DCSTab();
 
   DCSTab() = delete;
@@ -56,9 +63,11 @@ class DCSTab : public virtual ITab, public virtual EventReceiver {
  private:
   std::filesystem::path mInstallPath;
   std::filesystem::path mSavedGamesPath;
-  EventHandlerToken mAPIEventToken;
+  std::vector<EventHandlerToken> mAPIEventTokens;
 
-  void OnAPIEvent(const APIEvent&);
+  void OnInstallPathEvent(const APIEvent&);
+  void OnSavedGamesPathEvent(const APIEvent&);
+  void ForwardAPIEvent(const APIEvent&);
 };
 
 }// namespace OpenKneeboard
@@ -30,6 +30,7 @@
 #include <OpenKneeboard/TabsList.hpp>
 
 #include <OpenKneeboard/dprint.hpp>
+#include <OpenKneeboard/task/when_all.hpp>
 
 #include <shims/nlohmann/json.hpp>
 
@@ -129,14 +130,13 @@ task<void> TabsList::LoadSettings(nlohmann::json config) {
   }
   const std::vector<nlohmann::json> jsonTabs = config;
 
-  std::vector<task<std::shared_ptr<ITab>>> awaitables;
+  std::vector<task<std::shared_ptr<ITab>>> pending;
   for (auto&& tab: jsonTabs) {
-    awaitables.push_back(this->LoadTabFromJSON(tab));
+    pending.push_back(this->LoadTabFromJSON(tab));
   }
 
   decltype(mTabs) tabs;
-  for (auto&& it: awaitables) {
-    auto tab = co_await std::move(it);
+  for (auto&& tab: co_await when_all(std::move(pending))) {
     if (tab) {
       tabs.push_back(std::move(tab));
     }
@@ -145,28 +145,27 @@ task<void> TabsList::LoadSettings(nlohmann::json config) {
   co_await this->SetTabs(tabs);
 }
 
+// `when_all()` needs tasks of a single type
+template <std::derived_from<ITab> T>
+static task<std::shared_ptr<ITab>> AsTab(task<std::shared_ptr<T>> pending) {
+  co_return co_await std::move(pending);
+}
+
 task<void> TabsList::LoadDefaultSettings() {
-  // This is a little awkwardly structured because MSVC 2022 17.11 crashes if I
-  // put the `co_await`s in the SetTabs initializer list
-  auto quickStartPending = SingleFileTab::Create(
+  std::vector<task<std::shared_ptr<ITab>>> pending;
+  pending.push_back(AsTab(SingleFileTab::Create(
     mDXR,
     mKneeboard,
-    Filesystem::GetRuntimeDirectory() / RuntimeFiles::QUICK_START_PDF);
-  auto radioLogPending = DCSRadioLogTab::Create(mDXR, mKneeboard);
-  auto briefingPending = DCSBriefingTab::Create(mDXR, mKneeboard);
-
-  auto quickStart = co_await std::move(quickStartPending);
-  auto radioLog = co_await std::move(radioLogPending);
-  auto briefing = co_await std::move(briefingPending);
-
-  co_await this->SetTabs({
-    quickStart,
-    radioLog,
-    briefing,
-    std::make_shared<DCSMissionTab>(mDXR, mKneeboard),
-    std::make_shared<DCSAircraftTab>(mDXR, mKneeboard),
-    std::make_shared<DCSTerrainTab>(mDXR, mKneeboard),
-  });
+    Filesystem::GetRuntimeDirectory() / RuntimeFiles::QUICK_START_PDF)));
+  pending.push_back(AsTab(DCSRadioLogTab::Create(mDXR, mKneeboard)));
+  pending.push_back(AsTab(DCSBriefingTab::Create(mDXR, mKneeboard)));
+
+  auto tabs = co_await when_all(std::move(pending));
+  tabs.push_back(std::make_shared<DCSMissionTab>(mDXR, mKneeboard));
+  tabs.push_back(std::make_shared<DCSAircraftTab>(mDXR, mKneeboard));
+  tabs.push_back(std::make_shared<DCSTerrainTab>(mDXR, mKneeboard));
+
+  co_await this->SetTabs(std::move(tabs));
 }
 
 nlohmann::json TabsList::GetSettings() const {
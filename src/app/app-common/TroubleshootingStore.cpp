@@ -18,6 +18,7 @@
  * USA.
  */
 #include <OpenKneeboard/APIEvent.hpp>
+#include <OpenKneeboard/APIEventLog.hpp>
 #include <OpenKneeboard/Filesystem.hpp>
 #include <OpenKneeboard/Settings.hpp>
 #include <OpenKneeboard/TroubleshootingStore.hpp>
@@ -25,6 +26,7 @@
 #include <OpenKneeboard/bindline.hpp>
 #include <OpenKneeboard/config.hpp>
 #include <OpenKneeboard/dprint.hpp>
+#include <OpenKneeboard/format/filesystem.hpp>
 #include <OpenKneeboard/version.hpp>
 
 #include <chrono>
@@ -34,6 +36,33 @@ namespace OpenKneeboard {
 
 static std::weak_ptr<TroubleshootingStore> gStore;
 
+// HKCU takes precedence over HKLM; 0 if unset
+static DWORD GetRegistryDWORD(const wchar_t* name) {
+  DWORD value = 0;
+  for (auto hkey: {HKEY_CURRENT_USER, HKEY_LOCAL_MACHINE}) {
+    DWORD size = sizeof(value);
+    if (
+      RegGetValueW(
+        hkey, RegistrySubKey, name, RRF_RT_REG_DWORD, nullptr, &value, &size)
+      == ERROR_SUCCESS) {
+      return value;
+    }
+  }
+  return 0;
+}
+
+static auto GetLogFileStem() {
+  return std::format(
+    L"OpenKneeboard-{:%Y%m%dT%H%M%S}-{}.{}.{}.{}-{}",
+    std::chrono::time_point_cast<std::chrono::seconds>(
+      std::chrono::system_clock::now()),
+    Version::Major,
+    Version::Minor,
+    Version::Patch,
+    Version::Build,
+    GetCurrentProcessId());
+}
+
 std::shared_ptr<TroubleshootingStore> TroubleshootingStore::Get() {
   auto shared = gStore.lock();
   if (!shared) {
@@ -82,28 +111,13 @@ TroubleshootingStore::TroubleshootingStore() {
   AddEventListener(mDPrint->evMessageReceived, this->evDPrintMessageReceived);
 
   this->InitializeLogFile();
+  this->InitializeAPIEventLog();
 
   dprint("{}()", __FUNCTION__);
 }
 
 void TroubleshootingStore::InitializeLogFile() {
-  DWORD maxLogFiles = 0;
-  for (auto hkey: {HKEY_CURRENT_USER, HKEY_LOCAL_MACHINE}) {
-    DWORD size = sizeof(maxLogFiles);
-    if (
-      RegGetValueW(
-        hkey,
-        RegistrySubKey,
-        L"MaxLogFiles",
-        RRF_RT_REG_DWORD,
-        nullptr,
-        &maxLogFiles,
-        &size)
-      == ERROR_SUCCESS) {
-      break;
-    }
-  }
-
+  const auto maxLogFiles = GetRegistryDWORD(L"MaxLogFiles");
   if (maxLogFiles == 0) {
     return;
   }
@@ -119,15 +133,7 @@ void TroubleshootingStore::InitializeLogFile() {
   }
   std::sort(existingFiles.begin(), existingFiles.end());
 
-  const auto file = directory
-    / std::format(L"OpenKneeboard-{:%Y%m%dT%H%M%S}-{}.{}.{}.{}-{}.log",
-                  std::chrono::time_point_cast<std::chrono::seconds>(
-                    std::chrono::system_clock::now()),
-                  Version::Major,
-                  Version::Minor,
-                  Version::Patch,
-                  Version::Build,
-                  GetCurrentProcessId());
+  const auto file = directory / (GetLogFileStem() + L".log");
   mLogFile = std::ofstream(file, std::ios::binary);
 
   AddEventListener(
@@ -146,6 +152,28 @@ void TroubleshootingStore::InitializeLogFile() {
   }
 }
 
+/** Record API events for `apievent-replay`.
+ *
+ * These are not pruned by `MaxLogFiles`, so this is only intended to be
+ * enabled while investigating performance.
+ */
+void TroubleshootingStore::InitializeAPIEventLog() {
+  if (!GetRegistryDWORD(L"RecordAPIEvents")) {
+    return;
+  }
+
+  const auto directory = Filesystem::GetLogsDirectory() / "APIEvents";
+  std::filesystem::create_directories(directory);
+  const auto file = directory / (GetLogFileStem() + L".okbevents");
+  mAPIEventLog = std::make_unique<APIEventLog::Writer>(file);
+  if (!mAPIEventLog->IsValid()) {
+    dprint.Warning("Failed to open API event log {}", file);
+    mAPIEventLog.reset();
+    return;
+  }
+  dprint("Recording API events to {}", file);
+}
+
 TroubleshootingStore::~TroubleshootingStore() {
   dprint("{}()", __FUNCTION__);
   this->RemoveAllEventListeners();
@@ -170,6 +198,10 @@ void TroubleshootingStore::WriteDPrintMessageToLogFile(
 }
 
 void TroubleshootingStore::OnAPIEvent(const APIEvent& ev) {
+  if (mAPIEventLog) {
+    mAPIEventLog->Append(ev);
+  }
+
   if (!mAPIEvents.contains(ev.name)) {
     mAPIEvents[ev.name] = {
       .mFirstSeen = std::chrono::system_clock::now(),
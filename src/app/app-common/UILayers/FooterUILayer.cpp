@@ -38,8 +38,12 @@ FooterUILayer::FooterUILayer(
   AddEventListener(
     kneeboard->evFrameTimerPreEvent,
     std::bind_front(&FooterUILayer::Tick, this));
-  AddEventListener(
-    kneeboard->evAPIEvent, std::bind_front(&FooterUILayer::OnAPIEvent, this));
+  for (const auto topic:
+       {DCSWorld::EVT_SIMULATION_START, DCSWorld::EVT_MISSION_TIME}) {
+    AddEventListener(
+      kneeboard->evAPIEvent.GetTopic(topic),
+      std::bind_front(&FooterUILayer::OnAPIEvent, this));
+  }
   AddEventListener(
     kneeboard->evGameChangedEvent,
     std::bind_front(&FooterUILayer::OnGameChanged, this));
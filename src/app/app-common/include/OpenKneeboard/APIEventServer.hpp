@@ -20,15 +20,20 @@
 #pragma once
 
 #include <OpenKneeboard/APIEvent.hpp>
+#include <OpenKneeboard/APIEventBatchReader.hpp>
 #include <OpenKneeboard/Events.hpp>
 #include <OpenKneeboard/ProcessShutdownBlock.hpp>
-#include <OpenKneeboard/Win32.hpp>
 
 #include <shims/winrt/base.h>
 
 #include <winrt/Windows.Foundation.h>
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <stop_token>
+#include <thread>
+#include <vector>
 
 namespace OpenKneeboard {
 
@@ -42,19 +47,30 @@ class APIEventServer final
 
   Event<APIEvent> evAPIEvent;
 
+  struct Statistics {
+    // After expanding `EVT_MULTI_EVENT`
+    uint64_t mReceived {};
+    uint64_t mDispatched {};
+    // Replaced by a later event with the same name in the same batch
+    uint64_t mCoalesced {};
+    // Dropped because they couldn't be parsed
+    uint64_t mInvalid {};
+    uint64_t mBatches {};
+  };
+  Statistics GetStatistics() const;
+
  private:
   ProcessShutdownBlock mShutdownBlock;
   APIEventServer();
-  std::optional<task<void>> mRunner;
-  std::stop_source mStop;
+  std::unique_ptr<APIEventBatchReader> mReader;
+  std::jthread mReaderThread;
   winrt::apartment_context mUIThread;
+  std::atomic<uint64_t> mDispatched {};
 
   void Start();
 
-  task<void> Run();
-  static task<bool>
-  RunSingle(std::weak_ptr<APIEventServer>, HANDLE event, HANDLE mailslot);
-  OpenKneeboard::fire_and_forget DispatchEvent(std::string_view);
+  void Run(std::stop_token);
+  OpenKneeboard::fire_and_forget DispatchBatch(std::vector<APIEvent>);
 };
 
 }// namespace OpenKneeboard
@@ -0,0 +1,87 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#pragma once
+
+#include <OpenKneeboard/APIEvent.hpp>
+#include <OpenKneeboard/Events.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace OpenKneeboard {
+
+/** `APIEvent`s, split up by topic.
+ *
+ * A topic is either an event name, e.g. `DCSWorld::EVT_AIRCRAFT`, or a prefix
+ * ending in `/`, e.g. `dcs/`. Receivers subscribe to the topics they handle,
+ * so events are only delivered to receivers that want them.
+ *
+ * Like `Event`, this should only be used from the UI thread.
+ */
+class APIEventTopics final {
+ public:
+  APIEventTopics();
+  ~APIEventTopics();
+
+  APIEventTopics(const APIEventTopics&) = delete;
+  APIEventTopics(APIEventTopics&&) = delete;
+  APIEventTopics& operator=(const APIEventTopics&) = delete;
+  APIEventTopics& operator=(APIEventTopics&&) = delete;
+
+  /// The event for a topic; it is created if it doesn't already exist.
+  Event<APIEvent>& GetTopic(std::string_view topic);
+
+  void Emit(const APIEvent&);
+
+  struct TopicStatistics {
+    std::string mTopic;
+    // Events matching the topic
+    uint64_t mEmitted {};
+    // Calls to handlers; 0 if there were no subscribers
+    uint64_t mDelivered {};
+  };
+  struct Statistics {
+    // Events that didn't match any topic
+    uint64_t mUnrouted {};
+    std::vector<TopicStatistics> mTopics;
+  };
+  Statistics GetStatistics() const;
+
+ private:
+  struct Topic {
+    std::string mName;
+    Event<APIEvent> mEvent;
+    uint64_t mEmitted {};
+    uint64_t mDelivered {};
+  };
+
+  std::vector<std::unique_ptr<Topic>> mTopics;
+  // Event name topics, by `APIEventRegistry` ID
+  APIEventHandlerTable<Topic*> mNameTopics;
+  std::vector<Topic*> mPrefixTopics;
+  uint64_t mUnrouted {};
+
+  void Emit(Topic&, const APIEvent&);
+};
+
+}// namespace OpenKneeboard
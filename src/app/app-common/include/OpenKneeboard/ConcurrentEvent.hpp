@@ -0,0 +1,445 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#pragma once
+
+#include <OpenKneeboard/Events.hpp>
+
+#include <OpenKneeboard/dprint.hpp>
+#include <OpenKneeboard/tracing.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <source_location>
+#include <tuple>
+#include <vector>
+
+namespace OpenKneeboard {
+
+/** A connection that can be invalidated from any thread.
+ *
+ * `Call()` is only ever called by the thread draining the event, but
+ * `Invalidate()` may be called from any thread; the handler is destroyed
+ * by whichever of them finishes last.
+ */
+template <class... Args>
+class ConcurrentEventConnection final : public EventConnectionBase {
+ public:
+  ConcurrentEventConnection() = delete;
+  ConcurrentEventConnection(
+    EventHandler<Args...> handler,
+    std::source_location location)
+    : mHandler(std::move(handler)), mSourceLocation(location) {
+  }
+
+  bool IsValid() const noexcept {
+    return !(mState.load() & InvalidatedBit);
+  }
+
+  void Call(const Args&... args) {
+    if (mState.fetch_add(CallerIncrement) & InvalidatedBit) {
+      this->EndCall();
+      return;
+    }
+    try {
+      mHandler(args...);
+    } catch (const std::exception& e) {
+      dprint("Uncaught std::exception from event handler: {}", e.what());
+      OPENKNEEBOARD_BREAK;
+#ifdef _WIN32
+    } catch (const winrt::hresult_error& e) {
+      dprint(
+        L"Uncaught hresult error from event handler: {} - {}",
+        e.code().value,
+        std::wstring_view {e.message()});
+      OPENKNEEBOARD_BREAK;
+#endif
+    } catch (...) {
+      dprint("Uncaught unknown exception from event handler");
+      OPENKNEEBOARD_BREAK;
+    }
+    this->EndCall();
+  }
+
+  virtual void Invalidate() override {
+    if ((mState.fetch_or(InvalidatedBit) & ~InvalidatedBit) == 0) {
+      this->DestroyHandler();
+    }
+  }
+
+ private:
+  static constexpr uint64_t InvalidatedBit = 1 << 0;
+  static constexpr uint64_t DestroyedBit = 1 << 1;
+  // The rest of the bits are the number of calls in progress
+  static constexpr uint64_t CallerIncrement = 1 << 2;
+
+  EventHandler<Args...> mHandler;
+  std::source_location mSourceLocation;
+  std::atomic<uint64_t> mState {0};
+
+  void EndCall() noexcept {
+    const auto previous = mState.fetch_sub(CallerIncrement);
+    if (previous == (CallerIncrement | InvalidatedBit)) {
+      this->DestroyHandler();
+    }
+  }
+
+  // Both `Invalidate()` and the last `EndCall()` can get here at the same
+  // time; only one of them wins the exchange.
+  void DestroyHandler() noexcept {
+    auto expected = InvalidatedBit;
+    if (mState.compare_exchange_strong(
+          expected, InvalidatedBit | DestroyedBit)) {
+      mHandler.reset();
+    }
+  }
+};
+
+/** Base class for all `ConcurrentEvent`s.
+ *
+ * Tracks every live `ConcurrentEvent`, so that the frame loop can deliver
+ * everything that's been emitted with a single `DrainAll()`.
+ */
+class ConcurrentEventBase : public EventBase {
+ public:
+  /** Deliver everything that has been emitted so far.
+   *
+   * This must always be called from the same thread; it's called by the
+   * UI thread once per frame.
+   */
+  static void DrainAll();
+
+  /// Implemented by `ConcurrentEvent<Args...>`
+  class Queue {
+   public:
+    virtual ~Queue();
+    virtual void Drain() = 0;
+  };
+
+ protected:
+  static void Register(const std::shared_ptr<Queue>&);
+  static void RecordDropped(std::source_location) noexcept;
+};
+
+/** A 1:n event that can be emitted from any thread.
+ *
+ * `Emit()` does not call the handlers; it pushes the arguments onto a
+ * bounded queue, and returns. Handlers are called on the UI thread by
+ * `ConcurrentEventBase::DrainAll()`, in the order the events were emitted.
+ *
+ * This avoids a thread switch per event for producers that don't otherwise
+ * need the UI thread, such as `FilesystemWatcher`.
+ *
+ * Adding and removing handlers is lock-free, and safe from any thread: the
+ * change is pushed onto an intrusive stack with a single compare-exchange,
+ * and the next drain applies it. Removing a handler while it is running
+ * destroys it as soon as it returns. Hooks are not supported.
+ */
+template <class... Args>
+class ConcurrentEvent final : public ConcurrentEventBase {
+  friend class EventReceiver;
+
+ public:
+  using Handler = EventHandler<Args...>;
+
+  static constexpr std::size_t DefaultCapacity = 256;
+
+  ConcurrentEvent(std::size_t capacity = DefaultCapacity)
+    : mImpl(std::make_shared<Impl>(capacity)) {
+    Register(mImpl);
+  }
+  ~ConcurrentEvent() = default;
+
+  ConcurrentEvent(const ConcurrentEvent&) = delete;
+  ConcurrentEvent(ConcurrentEvent&&) = delete;
+  ConcurrentEvent& operator=(const ConcurrentEvent&) = delete;
+  ConcurrentEvent& operator=(ConcurrentEvent&&) = delete;
+
+  /** Queue the event for delivery on the UI thread.
+   *
+   * Safe to call from any thread. Returns false if the queue is full; the
+   * event is dropped.
+   */
+  bool Emit(
+    Args... args,
+    std::source_location location = std::source_location::current()) {
+    if (mImpl->Push(location, std::move(args)...)) {
+      return true;
+    }
+    RecordDropped(location);
+    ++mImpl->mDroppedCount;
+    return false;
+  }
+
+  /// Removed handlers are counted until the next drain
+  std::size_t GetHandlerCount() const noexcept {
+    return mImpl->mHandlerCount.load(std::memory_order_relaxed);
+  }
+
+  /// How many events `Emit()` has dropped because the queue was full
+  uint64_t GetDroppedCount() const noexcept {
+    return mImpl->mDroppedCount.load();
+  }
+
+ protected:
+  std::shared_ptr<EventConnectionBase> AddHandler(
+    Handler,
+    std::source_location);
+  virtual void RemoveHandler(EventHandlerToken) override;
+
+ private:
+  using Connection = ConcurrentEventConnection<Args...>;
+  using Receivers = std::vector<std::shared_ptr<Connection>>;
+
+  struct Item {
+    std::tuple<Args...> mArgs;
+    std::source_location mLocation;
+  };
+
+  // Bounded MPSC queue; this is Dmitry Vyukov's MPMC queue, with the
+  // consumer side simplified as there is only ever one consumer.
+  struct Cell {
+    std::atomic<std::size_t> mSequence;
+    std::optional<Item> mItem;
+  };
+
+  // A handler change that hasn't been applied by a drain yet
+  struct PendingChange {
+    std::shared_ptr<Connection> mAdd;
+    std::optional<EventHandlerToken> mRemove;
+    PendingChange* mNext {nullptr};
+  };
+
+  struct Impl final : Queue {
+    Impl(std::size_t capacity);
+    ~Impl();
+
+    // Newest first; producers push with a compare-exchange, and the consumer
+    // takes the whole stack with one exchange, so there's no ABA problem
+    alignas(64) std::atomic<PendingChange*> mPendingChanges {nullptr};
+    std::atomic<std::size_t> mHandlerCount {0};
+    std::atomic<uint64_t> mDroppedCount {0};
+
+    const std::size_t mMask;
+    std::unique_ptr<Cell[]> mCells;
+    alignas(64) std::atomic<std::size_t> mEnqueuePosition {0};
+    // Only accessed by the consumer thread
+    alignas(64) std::size_t mDequeuePosition {0};
+    // Only accessed by the consumer thread. Never modified; applying changes
+    // replaces it, so that deferred calls can keep it alive
+    std::shared_ptr<const Receivers> mReceivers {
+      std::make_shared<const Receivers>()};
+
+    void PushChange(PendingChange);
+    // Apply pending changes, and drop removed receivers
+    std::shared_ptr<const Receivers> UpdateReceivers();
+
+    bool Push(std::source_location location, Args&&... args);
+    std::optional<Item> Pop();
+
+    virtual void Drain() override;
+
+    static void CallReceivers(const Receivers&, const std::tuple<Args...>&);
+  };
+  std::shared_ptr<Impl> mImpl;
+};
+
+template <class... Args>
+ConcurrentEvent<Args...>::Impl::Impl(std::size_t capacity)
+  : mMask(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1),
+    mCells(std::make_unique<Cell[]>(mMask + 1)) {
+  for (std::size_t i = 0; i <= mMask; ++i) {
+    mCells[i].mSequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+template <class... Args>
+ConcurrentEvent<Args...>::Impl::~Impl() {
+  for (const auto& receiver: *this->UpdateReceivers()) {
+    receiver->Invalidate();
+  }
+}
+
+template <class... Args>
+void ConcurrentEvent<Args...>::Impl::PushChange(PendingChange change) {
+  auto node = new PendingChange {std::move(change)};
+  node->mNext = mPendingChanges.load(std::memory_order_relaxed);
+  while (!mPendingChanges.compare_exchange_weak(
+    node->mNext, node, std::memory_order_release, std::memory_order_relaxed)) {
+  }
+}
+
+template <class... Args>
+auto ConcurrentEvent<Args...>::Impl::UpdateReceivers()
+  -> std::shared_ptr<const Receivers> {
+  const auto isValid = [](const auto& receiver) { return receiver->IsValid(); };
+
+  auto pending = mPendingChanges.exchange(nullptr, std::memory_order_acquire);
+  if ((!pending) && std::ranges::all_of(*mReceivers, isValid)) {
+    return mReceivers;
+  }
+
+  // The stack is newest-first; reverse it, so that changes are applied in the
+  // order they were made
+  PendingChange* oldestFirst = nullptr;
+  while (pending) {
+    const auto older = pending->mNext;
+    pending->mNext = oldestFirst;
+    oldestFirst = std::exchange(pending, older);
+  }
+
+  auto next = std::make_shared<Receivers>();
+  std::ranges::copy_if(*mReceivers, std::back_inserter(*next), isValid);
+  auto previousCount = mReceivers->size();
+  while (oldestFirst) {
+    const std::unique_ptr<PendingChange> change {
+      std::exchange(oldestFirst, oldestFirst->mNext)};
+    if (change->mAdd) {
+      ++previousCount;
+      if (change->mAdd->IsValid()) {
+        next->push_back(std::move(change->mAdd));
+      }
+      continue;
+    }
+    const auto it = std::ranges::find(
+      *next, *change->mRemove, [](const auto& receiver) {
+        return receiver->mToken;
+      });
+    if (it != next->end()) {
+      (*it)->Invalidate();
+      next->erase(it);
+    }
+  }
+
+  mHandlerCount.fetch_sub(
+    previousCount - next->size(), std::memory_order_relaxed);
+  mReceivers = std::move(next);
+  return mReceivers;
+}
+
+template <class... Args>
+bool ConcurrentEvent<Args...>::Impl::Push(
+  std::source_location location,
+  Args&&... args) {
+  auto position = mEnqueuePosition.load(std::memory_order_relaxed);
+  while (true) {
+    auto& cell = mCells[position & mMask];
+    const auto sequence = cell.mSequence.load(std::memory_order_acquire);
+    const auto delta = static_cast<std::intptr_t>(sequence)
+      - static_cast<std::intptr_t>(position);
+    if (delta < 0) {
+      // The consumer hasn't freed this cell yet: the queue is full
+      return false;
+    }
+    if (delta > 0) {
+      // Another producer claimed this cell
+      position = mEnqueuePosition.load(std::memory_order_relaxed);
+      continue;
+    }
+    if (mEnqueuePosition.compare_exchange_weak(
+          position, position + 1, std::memory_order_relaxed)) {
+      cell.mItem.emplace(std::tuple<Args...> {std::move(args)...}, location);
+      cell.mSequence.store(position + 1, std::memory_order_release);
+      return true;
+    }
+  }
+}
+
+template <class... Args>
+auto ConcurrentEvent<Args...>::Impl::Pop() -> std::optional<Item> {
+  auto& cell = mCells[mDequeuePosition & mMask];
+  const auto sequence = cell.mSequence.load(std::memory_order_acquire);
+  if (sequence != mDequeuePosition + 1) {
+    return std::nullopt;
+  }
+  std::optional<Item> ret {std::move(cell.mItem)};
+  cell.mItem.reset();
+  cell.mSequence.store(mDequeuePosition + mMask + 1, std::memory_order_release);
+  ++mDequeuePosition;
+  return ret;
+}
+
+template <class... Args>
+void ConcurrentEvent<Args...>::Impl::Drain() {
+  // Receivers added by handlers called during this drain will see the next
+  // drain's events; this matches `Event<>`.
+  const auto receivers = this->UpdateReceivers();
+  // Only drain what fits in the queue, so that a busy producer can't keep
+  // the frame loop here forever
+  for (std::size_t i = 0; i <= mMask; ++i) {
+    auto item = this->Pop();
+    if (!item) {
+      return;
+    }
+    InvokeOrEnqueue(
+      [&]() { CallReceivers(*receivers, item->mArgs); },
+      [&]() {
+        return [receivers, args = std::move(item->mArgs)]() {
+          CallReceivers(*receivers, args);
+        };
+      },
+      item->mLocation);
+  }
+}
+
+template <class... Args>
+void ConcurrentEvent<Args...>::Impl::CallReceivers(
+  const Receivers& receivers,
+  const std::tuple<Args...>& args) {
+  for (const auto& receiver: receivers) {
+    std::apply(
+      [&receiver](const Args&... args) { receiver->Call(args...); }, args);
+  }
+}
+
+template <class... Args>
+std::shared_ptr<EventConnectionBase> ConcurrentEvent<Args...>::AddHandler(
+  Handler handler,
+  std::source_location location) {
+  auto connection = std::make_shared<Connection>(std::move(handler), location);
+  // Before pushing, so the drain never subtracts it first
+  mImpl->mHandlerCount.fetch_add(1, std::memory_order_relaxed);
+  mImpl->PushChange({.mAdd = connection});
+  return connection;
+}
+
+// `EventReceiver` invalidates its connections directly; this is only needed
+// for callers that just have the token, and takes effect at the next drain
+template <class... Args>
+void ConcurrentEvent<Args...>::RemoveHandler(EventHandlerToken token) {
+  mImpl->PushChange({.mRemove = token});
+}
+
+template <class... Args>
+EventHandlerToken EventReceiver::AddEventListener(
+  ConcurrentEvent<Args...>& event,
+  std::type_identity_t<EventHandler<Args...>> handler,
+  std::source_location location) {
+  mSenders.push_back(event.AddHandler(std::move(handler), location));
+  return mSenders.back()->mToken;
+}
+
+}// namespace OpenKneeboard
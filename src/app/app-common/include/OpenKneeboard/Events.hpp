@@ -30,13 +30,21 @@
 #include <OpenKneeboard/tracing.hpp>
 #include <OpenKneeboard/weak_refs.hpp>
 
+#ifdef _WIN32
 #include <shims/winrt/base.h>
 
 #include <winrt/Windows.Foundation.h>
+#endif
 
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <functional>
 #include <list>
+#include <memory>
+#include <new>
 #include <mutex>
 #include <source_location>
 #include <type_traits>
@@ -58,6 +66,9 @@ class Event;
 template <class... Args>
 class EventHandler;
 
+template <class... Args>
+class ConcurrentEvent;
+
 template <class TInvocable, class... TArgs>
 concept drop_extra_back_invocable
   = std::invocable<TInvocable, TArgs...>
@@ -88,30 +99,61 @@ static_assert(event_handler_invocable<std::function<void()>>);
 static_assert(event_handler_invocable<std::function<fire_and_forget()>>);
 static_assert(!event_handler_invocable<std::function<task<void>()>>);
 
+/** A move-only callback for `Event<Args...>`.
+ *
+ * Callables up to `InlineStorageSize` bytes - for example, the result of
+ * `bind_refs_front()` with one weak reference and a member function pointer -
+ * are stored in the handler itself; larger ones are heap-allocated.
+ */
 template <class... Args>
 class EventHandler final {
  public:
   using self_t = EventHandler<Args...>;
-  using Callback = std::function<void(Args...)>;
 
-  constexpr EventHandler() = default;
-  constexpr EventHandler(const EventHandler&) = default;
-  constexpr EventHandler(EventHandler&&) = default;
-  EventHandler& operator=(const EventHandler&) = default;
-  EventHandler& operator=(EventHandler&&) = default;
+  static constexpr std::size_t InlineStorageSize = 8 * sizeof(void*);
 
-  constexpr operator bool() const noexcept {
-    return static_cast<bool>(mImpl);
+  template <class T>
+  static constexpr bool fits_inline_v = sizeof(T) <= InlineStorageSize
+    && alignof(T) <= alignof(std::max_align_t)
+    && std::is_nothrow_move_constructible_v<T>;
+
+  EventHandler() = default;
+  EventHandler(const EventHandler&) = delete;
+  EventHandler& operator=(const EventHandler&) = delete;
+
+  EventHandler(EventHandler&& other) noexcept {
+    *this = std::move(other);
+  }
+
+  EventHandler& operator=(EventHandler&& other) noexcept {
+    if (this == &other) {
+      return *this;
+    }
+    this->reset();
+    if (other.mVTable) {
+      other.mVTable->mMove(other.mStorage, mStorage);
+      mVTable = std::exchange(other.mVTable, nullptr);
+    }
+    return *this;
+  }
+
+  ~EventHandler() {
+    this->reset();
+  }
+
+  operator bool() const noexcept {
+    return mVTable != nullptr;
   }
 
   template <event_handler_invocable<Args...> T>
     requires(!std::same_as<self_t, std::decay_t<T>>)
-  constexpr EventHandler(T&& fn) : mImpl(drop_extra_back(std::forward<T>(fn))) {
+  EventHandler(T&& fn) {
+    this->emplace(drop_extra_back(std::forward<T>(fn)));
   }
 
   /// Convenience wrapper for `{this, &MyClass::myMethod}`
   template <class F, convertible_to_weak_ref Bind>
-  constexpr EventHandler(Bind&& bind, F&& f)
+  EventHandler(Bind&& bind, F&& f)
     : EventHandler(
         bind_refs_front(std::forward<F>(f), std::forward<Bind>(bind))) {
   }
@@ -124,14 +166,83 @@ class EventHandler final {
    */
   template <class Bind, class F>
     requires(!convertible_to_weak_ref<Bind*>)
-  constexpr EventHandler(Bind*, F&& f) = delete;
+  EventHandler(Bind*, F&& f) = delete;
 
-  void operator()(Args... args) const noexcept {
-    mImpl(args...);
+  void operator()(const Args&... args) const noexcept {
+    mVTable->mInvoke(const_cast<std::byte*>(mStorage), args...);
+  }
+
+  bool IsInline() const noexcept {
+    return mVTable && mVTable->mIsInline;
+  }
+
+  void reset() noexcept {
+    if (mVTable) {
+      std::exchange(mVTable, nullptr)->mDestroy(mStorage);
+    }
   }
 
  private:
-  Callback mImpl;
+  struct VTable {
+    void (*mInvoke)(std::byte* storage, const Args&... args);
+    // Move-constructs into `to`, and destroys `from`
+    void (*mMove)(std::byte* from, std::byte* to) noexcept;
+    void (*mDestroy)(std::byte* storage) noexcept;
+    bool mIsInline;
+  };
+
+  template <class T>
+  static constexpr VTable InlineVTable {
+    .mInvoke =
+      [](std::byte* storage, const Args&... args) {
+        std::invoke(*std::launder(reinterpret_cast<T*>(storage)), args...);
+      },
+    .mMove =
+      [](std::byte* from, std::byte* to) noexcept {
+        auto source = std::launder(reinterpret_cast<T*>(from));
+        std::construct_at(reinterpret_cast<T*>(to), std::move(*source));
+        std::destroy_at(source);
+      },
+    .mDestroy =
+      [](std::byte* storage) noexcept {
+        std::destroy_at(std::launder(reinterpret_cast<T*>(storage)));
+      },
+    .mIsInline = true,
+  };
+
+  template <class T>
+  static constexpr VTable HeapVTable {
+    .mInvoke =
+      [](std::byte* storage, const Args&... args) {
+        std::invoke(**reinterpret_cast<T**>(storage), args...);
+      },
+    .mMove =
+      [](std::byte* from, std::byte* to) noexcept {
+        std::memcpy(to, from, sizeof(T*));
+      },
+    .mDestroy =
+      [](std::byte* storage) noexcept {
+        delete *reinterpret_cast<T**>(storage);
+      },
+    .mIsInline = false,
+  };
+
+  alignas(std::max_align_t) std::byte mStorage[InlineStorageSize];
+  const VTable* mVTable {nullptr};
+
+  template <class TFn>
+  void emplace(TFn&& fn) {
+    using T = std::decay_t<TFn>;
+    if constexpr (fits_inline_v<T>) {
+      std::construct_at(
+        reinterpret_cast<T*>(mStorage), std::forward<TFn>(fn));
+      mVTable = &InlineVTable<T>;
+    } else {
+      auto p = new T(std::forward<TFn>(fn));
+      std::memcpy(mStorage, &p, sizeof(p));
+      mVTable = &HeapVTable<T>;
+    }
+  }
 };
 
 class EventReceiver;
@@ -150,7 +261,9 @@ class EventBase {
     STOP_PROPAGATION,
   };
 
+#ifdef _WIN32
   static void Shutdown(HANDLE event);
+#endif
 
  protected:
   /** Event handlers are not invoked recursively to avoid deadlocks.
@@ -164,10 +277,53 @@ class EventBase {
    *
    * To similarly buffer events in a non-handler context, use the `EventDelay`
    * class.
+   *
+   * `makeDeferred()` is only called if the call needs to be queued; it must
+   * return a `void()` callable that owns copies of anything it needs. This
+   * means that `invoke` can capture by reference, and does not need to
+   * allocate.
+   *
+   * Queued callables are stored in a per-thread ring buffer; if they fit in
+   * an `EventHandler<>`'s inline storage, queueing does not allocate unless
+   * the ring buffer is full.
    */
-  static void InvokeOrEnqueue(std::function<void()>, std::source_location);
+  template <std::invocable TInvoke, std::invocable TMakeDeferred>
+  static void InvokeOrEnqueue(
+    TInvoke&& invoke,
+    TMakeDeferred&& makeDeferred,
+    std::source_location location) {
+    EventsTraceLoggingThreadActivity activity;
+    TraceLoggingWriteStart(
+      activity,
+      "EventBase::InvokeOrEnqueue()",
+      OPENKNEEBOARD_TraceLoggingSourceLocation(location));
+    switch (BeginInvoke()) {
+      case InvokeKind::Immediate:
+        std::invoke(invoke);
+        EndInvoke();
+        break;
+      case InvokeKind::Enqueue:
+        Enqueue(std::invoke(makeDeferred), location);
+        break;
+      case InvokeKind::Drop:
+        break;
+    }
+    TraceLoggingWriteStop(activity, "EventBase::InvokeOrEnqueue()");
+  }
 
   virtual void RemoveHandler(EventHandlerToken) = 0;
+
+ private:
+  enum class InvokeKind {
+    Immediate,
+    Enqueue,
+    // We're shutting down
+    Drop,
+  };
+  // If this returns `Immediate`, the caller must call `EndInvoke()` after
+  static InvokeKind BeginInvoke() noexcept;
+  static void EndInvoke() noexcept;
+  static void Enqueue(EventHandler<>, std::source_location);
 };
 
 /** Delay any event handling in the current thread for the lifetime of this
@@ -176,9 +332,19 @@ class EventBase {
  * For example, you may want to use this after */
 class EventDelay final {
  public:
+  struct Statistics {
+    // The most calls that have been queued at once
+    std::size_t mPeakDepth {};
+    // How many calls didn't fit in the ring buffer, so were heap-allocated
+    uint64_t mOverflowCount {};
+  };
+
   EventDelay(std::source_location location = std::source_location::current());
   ~EventDelay();
 
+  /// Queue statistics for the current thread
+  static Statistics GetStatistics() noexcept;
+
   EventDelay(const EventDelay&) = delete;
   EventDelay(EventDelay&&) = delete;
   auto operator=(const EventDelay&) = delete;
@@ -202,7 +368,7 @@ class EventConnection final
     public std::enable_shared_from_this<EventConnection<Args...>> {
  private:
   EventConnection(EventHandler<Args...> handler, std::source_location location)
-    : mHandler(handler), mSourceLocation(location) {
+    : mHandler(std::move(handler)), mSourceLocation(location) {
   }
 
  public:
@@ -212,46 +378,56 @@ class EventConnection final
     EventHandler<Args...> handler,
     std::source_location location) {
     return std::shared_ptr<EventConnection<Args...>>(
-      new EventConnection(handler, location));
+      new EventConnection(std::move(handler), location));
   }
 
   constexpr operator bool() const noexcept {
     // not bothering with the lock, as it's checked with lock in Call() and
     // Invalidate() anyway
-    return static_cast<bool>(mHandler);
+    return static_cast<bool>(mHandler) && !mInvalidated;
   }
 
-  void Call(Args... args) {
-    auto stayingAlive = this->shared_from_this();
-    auto handler = mHandler;
-    if (handler) {
+  void Call(const Args&... args) {
+    if (*this) {
+      ++mCallDepth;
       // In release builds, ignore but drop unhandled exceptions from
       // handlers. In debug builds, break (or crash)
       try {
-        handler(args...);
+        mHandler(args...);
       } catch (const std::exception& e) {
         dprint("Uncaught std::exception from event handler: {}", e.what());
         OPENKNEEBOARD_BREAK;
+#ifdef _WIN32
       } catch (const winrt::hresult_error& e) {
         dprint(
           L"Uncaught hresult error from event handler: {} - {}",
           e.code().value,
           std::wstring_view {e.message()});
         OPENKNEEBOARD_BREAK;
+#endif
       } catch (...) {
         dprint("Uncaught unknown exception from event handler");
         OPENKNEEBOARD_BREAK;
       }
+      if (--mCallDepth == 0 && mInvalidated) {
+        mHandler.reset();
+      }
     }
   }
 
   virtual void Invalidate() override {
-    mHandler = {};
+    // If the handler is running, we can't destroy it until it returns
+    mInvalidated = true;
+    if (mCallDepth == 0) {
+      mHandler.reset();
+    }
   }
 
  private:
   EventHandler<Args...> mHandler;
   std::source_location mSourceLocation;
+  std::size_t mCallDepth {0};
+  bool mInvalidated {false};
 };
 
 /** a 1:n event. */
@@ -288,25 +464,48 @@ class Event final : public EventBase {
   EventHookToken AddHook(Hook, EventHookToken token = {}) noexcept;
   void RemoveHook(EventHookToken) noexcept;
 
+  /// How many handlers `Emit()` will call, unless a hook stops it
+  std::size_t GetHandlerCount() const noexcept {
+    return mImpl->mSnapshot->mReceivers.size();
+  }
+
  protected:
   std::shared_ptr<EventConnectionBase> AddHandler(
-    const EventHandler<Args...>&,
+    EventHandler<Args...>,
     std::source_location current);
   virtual void RemoveHandler(EventHandlerToken token) override;
 
  private:
+  struct Snapshot {
+    std::vector<std::shared_ptr<EventConnection<Args...>>> mReceivers;
+    std::vector<std::pair<EventHookToken, Hook>> mHooks;
+  };
+
   struct Impl {
     ~Impl();
 
-    std::unordered_map<
-      EventHandlerToken,
-      std::shared_ptr<EventConnection<Args...>>>
-      mReceivers;
-    std::unordered_map<EventHookToken, Hook> mHooks;
+    // Never modified; adding or removing a receiver or hook replaces it.
+    // This lets `Emit()` take a reference instead of copying, even if a
+    // handler adds or removes receivers.
+    std::shared_ptr<const Snapshot> mSnapshot {std::make_shared<Snapshot>()};
+
+    template <std::invocable<Snapshot&> TFn>
+    void Update(TFn&& fn) {
+      auto next = std::make_shared<Snapshot>(*mSnapshot);
+      // `EventReceiver::RemoveEventListener()` only invalidates the
+      // connection; as we're copying anyway, drop them here
+      std::erase_if(next->mReceivers, [](const auto& receiver) {
+        return !static_cast<bool>(*receiver);
+      });
+      std::invoke(std::forward<TFn>(fn), *next);
+      mSnapshot = std::move(next);
+    }
 
     void Emit(
       Args... args,
       std::source_location location = std::source_location::current());
+
+    static void CallReceivers(const Snapshot&, const Args&... args);
   };
   std::shared_ptr<Impl> mImpl;
 };
@@ -335,7 +534,7 @@ class EventReceiver {
   template <class... Args>
   EventHandlerToken AddEventListener(
     Event<Args...>& event,
-    const std::type_identity_t<EventHandler<Args...>>& handler,
+    std::type_identity_t<EventHandler<Args...>> handler,
     std::source_location location = std::source_location::current());
 
   template <class... Args>
@@ -351,28 +550,43 @@ class EventReceiver {
     Event<>& forwardAs,
     std::source_location location = std::source_location::current());
 
+  // Defined in ConcurrentEvent.hpp
+  template <class... Args>
+  EventHandlerToken AddEventListener(
+    ConcurrentEvent<Args...>& event,
+    std::type_identity_t<EventHandler<Args...>> handler,
+    std::source_location location = std::source_location::current());
+
   void RemoveEventListener(EventHandlerToken);
   void RemoveAllEventListeners();
 };
 
 template <class... Args>
 std::shared_ptr<EventConnectionBase> Event<Args...>::AddHandler(
-  const EventHandler<Args...>& handler,
+  EventHandler<Args...> handler,
   std::source_location location) {
-  auto connection = EventConnection<Args...>::Create(handler, location);
-  auto token = connection->mToken;
-  mImpl->mReceivers.emplace(token, connection);
+  auto connection
+    = EventConnection<Args...>::Create(std::move(handler), location);
+  mImpl->Update([&connection](Snapshot& snapshot) {
+    snapshot.mReceivers.push_back(connection);
+  });
   return std::move(connection);
 }
 
 template <class... Args>
 void Event<Args...>::RemoveHandler(EventHandlerToken token) {
-  std::shared_ptr<EventConnectionBase> receiver;
-  if (!mImpl->mReceivers.contains(token)) {
+  const auto& receivers = mImpl->mSnapshot->mReceivers;
+  const auto it = std::ranges::find(
+    receivers, token, [](const auto& receiver) { return receiver->mToken; });
+  if (it == receivers.end()) {
     return;
   }
-  receiver = mImpl->mReceivers.at(token);
-  mImpl->mReceivers.erase(token);
+  const auto receiver = *it;
+  mImpl->Update([&token](Snapshot& snapshot) {
+    std::erase_if(snapshot.mReceivers, [&token](const auto& receiver) {
+      return receiver->mToken == token;
+    });
+  });
   receiver->Invalidate();
 }
 
@@ -383,11 +597,11 @@ void Event<Args...>::Impl::Emit(Args... args, std::source_location location) {
     activity,
     "Event::Emit()",
     OPENKNEEBOARD_TraceLoggingSourceLocation(location));
-  //  Copy in case one is erased while we're running
-  auto receivers = mReceivers;
-  auto hooks = mHooks;
+  // Keeps these receivers and hooks alive, even if they're removed while
+  // we're running
+  const auto snapshot = mSnapshot;
 
-  for (const auto& [_, hook]: hooks) {
+  for (const auto& [_, hook]: snapshot->mHooks) {
     if (hook(args...) == HookResult::STOP_PROPAGATION) {
       TraceLoggingWriteStop(
         activity,
@@ -398,25 +612,31 @@ void Event<Args...>::Impl::Emit(Args... args, std::source_location location) {
   }
 
   InvokeOrEnqueue(
-    [=]() {
-      for (const auto& [token, receiver]: receivers) {
-        if (receiver) {
-          receiver->Call(args...);
-        }
-      }
+    [&]() { CallReceivers(*snapshot, args...); },
+    [&]() {
+      return [snapshot, args...]() { CallReceivers(*snapshot, args...); };
     },
     location);
   TraceLoggingWriteStop(
     activity, "Event::Emit()", TraceLoggingValue("Done", "Result"));
 }
 
+template <class... Args>
+void Event<Args...>::Impl::CallReceivers(
+  const Snapshot& snapshot,
+  const Args&... args) {
+  for (const auto& receiver: snapshot.mReceivers) {
+    receiver->Call(args...);
+  }
+}
+
 template <class... Args>
 Event<Args...>::~Event() {
 }
 
 template <class... Args>
 Event<Args...>::Impl::~Impl() {
-  for (const auto& [token, receiver]: mReceivers) {
+  for (const auto& receiver: mSnapshot->mReceivers) {
     receiver->Invalidate();
   }
 }
@@ -425,24 +645,33 @@ template <class... Args>
 EventHookToken Event<Args...>::AddHook(
   Hook hook,
   EventHookToken token) noexcept {
-  mImpl->mHooks.insert_or_assign(token, hook);
+  mImpl->Update([&](Snapshot& snapshot) {
+    auto& hooks = snapshot.mHooks;
+    const auto it = std::ranges::find(
+      hooks, token, [](const auto& it) { return it.first; });
+    if (it == hooks.end()) {
+      hooks.emplace_back(token, std::move(hook));
+    } else {
+      it->second = std::move(hook);
+    }
+  });
   return token;
 }
 
 template <class... Args>
 void Event<Args...>::RemoveHook(EventHookToken token) noexcept {
-  auto it = mImpl->mHooks.find(token);
-  if (it != mImpl->mHooks.end()) {
-    mImpl->mHooks.erase(it);
-  }
+  mImpl->Update([&token](Snapshot& snapshot) {
+    std::erase_if(
+      snapshot.mHooks, [&token](const auto& it) { return it.first == token; });
+  });
 }
 
 template <class... Args>
 EventHandlerToken EventReceiver::AddEventListener(
   Event<Args...>& event,
-  const std::type_identity_t<EventHandler<Args...>>& handler,
+  std::type_identity_t<EventHandler<Args...>> handler,
   std::source_location location) {
-  mSenders.push_back(event.AddHandler(handler, location));
+  mSenders.push_back(event.AddHandler(std::move(handler), location));
   return mSenders.back()->mToken;
 }
 
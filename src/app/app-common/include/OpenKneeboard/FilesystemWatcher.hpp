@@ -19,7 +19,7 @@
  */
 #pragma once
 
-#include <OpenKneeboard/Events.hpp>
+#include <OpenKneeboard/ConcurrentEvent.hpp>
 
 #include <shims/winrt/base.h>
 
@@ -46,7 +46,12 @@ class FilesystemWatcher final
   static OpenKneeboard::fire_and_forget final_release(
     std::unique_ptr<FilesystemWatcher>);
 
-  Event<std::filesystem::path> evFilesystemModifiedEvent;
+  /** Emitted from a background thread, delivered on the UI thread.
+   *
+   * The argument is always the watched path, so notifications are coalesced:
+   * if one hasn't been delivered yet, it covers any later changes.
+   */
+  ConcurrentEvent<std::filesystem::path> evFilesystemModifiedEvent {2};
 
   FilesystemWatcher() = delete;
   ~FilesystemWatcher();
@@ -56,10 +61,10 @@ class FilesystemWatcher final
   void Initialize();
   task<void> Run();
   OpenKneeboard::fire_and_forget OnContentsChanged();
+  void EmitModified();
 
   std::optional<task<void>> mImpl;
 
-  winrt::apartment_context mOwnerThread;
   std::filesystem::path mPath;
 
   std::filesystem::file_time_type mLastWriteTime;
@@ -33,9 +33,13 @@
 
 #include <d3d11.h>
 
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <unordered_map>
 
 #include <d2d1.h>
 #include <d2d1_1.h>
@@ -97,7 +101,7 @@ class InterprocessRenderer final
     D3D11_VIEWPORT mViewport {};
   };
 
-  std::array<IPCTextureResources, SHMSwapchainLength> mIPCSwapchain;
+  std::array<IPCTextureResources, MaxSHMSwapchainLength> mIPCSwapchain;
 
   IPCTextureResources* GetIPCTextureResources(
     uint8_t textureIndex,
@@ -110,6 +114,9 @@ class InterprocessRenderer final
 
   std::shared_ptr<GameInstance> mCurrentGame;
 
+  // Layer ID => `ViewRenderInfo::mContentGeneration` in the last frame
+  std::unordered_map<uint64_t, uint64_t> mContentGenerations;
+
   void MarkDirty();
   task<SHM::LayerConfig> RenderLayer(
     const ViewRenderInfo&,
@@ -117,7 +124,27 @@ class InterprocessRenderer final
 
   void SubmitFrame(
     const std::vector<SHM::LayerConfig>&,
-    uint64_t inputLayerID) noexcept;
+    uint64_t inputLayerID,
+    std::chrono::steady_clock::time_point beginRenderTime) noexcept;
+
+  /** Tells consumers when the GPU finished copying a frame to each SHM
+   * texture.
+   *
+   * The event and threadpool wait are created once per texture, and re-armed
+   * for every frame.
+   */
+  struct FrameReadyWait {
+    InterprocessRenderer* mRenderer {nullptr};
+    uint8_t mTextureIndex {};
+    std::atomic<LONG64> mFenceValue {};
+    winrt::handle mEvent;
+    PTP_WAIT mWait {nullptr};
+  };
+  std::array<FrameReadyWait, MaxSHMSwapchainLength> mFrameReadyWaits;
+
+  void WaitForFrameReady(uint8_t textureIndex, LONG64 fenceValue) noexcept;
+  static void CALLBACK
+  OnFrameReady(PTP_CALLBACK_INSTANCE, void* context, PTP_WAIT, TP_WAIT_RESULT);
 
   void OnGameChanged(DWORD processID, const std::shared_ptr<GameInstance>&);
 
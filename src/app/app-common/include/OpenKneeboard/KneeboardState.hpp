@@ -20,10 +20,12 @@
 #pragma once
 
 #include <OpenKneeboard/APIEvent.hpp>
+#include <OpenKneeboard/APIEventTopics.hpp>
 #include <OpenKneeboard/DXResources.hpp>
 #include <OpenKneeboard/Events.hpp>
 #include <OpenKneeboard/IHasDisposeAsync.hpp>
 #include <OpenKneeboard/KneeboardView.hpp>
+#include <OpenKneeboard/OrderedEventQueue.hpp>
 #include <OpenKneeboard/ProfileSettings.hpp>
 #include <OpenKneeboard/RunnerThread.hpp>
 #include <OpenKneeboard/SHM.hpp>
@@ -39,7 +41,6 @@
 #include <winrt/Windows.Foundation.h>
 
 #include <memory>
-#include <queue>
 #include <shared_mutex>
 #include <thread>
 #include <vector>
@@ -67,6 +68,8 @@ struct ViewRenderInfo {
   std::optional<SHM::NonVRLayer> mNonVR;
   PixelSize mFullSize;
   bool mIsActiveForInput = false;
+  /// Changes if the view needs repainting
+  uint64_t mContentGeneration {};
 };
 
 struct RunningGame {
@@ -112,7 +115,8 @@ class KneeboardState final
   Event<> evActiveViewChangedEvent;
   Event<> evInputDevicesChangedEvent;
   Event<UserAction> evUserActionEvent;
-  Event<APIEvent> evAPIEvent;
+  // Events that aren't handled by `KneeboardState` itself
+  APIEventTopics evAPIEvent;
   Event<DWORD, std::shared_ptr<GameInstance>> evGameChangedEvent;
 
   std::vector<std::shared_ptr<UserInputDevice>> GetInputDevices() const;
@@ -150,6 +154,8 @@ class KneeboardState final
   [[nodiscard]] task<void> PostUserAction(UserAction action);
 
   bool IsRepaintNeeded() const;
+  /// Repaint all views; use `KneeboardView::evNeedsRepaintEvent` instead if
+  /// only one view has changed
   void SetRepaintNeeded();
   void Repainted();
 
@@ -176,7 +182,7 @@ class KneeboardState final
 
   task<void> FlushOrderedEventQueue(
     std::chrono::time_point<std::chrono::steady_clock> stopAt);
-  void EnqueueOrderedEvent(std::function<task<void>()>);
+  void EnqueueOrderedEvent(OrderedEventPriority, std::function<task<void>()>);
 
  private:
   KneeboardState(HWND mainWindow, const audited_ptr<DXResources>&);
@@ -192,6 +198,8 @@ class KneeboardState final
   std::size_t mUniqueLockDepth = 0;
 
   bool mNeedsRepaint;
+  // Incremented by `SetRepaintNeeded()`, but not by individual views
+  uint64_t mRepaintAllGeneration {};
   winrt::apartment_context mUIThread;
   HWND mHwnd;
   audited_ptr<DXResources> mDXResources;
@@ -221,7 +229,7 @@ class KneeboardState final
   RunnerThread mOpenVRThread;
   std::optional<RunningGame> mCurrentGame;
 
-  std::queue<std::function<task<void>()>> mOrderedEventQueue;
+  OrderedEventQueue mOrderedEventQueue;
   bool mFlushingQueue = false;
   winrt::handle mQueueFlushedEvent;
 
@@ -231,7 +239,19 @@ class KneeboardState final
     DWORD processID,
     const std::shared_ptr<GameInstance>& game);
   [[nodiscard]] void OnAPIEvent(APIEvent) noexcept;
-  task<void> ProcessAPIEvent(APIEvent) noexcept;
+  task<void> ProcessAPIEvent(
+    APIEvent,
+    std::chrono::steady_clock::time_point queuedAt) noexcept;
+
+  task<void> OnRemoteUserAction(APIEvent);
+  task<void> OnPluginTabCustomAction(APIEvent);
+  task<void> OnSetTabByID(APIEvent);
+  task<void> OnSetTabByName(APIEvent);
+  task<void> OnSetTabByIndex(APIEvent);
+  task<void> OnSetProfileByGUID(APIEvent);
+  task<void> OnSetProfileByName(APIEvent);
+  task<void> OnSetBrightness(APIEvent);
+  task<void> OnDumpTaskLatency(APIEvent);
 
   void BeforeFrame();
   void AfterFrame(FramePostEventKind);
@@ -250,6 +270,7 @@ class KneeboardState final
   [[nodiscard]] task<void> SwitchProfile(Direction);
 
   void InitializeViews();
+  void SetViewRepaintNeeded();
 };
 
 }// namespace OpenKneeboard
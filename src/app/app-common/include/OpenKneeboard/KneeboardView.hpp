@@ -115,6 +115,9 @@ class KneeboardView final : private EventReceiver,
 
   void PostCustomAction(std::string_view id, const nlohmann::json& arg);
 
+  /// Incremented whenever `evNeedsRepaintEvent` is emitted
+  uint64_t GetContentGeneration() const noexcept;
+
   // Not just overloading std::swap because this intentionally does not swap IDs
   void SwapState(KneeboardView& other);
 
@@ -153,6 +156,7 @@ class KneeboardView final : private EventReceiver,
   std::shared_ptr<TabView> mCurrentTabView;
 
   std::optional<D2D1_POINT_2F> mCursorCanvasPoint;
+  uint64_t mContentGeneration {};
 
   std::unique_ptr<CursorRenderer> mCursorRenderer;
   std::unique_ptr<D2DErrorRenderer> mErrorRenderer;
@@ -0,0 +1,119 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#pragma once
+
+#include <OpenKneeboard/task.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+
+namespace OpenKneeboard {
+
+/** Scheduling classes for `OrderedEventQueue`.
+ *
+ * Events run in order within a class; earlier classes overtake later
+ * classes.
+ */
+enum class OrderedEventPriority : uint8_t {
+  // User-visible actions, e.g. bindings, toolbar buttons, and API commands
+  // like `SetTabByName`. These are in one class so that commands from the
+  // same client stay in order.
+  Interactive,
+  // Game state, e.g. DCS events
+  State,
+  // Anything else, e.g. third-party API events
+  Bulk,
+};
+
+/** Work for the UI thread that must not overlap; it runs between frames.
+ *
+ * `Flush()` runs events in priority order until its deadline. It doesn't
+ * start an event that is expected to overrun the deadline unless nothing else
+ * has run in this flush; the expected cost is a moving average for the event's
+ * class and `CostKey`, so that one slow kind of event - e.g. switching
+ * profiles - doesn't hold back cheap events in the same class.
+ *
+ * Events that have waited for `MaxWait` run in the order they were queued,
+ * regardless of class, so that lower classes are not starved.
+ */
+class OrderedEventQueue final {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using Event = std::function<task<void>()>;
+  /** Events with the same class and key share a cost estimate.
+   *
+   * Events without a key share one estimate per class.
+   */
+  using CostKey = uint32_t;
+
+  static constexpr std::chrono::milliseconds MaxWait {250};
+  static constexpr std::size_t ClassCount = 3;
+
+  OrderedEventQueue();
+  ~OrderedEventQueue();
+
+  OrderedEventQueue(const OrderedEventQueue&) = delete;
+  OrderedEventQueue(OrderedEventQueue&&) = delete;
+  OrderedEventQueue& operator=(const OrderedEventQueue&) = delete;
+  OrderedEventQueue& operator=(OrderedEventQueue&&) = delete;
+
+  void Push(OrderedEventPriority, Event, CostKey = {});
+  /// Must not be called again until the previous call has completed
+  task<void> Flush(Clock::time_point stopAt);
+
+  bool IsEmpty() const noexcept;
+  std::size_t GetSize() const noexcept;
+
+  struct Statistics {
+    uint64_t mCount {};
+    // Time spent running events
+    Clock::duration mTotalCost {};
+    Clock::duration mMaxCost {};
+    // Time from `Push()` until the event started
+    Clock::duration mTotalWait {};
+    Clock::duration mMaxWait {};
+    // Times that this class was next, but didn't fit before the deadline
+    uint64_t mDeferred {};
+  };
+  Statistics GetStatistics(OrderedEventPriority) const;
+
+ private:
+  struct Entry {
+    Event mEvent;
+    Clock::time_point mQueuedAt;
+    CostKey mCostKey {};
+  };
+  struct Class {
+    std::deque<Entry> mEntries;
+    std::unordered_map<CostKey, Clock::duration> mEstimatedCosts;
+    Statistics mStatistics;
+  };
+  std::array<Class, ClassCount> mClasses;
+
+  Class& GetClass(OrderedEventPriority);
+  const Class& GetClass(OrderedEventPriority) const;
+  OrderedEventPriority SelectNext(Clock::time_point now) const;
+};
+
+}// namespace OpenKneeboard
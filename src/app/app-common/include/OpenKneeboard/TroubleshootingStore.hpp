@@ -32,6 +32,9 @@
 namespace OpenKneeboard {
 
 struct APIEvent;
+namespace APIEventLog {
+class Writer;
+}
 
 class TroubleshootingStore final : private EventReceiver {
  public:
@@ -71,8 +74,10 @@ class TroubleshootingStore final : private EventReceiver {
   std::jthread mDPrintThread;
   std::map<std::string, APIEventEntry> mAPIEvents;
   std::optional<std::ofstream> mLogFile;
+  std::unique_ptr<APIEventLog::Writer> mAPIEventLog;
 
   void InitializeLogFile();
+  void InitializeAPIEventLog();
   void WriteDPrintMessageToLogFile(const DPrintEntry&);
 
   TroubleshootingStore();
@@ -19,10 +19,13 @@
  */
 #pragma once
 
-#include <OpenKneeboard/cppwinrt.hpp>
 #include <OpenKneeboard/task.hpp>
 
+#ifdef _WIN32
+#include <OpenKneeboard/cppwinrt.hpp>
+
 #include <shims/winrt/base.h>
+#endif
 
 #include <FredEmmott/bindline.hpp>
 
@@ -97,7 +100,7 @@ constexpr auto task_bind_refs_front(TArgs&&... args) {
     std::forward<TArgs>(args)...);
 }
 
-template <class TQueue>
+template <class TQueue, class TPriority>
 struct ordered_enqueue_binder_t
   : public ::FredEmmott::bindline_extension_api::bindable_t {
   using ordering_t
@@ -106,28 +109,41 @@ struct ordered_enqueue_binder_t
     = ordering_t::invoke_after_context_switch;
 
   ordered_enqueue_binder_t() = delete;
-  constexpr ordered_enqueue_binder_t(TQueue* kbs) : mKneeboard(kbs) {
+  constexpr ordered_enqueue_binder_t(TQueue* kbs, TPriority priority)
+    : mKneeboard(kbs), mPriority(priority) {
   }
 
   template <class TFn>
   constexpr auto bind_to(TFn&& fn) const {
     return std::bind_front(
-      &TQueue::EnqueueOrderedEvent, mKneeboard, std::decay_t<TFn> {fn});
+      &TQueue::EnqueueOrderedEvent,
+      mKneeboard,
+      mPriority,
+      std::decay_t<TFn> {fn});
   }
 
  private:
   TQueue* mKneeboard {nullptr};
+  TPriority mPriority {};
 };
 
 class KneeboardState;
 
-constexpr auto bind_enqueue(KneeboardState* kneeboard) {
-  return ordered_enqueue_binder_t {kneeboard};
+/** Enqueue on the kneeboard's `OrderedEventQueue`.
+ *
+ * `priority` is an `OrderedEventPriority`; it's a template parameter so that
+ * this header doesn't need the queue.
+ */
+template <class TPriority>
+constexpr auto bind_enqueue(KneeboardState* kneeboard, TPriority priority) {
+  return ordered_enqueue_binder_t {kneeboard, priority};
 }
 
-template <class TFn>
-constexpr auto bind_enqueue(KneeboardState* kneeboard, TFn&& fn) {
-  return ordered_enqueue_binder_t {kneeboard}.bind_to(std::forward<TFn>(fn));
+template <class TPriority, class TFn>
+constexpr auto
+bind_enqueue(KneeboardState* kneeboard, TPriority priority, TFn&& fn) {
+  return ordered_enqueue_binder_t {kneeboard, priority}.bind_to(
+    std::forward<TFn>(fn));
 }
 
 }// namespace OpenKneeboard
\ No newline at end of file
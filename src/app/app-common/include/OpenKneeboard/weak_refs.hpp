@@ -19,7 +19,9 @@
  */
 #pragma once
 
+#ifdef _WIN32
 #include <shims/winrt/base.h>
+#endif
 
 #include <FredEmmott/weak_refs.hpp>
 
@@ -43,6 +43,7 @@
 #include <OpenKneeboard/dprint.hpp>
 #include <OpenKneeboard/format/filesystem.hpp>
 #include <OpenKneeboard/scope_exit.hpp>
+#include <OpenKneeboard/task/latency.hpp>
 #include <OpenKneeboard/tracing.hpp>
 #include <OpenKneeboard/version.hpp>
 
@@ -110,6 +111,10 @@ task<void> App::CleanupAndExitAsync() {
 
   dprint("Exiting app");
 
+  if constexpr (TaskLatencyTracing) {
+    TaskLatencyTracker::DumpStatistics();
+  }
+
   co_await uiThread;
 
   /* TODO (Windows App SDK v1.5?): This should be implied by Exit(),
@@ -30,6 +30,7 @@
 #include <OpenKneeboard/LaunchURI.hpp>
 #include <OpenKneeboard/RuntimeFiles.hpp>
 #include <OpenKneeboard/SHM/ActiveConsumers.hpp>
+#include <OpenKneeboard/SHM/ConsumerLatency.hpp>
 #include <OpenKneeboard/Settings.hpp>
 #include <OpenKneeboard/TroubleshootingStore.hpp>
 
@@ -452,6 +453,28 @@ std::string HelpPage::GetActiveConsumers() noexcept {
     consumers.mNonVRPixelSize.mWidth,
     consumers.mNonVRPixelSize.mHeight);
 
+  ret += "\nFrame age when first read:\n";
+  const auto latency = SHM::ConsumerLatency::Get();
+  auto logLatency = [&](const auto name, const auto& histogram) {
+    const auto count = histogram.GetSampleCount();
+    if (count == 0) {
+      ret += std::format("{}: no frames\n", name);
+      return;
+    }
+    ret += std::format(
+      "{}: {} frames; p50 {}, p95 {}, p99 {}\n",
+      name,
+      count,
+      histogram.GetPercentile(0.50),
+      histogram.GetPercentile(0.95),
+      histogram.GetPercentile(0.99));
+  };
+  logLatency("SteamVR", latency.mSteamVR);
+  logLatency("OpenXR", latency.mOpenXR);
+  logLatency("Oculus-D3D11", latency.mOculusD3D11);
+  logLatency("NonVR-D3D11", latency.mNonVRD3D11);
+  logLatency("Viewer", latency.mViewer);
+
   return ret;
 }
 
@@ -33,6 +33,7 @@
 #include "TabPage.xaml.h"
 
 #include <OpenKneeboard/APIEvent.hpp>
+#include <OpenKneeboard/ConcurrentEvent.hpp>
 #include <OpenKneeboard/DXResources.hpp>
 #include <OpenKneeboard/Elevation.hpp>
 #include <OpenKneeboard/Filesystem.hpp>
@@ -159,7 +160,8 @@ task<void> MainWindow::Init() {
     std::bind_front(&MainWindow::OnTabsChanged, this));
 
   AddEventListener(
-    mKneeboard->evAPIEvent, std::bind_front(&MainWindow::OnAPIEvent, this));
+    mKneeboard->evAPIEvent.GetTopic(APIEvent::EVT_OKB_EXECUTABLE_LAUNCHED),
+    std::bind_front(&MainWindow::OnAPIEvent, this));
 
   RootGrid().Loaded([this](const auto&, const auto&) { this->OnLoaded(); });
 
@@ -403,6 +405,7 @@ task<void> MainWindow::FrameTick(
 
   // Finish any pending UI stuff
   co_await wil::resume_foreground(this->DispatcherQueue());
+  ConcurrentEventBase::DrainAll();
   co_await mKneeboard->FlushOrderedEventQueue(nextFrameAt);
 }
 
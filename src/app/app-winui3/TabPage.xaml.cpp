@@ -36,6 +36,7 @@
 #include <OpenKneeboard/IToolbarItemWithVisibility.hpp>
 #include <OpenKneeboard/KneeboardState.hpp>
 #include <OpenKneeboard/KneeboardView.hpp>
+#include <OpenKneeboard/OrderedEventQueue.hpp>
 #include <OpenKneeboard/TabView.hpp>
 #include <OpenKneeboard/ToolbarAction.hpp>
 #include <OpenKneeboard/ToolbarSeparator.hpp>
@@ -247,10 +248,12 @@ muxc::AppBarToggleButton TabPage::CreateAppBarToggleButton(
   button.IsChecked(action->IsActive());
   button.Checked(
     &ToolbarToggleAction::Activate | task_bind_refs_front(action)
-    | bind_enqueue(mKneeboard.get()) | drop_winrt_event_args());
+    | bind_enqueue(mKneeboard.get(), OrderedEventPriority::Interactive)
+    | drop_winrt_event_args());
   button.Unchecked(
     &ToolbarToggleAction::Deactivate | task_bind_refs_front(action)
-    | bind_enqueue(mKneeboard.get()) | drop_winrt_event_args());
+    | bind_enqueue(mKneeboard.get(), OrderedEventPriority::Interactive)
+    | drop_winrt_event_args());
 
   AddEventListener(
     action->evStateChangedEvent,
@@ -316,7 +319,8 @@ muxc::AppBarButton TabPage::CreateAppBarButton(
   auto button = CreateAppBarButtonBase(action);
   button.Click(
     &TabPage::OnToolbarActionClick | task_bind_refs_front(this, action)
-    | bind_enqueue(mKneeboard.get()) | drop_winrt_event_args());
+    | bind_enqueue(mKneeboard.get(), OrderedEventPriority::Interactive)
+    | drop_winrt_event_args());
   return button;
 }
 
@@ -345,7 +349,8 @@ muxc::MenuFlyoutItemBase TabPage::CreateMenuFlyoutItem(
   ret.IsEnabled(action->IsEnabled());
   ret.Click(
     &TabPage::OnToolbarActionClick | task_bind_refs_front(this, action)
-    | bind_enqueue(mKneeboard.get()) | drop_winrt_event_args());
+    | bind_enqueue(mKneeboard.get(), OrderedEventPriority::Interactive)
+    | drop_winrt_event_args());
 
   AddEventListener(
     action->evStateChangedEvent,
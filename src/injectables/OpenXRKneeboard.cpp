@@ -249,6 +249,7 @@ XrResult OpenXRKneeboard::xrEndFrame(
       this->ReleaseSwapchainResources(mSwapchain);
       mOpenXR->xrDestroySwapchain(mSwapchain);
       mSwapchain = {};
+      mRenderCacheKeys.fill(~(0ui64));
     }
   }
 
@@ -300,6 +301,7 @@ XrResult OpenXRKneeboard::xrEndFrame(
     std::back_inserter(nextLayers));
 
   uint8_t topMost = layerCount - 1;
+  bool needRender = false;
 
   std::vector<SHM::LayerSprite> layerSprites;
   std::vector<uint64_t> cacheKeys;
@@ -319,6 +321,10 @@ XrResult OpenXRKneeboard::xrEndFrame(
         layer->mVR.mLocationOnTexture, "LocationOnTexture"));
 
     cacheKeys.push_back(params.mCacheKey);
+    if (mRenderCacheKeys.at(layerIndex) != params.mCacheKey) {
+      needRender = true;
+    }
+
     PixelRect destRect {
       Spriting::GetOffset(layerIndex, snapshot.GetLayerCount()),
       layer->mVR.mLocationOnTexture.mSize,
@@ -391,35 +397,41 @@ XrResult OpenXRKneeboard::xrEndFrame(
     std::swap(addedXRLayers.back(), addedXRLayers.at(topMost));
   }
 
-  uint32_t swapchainTextureIndex {~(0ui32)};
-  {
-    OPENKNEEBOARD_TraceLoggingScope("AcquireSwapchainImage");
-    check_xrresult(mOpenXR->xrAcquireSwapchainImage(
-      mSwapchain, nullptr, &swapchainTextureIndex));
-  }
+  // If nothing's changed, the runtime will keep using the most recently
+  // released swapchain image
+  if (needRender) {
+    uint32_t swapchainTextureIndex {~(0ui32)};
+    {
+      OPENKNEEBOARD_TraceLoggingScope("AcquireSwapchainImage");
+      check_xrresult(mOpenXR->xrAcquireSwapchainImage(
+        mSwapchain, nullptr, &swapchainTextureIndex));
+    }
 
-  {
-    OPENKNEEBOARD_TraceLoggingScope("WaitSwapchainImage");
-    XrSwapchainImageWaitInfo waitInfo {
-      .type = XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO,
-      .timeout = XR_INFINITE_DURATION,
-    };
-    check_xrresult(mOpenXR->xrWaitSwapchainImage(mSwapchain, &waitInfo));
-  }
+    {
+      OPENKNEEBOARD_TraceLoggingScope("WaitSwapchainImage");
+      XrSwapchainImageWaitInfo waitInfo {
+        .type = XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO,
+        .timeout = XR_INFINITE_DURATION,
+      };
+      check_xrresult(mOpenXR->xrWaitSwapchainImage(mSwapchain, &waitInfo));
+    }
 
-  {
-    OPENKNEEBOARD_TraceLoggingScope("RenderLayers()");
-    this->RenderLayers(
-      mSwapchain, swapchainTextureIndex, snapshot, layerSprites);
-  }
+    {
+      OPENKNEEBOARD_TraceLoggingScope("RenderLayers()");
+      this->RenderLayers(
+        mSwapchain, swapchainTextureIndex, snapshot, layerSprites);
+    }
 
-  {
-    OPENKNEEBOARD_TraceLoggingScope("xrReleaseSwapchainImage()");
-    check_xrresult(mOpenXR->xrReleaseSwapchainImage(mSwapchain, nullptr));
-  }
+    {
+      OPENKNEEBOARD_TraceLoggingScope("xrReleaseSwapchainImage()");
+      check_xrresult(mOpenXR->xrReleaseSwapchainImage(mSwapchain, nullptr));
+    }
 
-  for (size_t i = 0; i < cacheKeys.size(); ++i) {
-    mRenderCacheKeys[i] = cacheKeys.at(i);
+    for (size_t i = 0; i < cacheKeys.size(); ++i) {
+      mRenderCacheKeys[i] = cacheKeys.at(i);
+    }
+  } else {
+    TraceLoggingWriteTagged(activity, "Unchanged");
   }
 
   XrFrameEndInfo nextFrameEndInfo {*frameEndInfo};
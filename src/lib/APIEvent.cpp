@@ -18,20 +18,24 @@
  * USA.
  */
 #include <OpenKneeboard/APIEvent.hpp>
-#include <OpenKneeboard/Win32.hpp>
+#include <OpenKneeboard/APIEventTransport.hpp>
 
 #include <OpenKneeboard/config.hpp>
 #include <OpenKneeboard/dprint.hpp>
 #include <OpenKneeboard/json.hpp>
 #include <OpenKneeboard/tracing.hpp>
 
-#include <shims/winrt/base.h>
-
-#include <Windows.h>
-
+#include <bit>
 #include <charconv>
 #include <chrono>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
 #include <string_view>
+#include <unordered_map>
 
 static uint32_t hex_to_ui32(const std::string_view& sv) {
   if (sv.empty()) {
@@ -43,33 +47,35 @@ static uint32_t hex_to_ui32(const std::string_view& sv) {
   return value;
 }
 
-static winrt::file_handle gMailslotHandle;
+namespace OpenKneeboard {
 
-static bool OpenMailslotHandle() {
-  if (gMailslotHandle) {
-    return true;
-  }
+namespace {
 
-  static std::chrono::steady_clock::time_point sLastAttempt {};
-  const auto now = std::chrono::steady_clock::now();
-  if (now - sLastAttempt < std::chrono::seconds(1)) {
-    return false;
-  }
-  sLastAttempt = now;
-
-  gMailslotHandle = OpenKneeboard::Win32::or_default::CreateFile(
-    OpenKneeboard::APIEvent::GetMailslotPath(),
-    GENERIC_WRITE,
-    FILE_SHARE_READ,
-    nullptr,
-    OPEN_EXISTING,
-    0,
-    NULL);
-
-  return static_cast<bool>(gMailslotHandle);
-}
+/* Header for binary packets; followed by the name (if not a built-in event),
+ * then the value.
+ *
+ * Text packets start with a hex digit, so they can't be confused with the
+ * magic.
+ */
+struct BinaryPacketHeader {
+  static constexpr std::string_view Magic {"OKBE"};
+  // Increment for incompatible changes; compatible additions can increase
+  // `mHeaderSize` instead
+  static constexpr uint16_t CurrentVersion = 1;
 
-namespace OpenKneeboard {
+  std::array<char, 4> mMagic {'O', 'K', 'B', 'E'};
+  uint16_t mVersion {CurrentVersion};
+  uint16_t mHeaderSize {sizeof(BinaryPacketHeader)};
+  APIEventTypeID mTypeID {APIEventTypeID::Inline};
+  uint16_t mNameSize {};
+  uint32_t mValueSize {};
+};
+static_assert(sizeof(BinaryPacketHeader) == 16);
+static_assert(std::is_trivially_copyable_v<BinaryPacketHeader>);
+// Senders and receivers are all x86 or x64
+static_assert(std::endian::native == std::endian::little);
+
+}// namespace
 
 #define CHECK_PACKET(condition) \
   if (!(condition)) { \
@@ -81,7 +87,32 @@ APIEvent::operator bool() const {
   return !(name.empty() || value.empty());
 }
 
-APIEvent APIEvent::Unserialize(std::string_view packet) {
+static APIEventView ParseBinaryPacket(std::string_view packet) {
+  BinaryPacketHeader header;
+  CHECK_PACKET(packet.size() >= sizeof(header));
+  std::memcpy(&header, packet.data(), sizeof(header));
+  CHECK_PACKET(header.mVersion == BinaryPacketHeader::CurrentVersion);
+  CHECK_PACKET(header.mHeaderSize >= sizeof(header));
+  CHECK_PACKET(
+    packet.size()
+    == std::size_t {header.mHeaderSize} + header.mNameSize + header.mValueSize);
+
+  auto name = packet.substr(header.mHeaderSize, header.mNameSize);
+  if (header.mTypeID != APIEventTypeID::Inline) {
+    CHECK_PACKET(name.empty());
+    name = GetBuiltinAPIEventName(header.mTypeID);
+    // Probably from a newer version
+    CHECK_PACKET(!name.empty());
+  }
+
+  return {
+    name,
+    packet.substr(header.mHeaderSize + header.mNameSize),
+    header.mTypeID,
+  };
+}
+
+static APIEventView ParseTextPacket(std::string_view packet) {
   // "{:08x}!{}!{:08x}!{}!", name size, name, value size, value
   CHECK_PACKET(packet.ends_with("!"));
   CHECK_PACKET(packet.size() >= sizeof("12345678!!12345678!!") - 1);
@@ -89,19 +120,64 @@ APIEvent APIEvent::Unserialize(std::string_view packet) {
   const auto nameLen = hex_to_ui32(packet.substr(0, 8));
   CHECK_PACKET(packet.size() >= 8 + nameLen + 8 + 4);
   const uint32_t nameOffset = 9;
-  const std::string name(packet.substr(nameOffset, nameLen));
+  const auto name = packet.substr(nameOffset, nameLen);
 
   const uint32_t valueLenOffset = nameOffset + nameLen + 1;
   CHECK_PACKET(packet.size() >= valueLenOffset + 10);
   const auto valueLen = hex_to_ui32(packet.substr(valueLenOffset, 8));
   const uint32_t valueOffset = valueLenOffset + 8 + 1;
   CHECK_PACKET(packet.size() == valueOffset + valueLen + 1);
-  const std::string value(packet.substr(valueOffset, valueLen));
 
-  return {name, value};
+  return {
+    name,
+    packet.substr(valueOffset, valueLen),
+    GetBuiltinAPIEventTypeID(name),
+  };
+}
+
+APIEventView::operator bool() const {
+  return !(name.empty() || value.empty());
+}
+
+APIEvent APIEventView::ToAPIEvent() const {
+  return {std::string {name}, std::string {value}, typeID};
+}
+
+APIEventView APIEventView::Parse(std::string_view packet) {
+  if (packet.starts_with(BinaryPacketHeader::Magic)) {
+    return ParseBinaryPacket(packet);
+  }
+  return ParseTextPacket(packet);
+}
+
+APIEvent APIEvent::Unserialize(std::string_view packet) {
+  return APIEventView::Parse(packet).ToAPIEvent();
 }
 
 std::vector<std::byte> APIEvent::Serialize() const {
+  BinaryPacketHeader header {
+    .mTypeID = GetBuiltinAPIEventTypeID(name),
+    .mValueSize = static_cast<uint32_t>(value.size()),
+  };
+  if (header.mTypeID == APIEventTypeID::Inline) {
+    if (name.size() > std::numeric_limits<uint16_t>::max()) [[unlikely]] {
+      return this->SerializeText();
+    }
+    header.mNameSize = static_cast<uint16_t>(name.size());
+  }
+
+  std::vector<std::byte> ret(
+    sizeof(header) + header.mNameSize + header.mValueSize);
+  auto it = ret.data();
+  std::memcpy(it, &header, sizeof(header));
+  it += sizeof(header);
+  std::memcpy(it, name.data(), header.mNameSize);
+  it += header.mNameSize;
+  std::memcpy(it, value.data(), value.size());
+  return ret;
+}
+
+std::vector<std::byte> APIEvent::SerializeText() const {
   const auto str = std::format(
     "{:08x}!{}!{:08x}!{}!", name.size(), name, value.size(), value);
   const auto first = reinterpret_cast<const std::byte*>(str.data());
@@ -116,53 +192,100 @@ void APIEvent::Send() const {
     TraceLoggingValue(this->name.c_str(), "Name"),
     TraceLoggingBinary(this->value.c_str(), this->value.size(), "Value"));
 
-  if (!OpenMailslotHandle()) {
+  static const auto sSender
+    = APIEventSender::Create(GetAPIEventTransportKind());
+  if (!sSender) {
     TraceLoggingWriteStop(
       activity,
       "APIEvent::Send()",
-      TraceLoggingValue("Couldn't open mailslot", "Result"));
+      TraceLoggingValue("No transport", "Result"));
     return;
   }
-  const auto packet = this->Serialize();
-
-  if (WriteFile(
-        gMailslotHandle.get(),
-        packet.data(),
-        static_cast<DWORD>(packet.size()),
-        nullptr,
-        nullptr)) {
+
+  // The mailslot is shared with older OpenKneeboard versions that only
+  // understand v1.3 text packets, so only receivers get the binary format
+  if (sSender->Send(this->SerializeText())) {
     TraceLoggingWriteStop(
       activity, "APIEvent::Send()", TraceLoggingValue("Success", "Result"));
-    return;
+  } else {
+    TraceLoggingWriteStop(
+      activity, "APIEvent::Send()", TraceLoggingValue("Failed", "Result"));
   }
+}
 
-  gMailslotHandle.close();
-  gMailslotHandle = {};
-  TraceLoggingWriteTagged(activity, "Closed handle");
+class APIEventRegistry::Impl final {
+ public:
+  static Impl& Get() {
+    static Impl sInstance;
+    return sInstance;
+  }
 
-  if (!OpenMailslotHandle()) {
-    TraceLoggingWriteStop(
-      activity,
-      "APIEvent::Send()",
-      TraceLoggingValue("Couldn't reopen handle", "Result"));
-    return;
+  APIEventTypeID Intern(std::string_view name) {
+    {
+      const std::shared_lock lock(mMutex);
+      if (const auto it = mIDs.find(name); it != mIDs.end()) {
+        return it->second;
+      }
+    }
+
+    const std::unique_lock lock(mMutex);
+    // Another thread may have interned it while we didn't hold the lock
+    if (const auto it = mIDs.find(name); it != mIDs.end()) {
+      return it->second;
+    }
+    using ID = std::underlying_type_t<APIEventTypeID>;
+    if (mNextID > std::numeric_limits<ID>::max()) {
+      dprint.Warning("API event registry is full; can't intern '{}'", name);
+      return APIEventTypeID::Inline;
+    }
+    const auto id = static_cast<APIEventTypeID>(mNextID++);
+    mIDs.emplace(std::string {name}, id);
+    return id;
   }
-  TraceLoggingWriteTagged(activity, "Reopened handle");
-  if (WriteFile(
-        gMailslotHandle.get(),
-        packet.data(),
-        static_cast<DWORD>(packet.size()),
-        nullptr,
-        nullptr)) {
-    TraceLoggingWriteStop(
-      activity, "APIEvent::Send()", TraceLoggingValue("Success", "Result"));
-  } else {
-    TraceLoggingWriteStop(
-      activity,
-      "APIEvent::Send()",
-      TraceLoggingValue("Error", "Result"),
-      TraceLoggingValue(GetLastError(), "Error"));
+
+  APIEventTypeID Find(std::string_view name) const {
+    const std::shared_lock lock(mMutex);
+    const auto it = mIDs.find(name);
+    return (it == mIDs.end()) ? APIEventTypeID::Inline : it->second;
   }
+
+  std::size_t GetTypeCount() const {
+    const std::shared_lock lock(mMutex);
+    return mNextID;
+  }
+
+ private:
+  // Allow `find()` with a `std::string_view`
+  struct Hash {
+    using is_transparent = void;
+    std::size_t operator()(std::string_view it) const noexcept {
+      return std::hash<std::string_view> {}(it);
+    }
+  };
+
+  mutable std::shared_mutex mMutex;
+  std::unordered_map<std::string, APIEventTypeID, Hash, std::equal_to<>> mIDs;
+  std::size_t mNextID {Detail::BuiltinAPIEventNames.size()};
+};
+
+APIEventTypeID APIEventRegistry::Intern(std::string_view name) {
+  if (const auto id = GetBuiltinAPIEventTypeID(name);
+      id != APIEventTypeID::Inline) {
+    return id;
+  }
+  return Impl::Get().Intern(name);
+}
+
+APIEventTypeID APIEventRegistry::Find(std::string_view name) {
+  if (const auto id = GetBuiltinAPIEventTypeID(name);
+      id != APIEventTypeID::Inline) {
+    return id;
+  }
+  return Impl::Get().Find(name);
+}
+
+std::size_t APIEventRegistry::GetTypeCount() {
+  return Impl::Get().GetTypeCount();
 }
 
 const wchar_t* APIEvent::GetMailslotPath() {
@@ -0,0 +1,154 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#include <OpenKneeboard/APIEventBatchReader.hpp>
+
+#include <OpenKneeboard/dprint.hpp>
+#include <OpenKneeboard/json.hpp>
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <ranges>
+#include <string>
+#include <tuple>
+
+namespace OpenKneeboard {
+
+namespace {
+// Events that describe the current state, rather than being commands or
+// messages
+constexpr std::array CoalescedEvents {
+  APIEventTypeID::DCSSelfData,
+  APIEventTypeID::DCSMissionTime,
+  APIEventTypeID::DCSAircraft,
+  APIEventTypeID::DCSTerrain,
+  APIEventTypeID::DCSMission,
+  APIEventTypeID::DCSOrigin,
+};
+}// namespace
+
+APIEventBatchReader::APIEventBatchReader(
+  std::unique_ptr<APIEventReceiver> receiver)
+  : mReceiver(std::move(receiver)) {
+}
+
+APIEventBatchReader::~APIEventBatchReader() = default;
+
+std::vector<APIEvent> APIEventBatchReader::Read(std::stop_token stop) {
+  using Result = APIEventReceiver::Result;
+
+  std::vector<APIEvent> batch;
+  while (batch.empty()) {
+    if (stop.stop_requested()) {
+      return {};
+    }
+    switch (mReceiver->Receive(mBuffer, stop)) {
+      case Result::Stopped:
+        return {};
+      case Result::Packet:
+        this->Append(batch, {mBuffer.data(), mBuffer.size()});
+        break;
+      case Result::NoPacket:
+      case Result::Error:
+        break;
+    }
+  }
+
+  // Drain anything else that's already waiting, so that a burst is handled
+  // as a single batch
+  while (batch.size() < MaxBatchSize
+         && mReceiver->TryReceive(mBuffer) == Result::Packet) {
+    this->Append(batch, {mBuffer.data(), mBuffer.size()});
+  }
+
+  this->Coalesce(batch);
+  mStatistics.mBatches.fetch_add(1, std::memory_order_relaxed);
+  return batch;
+}
+
+bool APIEventBatchReader::IsCoalesced(APIEventTypeID id) {
+  return std::ranges::find(CoalescedEvents, id) != CoalescedEvents.end();
+}
+
+APIEventBatchReader::Statistics APIEventBatchReader::GetStatistics() const {
+  return {
+    .mReceived = mStatistics.mReceived.load(std::memory_order_relaxed),
+    .mCoalesced = mStatistics.mCoalesced.load(std::memory_order_relaxed),
+    .mInvalid = mStatistics.mInvalid.load(std::memory_order_relaxed),
+    .mBatches = mStatistics.mBatches.load(std::memory_order_relaxed),
+  };
+}
+
+void APIEventBatchReader::Append(
+  std::vector<APIEvent>& batch,
+  std::string_view packet) {
+  const auto event = APIEventView::Parse(packet);
+  if (!event) {
+    mStatistics.mInvalid.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  if (event.typeID != APIEventTypeID::MultiEvent) {
+    batch.push_back(event.ToAPIEvent());
+    mStatistics.mReceived.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  std::vector<std::tuple<std::string, std::string>> events;
+  try {
+    events = nlohmann::json::parse(event.value);
+  } catch (const nlohmann::json::exception& e) {
+    dprint.Warning("Invalid {}: {}", APIEvent::EVT_MULTI_EVENT, e.what());
+    mStatistics.mInvalid.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  for (auto&& [name, value]: events) {
+    const auto typeID = GetBuiltinAPIEventTypeID(name);
+    batch.push_back({std::move(name), std::move(value), typeID});
+  }
+  mStatistics.mReceived.fetch_add(events.size(), std::memory_order_relaxed);
+}
+
+void APIEventBatchReader::Coalesce(std::vector<APIEvent>& batch) {
+  // Keep the last of each coalesced event, in its original position
+  std::bitset<CoalescedEvents.size()> seen;
+  uint64_t coalesced {};
+  for (auto& event: std::views::reverse(batch)) {
+    const auto it = std::ranges::find(CoalescedEvents, event.typeID);
+    if (it == CoalescedEvents.end()) {
+      continue;
+    }
+    const auto index = std::distance(CoalescedEvents.begin(), it);
+    if (seen.test(index)) {
+      // Marks it for removal below
+      event = {};
+      ++coalesced;
+    }
+    seen.set(index);
+  }
+
+  if (coalesced == 0) {
+    return;
+  }
+  std::erase_if(batch, [](const APIEvent& it) { return it.name.empty(); });
+  mStatistics.mCoalesced.fetch_add(coalesced, std::memory_order_relaxed);
+}
+
+}// namespace OpenKneeboard
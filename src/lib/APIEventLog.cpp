@@ -0,0 +1,128 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#include <OpenKneeboard/APIEventLog.hpp>
+#include <OpenKneeboard/APIEventTransport.hpp>
+
+#include <OpenKneeboard/dprint.hpp>
+#include <OpenKneeboard/format/filesystem.hpp>
+
+namespace OpenKneeboard::APIEventLog {
+
+Writer::Writer(const std::filesystem::path& path)
+  : mFile(path, std::ios::binary | std::ios::trunc) {
+  const FileHeader header {};
+  mFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+Writer::~Writer() = default;
+
+bool Writer::IsValid() const noexcept {
+  return mFile.good();
+}
+
+void Writer::Append(const APIEvent& event) {
+  if (!mFile) {
+    return;
+  }
+
+  const auto packet = event.Serialize();
+  if (packet.size() > APIEventReceiver::MaxPacketSize) [[unlikely]] {
+    dprint.Warning(
+      "Not logging {}-byte '{}' API event, as it's larger than any packet",
+      packet.size(),
+      event.name);
+    return;
+  }
+  const RecordHeader header {
+    .mNanoseconds = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - mStart)
+        .count()),
+    .mPacketSize = static_cast<uint32_t>(packet.size()),
+  };
+  mFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  mFile.write(reinterpret_cast<const char*>(packet.data()), packet.size());
+}
+
+std::vector<Record> ReadAll(const std::filesystem::path& path) {
+  std::error_code ec;
+  const auto fileSize = std::filesystem::file_size(path, ec);
+  if (ec) {
+    dprint.Warning(
+      "Couldn't get size of API event log {}: {}", path, ec.message());
+    return {};
+  }
+
+  std::ifstream file(path, std::ios::binary);
+  FileHeader header;
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+    dprint.Warning("Couldn't read API event log header from {}", path);
+    return {};
+  }
+  if (header.mMagic != FileHeader::Magic) {
+    dprint.Warning("{} is not an API event log", path);
+    return {};
+  }
+  if (header.mVersion != FileHeader::CurrentVersion) {
+    dprint.Warning(
+      "{} is an API event log version {}, but only version {} is supported",
+      path,
+      header.mVersion,
+      FileHeader::CurrentVersion);
+    return {};
+  }
+
+  std::vector<Record> ret;
+  uint64_t offset = sizeof(header);
+  RecordHeader recordHeader;
+  while (
+    file.read(reinterpret_cast<char*>(&recordHeader), sizeof(recordHeader))) {
+    offset += sizeof(recordHeader);
+    // Check before allocating, as the size comes from the file
+    if (recordHeader.mPacketSize > APIEventReceiver::MaxPacketSize) {
+      dprint.Warning(
+        "{} is corrupt after {} events: {}-byte packet",
+        path,
+        ret.size(),
+        recordHeader.mPacketSize);
+      break;
+    }
+    if (recordHeader.mPacketSize > fileSize - offset) {
+      dprint.Warning("{} is truncated after {} events", path, ret.size());
+      break;
+    }
+    offset += recordHeader.mPacketSize;
+
+    Record record {
+      .mTime = std::chrono::nanoseconds {recordHeader.mNanoseconds},
+      .mPacket = std::vector<std::byte>(recordHeader.mPacketSize),
+    };
+    if (!file.read(
+          reinterpret_cast<char*>(record.mPacket.data()),
+          record.mPacket.size())) {
+      dprint.Warning("{} is truncated after {} events", path, ret.size());
+      break;
+    }
+    ret.push_back(std::move(record));
+  }
+  return ret;
+}
+
+}// namespace OpenKneeboard::APIEventLog
@@ -0,0 +1,266 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#include <OpenKneeboard/APIEventTransport.hpp>
+
+#include <OpenKneeboard/config.hpp>
+#include <OpenKneeboard/dprint.hpp>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Local socket transport; mailslots are Windows-only.
+namespace OpenKneeboard {
+
+namespace {
+
+class FileDescriptor final {
+ public:
+  FileDescriptor() = default;
+  explicit FileDescriptor(int fd) : mFD(fd) {
+  }
+
+  ~FileDescriptor() {
+    if (mFD >= 0) {
+      close(mFD);
+    }
+  }
+
+  int get() const noexcept {
+    return mFD;
+  }
+
+  explicit operator bool() const noexcept {
+    return mFD >= 0;
+  }
+
+  FileDescriptor(FileDescriptor&& other) noexcept
+    : mFD(std::exchange(other.mFD, -1)) {
+  }
+
+  FileDescriptor(const FileDescriptor&) = delete;
+  FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+ private:
+  int mFD {-1};
+};
+
+sockaddr_un GetSocketAddress() {
+  const auto dir = std::getenv("XDG_RUNTIME_DIR");
+  const auto path = std::format(
+    "{}/{}.events.v1.3",
+    (dir && *dir) ? dir : "/tmp",
+    ProjectReverseDomainA);
+
+  sockaddr_un ret {.sun_family = AF_UNIX};
+  if (path.size() >= sizeof(ret.sun_path)) {
+    dprint.Warning("API event socket path '{}' is too long", path);
+    return ret;
+  }
+  std::memcpy(ret.sun_path, path.data(), path.size());
+  return ret;
+}
+
+class LocalSocketSender final : public APIEventSender {
+ public:
+  LocalSocketSender()
+    : mSocket(socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0)),
+      mAddress(GetSocketAddress()) {
+  }
+
+  bool Send(std::span<const std::byte> packet) override {
+    if (!mSocket) {
+      return false;
+    }
+    // Not connected, so that we don't need to reconnect if the server is
+    // restarted
+    return sendto(
+             mSocket.get(),
+             packet.data(),
+             packet.size(),
+             0,
+             reinterpret_cast<const sockaddr*>(&mAddress),
+             sizeof(mAddress))
+      == static_cast<ssize_t>(packet.size());
+  }
+
+ private:
+  FileDescriptor mSocket;
+  sockaddr_un mAddress;
+};
+
+class LocalSocketReceiver final : public APIEventReceiver {
+ public:
+  LocalSocketReceiver() = delete;
+  LocalSocketReceiver(
+    FileDescriptor socket,
+    const sockaddr_un& address,
+    int stopReadFD,
+    int stopWriteFD)
+    : mSocket(std::move(socket)),
+      mAddress(address),
+      mStopRead(stopReadFD),
+      mStopWrite(stopWriteFD) {
+    mBuffer.resize(MaxPacketSize);
+  }
+
+  ~LocalSocketReceiver() {
+    unlink(mAddress.sun_path);
+  }
+
+  Result Receive(std::vector<char>& packet, std::stop_token stop) override {
+    const std::stop_callback onStop(stop, [fd = mStopWrite.get()]() {
+      const char byte {};
+      [[maybe_unused]] const auto written = write(fd, &byte, 1);
+    });
+
+    while (!stop.stop_requested()) {
+      pollfd fds[] {
+        {.fd = mSocket.get(), .events = POLLIN},
+        {.fd = mStopRead.get(), .events = POLLIN},
+      };
+      if (poll(fds, std::size(fds), -1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        dprint("APIEvent poll() failed: {}", errno);
+        return Result::Error;
+      }
+      if (fds[0].revents & POLLIN) {
+        return this->Read(packet, 0);
+      }
+      if (fds[1].revents & POLLIN) {
+        // Either `stop`, or left over from a previous stop token
+        char buffer[16];
+        [[maybe_unused]] const auto bytesRead
+          = read(mStopRead.get(), buffer, sizeof(buffer));
+      }
+    }
+    return Result::Stopped;
+  }
+
+  Result TryReceive(std::vector<char>& packet) override {
+    return this->Read(packet, MSG_DONTWAIT);
+  }
+
+ private:
+  FileDescriptor mSocket;
+  sockaddr_un mAddress;
+  FileDescriptor mStopRead;
+  FileDescriptor mStopWrite;
+  // Reused, so that small packets don't cost a `MaxPacketSize` allocation
+  // or fill
+  std::vector<char> mBuffer;
+
+  Result Read(std::vector<char>& packet, int flags) {
+    iovec iov {.iov_base = mBuffer.data(), .iov_len = mBuffer.size()};
+    msghdr message {.msg_iov = &iov, .msg_iovlen = 1};
+    const auto bytesRead = recvmsg(mSocket.get(), &message, flags);
+    if (bytesRead < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return Result::NoPacket;
+      }
+      dprint("APIEvent recvmsg() failed: {}", errno);
+      return Result::Error;
+    }
+    if (message.msg_flags & MSG_TRUNC) {
+      dprint.Warning(
+        "Dropping API event packet larger than {} bytes", MaxPacketSize);
+      return Result::Error;
+    }
+    if (bytesRead == 0) {
+      dprint("Read 0-byte APIEvent message");
+      return Result::Error;
+    }
+    packet.assign(mBuffer.data(), mBuffer.data() + bytesRead);
+    return Result::Packet;
+  }
+};
+
+}// namespace
+
+std::unique_ptr<APIEventSender> APIEventSender::Create(
+  APIEventTransportKind kind) {
+  if (kind != APIEventTransportKind::LocalSocket) {
+    dprint.Warning("Only local socket API event transports are supported");
+    return nullptr;
+  }
+  return std::make_unique<LocalSocketSender>();
+}
+
+std::unique_ptr<APIEventReceiver> APIEventReceiver::Create(
+  APIEventTransportKind kind) {
+  if (kind != APIEventTransportKind::LocalSocket) {
+    dprint.Warning("Only local socket API event transports are supported");
+    return nullptr;
+  }
+
+  const auto address = GetSocketAddress();
+  if (!address.sun_path[0]) {
+    return nullptr;
+  }
+
+  FileDescriptor socket {::socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0)};
+  if (!socket) {
+    dprint("Failed to create APIEvent socket: {}", errno);
+    return nullptr;
+  }
+  // Left behind if a previous server crashed
+  unlink(address.sun_path);
+  if (
+    bind(
+      socket.get(),
+      reinterpret_cast<const sockaddr*>(&address),
+      sizeof(address))
+    != 0) {
+    dprint("Failed to bind APIEvent socket: {}", errno);
+    return nullptr;
+  }
+
+  // Best effort: a bigger queue means senders block less often during bursts
+  const int receiveBufferSize = 4 * 1024 * 1024;
+  setsockopt(
+    socket.get(),
+    SOL_SOCKET,
+    SO_RCVBUF,
+    &receiveBufferSize,
+    sizeof(receiveBufferSize));
+
+  int stopPipe[2] {};
+  if (pipe2(stopPipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+    dprint("Failed to create APIEvent stop pipe: {}", errno);
+    unlink(address.sun_path);
+    return nullptr;
+  }
+
+  return std::make_unique<LocalSocketReceiver>(
+    std::move(socket), address, stopPipe[0], stopPipe[1]);
+}
+
+}// namespace OpenKneeboard
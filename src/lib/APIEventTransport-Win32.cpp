@@ -0,0 +1,209 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#include <OpenKneeboard/APIEvent.hpp>
+#include <OpenKneeboard/APIEventTransport.hpp>
+#include <OpenKneeboard/Win32.hpp>
+
+#include <OpenKneeboard/dprint.hpp>
+
+#include <shims/winrt/base.h>
+
+#include <Windows.h>
+
+#include <chrono>
+
+// Mailslot transport; local sockets are only implemented for POSIX, as
+// Windows' `AF_UNIX` does not support datagrams.
+namespace OpenKneeboard {
+
+namespace {
+
+class MailslotSender final : public APIEventSender {
+ public:
+  bool Send(std::span<const std::byte> packet) override {
+    if (!this->OpenHandle()) {
+      return false;
+    }
+    if (this->Write(packet)) {
+      return true;
+    }
+
+    // The server may have been restarted; our handle refers to the old
+    // mailslot, so try again with a new handle
+    mHandle = {};
+    return this->OpenHandle() && this->Write(packet);
+  }
+
+ private:
+  winrt::file_handle mHandle;
+  std::chrono::steady_clock::time_point mLastAttempt {};
+
+  bool OpenHandle() {
+    if (mHandle) {
+      return true;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now - mLastAttempt < std::chrono::seconds(1)) {
+      return false;
+    }
+    mLastAttempt = now;
+
+    mHandle = Win32::or_default::CreateFile(
+      APIEvent::GetMailslotPath(),
+      GENERIC_WRITE,
+      FILE_SHARE_READ,
+      nullptr,
+      OPEN_EXISTING,
+      0,
+      NULL);
+    return static_cast<bool>(mHandle);
+  }
+
+  bool Write(std::span<const std::byte> packet) {
+    return WriteFile(
+      mHandle.get(),
+      packet.data(),
+      static_cast<DWORD>(packet.size()),
+      nullptr,
+      nullptr);
+  }
+};
+
+class MailslotReceiver final : public APIEventReceiver {
+ public:
+  MailslotReceiver() = delete;
+  MailslotReceiver(winrt::file_handle mailslot)
+    : mMailslot(std::move(mailslot)) {
+    mReadEvent = Win32::or_throw::CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    mStopEvent = Win32::or_throw::CreateEvent(nullptr, TRUE, FALSE, nullptr);
+  }
+
+  Result Receive(std::vector<char>& packet, std::stop_token stop) override {
+    /* If there's no message yet, use this buffer size.
+     *
+     * If the buffer is too small, we'll have '0 bytes read', and return an
+     * error; the next call will get a good result from `GetMailslotInfo()`.
+     */
+    constexpr DWORD DefaultBufferSize = 4096;
+    DWORD bufferSize {DefaultBufferSize};
+    if (
+      (!GetMailslotInfo(
+        mMailslot.get(), nullptr, &bufferSize, nullptr, nullptr))
+      || bufferSize == MAILSLOT_NO_MESSAGE) {
+      bufferSize = DefaultBufferSize;
+    }
+    packet.resize(bufferSize);
+
+    OVERLAPPED overlapped {.hEvent = mReadEvent.get()};
+    if (
+      (!ReadFile(
+        mMailslot.get(), packet.data(), bufferSize, nullptr, &overlapped))
+      && GetLastError() != ERROR_IO_PENDING) {
+      dprint("APIEvent ReadFile failed: {}", GetLastError());
+      return Result::Error;
+    }
+
+    const std::stop_callback onStop(
+      stop, [event = mStopEvent.get()]() { SetEvent(event); });
+    const HANDLE handles[] {mReadEvent.get(), mStopEvent.get()};
+    if (
+      WaitForMultipleObjects(std::size(handles), handles, FALSE, INFINITE)
+      != WAIT_OBJECT_0) {
+      CancelIoEx(mMailslot.get(), &overlapped);
+      DWORD ignored {};
+      GetOverlappedResult(mMailslot.get(), &overlapped, &ignored, TRUE);
+      return stop.stop_requested() ? Result::Stopped : Result::Error;
+    }
+
+    return this->GetResult(packet, overlapped);
+  }
+
+  Result TryReceive(std::vector<char>& packet) override {
+    DWORD nextSize {};
+    if (
+      (!GetMailslotInfo(mMailslot.get(), nullptr, &nextSize, nullptr, nullptr))
+      || nextSize == MAILSLOT_NO_MESSAGE) {
+      return Result::NoPacket;
+    }
+    packet.resize(nextSize);
+
+    OVERLAPPED overlapped {.hEvent = mReadEvent.get()};
+    if (
+      (!ReadFile(
+        mMailslot.get(), packet.data(), nextSize, nullptr, &overlapped))
+      && GetLastError() != ERROR_IO_PENDING) {
+      dprint("APIEvent ReadFile failed while draining: {}", GetLastError());
+      return Result::Error;
+    }
+    // The message is already there, so this shouldn't block
+    return this->GetResult(packet, overlapped);
+  }
+
+ private:
+  winrt::file_handle mMailslot;
+  winrt::handle mReadEvent;
+  winrt::handle mStopEvent;
+
+  Result GetResult(std::vector<char>& packet, OVERLAPPED& overlapped) {
+    DWORD bytesRead {};
+    if (!GetOverlappedResult(mMailslot.get(), &overlapped, &bytesRead, TRUE)) {
+      return Result::Error;
+    }
+    if (bytesRead == 0) {
+      dprint("Read 0-byte APIEvent message");
+      return Result::Error;
+    }
+    packet.resize(bytesRead);
+    return Result::Packet;
+  }
+};
+
+}// namespace
+
+std::unique_ptr<APIEventSender> APIEventSender::Create(
+  APIEventTransportKind kind) {
+  if (kind != APIEventTransportKind::Mailslot) {
+    dprint.Warning("Only mailslot API event transports are supported");
+    return nullptr;
+  }
+  return std::make_unique<MailslotSender>();
+}
+
+std::unique_ptr<APIEventReceiver> APIEventReceiver::Create(
+  APIEventTransportKind kind) {
+  if (kind != APIEventTransportKind::Mailslot) {
+    dprint.Warning("Only mailslot API event transports are supported");
+    return nullptr;
+  }
+
+  auto mailslot = Win32::CreateMailslot(
+    APIEvent::GetMailslotPath(),
+    static_cast<DWORD>(MaxPacketSize),
+    MAILSLOT_WAIT_FOREVER,
+    nullptr);
+  if (!mailslot) {
+    dprint("Failed to create APIEvent mailslot: {}", mailslot.error());
+    return nullptr;
+  }
+  return std::make_unique<MailslotReceiver>(std::move(*mailslot));
+}
+
+}// namespace OpenKneeboard
@@ -0,0 +1,56 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#include <OpenKneeboard/APIEventTransport.hpp>
+
+#include <OpenKneeboard/dprint.hpp>
+
+#include <cstdlib>
+#include <string_view>
+
+namespace OpenKneeboard {
+
+APIEventTransportKind GetAPIEventTransportKind() {
+#ifdef _WIN32
+  constexpr auto platformDefault = APIEventTransportKind::Mailslot;
+#else
+  constexpr auto platformDefault = APIEventTransportKind::LocalSocket;
+#endif
+
+  const auto env = std::getenv("OPENKNEEBOARD_APIEVENT_TRANSPORT");
+  if (!env) {
+    return platformDefault;
+  }
+
+  const std::string_view value {env};
+  if (value == "mailslot") {
+    return APIEventTransportKind::Mailslot;
+  }
+  if (value == "local-socket") {
+    return APIEventTransportKind::LocalSocket;
+  }
+  dprint.Warning(
+    "Ignoring unrecognized OPENKNEEBOARD_APIEVENT_TRANSPORT: '{}'", value);
+  return platformDefault;
+}
+
+APIEventSender::~APIEventSender() = default;
+APIEventReceiver::~APIEventReceiver() = default;
+
+}// namespace OpenKneeboard
@@ -17,29 +17,43 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
  * USA.
  */
+#include "SHM/Platform.hpp"
 #include "SHM/ReaderState.hpp"
 #include "SHM/WriterState.hpp"
 
 #include <OpenKneeboard/LazyOnceValue.hpp>
 #include <OpenKneeboard/SHM.hpp>
 #include <OpenKneeboard/SHM/ActiveConsumers.hpp>
+#include <OpenKneeboard/SHM/ConsumerLatency.hpp>
+#include <OpenKneeboard/SHM/SwapchainSlots.hpp>
 #include <OpenKneeboard/StateMachine.hpp>
-#include <OpenKneeboard/Win32.hpp>
 
 #include <OpenKneeboard/bitflags.hpp>
 #include <OpenKneeboard/config.hpp>
 #include <OpenKneeboard/dprint.hpp>
 #include <OpenKneeboard/scope_exit.hpp>
+#include <OpenKneeboard/task/resume_on_signal.hpp>
 #include <OpenKneeboard/tracing.hpp>
 #include <OpenKneeboard/version.hpp>
 
 #include <Windows.h>
 
+#include <algorithm>
+#include <atomic>
 #include <bit>
+#include <chrono>
 #include <concepts>
 #include <format>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <optional>
 #include <random>
+#include <ranges>
+#include <span>
+#include <tuple>
 #include <utility>
+#include <vector>
 
 #include <processthreadsapi.h>
 
@@ -95,6 +109,13 @@ static_assert(sizeof(FixedSizeHandle) == sizeof(uint64_t));
 
 }// namespace
 
+namespace Detail {
+// `steady_clock` is `QueryPerformanceCounter()` on Windows, which is
+// consistent across processes
+using FrameClock = std::chrono::steady_clock;
+}// namespace Detail
+using Detail::FrameClock;
+
 struct Detail::FrameMetadata final {
   // Use the magic string to make sure we don't have
   // uninitialized memory that happens to have the
@@ -102,6 +123,9 @@ struct Detail::FrameMetadata final {
   static constexpr std::string_view Magic {"OKBMagic"};
   static_assert(Magic.size() == sizeof(uint64_t));
   uint64_t mMagic = *reinterpret_cast<const uint64_t*>(Magic.data());
+  // Checked by `HaveFeeder()`. This must stay at the start so that readers can
+  // find it even if the rest of the layout is different.
+  LayoutInfo mLayoutInfo = GetLayoutInfo();
 
   uint64_t mGPULUID {};
 
@@ -110,23 +134,189 @@ struct Detail::FrameMetadata final {
   HeaderFlags mFlags;
   Config mConfig;
 
+  // The number of populated entries in the layer table, which follows
+  // `SHMLayout` in the mapping
   uint8_t mLayerCount = 0;
-  LayerConfig mLayers[MaxViewCount];
 
   DWORD mFeederProcessID {};
   // If you're looking for texture size, it's in Config
   FixedSizeHandle mTexture {};
   FixedSizeHandle mFence {};
 
+  // Chosen by the feeder between `MinSHMSwapchainLength` and
+  // `MaxSHMSwapchainLength`; this can increase during a session, but never
+  // decreases
+  uint8_t mSwapchainLength = MinSHMSwapchainLength;
+  // The texture containing `mFrameNumber`
+  uint8_t mTextureIndex = 0;
+  // The frame that was most recently written to each texture
+  std::array<uint64_t, MaxSHMSwapchainLength> mTextureFrameNumbers {0};
+
   alignas(2 * sizeof(LONG64))
-    std::array<LONG64, SHMSwapchainLength> mFrameReadyFenceValues {0};
+    std::array<LONG64, MaxSHMSwapchainLength> mFrameReadyFenceValues {0};
+
+  // Latency telemetry; see `SHM::ConsumerLatency`. When the fence was
+  // signalled is in `SHMLayout`, as it's usually after the frame is submitted.
+  FrameClock::time_point mBeginRenderTime {};
+  FrameClock::time_point mSubmitTime {};
 
   uint64_t GetRenderCacheKey() const;
+  uint64_t GetRenderCacheKey(uint64_t frameNumber) const;
+  std::optional<uint64_t> FindFrameNumber(
+    uint64_t renderCacheKey,
+    uint64_t oldestFrameNumber) const;
+  // Attached, but possibly with a different layout
+  bool IsFeederAttached() const;
   bool HaveFeeder() const;
 };
 using Detail::FrameMetadata;
 static_assert(std::is_standard_layout_v<FrameMetadata>);
-static constexpr DWORD SHM_SIZE = sizeof(FrameMetadata);
+// Shared between 32-bit and 64-bit processes; bump `SHMLayoutVersion` if
+// these change. `LayoutInfo` only catches a mismatch at runtime.
+static_assert(sizeof(FrameMetadata) == 256);
+static_assert(alignof(FrameMetadata) == 16);
+static_assert(offsetof(FrameMetadata, mLayoutInfo) == 8);
+static_assert(offsetof(FrameMetadata, mConfig) == 80);
+static_assert(offsetof(FrameMetadata, mLayerCount) == 144);
+static_assert(offsetof(FrameMetadata, mFeederProcessID) == 148);
+static_assert(offsetof(FrameMetadata, mTexture) == 152);
+static_assert(offsetof(FrameMetadata, mTextureFrameNumbers) == 176);
+static_assert(offsetof(FrameMetadata, mFrameReadyFenceValues) == 208);
+static_assert(offsetof(FrameMetadata, mSubmitTime) == 248);
+
+// A copy of the header, and only the populated part of the layer table
+struct Detail::Frame final {
+  FrameMetadata mMetadata;
+  std::vector<LayerConfig> mLayers;
+};
+using Detail::Frame;
+
+/* The fixed-size start of the mapping; this is followed by the layer table.
+ *
+ * `mFrame` and the layer table are protected by both the SHM mutex and a
+ * seqlock:
+ * - writers must hold the mutex, and must modify `mFrame` inside a
+ *   `SeqlockWriteScope`
+ * - readers that need the texture take the mutex, so the feeder can't start
+ *   reusing the texture while it's being copied
+ * - metadata-only readers never take the mutex; they copy `mFrame`, and retry
+ *   if `mSequenceNumber` was odd, or changed during the copy. This means a
+ *   slow feeder never blocks a game's render thread just to check if there's
+ *   a new frame.
+ */
+struct SHMLayout final {
+  // Odd while `mFrame` is being modified
+  alignas(64) std::atomic<uint64_t> mSequenceNumber {0};
+  FrameMetadata mFrame {};
+
+  // Written by readers: incremented when they submit a copy from a texture,
+  // and decremented when their GPU has finished it. The feeder uses this to
+  // avoid overwriting textures that are still being copied, and resets counts
+  // that a crashed consumer left behind; see `AbandonedCopyTimeout`.
+  alignas(64) std::array<std::atomic<uint32_t>, MaxSHMSwapchainLength>
+    mPendingCopies {};
+
+  // Written by the feeder when its GPU signals `mFrameReadyFenceValues` for
+  // each texture; the time is only valid if the fence value matches.
+  //
+  // Telemetry only: this is not protected by the seqlock, so `mFenceValue`
+  // is zeroed while `mTime` is updated.
+  struct FrameReadyTime {
+    std::atomic<int64_t> mFenceValue;
+    std::atomic<FrameClock::rep> mTime;
+  };
+  alignas(64) std::array<FrameReadyTime, MaxSHMSwapchainLength>
+    mFrameReadyTimes {};
+
+  // Incremented whenever `mFrame` has a new render cache key; see
+  // `Impl::NotifyFrame()`. This is deliberately not reset with the header.
+  alignas(64) std::atomic<uint64_t> mFrameEventGeneration {0};
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+static_assert(std::atomic<FrameClock::rep>::is_always_lock_free);
+static_assert(std::is_standard_layout_v<SHMLayout>);
+static_assert(sizeof(SHMLayout) == 512);
+static_assert(offsetof(SHMLayout, mFrame) == 16);
+static_assert(offsetof(SHMLayout, mPendingCopies) == 320);
+static_assert(offsetof(SHMLayout, mFrameReadyTimes) == 384);
+static_assert(offsetof(SHMLayout, mFrameEventGeneration) == 448);
+
+// Increment when changing anything in the mapping
+static constexpr uint32_t SHMLayoutVersion = 1;
+
+// The capacity is fixed so that tuning `MaxViewCount` doesn't change the
+// mapping; only the first `FrameMetadata::mLayerCount` entries are copied
+static constexpr std::size_t LayerTableCapacity = 64;
+static_assert(MaxViewCount <= LayerTableCapacity);
+static_assert(MaxViewCount <= std::numeric_limits<uint8_t>::max());
+static constexpr std::size_t LayerTableOffset = sizeof(SHMLayout);
+static_assert(LayerTableOffset % alignof(LayerConfig) == 0);
+
+static constexpr DWORD SHM_SIZE
+  = LayerTableOffset + (LayerTableCapacity * sizeof(LayerConfig));
+
+LayoutInfo GetLayoutInfo() noexcept {
+  static constexpr LayoutInfo sRet {
+    .mVersion = SHMLayoutVersion,
+    .mMappingSize = SHM_SIZE,
+    .mFrameMetadataSize = sizeof(FrameMetadata),
+    .mConfigOffset = offsetof(FrameMetadata, mConfig),
+    .mConfigSize = sizeof(Config),
+    .mLayerCountOffset = offsetof(FrameMetadata, mLayerCount),
+    .mFeederProcessIDOffset = offsetof(FrameMetadata, mFeederProcessID),
+    .mLayerTableOffset = LayerTableOffset,
+    .mLayerTableCapacity = LayerTableCapacity,
+    .mLayerConfigSize = sizeof(LayerConfig),
+  };
+  return sRet;
+}
+
+namespace {
+
+// Writer side of the seqlock; see `SHMLayout`
+class SeqlockWriteScope final {
+ public:
+  SeqlockWriteScope() = delete;
+  explicit SeqlockWriteScope(std::atomic<uint64_t>& sequenceNumber)
+    : mSequenceNumber(sequenceNumber) {
+    mSequenceNumber.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  ~SeqlockWriteScope() {
+    mSequenceNumber.fetch_add(1, std::memory_order_release);
+  }
+
+  SeqlockWriteScope(const SeqlockWriteScope&) = delete;
+  SeqlockWriteScope(SeqlockWriteScope&&) = delete;
+  SeqlockWriteScope& operator=(const SeqlockWriteScope&) = delete;
+  SeqlockWriteScope& operator=(SeqlockWriteScope&&) = delete;
+
+ private:
+  std::atomic<uint64_t>& mSequenceNumber;
+};
+
+// The smallest rect covering everywhere this layer is on the texture
+PixelRect GetFullLayerRect(const LayerConfig& layer) {
+  if (!(layer.mVREnabled && layer.mNonVREnabled)) {
+    return layer.mVREnabled ? layer.mVR.mLocationOnTexture
+                            : layer.mNonVR.mLocationOnTexture;
+  }
+  const auto& vr = layer.mVR.mLocationOnTexture;
+  const auto& nonVR = layer.mNonVR.mLocationOnTexture;
+  const auto left = std::min(vr.Left(), nonVR.Left());
+  const auto top = std::min(vr.Top(), nonVR.Top());
+  return {
+    {left, top},
+    {
+      std::max(vr.Right(), nonVR.Right()) - left,
+      std::max(vr.Bottom(), nonVR.Bottom()) - top,
+    },
+  };
+}
+
+}// namespace
 
 struct Detail::IPCHandles {
  public:
@@ -187,6 +377,14 @@ static std::wstring MutexPath() {
   return sRet;
 }
 
+static std::wstring FrameEventPath(uint8_t index) {
+  return std::format(L"{}.frameEvent{}", SHMPath(), index);
+}
+
+// Upper bound on how long a missed wakeup can delay `WaitForFrame()`; see
+// `Impl::NotifyFrame()`
+static constexpr std::chrono::milliseconds FrameEventRecheckInterval {50};
+
 Snapshot::Snapshot(nullptr_t) : mState(State::Empty) {
 }
 
@@ -199,37 +397,35 @@ Snapshot::Snapshot(incorrect_gpu_t) : mState(State::IncorrectGPU) {
 Snapshot::Snapshot(ipc_handle_error_t) : mState(State::IPCHandleError) {
 }
 
-Snapshot::Snapshot(FrameMetadata* metadata) : mState(State::Empty) {
-  OPENKNEEBOARD_TraceLoggingScope("SHM::Snapshot::Snapshot(FrameMetadata)");
-  mHeader = std::make_shared<FrameMetadata>(*metadata);
+Snapshot::Snapshot(const std::shared_ptr<Frame>& frame)
+  : mFrame(frame), mState(State::Empty) {
+  OPENKNEEBOARD_TraceLoggingScope("SHM::Snapshot::Snapshot(Frame)");
 
-  if (mHeader && mHeader->HaveFeeder()) {
+  if (mFrame && mFrame->mMetadata.HaveFeeder()) {
     mState = State::ValidWithoutTexture;
   }
 }
 
 uint64_t Snapshot::GetSessionID() const {
-  if (!mHeader) {
+  if (!mFrame) {
     return {};
   }
 
-  return mHeader->mSessionID;
+  return mFrame->mMetadata.mSessionID;
 }
 
 Snapshot::Snapshot(
-  FrameMetadata* metadata,
+  const std::shared_ptr<Frame>& frame,
   IPCTextureCopier* copier,
   IPCHandles* source,
   const std::shared_ptr<IPCClientTexture>& dest)
-  : mIPCTexture(dest), mState(State::Empty) {
+  : mFrame(frame), mIPCTexture(dest), mState(State::Empty) {
   OPENKNEEBOARD_TraceLoggingScopedActivity(
     activity, "SHM::Snapshot::Snapshot(metadataAndTextures)");
 
-  const auto textureIndex = metadata->mFrameNumber % SHMSwapchainLength;
-  auto fenceValue = &metadata->mFrameReadyFenceValues.at(textureIndex);
-  const auto fenceIn = *fenceValue;
-
-  mHeader = std::make_shared<FrameMetadata>(*metadata);
+  const auto& metadata = mFrame->mMetadata;
+  const auto fenceIn
+    = metadata.mFrameReadyFenceValues.at(metadata.mTextureIndex);
 
   {
     OPENKNEEBOARD_TraceLoggingScope("CopyTexture");
@@ -240,9 +436,9 @@ Snapshot::Snapshot(
       fenceIn);
   }
 
-  if (mHeader && mHeader->HaveFeeder()) {
+  if (metadata.HaveFeeder()) {
     TraceLoggingWriteTagged(activity, "MarkingValid");
-    if (mHeader->mLayerCount > 0) {
+    if (metadata.mLayerCount > 0) {
       mState = State::ValidWithTexture;
     } else {
       mState = State::ValidWithoutTexture;
@@ -263,28 +459,28 @@ uint64_t Snapshot::GetRenderCacheKey() const {
   // - we're only combining *one* other value which isn't
   // If adding more data, it either needs to be random,
   // or need something like boost::hash_combine()
-  return mHeader->GetRenderCacheKey();
+  return mFrame->mMetadata.GetRenderCacheKey();
 }
 
 uint64_t Snapshot::GetSequenceNumberForDebuggingOnly() const {
   if (!this->HasMetadata()) {
     return 0;
   }
-  return mHeader->mFrameNumber;
+  return mFrame->mMetadata.mFrameNumber;
 }
 
 Config Snapshot::GetConfig() const {
   if (!this->HasMetadata()) {
     return {};
   }
-  return mHeader->mConfig;
+  return mFrame->mMetadata.mConfig;
 }
 
 uint8_t Snapshot::GetLayerCount() const {
   if (!this->HasMetadata()) {
     return 0;
   }
-  return mHeader->mLayerCount;
+  return static_cast<uint8_t>(mFrame->mLayers.size());
 }
 
 const LayerConfig* Snapshot::GetLayerConfig(uint8_t layerIndex) const {
@@ -295,85 +491,233 @@ const LayerConfig* Snapshot::GetLayerConfig(uint8_t layerIndex) const {
       this->GetLayerCount());
   }
 
-  return &mHeader->mLayers[layerIndex];
+  return &mFrame->mLayers[layerIndex];
+}
+
+uint64_t Snapshot::GetLayerRenderCacheKey(uint8_t layerIndex) const {
+  return mFrame->mMetadata.GetRenderCacheKey(
+    this->GetLayerConfig(layerIndex)->mContentGeneration);
+}
+
+std::bitset<MaxViewCount> Snapshot::GetLayersChangedSince(
+  uint64_t renderCacheKey) const {
+  const auto layerCount = this->GetLayerCount();
+  std::bitset<MaxViewCount> ret;
+  if (layerCount == 0) {
+    return ret;
+  }
+
+  // If the cache key is older than every layer, everything's changed, so
+  // we don't need to look further back than the oldest layer
+  const auto oldestGeneration = std::ranges::min(
+    mFrame->mLayers | std::views::transform(&LayerConfig::mContentGeneration));
+  const auto frameNumber
+    = mFrame->mMetadata.FindFrameNumber(renderCacheKey, oldestGeneration);
+
+  for (uint8_t i = 0; i < layerCount; ++i) {
+    const auto generation = mFrame->mLayers[i].mContentGeneration;
+    if ((!frameNumber) || generation > *frameNumber) {
+      ret.set(i);
+    }
+  }
+  return ret;
 }
 
 template <class T>
 concept shm_state_machine = lockable_state_machine<T> && (T::HasFinalState)
   && (T::FinalState == T::Values::Unlocked);
 
+using Detail::LockResult;
+
+// See `Impl::ReadHeader()`
+template <class T>
+concept header_reader = std::invocable<T, const FrameMetadata&>
+  || std::invocable<T, const FrameMetadata&, std::span<const LayerConfig>>;
+
 template <shm_state_machine TStateMachine>
 class Impl {
  public:
   using State = TStateMachine::Values;
-  winrt::handle mFileHandle;
-  winrt::handle mMutexHandle;
-  std::byte* mMapping = nullptr;
+  Detail::SharedMapping mMapping {SHMPath(), SHM_SIZE};
+  Detail::SharedMutex mMutex {MutexPath()};
+  std::array<Detail::SharedEvent, 2> mFrameEvents {
+    Detail::SharedEvent {FrameEventPath(0)},
+    Detail::SharedEvent {FrameEventPath(1)},
+  };
+  SHMLayout* mLayout = nullptr;
   FrameMetadata* mHeader = nullptr;
+  // `LayerTableCapacity` entries; see `FrameMetadata::mLayerCount`
+  LayerConfig* mLayers = nullptr;
 
   Impl() {
     // For debugging 32-bit/64-bit interop stuff
     static std::once_flag sDumpLayoutOnce;
     std::call_once(sDumpLayoutOnce, []() {
+      const auto layout = GetLayoutInfo();
       dprint(
         "SHM information:\n"
         L"- Path: {}\n"
+        L"- Layout version: {}\n"
         L"- Size: {}\n"
+        L"- Frame metadata size: {}\n"
         L"- Config offset: {}\n"
         L"- Config size: {}\n"
-        L"- Layer config offset: {}\n"
-        L"- Layer config size: {}\n"
+        L"- Layer count offset: {}\n"
         L"- Feeder PID offset: {}\n"
-        L"- Feeder PID size: {}\n",
+        L"- Layer table offset: {}\n"
+        L"- Layer table capacity: {}\n"
+        L"- Layer config size: {}\n",
         SHMPath(),
-        SHM_SIZE,
-        offsetof(FrameMetadata, mConfig),
-        sizeof(FrameMetadata::mConfig),
-        offsetof(FrameMetadata, mLayers),
-        sizeof(LayerConfig),
-        offsetof(FrameMetadata, mFeederProcessID),
-        sizeof(FrameMetadata::mFeederProcessID));
+        layout.mVersion,
+        layout.mMappingSize,
+        layout.mFrameMetadataSize,
+        layout.mConfigOffset,
+        layout.mConfigSize,
+        layout.mLayerCountOffset,
+        layout.mFeederProcessIDOffset,
+        layout.mLayerTableOffset,
+        layout.mLayerTableCapacity,
+        layout.mLayerConfigSize);
     });
 
-    auto fileHandle = Win32::or_default::CreateFileMapping(
-      INVALID_HANDLE_VALUE,
-      NULL,
-      PAGE_READWRITE,
-      0,
-      DWORD {SHM_SIZE},// Perfect forwarding fails with static constexpr
-                       // integer values
-      SHMPath().c_str());
-    if (!fileHandle) {
-      dprint("CreateFileMapping failed: {}", static_cast<int>(GetLastError()));
+    const auto eventsValid
+      = std::ranges::all_of(mFrameEvents, &Detail::SharedEvent::IsValid);
+    if (!(mMapping.IsValid() && mMutex.IsValid() && eventsValid)) {
       return;
     }
 
-    auto mutexHandle
-      = Win32::or_default::CreateMutex(nullptr, FALSE, MutexPath().c_str());
-    if (!mutexHandle) {
-      dprint("CreateMutexW failed: {}", static_cast<int>(GetLastError()));
-      return;
-    }
+    mLayout = reinterpret_cast<SHMLayout*>(mMapping.GetView());
+    mHeader = &mLayout->mFrame;
+    mLayers
+      = reinterpret_cast<LayerConfig*>(mMapping.GetView() + LayerTableOffset);
+  }
 
-    mMapping = reinterpret_cast<std::byte*>(
-      MapViewOfFile(fileHandle.get(), FILE_MAP_WRITE, 0, 0, SHM_SIZE));
-    if (!mMapping) {
-      dprint(
-        "MapViewOfFile failed: {:#x}", std::bit_cast<uint32_t>(GetLastError()));
-      return;
+  bool IsValid() const {
+    return mHeader;
+  }
+
+  // Keep the result alive while modifying `*mHeader` or `mLayers`; the mutex
+  // must also be held
+  [[nodiscard]] SeqlockWriteScope BeginWrite() noexcept {
+    return SeqlockWriteScope {mLayout->mSequenceNumber};
+  }
+
+  // Must be called with the mutex held
+  void ResetHeader() noexcept {
+    auto& sequenceNumber = mLayout->mSequenceNumber;
+    // If the previous owner died mid-write, the sequence number will be odd;
+    // `ReadHeader()` uses its last consistent copy until it's even again
+    if (sequenceNumber.load(std::memory_order_relaxed) & 1) {
+      sequenceNumber.fetch_add(1, std::memory_order_relaxed);
+    }
+    const auto write = this->BeginWrite();
+    *mHeader = {};
+    for (auto& it: mLayout->mPendingCopies) {
+      it.store(0, std::memory_order_relaxed);
+    }
+    for (auto& it: mLayout->mFrameReadyTimes) {
+      it.mFenceValue.store(0, std::memory_order_relaxed);
     }
+  }
 
-    mFileHandle = std::move(fileHandle);
-    mMutexHandle = std::move(mutexHandle);
-    mHeader = reinterpret_cast<FrameMetadata*>(mMapping);
+  /** Wake readers that are waiting for a new frame.
+   *
+   * Call after changing the render cache key, once the seqlock write has
+   * finished.
+   *
+   * There are two manual-reset events, alternating by generation:
+   * - the event for the generation after next is reset before incrementing
+   *   the generation
+   * - the event for the new generation is set after
+   *
+   * Readers check the key, then wait for the event for the generation after
+   * the one they saw. This can miss a wakeup: if two frames are published
+   * between re-checking the generation and starting the wait, the second
+   * frame resets the event the reader is about to wait on, and there may
+   * never be a third frame.
+   *
+   * To handle that, readers never wait longer than
+   * `FrameEventRecheckInterval` before re-checking the generation. The events
+   * are just for latency; correctness comes from the generation, which is
+   * monotonic and never reset.
+   */
+  void NotifyFrame() noexcept {
+    auto& generation = mLayout->mFrameEventGeneration;
+    const auto next = generation.load(std::memory_order_relaxed) + 1;
+    this->GetFrameEvent(next + 1).Reset();
+    generation.store(next, std::memory_order_release);
+    this->GetFrameEvent(next).Set();
   }
 
-  ~Impl() {
-    UnmapViewOfFile(mMapping);
+  uint64_t GetFrameEventGeneration() const noexcept {
+    return mLayout->mFrameEventGeneration.load(std::memory_order_acquire);
   }
 
-  bool IsValid() const {
-    return mMapping;
+  Detail::SharedEvent& GetFrameEvent(uint64_t generation) noexcept {
+    return mFrameEvents.at(generation % mFrameEvents.size());
+  }
+
+  /** Copy the header, and the layers it says are populated.
+   *
+   * Either call inside `ReadHeader()`, or with the mutex held.
+   */
+  std::shared_ptr<Frame> CopyFrame(
+    const FrameMetadata& header,
+    std::span<const LayerConfig> layers) const {
+    auto ret = std::make_shared<Frame>(header);
+    // The count may be garbage if this is a torn read; `ReadHeader()` will
+    // discard the result, but we still need to stay inside the table
+    const auto layerCount
+      = std::min<std::size_t>(header.mLayerCount, layers.size());
+    ret->mLayers.assign(layers.begin(), layers.begin() + layerCount);
+    return ret;
+  }
+
+  std::shared_ptr<Frame> CopyFrame(const FrameMetadata& header) const {
+    return this->CopyFrame(header, this->GetSharedLayers());
+  }
+
+  /** Call `fn` with a consistent view of the header and layer table, without
+   * taking the mutex.
+   *
+   * `fn` may be called multiple times, and may be passed a torn header on
+   * all but the last call; its result is only returned for a consistent
+   * view.
+   *
+   * `fn` is either called with just the header, or with the header and the
+   * layer table; use the passed table rather than `mLayers`, as it may be a
+   * copy.
+   *
+   * If we keep seeing an update in progress, `fn` is called with the last
+   * consistent view this process saw, or with an empty header ("no frame")
+   * if there isn't one; this never blocks. If the feeder died mid-write,
+   * the sequence number is fixed up by the next `lock()` - by a new feeder,
+   * or by a reader copying a texture - not here.
+   */
+  template <header_reader TFn>
+  auto ReadHeader(TFn&& fn) {
+    const auto& sequenceNumber = mLayout->mSequenceNumber;
+    for (std::size_t i = 0; i < MaxSeqlockReadAttempts; ++i) {
+      const auto before = sequenceNumber.load(std::memory_order_acquire);
+      if (before & 1) {
+        YieldProcessor();
+        continue;
+      }
+      auto ret = InvokeHeaderReader(fn, *mHeader, this->GetSharedLayers());
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (sequenceNumber.load(std::memory_order_relaxed) == before) {
+        this->MaybeUpdateLastConsistent(before);
+        return ret;
+      }
+    }
+
+    TraceLoggingWrite(gTraceProvider, "SHM::Impl::ReadHeader()/Fallback");
+    const std::unique_lock lock(mLastConsistent.mMutex, std::try_to_lock);
+    if (lock && mLastConsistent.mSequenceNumber) {
+      return InvokeHeaderReader(
+        fn, mLastConsistent.mHeader, mLastConsistent.mLayers);
+    }
+    return InvokeHeaderReader(fn, FrameMetadata {}, {});
   }
 
   template <State in, State out>
@@ -389,22 +733,23 @@ class Impl {
     TraceLoggingThreadActivity<gTraceProvider> activity;
     TraceLoggingWriteStart(activity, "SHM::Impl::lock()");
 
-    const auto result = WaitForSingleObject(mMutexHandle.get(), INFINITE);
+    const auto result = mMutex.Lock();
     switch (result) {
-      case WAIT_OBJECT_0:
+      case LockResult::Locked:
         // success
         break;
-      case WAIT_ABANDONED:
-        *mHeader = {};
+      case LockResult::LockedAbandoned:
+        this->ResetHeader();
         break;
       default:
         mState.template Transition<State::TryLock, State::Unlocked>();
         TraceLoggingWriteStop(
-          activity, "SHM::Impl::lock()", TraceLoggingValue(result, "Error"));
+          activity,
+          "SHM::Impl::lock()",
+          TraceLoggingValue(std::to_underlying(result), "Error"));
         dprint(
-          "Unexpected result from SHM WaitForSingleObject in lock(): "
-          "{:#016x}",
-          static_cast<uint64_t>(result));
+          "Unexpected result from SHM mutex in lock(): {}",
+          std::to_underlying(result));
         OPENKNEEBOARD_BREAK;
         return;
     }
@@ -419,15 +764,15 @@ class Impl {
     TraceLoggingThreadActivity<gTraceProvider> activity;
     TraceLoggingWriteStart(activity, "SHM::Impl::try_lock()");
 
-    const auto result = WaitForSingleObject(mMutexHandle.get(), 0);
+    const auto result = mMutex.TryLock();
     switch (result) {
-      case WAIT_OBJECT_0:
+      case LockResult::Locked:
         // success
         break;
-      case WAIT_ABANDONED:
-        *mHeader = {};
+      case LockResult::LockedAbandoned:
+        this->ResetHeader();
         break;
-      case WAIT_TIMEOUT:
+      case LockResult::WouldBlock:
         // expected in try_lock()
         mState.template Transition<State::TryLock, State::Unlocked>();
         return false;
@@ -436,10 +781,10 @@ class Impl {
         TraceLoggingWriteStop(
           activity,
           "SHM::Impl::try_lock()",
-          TraceLoggingValue(result, "Error"));
+          TraceLoggingValue(std::to_underlying(result), "Error"));
         dprint(
-          "Unexpected result from SHM WaitForSingleObject in try_lock(): {}",
-          result);
+          "Unexpected result from SHM mutex in try_lock(): {}",
+          std::to_underlying(result));
         OPENKNEEBOARD_BREAK;
         return false;
     }
@@ -455,7 +800,7 @@ class Impl {
   void unlock() {
     mState.template Transition<State::Locked, State::Unlocked>();
     OPENKNEEBOARD_TraceLoggingScope("SHM::Impl::unlock()");
-    ReleaseMutex(mMutexHandle.get());
+    mMutex.Unlock();
   }
 
   Impl(const Impl&) = delete;
@@ -465,6 +810,68 @@ class Impl {
 
  protected:
   TStateMachine mState;
+
+ private:
+  // Bounds the lock-free read; in practice, the writer's critical section is a
+  // `memcpy()`, so a handful of attempts is enough
+  static constexpr std::size_t MaxSeqlockReadAttempts = 1024;
+
+  template <class TFn>
+  static auto InvokeHeaderReader(
+    TFn& fn,
+    const FrameMetadata& header,
+    std::span<const LayerConfig> layers) {
+    if constexpr (std::invocable<
+                    TFn,
+                    const FrameMetadata&,
+                    std::span<const LayerConfig>>) {
+      return std::invoke(fn, header, layers);
+    } else {
+      return std::invoke(fn, header);
+    }
+  }
+
+  std::span<const LayerConfig> GetSharedLayers() const noexcept {
+    return {mLayers, LayerTableCapacity};
+  }
+
+  /* Fallback for `ReadHeader()`; this is only for this process, so an
+   * in-process mutex is fine, and it's only ever `try_lock()`ed */
+  struct LastConsistent {
+    std::mutex mMutex;
+    // Even when valid; 0 if there isn't a copy yet
+    uint64_t mSequenceNumber {};
+    FrameMetadata mHeader {};
+    std::vector<LayerConfig> mLayers;
+    // Reused for the copy, which is discarded if it's torn
+    FrameMetadata mNextHeader {};
+    std::vector<LayerConfig> mNextLayers;
+  };
+  LastConsistent mLastConsistent;
+
+  // Copies once per published header, not once per read
+  void MaybeUpdateLastConsistent(uint64_t sequenceNumber) {
+    auto& last = mLastConsistent;
+    const std::unique_lock lock(last.mMutex, std::try_to_lock);
+    if ((!lock) || last.mSequenceNumber == sequenceNumber) {
+      return;
+    }
+
+    last.mNextHeader = *mHeader;
+    const auto layerCount = std::min<std::size_t>(
+      last.mNextHeader.mLayerCount, LayerTableCapacity);
+    last.mNextLayers.assign(mLayers, mLayers + layerCount);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (
+      mLayout->mSequenceNumber.load(std::memory_order_relaxed)
+      != sequenceNumber) {
+      return;
+    }
+
+    std::swap(last.mHeader, last.mNextHeader);
+    std::swap(last.mLayers, last.mNextLayers);
+    last.mSequenceNumber = sequenceNumber;
+  }
 };
 
 class Writer::Impl : public SHM::Impl<WriterStateMachine> {
@@ -473,8 +880,87 @@ class Writer::Impl : public SHM::Impl<WriterStateMachine> {
 
   DWORD mProcessID = GetCurrentProcessId();
   uint64_t mGPULUID {};
+  // Chosen in `BeginFrame()`, published in `SubmitFrame()`
+  uint8_t mNextTextureIndex {};
+  FrameClock::time_point mNextBeginRenderTime {};
+  // When each texture was last seen with no pending copies
+  std::array<std::chrono::steady_clock::time_point, MaxSHMSwapchainLength>
+    mLastConsumedAt {};
+
+  uint8_t ChooseTextureIndex() noexcept;
+  void ReclaimAbandonedCopies() noexcept;
 };
 
+void Writer::Impl::ReclaimAbandonedCopies() noexcept {
+  const auto now = std::chrono::steady_clock::now();
+  for (uint8_t i = 0; i < mHeader->mSwapchainLength; ++i) {
+    auto& pending = mLayout->mPendingCopies[i];
+    auto count = pending.load(std::memory_order_acquire);
+    if (count == 0) {
+      mLastConsumedAt[i] = now;
+      continue;
+    }
+    // Consumers may be about to copy the latest frame
+    if (i == mHeader->mTextureIndex) {
+      continue;
+    }
+    if (now - mLastConsumedAt[i] < AbandonedCopyTimeout) {
+      continue;
+    }
+    // If this fails, a consumer just finished; check again next frame
+    if (!pending.compare_exchange_strong(count, 0)) {
+      continue;
+    }
+    mLastConsumedAt[i] = now;
+    TraceLoggingWrite(
+      gTraceProvider,
+      "SHM::Writer::ReclaimAbandonedCopies()",
+      TraceLoggingValue(i, "TextureIndex"),
+      TraceLoggingValue(count, "PendingCopies"));
+    dprint.Warning(
+      "Reclaimed {} SHM copies from texture {} that were never finished; did "
+      "a consumer crash?",
+      count,
+      i);
+  }
+}
+
+uint8_t Writer::Impl::ChooseTextureIndex() noexcept {
+  this->ReclaimAbandonedCopies();
+
+  const auto length = mHeader->mSwapchainLength;
+  std::array<SwapchainSlot, MaxSHMSwapchainLength> slots {};
+  for (uint8_t i = 0; i < length; ++i) {
+    slots[i] = {
+      .mFrameNumber = mHeader->mTextureFrameNumbers[i],
+      .mPendingCopies
+      = mLayout->mPendingCopies[i].load(std::memory_order_acquire),
+    };
+  }
+
+  const auto choice = ChooseSlot(slots, length, mHeader->mTextureIndex);
+  switch (choice.mKind) {
+    case SlotChoiceKind::Consumed:
+      break;
+    case SlotChoiceKind::Grow: {
+      TraceLoggingWrite(
+        gTraceProvider,
+        "SHM::Writer::ChooseTextureIndex()/GrowSwapchain",
+        TraceLoggingValue(length + 1, "SwapchainLength"));
+      const auto write = this->BeginWrite();
+      ++mHeader->mSwapchainLength;
+      break;
+    }
+    case SlotChoiceKind::OverwritingPendingCopy:
+      TraceLoggingWrite(
+        gTraceProvider,
+        "SHM::Writer::ChooseTextureIndex()/OverwritingUnconsumed",
+        TraceLoggingValue(length, "SwapchainLength"));
+      break;
+  }
+  return choice.mSlot;
+}
+
 Writer::Writer(uint64_t gpuLUID) {
   const auto path = SHMPath();
   dprint(L"Initializing SHM writer");
@@ -486,7 +972,7 @@ Writer::Writer(uint64_t gpuLUID) {
   }
   p->mGPULUID = gpuLUID;
 
-  *p->mHeader = FrameMetadata {};
+  p->ResetHeader();
   dprint("Writer initialized.");
 }
 
@@ -494,8 +980,9 @@ void Writer::Detach() {
   p->Transition<State::Locked, State::Detaching>();
 
   const auto oldID = p->mHeader->mSessionID;
-  *p->mHeader = {};
-  FlushViewOfFile(p->mMapping, NULL);
+  p->ResetHeader();
+  p->mMapping.Flush();
+  p->NotifyFrame();
 
   p->Transition<State::Detaching, State::Locked>();
   dprint(
@@ -515,18 +1002,27 @@ void Writer::SubmitEmptyFrame() {
     State::Locked,
     State::SubmittingEmptyFrame,
     State::Locked>(p);
-  p->mHeader->mFrameNumber++;
-  p->mHeader->mLayerCount = 0;
+  {
+    const auto write = p->BeginWrite();
+    p->mHeader->mFrameNumber++;
+    p->mHeader->mLayerCount = 0;
+  }
+  p->NotifyFrame();
 }
 
-Writer::NextFrameInfo Writer::BeginFrame() noexcept {
+Writer::NextFrameInfo Writer::BeginFrame(
+  std::chrono::steady_clock::time_point beginRenderTime) noexcept {
   using State = WriterState;
   p->Transition<State::Locked, State::FrameInProgress>();
 
-  const auto textureIndex
-    = static_cast<uint8_t>((p->mHeader->mFrameNumber + 1) % SHMSwapchainLength);
+  const auto textureIndex = p->ChooseTextureIndex();
+  p->mNextTextureIndex = textureIndex;
+  p->mNextBeginRenderTime = beginRenderTime;
   auto fenceValue = &p->mHeader->mFrameReadyFenceValues[textureIndex];
-  const auto fenceOut = InterlockedIncrement64(fenceValue);
+  const auto fenceOut = [&] {
+    const auto write = p->BeginWrite();
+    return InterlockedIncrement64(fenceValue);
+  }();
 
   return NextFrameInfo {
     .mTextureIndex = textureIndex,
@@ -534,6 +1030,20 @@ Writer::NextFrameInfo Writer::BeginFrame() noexcept {
   };
 }
 
+void Writer::SetFrameReadyTime(
+  uint8_t textureIndex,
+  LONG64 fenceValue,
+  std::chrono::steady_clock::time_point time) noexcept {
+  if (!p) {
+    return;
+  }
+  auto& it = p->mLayout->mFrameReadyTimes.at(textureIndex);
+  it.mFenceValue.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  it.mTime.store(time.time_since_epoch().count(), std::memory_order_relaxed);
+  it.mFenceValue.store(fenceValue, std::memory_order_release);
+}
+
 void Writer::lock() {
   p->lock();
 }
@@ -551,12 +1061,10 @@ class Reader::Impl : public SHM::Impl<ReaderStateMachine> {
   winrt::handle mFeederProcessHandle;
   uint64_t mSessionID {~(0ui64)};
 
-  std::array<std::unique_ptr<IPCHandles>, SHMSwapchainLength> mHandles;
+  std::array<std::unique_ptr<IPCHandles>, MaxSHMSwapchainLength> mHandles;
 
-  void UpdateSession() {
+  void UpdateSession(const FrameMetadata& metadata) {
     OPENKNEEBOARD_TraceLoggingScope("SHM::Reader::Impl::UpdateSession()");
-    const auto& metadata = *this->mHeader;
-
     if (mSessionID != metadata.mSessionID) {
       mFeederProcessHandle = {};
       mHandles = {};
@@ -571,6 +1079,43 @@ class Reader::Impl : public SHM::Impl<ReaderStateMachine> {
       OpenProcess(PROCESS_DUP_HANDLE, FALSE, metadata.mFeederProcessID)};
   }
 
+  uint64_t ReadRenderCacheKey() {
+    return this->ReadHeader(
+      [](const FrameMetadata& it) { return it.GetRenderCacheKey(); });
+  }
+
+  void BeginCopy(uint8_t textureIndex) noexcept {
+    mLayout->mPendingCopies.at(textureIndex)
+      .fetch_add(1, std::memory_order_relaxed);
+  }
+
+  std::optional<FrameClock::time_point> GetFrameReadyTime(
+    uint8_t textureIndex,
+    LONG64 fenceValue) const noexcept {
+    const auto& it = mLayout->mFrameReadyTimes.at(textureIndex);
+    if (it.mFenceValue.load(std::memory_order_acquire) != fenceValue) {
+      return std::nullopt;
+    }
+    const FrameClock::duration time {
+      it.mTime.load(std::memory_order_relaxed)};
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (it.mFenceValue.load(std::memory_order_relaxed) != fenceValue) {
+      return std::nullopt;
+    }
+    return FrameClock::time_point {time};
+  }
+
+  /// Let the feeder know it can reuse the texture
+  void EndCopy(uint8_t textureIndex) noexcept {
+    auto& pending = mLayout->mPendingCopies.at(textureIndex);
+    // If the feeder restarted, it will have reset the count
+    auto previous = pending.load(std::memory_order_relaxed);
+    while (previous > 0
+           && !pending.compare_exchange_weak(
+             previous, previous - 1, std::memory_order_release)) {
+    }
+  }
+
  private:
   // Only valid in the feeder process, but keep track of them to see if they
   // change
@@ -585,7 +1130,7 @@ uint64_t Reader::GetSessionID() const {
   if (!p->mHeader) {
     return {};
   }
-  return p->mHeader->mSessionID;
+  return p->ReadHeader(&FrameMetadata::mSessionID);
 }
 
 Reader::Reader() {
@@ -606,7 +1151,7 @@ Reader::~Reader() {
 }
 
 Reader::operator bool() const {
-  return p && p->IsValid() && p->mHeader->HaveFeeder();
+  return p && p->IsValid() && p->ReadHeader(&FrameMetadata::HaveFeeder);
 }
 
 Writer::operator bool() const {
@@ -621,16 +1166,53 @@ void CachedReader::InitializeCache(uint64_t gpuLUID, uint8_t swapchainLength) {
   OPENKNEEBOARD_TraceLoggingScope(
     "SHM::CachedReader::InitializeCache()",
     TraceLoggingValue(swapchainLength, "SwapchainLength"));
+  this->ReleaseAllCopies();
   mGPULUID = gpuLUID;
   mCache = {};
   mCacheKey = {};
   mClientTextures = {swapchainLength, nullptr};
 }
 
-CachedReader::~CachedReader() = default;
+CachedReader::~CachedReader() {
+  // Subclasses wait for their pending copies in their destructors
+  this->ReleaseAllCopies();
+}
+
+void CachedReader::ReleaseCompletedCopies() {
+  std::erase_if(mPendingCopies, [this](const PendingCopy& copy) {
+    if (!mTextureCopier->IsCopyComplete(copy.mSwapchainIndex)) {
+      return false;
+    }
+    p->EndCopy(copy.mFeederTextureIndex);
+    return true;
+  });
+}
+
+void CachedReader::ReleaseAllCopies() {
+  if (p) {
+    for (const auto& copy: mPendingCopies) {
+      p->EndCopy(copy.mFeederTextureIndex);
+    }
+  }
+  mPendingCopies.clear();
+}
 
 Snapshot Reader::MaybeGetUncached(ConsumerKind kind) {
-  return MaybeGetUncached({}, nullptr, nullptr, kind);
+  OPENKNEEBOARD_TraceLoggingScopedActivity(
+    activity, "SHM::Reader::MaybeGetUncached(ConsumerKind)");
+  const auto frame = p->ReadHeader(
+    [impl = p.get()](
+      const FrameMetadata& it, std::span<const LayerConfig> layers) {
+      return impl->CopyFrame(it, layers);
+    });
+
+  if (!frame->mMetadata.mConfig.mTarget.Matches(kind)) {
+    activity.StopWithResult("incorrect_kind");
+    return {Snapshot::incorrect_kind};
+  }
+
+  p->UpdateSession(frame->mMetadata);
+  return Snapshot(frame);
 }
 
 Snapshot Reader::MaybeGetUncached(
@@ -656,10 +1238,10 @@ Snapshot Reader::MaybeGetUncached(
     return {Snapshot::incorrect_kind};
   }
 
-  p->UpdateSession();
+  p->UpdateSession(*p->mHeader);
 
   if (!(gpuLUID && copier && dest)) {
-    return Snapshot(p->mHeader);
+    return Snapshot(p->CopyFrame(*p->mHeader));
   }
 
   if (p->mHeader->mGPULUID != gpuLUID) {
@@ -672,7 +1254,7 @@ Snapshot Reader::MaybeGetUncached(
     return {Snapshot::incorrect_gpu};
   }
 
-  auto& handles = p->mHandles.at(p->mHeader->mFrameNumber % SHMSwapchainLength);
+  auto& handles = p->mHandles.at(p->mHeader->mTextureIndex);
   if (handles && (
     (handles->mForeignFenceHandle != p->mHeader->mFence) 
   ||
@@ -697,7 +1279,7 @@ Snapshot Reader::MaybeGetUncached(
     }
   }
 
-  return Snapshot(p->mHeader, copier, handles.get(), dest);
+  return Snapshot(p->CopyFrame(*p->mHeader), copier, handles.get(), dest);
 }
 
 uint64_t Reader::GetRenderCacheKey(ConsumerKind kind) const {
@@ -705,11 +1287,16 @@ uint64_t Reader::GetRenderCacheKey(ConsumerKind kind) const {
     return {};
   }
 
-  if (p->mHeader->mConfig.mTarget.Matches(kind)) {
+  const auto [target, cacheKey]
+    = p->ReadHeader([](const FrameMetadata& it) {
+        return std::tuple {it.mConfig.mTarget, it.GetRenderCacheKey()};
+      });
+
+  if (target.Matches(kind)) {
     ActiveConsumers::Set(kind);
   }
 
-  return p->mHeader->GetRenderCacheKey();
+  return cacheKey;
 }
 
 void Writer::SubmitFrame(
@@ -731,39 +1318,161 @@ void Writer::SubmitFrame(
       "Asked to publish {} layers, but max is {}", layers.size(), MaxViewCount);
   }
 
+  // Declared before `write` so it runs after the seqlock write is finished
+  const scope_exit notify([this]() { p->NotifyFrame(); });
+  const auto write = p->BeginWrite();
+  const auto frameNumber = ++p->mHeader->mFrameNumber;
+  // If layers have been added, removed, or reordered, the location of every
+  // layer on the texture and in consumer swapchains may have changed
+  const auto layoutChanged = (layers.size() != p->mHeader->mLayerCount);
+  for (std::size_t i = 0; i < layers.size(); ++i) {
+    auto layer = layers.at(i);
+    const auto& previous = p->mLayers[i];
+    if (layoutChanged || layer.mLayerID != previous.mLayerID) {
+      layer.mDirtyRect = GetFullLayerRect(layer);
+    }
+    layer.mContentGeneration
+      = layer.mDirtyRect ? frameNumber : previous.mContentGeneration;
+    p->mLayers[i] = layer;
+  }
+
+  p->mHeader->mTextureIndex = p->mNextTextureIndex;
+  p->mHeader->mTextureFrameNumbers[p->mNextTextureIndex] = frameNumber;
   p->mHeader->mGPULUID = p->mGPULUID;
   p->mHeader->mConfig = config;
-  p->mHeader->mFrameNumber++;
   p->mHeader->mFlags |= HeaderFlags::FEEDER_ATTACHED;
   p->mHeader->mLayerCount = static_cast<uint8_t>(layers.size());
   p->mHeader->mFeederProcessID = p->mProcessID;
   p->mHeader->mTexture = texture;
   p->mHeader->mFence = fence;
-  memcpy(
-    p->mHeader->mLayers, layers.data(), sizeof(LayerConfig) * layers.size());
+  p->mHeader->mBeginRenderTime = p->mNextBeginRenderTime;
+  p->mHeader->mSubmitTime = FrameClock::now();
 }
 
-bool FrameMetadata::HaveFeeder() const {
+bool FrameMetadata::IsFeederAttached() const {
   return (mMagic == *reinterpret_cast<const uint64_t*>(Magic.data()))
     && ((mFlags & HeaderFlags::FEEDER_ATTACHED)
         == HeaderFlags::FEEDER_ATTACHED);
 }
 
+bool FrameMetadata::HaveFeeder() const {
+  return this->IsFeederAttached() && (mLayoutInfo == GetLayoutInfo());
+}
+
 uint64_t FrameMetadata::GetRenderCacheKey() const {
   // This is lazy, and only works because:
   // - session ID already contains random data
   // - we're only combining *one* other value which isn't
   // If adding more data, it either needs to be random,
   // or need something like boost::hash_combine()
+  return this->GetRenderCacheKey(mFrameNumber);
+}
+
+uint64_t FrameMetadata::GetRenderCacheKey(uint64_t frameNumber) const {
   std::hash<uint64_t> HashUI64;
-  return HashUI64(mSessionID) ^ HashUI64(mFrameNumber);
+  return HashUI64(mSessionID) ^ HashUI64(frameNumber);
+}
+
+std::optional<uint64_t> FrameMetadata::FindFrameNumber(
+  uint64_t renderCacheKey,
+  uint64_t oldestFrameNumber) const {
+  // Consumers are usually only a few frames behind; don't spend too long
+  // hashing if they're not
+  constexpr uint64_t MaxFramesToSearch = 4 * FramesPerSecond;
+  if (mFrameNumber - oldestFrameNumber > MaxFramesToSearch) {
+    oldestFrameNumber = mFrameNumber - MaxFramesToSearch;
+  }
+
+  for (auto frameNumber = mFrameNumber; frameNumber >= oldestFrameNumber;
+       --frameNumber) {
+    if (this->GetRenderCacheKey(frameNumber) == renderCacheKey) {
+      return frameNumber;
+    }
+    if (frameNumber == 0) {
+      break;
+    }
+  }
+  return std::nullopt;
+}
+
+bool Reader::WaitForFrame(
+  uint64_t lastRenderCacheKey,
+  std::chrono::milliseconds timeout) const {
+  if (!p) {
+    return false;
+  }
+  OPENKNEEBOARD_TraceLoggingScope("SHM::Reader::WaitForFrame()");
+
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (true) {
+    const auto generation = p->GetFrameEventGeneration();
+    if (p->ReadRenderCacheKey() != lastRenderCacheKey) {
+      return true;
+    }
+    if (p->GetFrameEventGeneration() != generation) {
+      continue;
+    }
+
+    const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+      deadline - std::chrono::steady_clock::now());
+    if (remaining <= std::chrono::milliseconds::zero()) {
+      return false;
+    }
+    p->GetFrameEvent(generation + 1)
+      .Wait(std::min(remaining, FrameEventRecheckInterval));
+  }
+}
+
+task<bool> Reader::WaitForFrame(
+  uint64_t lastRenderCacheKey,
+  std::stop_token stopToken) const {
+  // Keep the mapping and events alive even if this `Reader` is destroyed
+  // while we're waiting
+  const auto impl = p;
+  if (!impl) {
+    co_return false;
+  }
+
+  while (true) {
+    const auto generation = impl->GetFrameEventGeneration();
+    if (impl->ReadRenderCacheKey() != lastRenderCacheKey) {
+      co_return true;
+    }
+    if (impl->GetFrameEventGeneration() != generation) {
+      continue;
+    }
+
+    const auto event = impl->GetFrameEvent(generation + 1).GetNativeHandle();
+    const auto result
+      = co_await resume_on_signal(event, stopToken, FrameEventRecheckInterval);
+    if (!result && result.error() != ResumeOnSignalError::Timeout) {
+      co_return false;
+    }
+  }
+}
+
+std::optional<LayoutInfo> Reader::GetFeederLayoutInfo() const {
+  if (!(p && p->mHeader)) {
+    return std::nullopt;
+  }
+
+  // `mLayoutInfo` is at the same offset in every layout, and the
+  // sequence number is at the start of the mapping
+  const auto [attached, layout]
+    = p->ReadHeader([](const FrameMetadata& it) {
+        return std::tuple {it.IsFeederAttached(), it.mLayoutInfo};
+      });
+  if (!attached) {
+    return std::nullopt;
+  }
+  return layout;
 }
 
 uint64_t Reader::GetFrameCountForMetricsOnly() const {
   if (!(p && p->mHeader)) {
     return {};
   }
-  return p->mHeader->mFrameNumber;
+  return p->ReadHeader(&FrameMetadata::mFrameNumber);
 }
 
 ConsumerPattern::ConsumerPattern() = default;
@@ -793,6 +1502,7 @@ Snapshot CachedReader::MaybeGet(const std::source_location& loc) {
   }
 
   this->UpdateSession();
+  this->ReleaseCompletedCopies();
 
   ActiveConsumers::Set(mConsumerKind);
 
@@ -830,7 +1540,7 @@ Snapshot CachedReader::MaybeGet(const std::source_location& loc) {
 
   if (p->mHeader->mLayerCount == 0) {
     maybeGetActivity.StopWithResult("NoLayers");
-    return Snapshot {p->mHeader};
+    return Snapshot {p->CopyFrame(*p->mHeader)};
   }
 
   const auto dimensions = p->mHeader->mConfig.mTextureSize;
@@ -841,6 +1551,17 @@ Snapshot CachedReader::MaybeGet(const std::source_location& loc) {
   const auto state = snapshot.GetState();
   maybeGetActivity.StopWithResult(static_cast<int>(state));
 
+  if (state == Snapshot::State::ValidWithTexture) {
+    // We still hold the lock, so the feeder hasn't moved on
+    const auto feederTextureIndex = p->mHeader->mTextureIndex;
+    p->BeginCopy(feederTextureIndex);
+    mPendingCopies.push_back({swapchainIndex, feederTextureIndex});
+
+    if (cacheKey != mCacheKey) {
+      this->RecordLatency(*p->mHeader);
+    }
+  }
+
   if (state == Snapshot::State::Empty) {
     const auto& cache = mCache.front();
     TraceLoggingWriteStop(
@@ -902,24 +1623,56 @@ Snapshot CachedReader::MaybeGetMetadata() {
     return MaybeGet();
   }
 
-  std::unique_lock lock(*p);
+  // Lock-free; the snapshot may be newer than `cacheKey`
   auto snapshot = this->MaybeGetUncached(mConsumerKind);
   if (snapshot.HasMetadata()) {
     mCache.push_front(snapshot);
-    mCacheKey = cacheKey;
+    mCacheKey = snapshot.GetRenderCacheKey();
   }
 
   return snapshot;
 }
 
+void CachedReader::RecordLatency(const FrameMetadata& frame) {
+  if (frame.mBeginRenderTime == FrameClock::time_point {}) {
+    // Feeder doesn't provide timestamps
+    return;
+  }
+
+  const auto now = FrameClock::now();
+  ConsumerLatency::Record(mConsumerKind, now - frame.mBeginRenderTime);
+
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+  const auto textureIndex = frame.mTextureIndex;
+  const auto readyTime = p->GetFrameReadyTime(
+    textureIndex, frame.mFrameReadyFenceValues.at(textureIndex));
+  TraceLoggingWrite(
+    gTraceProvider,
+    "CachedReader::RecordLatency()",
+    TraceLoggingValue(std::to_underlying(mConsumerKind), "ConsumerKind"),
+    TraceLoggingValue(
+      duration_cast<microseconds>(now - frame.mBeginRenderTime).count(),
+      "SinceBeginRenderMicroseconds"),
+    TraceLoggingValue(
+      duration_cast<microseconds>(now - frame.mSubmitTime).count(),
+      "SinceSubmitMicroseconds"),
+    // -1 if the GPU hasn't finished the frame yet; our copy waits for it
+    TraceLoggingValue(
+      readyTime ? duration_cast<microseconds>(now - *readyTime).count() : -1,
+      "SinceFrameReadyMicroseconds"));
+}
+
 void CachedReader::UpdateSession() {
   const auto sessionID = this->GetSessionID();
   if (sessionID == mSessionID) {
     return;
   }
   this->ReleaseIPCHandles();
-  p->UpdateSession();
+  p->UpdateSession(p->ReadHeader([](const FrameMetadata& it) { return it; }));
   mSessionID = sessionID;
+  // The new feeder starts with no pending copies
+  mPendingCopies.clear();
 }
 
 IPCClientTexture::IPCClientTexture(
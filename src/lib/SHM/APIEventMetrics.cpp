@@ -0,0 +1,122 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#include "Platform.hpp"
+
+#include <OpenKneeboard/SHM/APIEventMetrics.hpp>
+
+#include <OpenKneeboard/config.hpp>
+#include <OpenKneeboard/version.hpp>
+
+#include <atomic>
+#include <format>
+#include <string>
+
+namespace OpenKneeboard::SHM {
+
+class APIEventMetrics::Impl {
+ public:
+  static APIEventMetrics* Get() {
+    static Detail::SharedMapping sMapping {
+      GetSHMPath(), sizeof(APIEventMetrics)};
+    // Newly-created mappings are zero-filled, which is a valid empty
+    // `APIEventMetrics`
+    return reinterpret_cast<APIEventMetrics*>(sMapping.GetView());
+  }
+
+ private:
+  static std::wstring GetSHMPath() {
+    return std::format(
+      L"{}/{}.{}.{}.{}/APIEventMetrics-s{:x}",
+      ProjectReverseDomainW,
+      Version::Major,
+      Version::Minor,
+      Version::Patch,
+      Version::Build,
+      sizeof(APIEventMetrics));
+  }
+};
+
+namespace {
+void UpdateMax(uint64_t& max, uint64_t value) {
+  std::atomic_ref ref(max);
+  auto current = ref.load(std::memory_order_relaxed);
+  while (value > current
+         && !ref.compare_exchange_weak(
+           current, value, std::memory_order_relaxed)) {
+  }
+}
+}// namespace
+
+void APIEventMetrics::Clear() {
+  auto p = Impl::Get();
+  if (p) {
+    *p = {};
+  }
+}
+
+APIEventMetrics APIEventMetrics::Get() {
+  auto p = Impl::Get();
+  if (p) {
+    // Not atomic as a whole, but good enough for statistics
+    return *p;
+  }
+  return {};
+}
+
+void APIEventMetrics::RecordProcessingLatency(Clock::duration latency) {
+  auto p = Impl::Get();
+  if (p) {
+    p->mProcessingLatency.Record(latency);
+  }
+}
+
+void APIEventMetrics::RecordBacklog(std::size_t queueLength) {
+  auto p = Impl::Get();
+  if (!p) {
+    return;
+  }
+  std::atomic_ref(p->mFlushCount).fetch_add(1, std::memory_order_relaxed);
+  std::atomic_ref(p->mTotalBacklog)
+    .fetch_add(queueLength, std::memory_order_relaxed);
+  UpdateMax(p->mMaxBacklog, queueLength);
+}
+
+void APIEventMetrics::RecordHandlerCost(
+  APIEventTypeID typeID,
+  Clock::duration cost) {
+  auto p = Impl::Get();
+  if (!p) {
+    return;
+  }
+
+  const auto index = static_cast<std::size_t>(typeID);
+  if (index >= HandlerCostSlots) {
+    return;
+  }
+  auto& entry = p->mHandlerCosts.at(index);
+  const auto ns = static_cast<uint64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(cost).count());
+  std::atomic_ref(entry.mCount).fetch_add(1, std::memory_order_relaxed);
+  std::atomic_ref(entry.mTotalNanoseconds)
+    .fetch_add(ns, std::memory_order_relaxed);
+  UpdateMax(entry.mMaxNanoseconds, ns);
+}
+
+}// namespace OpenKneeboard::SHM
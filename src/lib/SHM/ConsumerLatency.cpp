@@ -0,0 +1,141 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#include "Platform.hpp"
+
+#include <OpenKneeboard/SHM/ConsumerLatency.hpp>
+
+#include <OpenKneeboard/config.hpp>
+#include <OpenKneeboard/dprint.hpp>
+#include <OpenKneeboard/version.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <format>
+#include <numeric>
+#include <string>
+#include <utility>
+
+namespace OpenKneeboard::SHM {
+
+class ConsumerLatency::Impl {
+ public:
+  static ConsumerLatency* Get() {
+    static Detail::SharedMapping sMapping {
+      GetSHMPath(), sizeof(ConsumerLatency)};
+    // Newly-created mappings are zero-filled, which is a valid empty
+    // `ConsumerLatency`
+    return reinterpret_cast<ConsumerLatency*>(sMapping.GetView());
+  }
+
+ private:
+  static std::wstring GetSHMPath() {
+    return std::format(
+      L"{}/{}.{}.{}.{}/ConsumerLatency-s{:x}",
+      ProjectReverseDomainW,
+      Version::Major,
+      Version::Minor,
+      Version::Patch,
+      Version::Build,
+      sizeof(ConsumerLatency));
+  }
+};
+
+void ConsumerLatency::Histogram::Record(Clock::duration age) noexcept {
+  const auto bucket = std::clamp<int64_t>(
+    age / BucketWidth, 0, static_cast<int64_t>(BucketCount - 1));
+  // Multiple consumers of the same kind may be recording at once, e.g. two
+  // viewers
+  std::atomic_ref(mBuckets.at(static_cast<std::size_t>(bucket)))
+    .fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t ConsumerLatency::Histogram::GetSampleCount() const noexcept {
+  return std::accumulate(mBuckets.begin(), mBuckets.end(), uint64_t {0});
+}
+
+std::chrono::microseconds ConsumerLatency::Histogram::GetPercentile(
+  double percentile) const noexcept {
+  const auto count = this->GetSampleCount();
+  if (count == 0) {
+    return {};
+  }
+
+  const auto target = std::max<uint64_t>(
+    1, static_cast<uint64_t>(percentile * static_cast<double>(count)));
+  uint64_t seen = 0;
+  for (std::size_t i = 0; i < BucketCount; ++i) {
+    seen += mBuckets[i];
+    if (seen >= target) {
+      return BucketWidth * (i + 1);
+    }
+  }
+  return BucketWidth * BucketCount;
+}
+
+namespace {
+template <class T>
+auto& GetHistogram(T& latency, ConsumerKind kind) {
+  switch (kind) {
+    case ConsumerKind::SteamVR:
+      return latency.mSteamVR;
+    case ConsumerKind::OpenXR:
+      return latency.mOpenXR;
+    case ConsumerKind::OculusD3D11:
+      return latency.mOculusD3D11;
+    case ConsumerKind::NonVRD3D11:
+      return latency.mNonVRD3D11;
+    case ConsumerKind::Viewer:
+      return latency.mViewer;
+  }
+  fatal("Unhandled consumer kind: {}", std::to_underlying(kind));
+}
+}// namespace
+
+const ConsumerLatency::Histogram& ConsumerLatency::Get(
+  ConsumerKind kind) const {
+  return GetHistogram(*this, kind);
+}
+
+void ConsumerLatency::Clear() {
+  auto p = Impl::Get();
+  if (p) {
+    *p = {};
+  }
+}
+
+ConsumerLatency ConsumerLatency::Get() {
+  auto p = Impl::Get();
+  if (p) {
+    // Not atomic as a whole, but good enough for statistics
+    return *p;
+  }
+  return {};
+}
+
+void ConsumerLatency::Record(ConsumerKind kind, Clock::duration age) {
+  auto p = Impl::Get();
+  if (!p) {
+    return;
+  }
+
+  GetHistogram(*p, kind).Record(age);
+}
+
+}// namespace OpenKneeboard::SHM
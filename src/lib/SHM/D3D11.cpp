@@ -114,6 +114,7 @@ void CachedReader::InitializeCache(
     mDevice = {};
     mDeviceContext = {};
     mCopyFence = {};
+    mCopyFenceValues.clear();
 
     check_hresult(device->QueryInterface(mDevice.put()));
     winrt::com_ptr<ID3D11DeviceContext> context;
@@ -184,6 +185,16 @@ void CachedReader::Copy(
       mCopyFence.mFence.get(),
       ++mCopyFence.mValue);
   fenceAndValue->mValue = fenceValueIn;
+  mCopyFenceValues[destinationTexture->GetSwapchainIndex()]
+    = mCopyFence.mValue;
+}
+
+bool CachedReader::IsCopyComplete(uint8_t swapchainIndex) noexcept {
+  const auto it = mCopyFenceValues.find(swapchainIndex);
+  if (it == mCopyFenceValues.end() || !mCopyFence) {
+    return true;
+  }
+  return mCopyFence.mFence->GetCompletedValue() >= it->second;
 }
 
 std::shared_ptr<SHM::IPCClientTexture> CachedReader::CreateIPCClientTexture(
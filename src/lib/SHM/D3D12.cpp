@@ -261,6 +261,7 @@ void CachedReader::InitializeCache(
     mCommandQueue.copy_from(queue);
     mBufferResources = {};
     mCopyFence = {};
+    mCopyFenceValues.clear();
 
     // debug logging
     // It's a pain to get the adapater name with D3D12; you 'should'
@@ -374,6 +375,15 @@ void CachedReader::Copy(
       ++mCopyFence.mValue);
 
   fenceAndValue->mValue = fenceValueIn;
+  mCopyFenceValues[swapchainIndex] = mCopyFence.mValue;
+}
+
+bool CachedReader::IsCopyComplete(uint8_t swapchainIndex) noexcept {
+  const auto it = mCopyFenceValues.find(swapchainIndex);
+  if (it == mCopyFenceValues.end() || !mCopyFence) {
+    return true;
+  }
+  return mCopyFence.mFence->GetCompletedValue() >= it->second;
 }
 
 uint8_t CachedReader::GetSwapchainLength() const {
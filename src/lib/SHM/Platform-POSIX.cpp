@@ -0,0 +1,435 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#include "Platform.hpp"
+
+#include <OpenKneeboard/dprint.hpp>
+#include <OpenKneeboard/scope_exit.hpp>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <string>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace OpenKneeboard::SHM::Detail {
+
+namespace {
+
+// POSIX shared memory names must start with a `/`, and must not contain any
+// other `/`; our names are all ASCII
+std::string GetPOSIXName(std::wstring_view name) {
+  std::string ret {"/"};
+  ret.reserve(name.size() + 1);
+  for (const auto c: name) {
+    if (c == L'/' || c == L'\\') {
+      ret.push_back('.');
+      continue;
+    }
+    ret.push_back(static_cast<char>(c));
+  }
+  return ret;
+}
+
+class FileDescriptor final {
+ public:
+  FileDescriptor() = default;
+  explicit FileDescriptor(int fd) : mFD(fd) {
+  }
+
+  ~FileDescriptor() {
+    if (mFD >= 0) {
+      close(mFD);
+    }
+  }
+
+  int get() const noexcept {
+    return mFD;
+  }
+
+  explicit operator bool() const noexcept {
+    return mFD >= 0;
+  }
+
+  FileDescriptor(const FileDescriptor&) = delete;
+  FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+ private:
+  int mFD {-1};
+};
+
+void* MapFileDescriptor(int fd, std::size_t size) {
+  auto ret = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (ret == MAP_FAILED) {
+    dprint("mmap() failed: {}", errno);
+    return nullptr;
+  }
+  return ret;
+}
+
+}// namespace
+
+class SharedMapping::Impl final {
+ public:
+  std::byte* mView {nullptr};
+  std::size_t mSize {};
+
+  Impl(std::wstring_view name, std::size_t size) {
+    const auto posixName = GetPOSIXName(name);
+    FileDescriptor fd {shm_open(posixName.c_str(), O_RDWR | O_CREAT, 0600)};
+    if (!fd) {
+      dprint("shm_open({}) failed: {}", posixName, errno);
+      return;
+    }
+
+    struct stat info {};
+    if (fstat(fd.get(), &info) != 0) {
+      dprint("fstat() on SHM failed: {}", errno);
+      return;
+    }
+    // `ftruncate()` zero-fills, matching `CreateFileMapping()`
+    if (
+      static_cast<std::size_t>(info.st_size) < size
+      && ftruncate(fd.get(), static_cast<off_t>(size)) != 0) {
+      dprint("ftruncate() on SHM failed: {}", errno);
+      return;
+    }
+
+    mView = reinterpret_cast<std::byte*>(MapFileDescriptor(fd.get(), size));
+    if (mView) {
+      mSize = size;
+    }
+  }
+
+  ~Impl() {
+    if (mView) {
+      munmap(mView, mSize);
+    }
+  }
+};
+
+SharedMapping::SharedMapping(std::wstring_view name, std::size_t size)
+  : p(std::make_unique<Impl>(name, size)) {
+}
+
+SharedMapping::~SharedMapping() = default;
+
+bool SharedMapping::IsValid() const noexcept {
+  return p->mView;
+}
+
+std::byte* SharedMapping::GetView() const noexcept {
+  return p->mView;
+}
+
+std::size_t SharedMapping::GetSize() const noexcept {
+  return p->mSize;
+}
+
+void SharedMapping::Flush() noexcept {
+  if (p->mView) {
+    msync(p->mView, p->mSize, MS_SYNC);
+  }
+}
+
+namespace {
+
+constexpr uint32_t InitializedMagic = 0x4f4b4d58;// "OKMX"
+
+/** A small struct in its own shared memory, initialized by whichever process
+ * first opens it.
+ *
+ * `T` must have a `std::atomic<uint32_t> mInitialized` member, which is set
+ * last by the initializer.
+ *
+ * Initialization is serialized with `flock()` on the segment itself: unlike a
+ * flag or a mutex in the segment, the kernel drops it if the holder dies, so
+ * if a process dies after creating the segment but before finishing
+ * initialization, the next process to open it initializes it instead of
+ * waiting forever for the magic.
+ */
+template <class T>
+class SharedSegment final {
+ public:
+  using Initializer = bool (*)(T*);
+
+  SharedSegment(std::wstring_view name, Initializer initialize) {
+    const auto posixName = GetPOSIXName(name);
+
+    FileDescriptor fd {shm_open(posixName.c_str(), O_RDWR | O_CREAT, 0600)};
+    if (!fd) {
+      dprint("shm_open({}) for segment failed: {}", posixName, errno);
+      return;
+    }
+
+    while (flock(fd.get(), LOCK_EX) != 0) {
+      if (errno != EINTR) {
+        dprint("flock() on SHM segment failed: {}", errno);
+        return;
+      }
+    }
+    const scope_exit unlock([fd = fd.get()]() { flock(fd, LOCK_UN); });
+
+    struct stat info {};
+    if (fstat(fd.get(), &info) != 0) {
+      dprint("fstat() on SHM segment failed: {}", errno);
+      return;
+    }
+    // `ftruncate()` zero-fills, so a short segment is never initialized
+    if (
+      static_cast<std::size_t>(info.st_size) < sizeof(T)
+      && ftruncate(fd.get(), sizeof(T)) != 0) {
+      dprint("ftruncate() on SHM segment failed: {}", errno);
+      return;
+    }
+
+    auto segment = reinterpret_cast<T*>(MapFileDescriptor(fd.get(), sizeof(T)));
+    if (!segment) {
+      return;
+    }
+
+    // Either the magic was stored by a process that finished initializing,
+    // or we own the only initialization attempt that can make progress
+    if (
+      segment->mInitialized.load(std::memory_order_acquire)
+      != InitializedMagic) {
+      if (!initialize(segment)) {
+        munmap(segment, sizeof(T));
+        return;
+      }
+      segment->mInitialized.store(InitializedMagic, std::memory_order_release);
+    }
+    mSegment = segment;
+  }
+
+  ~SharedSegment() {
+    // Deliberately not destroying the contents or unlinking the segment:
+    // other processes may still be using it, just like a Win32 named object
+    if (mSegment) {
+      munmap(mSegment, sizeof(T));
+    }
+  }
+
+  T* get() const noexcept {
+    return mSegment;
+  }
+
+  SharedSegment(const SharedSegment&) = delete;
+  SharedSegment(SharedSegment&&) = delete;
+  SharedSegment& operator=(const SharedSegment&) = delete;
+  SharedSegment& operator=(SharedSegment&&) = delete;
+
+ private:
+  T* mSegment {nullptr};
+};
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+bool InitializeMutex(pthread_mutex_t* mutex) {
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+  const auto result = pthread_mutex_init(mutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+  if (result != 0) {
+    dprint("pthread_mutex_init() failed: {}", result);
+    return false;
+  }
+  return true;
+}
+
+}// namespace
+
+class SharedMutex::Impl final {
+ public:
+  struct Segment {
+    std::atomic<uint32_t> mInitialized;
+    pthread_mutex_t mMutex;
+  };
+
+  SharedSegment<Segment> mSegment;
+
+  Impl(std::wstring_view name)
+    : mSegment(name, [](Segment* it) { return InitializeMutex(&it->mMutex); }) {
+  }
+
+  pthread_mutex_t* GetMutex() const noexcept {
+    return &mSegment.get()->mMutex;
+  }
+
+  LockResult FromPthreadResult(int result) noexcept {
+    switch (result) {
+      case 0:
+        return LockResult::Locked;
+      case EOWNERDEAD:
+        // We own it, but need to tell pthreads we've recovered, otherwise
+        // the next unlock makes it permanently unusable
+        pthread_mutex_consistent(this->GetMutex());
+        return LockResult::LockedAbandoned;
+      case EBUSY:
+        return LockResult::WouldBlock;
+      default:
+        dprint("Unexpected result from SHM pthread_mutex_*lock(): {}", result);
+        return LockResult::Error;
+    }
+  }
+};
+
+SharedMutex::SharedMutex(std::wstring_view name)
+  : p(std::make_unique<Impl>(name)) {
+}
+
+SharedMutex::~SharedMutex() = default;
+
+bool SharedMutex::IsValid() const noexcept {
+  return p->mSegment.get();
+}
+
+LockResult SharedMutex::Lock() noexcept {
+  return p->FromPthreadResult(pthread_mutex_lock(p->GetMutex()));
+}
+
+LockResult SharedMutex::TryLock() noexcept {
+  return p->FromPthreadResult(pthread_mutex_trylock(p->GetMutex()));
+}
+
+void SharedMutex::Unlock() noexcept {
+  pthread_mutex_unlock(p->GetMutex());
+}
+
+class SharedEvent::Impl final {
+ public:
+  struct Segment {
+    std::atomic<uint32_t> mInitialized;
+    pthread_mutex_t mMutex;
+    pthread_cond_t mCondition;
+    bool mIsSet;
+  };
+
+  SharedSegment<Segment> mSegment;
+
+  Impl(std::wstring_view name) : mSegment(name, &Initialize) {
+  }
+
+  // Returns false if the mutex is unusable
+  bool Lock() noexcept {
+    auto segment = mSegment.get();
+    const auto result = pthread_mutex_lock(&segment->mMutex);
+    if (result == EOWNERDEAD) {
+      // Nothing to recover: `mIsSet` is always consistent
+      pthread_mutex_consistent(&segment->mMutex);
+      return true;
+    }
+    if (result != 0) {
+      dprint("pthread_mutex_lock() for SHM event failed: {}", result);
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  static bool Initialize(Segment* segment) {
+    if (!InitializeMutex(&segment->mMutex)) {
+      return false;
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    // Match `std::chrono::steady_clock`
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    const auto result = pthread_cond_init(&segment->mCondition, &attr);
+    pthread_condattr_destroy(&attr);
+    if (result != 0) {
+      dprint("pthread_cond_init() failed: {}", result);
+      return false;
+    }
+    segment->mIsSet = false;
+    return true;
+  }
+};
+
+SharedEvent::SharedEvent(std::wstring_view name)
+  : p(std::make_unique<Impl>(name)) {
+}
+
+SharedEvent::~SharedEvent() = default;
+
+bool SharedEvent::IsValid() const noexcept {
+  return p->mSegment.get();
+}
+
+void SharedEvent::Set() noexcept {
+  if (!p->Lock()) {
+    return;
+  }
+  auto segment = p->mSegment.get();
+  segment->mIsSet = true;
+  pthread_cond_broadcast(&segment->mCondition);
+  pthread_mutex_unlock(&segment->mMutex);
+}
+
+void SharedEvent::Reset() noexcept {
+  if (!p->Lock()) {
+    return;
+  }
+  auto segment = p->mSegment.get();
+  segment->mIsSet = false;
+  pthread_mutex_unlock(&segment->mMutex);
+}
+
+bool SharedEvent::Wait(std::chrono::milliseconds timeout) noexcept {
+  timespec deadline {};
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  const auto ns = std::chrono::nanoseconds {deadline.tv_nsec} + timeout;
+  deadline.tv_sec
+    += std::chrono::duration_cast<std::chrono::seconds>(ns).count();
+  deadline.tv_nsec = (ns % std::chrono::seconds {1}).count();
+
+  if (!p->Lock()) {
+    return false;
+  }
+  auto segment = p->mSegment.get();
+  while (!segment->mIsSet) {
+    const auto result = pthread_cond_timedwait(
+      &segment->mCondition, &segment->mMutex, &deadline);
+    if (result == EOWNERDEAD) {
+      pthread_mutex_consistent(&segment->mMutex);
+      continue;
+    }
+    if (result != 0) {
+      break;
+    }
+  }
+  const auto ret = segment->mIsSet;
+  pthread_mutex_unlock(&segment->mMutex);
+  return ret;
+}
+
+void* SharedEvent::GetNativeHandle() const noexcept {
+  return nullptr;
+}
+
+}// namespace OpenKneeboard::SHM::Detail
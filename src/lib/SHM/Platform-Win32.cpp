@@ -0,0 +1,184 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#include "Platform.hpp"
+
+#include <OpenKneeboard/Win32.hpp>
+
+#include <OpenKneeboard/dprint.hpp>
+
+#include <shims/winrt/base.h>
+
+#include <Windows.h>
+
+#include <bit>
+#include <string>
+
+namespace OpenKneeboard::SHM::Detail {
+
+class SharedMapping::Impl final {
+ public:
+  winrt::handle mFileHandle;
+  std::byte* mView {nullptr};
+  std::size_t mSize {};
+
+  Impl(std::wstring_view name, std::size_t size) {
+    auto fileHandle = Win32::or_default::CreateFileMapping(
+      INVALID_HANDLE_VALUE,
+      NULL,
+      PAGE_READWRITE,
+      0,
+      static_cast<DWORD>(size),
+      std::wstring {name}.c_str());
+    if (!fileHandle) {
+      dprint("CreateFileMapping failed: {}", static_cast<int>(GetLastError()));
+      return;
+    }
+
+    mView = reinterpret_cast<std::byte*>(
+      MapViewOfFile(fileHandle.get(), FILE_MAP_WRITE, 0, 0, size));
+    if (!mView) {
+      dprint(
+        "MapViewOfFile failed: {:#x}", std::bit_cast<uint32_t>(GetLastError()));
+      return;
+    }
+
+    mFileHandle = std::move(fileHandle);
+    mSize = size;
+  }
+
+  ~Impl() {
+    if (mView) {
+      UnmapViewOfFile(mView);
+    }
+  }
+};
+
+SharedMapping::SharedMapping(std::wstring_view name, std::size_t size)
+  : p(std::make_unique<Impl>(name, size)) {
+}
+
+SharedMapping::~SharedMapping() = default;
+
+bool SharedMapping::IsValid() const noexcept {
+  return p->mView;
+}
+
+std::byte* SharedMapping::GetView() const noexcept {
+  return p->mView;
+}
+
+std::size_t SharedMapping::GetSize() const noexcept {
+  return p->mSize;
+}
+
+void SharedMapping::Flush() noexcept {
+  if (p->mView) {
+    FlushViewOfFile(p->mView, NULL);
+  }
+}
+
+class SharedMutex::Impl final {
+ public:
+  winrt::handle mHandle;
+
+  LockResult Wait(DWORD timeout) noexcept {
+    const auto result = WaitForSingleObject(mHandle.get(), timeout);
+    switch (result) {
+      case WAIT_OBJECT_0:
+        return LockResult::Locked;
+      case WAIT_ABANDONED:
+        return LockResult::LockedAbandoned;
+      case WAIT_TIMEOUT:
+        return LockResult::WouldBlock;
+      default:
+        dprint(
+          "Unexpected result from SHM WaitForSingleObject(): {:#016x}",
+          static_cast<uint64_t>(result));
+        return LockResult::Error;
+    }
+  }
+};
+
+SharedMutex::SharedMutex(std::wstring_view name)
+  : p(std::make_unique<Impl>()) {
+  p->mHandle = Win32::or_default::CreateMutex(
+    nullptr, FALSE, std::wstring {name}.c_str());
+  if (!p->mHandle) {
+    dprint("CreateMutexW failed: {}", static_cast<int>(GetLastError()));
+  }
+}
+
+SharedMutex::~SharedMutex() = default;
+
+bool SharedMutex::IsValid() const noexcept {
+  return static_cast<bool>(p->mHandle);
+}
+
+LockResult SharedMutex::Lock() noexcept {
+  return p->Wait(INFINITE);
+}
+
+LockResult SharedMutex::TryLock() noexcept {
+  return p->Wait(0);
+}
+
+void SharedMutex::Unlock() noexcept {
+  ReleaseMutex(p->mHandle.get());
+}
+
+class SharedEvent::Impl final {
+ public:
+  winrt::handle mHandle;
+};
+
+SharedEvent::SharedEvent(std::wstring_view name)
+  : p(std::make_unique<Impl>()) {
+  p->mHandle = Win32::or_default::CreateEvent(
+    nullptr, /* manual reset = */ TRUE, FALSE, std::wstring {name}.c_str());
+  if (!p->mHandle) {
+    dprint("CreateEventW failed: {}", static_cast<int>(GetLastError()));
+  }
+}
+
+SharedEvent::~SharedEvent() = default;
+
+bool SharedEvent::IsValid() const noexcept {
+  return static_cast<bool>(p->mHandle);
+}
+
+void SharedEvent::Set() noexcept {
+  SetEvent(p->mHandle.get());
+}
+
+void SharedEvent::Reset() noexcept {
+  ResetEvent(p->mHandle.get());
+}
+
+bool SharedEvent::Wait(std::chrono::milliseconds timeout) noexcept {
+  return WaitForSingleObject(
+           p->mHandle.get(), static_cast<DWORD>(timeout.count()))
+    == WAIT_OBJECT_0;
+}
+
+void* SharedEvent::GetNativeHandle() const noexcept {
+  return p->mHandle.get();
+}
+
+}// namespace OpenKneeboard::SHM::Detail
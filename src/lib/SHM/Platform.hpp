@@ -0,0 +1,129 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+// Operating system primitives used by `SHM::Impl`.
+//
+// There are two implementations:
+// - Platform-Win32.cpp: `CreateFileMapping()` + named mutex; this is what
+//   ships
+// - Platform-POSIX.cpp: `shm_open()` + a robust process-shared pthread mutex;
+//   this exists so that the metadata protocol can be exercised on machines
+//   without Windows or a GPU. It is built by src/portable.cmake, and tested
+//   by `shm-platform-stress`
+namespace OpenKneeboard::SHM::Detail {
+
+enum class LockResult {
+  Locked,
+  // The previous owner died while holding the lock; we now own the lock, but
+  // the protected data may be half-written. This is `WAIT_ABANDONED` on
+  // Windows, and `EOWNERDEAD` on POSIX
+  LockedAbandoned,
+  // Only returned by `TryLock()`
+  WouldBlock,
+  Error,
+};
+
+/** A named, read-write mapping of shared memory.
+ *
+ * The mapping is created if it does not exist; newly created mappings are
+ * zero-filled.
+ */
+class SharedMapping final {
+ public:
+  SharedMapping() = delete;
+  SharedMapping(std::wstring_view name, std::size_t size);
+  ~SharedMapping();
+
+  bool IsValid() const noexcept;
+  std::byte* GetView() const noexcept;
+  std::size_t GetSize() const noexcept;
+
+  void Flush() noexcept;
+
+  SharedMapping(const SharedMapping&) = delete;
+  SharedMapping(SharedMapping&&) = delete;
+  SharedMapping& operator=(const SharedMapping&) = delete;
+  SharedMapping& operator=(SharedMapping&&) = delete;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> p;
+};
+
+/// A named mutex that can be shared between processes
+class SharedMutex final {
+ public:
+  SharedMutex() = delete;
+  SharedMutex(std::wstring_view name);
+  ~SharedMutex();
+
+  bool IsValid() const noexcept;
+
+  LockResult Lock() noexcept;
+  LockResult TryLock() noexcept;
+  void Unlock() noexcept;
+
+  SharedMutex(const SharedMutex&) = delete;
+  SharedMutex(SharedMutex&&) = delete;
+  SharedMutex& operator=(const SharedMutex&) = delete;
+  SharedMutex& operator=(SharedMutex&&) = delete;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> p;
+};
+
+/** A named, manual-reset event that can be shared between processes.
+ *
+ * Newly-created events are not set.
+ */
+class SharedEvent final {
+ public:
+  SharedEvent() = delete;
+  SharedEvent(std::wstring_view name);
+  ~SharedEvent();
+
+  bool IsValid() const noexcept;
+
+  void Set() noexcept;
+  void Reset() noexcept;
+  /// Returns false if the timeout expired first
+  bool Wait(std::chrono::milliseconds timeout) noexcept;
+
+  /// The Win32 `HANDLE` for cancellable waits; `nullptr` on other platforms
+  void* GetNativeHandle() const noexcept;
+
+  SharedEvent(const SharedEvent&) = delete;
+  SharedEvent(SharedEvent&&) = delete;
+  SharedEvent& operator=(const SharedEvent&) = delete;
+  SharedEvent& operator=(SharedEvent&&) = delete;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> p;
+};
+
+}// namespace OpenKneeboard::SHM::Detail
@@ -472,6 +472,15 @@ void CachedReader::Copy(
       semaphoreValueIn);
 }
 
+bool CachedReader::IsCopyComplete(uint8_t swapchainIndex) noexcept {
+  if (swapchainIndex >= mCompletionFences.size()) {
+    return true;
+  }
+  // Zero timeout: just check the fence status
+  auto fence = mCompletionFences.at(swapchainIndex).get();
+  return mVK->WaitForFences(mDevice, 1, &fence, true, 0) == VK_SUCCESS;
+}
+
 std::shared_ptr<SHM::IPCClientTexture> CachedReader::CreateIPCClientTexture(
   const PixelSize& dimensions,
   uint8_t swapchainIndex) noexcept {
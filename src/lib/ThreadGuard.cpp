@@ -26,12 +26,17 @@ namespace OpenKneeboard {
 
 ThreadGuard::ThreadGuard(const std::source_location& loc) : mLocation(loc) {
 #ifdef DEBUG
+#ifdef _WIN32
   mThreadID = GetCurrentThreadId();
+#else
+  mThreadID = std::this_thread::get_id();
+#endif
 #endif
 }
 
 void ThreadGuard::CheckThread(const std::source_location& loc) const {
 #ifdef DEBUG
+#ifdef _WIN32
   const auto thisThread = GetCurrentThreadId();
   if (thisThread == mThreadID) {
     return;
@@ -42,6 +47,13 @@ void ThreadGuard::CheckThread(const std::source_location& loc) const {
     mThreadID,
     thisThread,
     thisThread);
+#else
+  const auto thisThread = std::this_thread::get_id();
+  if (thisThread == mThreadID) {
+    return;
+  }
+  dprint("ThreadGuard mismatch: was {}, now {}", mThreadID, thisThread);
+#endif
   dprint("Created at {}", mLocation);
   dprint("Checking at {}", loc);
   OPENKNEEBOARD_BREAK;
@@ -116,14 +116,14 @@ std::vector<VRKneeboard::Layer> VRKneeboard::GetLayers(
 
   std::vector<Layer> ret;
   ret.reserve(totalLayers);
-  for (uint32_t layerIndex = 0; layerIndex < totalLayers; ++layerIndex) {
+  for (uint8_t layerIndex = 0; layerIndex < totalLayers; ++layerIndex) {
     const auto layerConfig = snapshot.GetLayerConfig(layerIndex);
     if (!layerConfig->mVREnabled) {
       continue;
     }
 
     ret.push_back(Layer {
-      layerConfig, GetRenderParameters(snapshot, *layerConfig, hmdPose)});
+      layerConfig, GetRenderParameters(snapshot, layerIndex, hmdPose)});
   }
 
   const auto config = snapshot.GetConfig();
@@ -157,14 +157,18 @@ std::vector<VRKneeboard::Layer> VRKneeboard::GetLayers(
 
 VRKneeboard::RenderParameters VRKneeboard::GetRenderParameters(
   const SHM::Snapshot& snapshot,
-  const SHM::LayerConfig& layer,
+  uint8_t layerIndex,
   const Pose& hmdPose) {
+  const auto& layer = *snapshot.GetLayerConfig(layerIndex);
   auto config = snapshot.GetConfig();
   const auto kneeboardPose = this->GetKneeboardPose(config.mVR, layer, hmdPose);
   const auto isLookingAtKneeboard
     = this->IsLookingAtKneeboard(config, layer, hmdPose, kneeboardPose);
 
-  auto cacheKey = snapshot.GetRenderCacheKey();
+  // Per-layer so that consumers can skip layers that haven't changed; this
+  // includes pose, size etc, as the feeder marks the layer as changed if the
+  // layer config or kneeboard settings change
+  auto cacheKey = snapshot.GetLayerRenderCacheKey(layerIndex);
   if (isLookingAtKneeboard) {
     cacheKey |= 1ui64;
   } else {
@@ -0,0 +1,89 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+// Implementation for the portable build (see src/portable.cmake); there is no
+// debug stream or DPrintReceiver IPC, so everything goes to stderr.
+
+#include <OpenKneeboard/dprint.hpp>
+
+#include <cstdio>
+#include <mutex>
+#include <optional>
+#include <string>
+
+namespace OpenKneeboard {
+
+static DebugPrinter::HistoryProvider sHistoryProvider;
+
+void DebugPrinter::SetHistoryProvider(const HistoryProvider& provider) {
+  sHistoryProvider = provider;
+}
+
+std::optional<std::string> DebugPrinter::MaybeGetHistory() {
+  if (sHistoryProvider) {
+    return sHistoryProvider();
+  }
+  return std::nullopt;
+}
+
+static DPrintSettings gSettings;
+static std::mutex gMutex;
+
+void DebugPrinter::Write(std::string_view message) {
+  std::unique_lock lock(gMutex);
+  std::fprintf(
+    stderr,
+    "[%s] %.*s\n",
+    gSettings.prefix.c_str(),
+    static_cast<int>(message.size()),
+    message.data());
+}
+
+void DebugPrinter::Write(std::wstring_view message) {
+  // `wchar_t` is UTF-32 on POSIX platforms
+  std::string utf8;
+  utf8.reserve(message.size());
+  for (const auto wc: message) {
+    const auto c = static_cast<char32_t>(wc);
+    if (c < 0x80) {
+      utf8.push_back(static_cast<char>(c));
+    } else if (c < 0x800) {
+      utf8.push_back(static_cast<char>(0xc0 | (c >> 6)));
+      utf8.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+    } else if (c < 0x10000) {
+      utf8.push_back(static_cast<char>(0xe0 | (c >> 12)));
+      utf8.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3f)));
+      utf8.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+    } else {
+      utf8.push_back(static_cast<char>(0xf0 | (c >> 18)));
+      utf8.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3f)));
+      utf8.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3f)));
+      utf8.push_back(static_cast<char>(0x80 | (c & 0x3f)));
+    }
+  }
+  Write(std::string_view {utf8});
+}
+
+void DPrintSettings::Set(const DPrintSettings& settings) {
+  std::unique_lock lock(gMutex);
+  gSettings = settings;
+}
+
+}// namespace OpenKneeboard
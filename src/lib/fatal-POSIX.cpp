@@ -0,0 +1,209 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+// Implementation for the portable build (see src/portable.cmake); there are
+// no crash dumps or exception hooks, so this logs to stderr and aborts.
+//
+// Stack traces use `backtrace()` and `dladdr()` rather than
+// `std::stacktrace`, as libstdc++ needs an extra library for that.
+
+#include <OpenKneeboard/fatal.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <ostream>
+#include <source_location>
+#include <sstream>
+#include <string>
+#include <typeinfo>
+
+#include <dlfcn.h>
+#include <execinfo.h>
+
+namespace OpenKneeboard {
+
+namespace {
+thread_local std::optional<StackTrace> tNextExceptionStack;
+
+std::string DescribeAddress(void* address) {
+  Dl_info info {};
+  if (!dladdr(address, &info)) {
+    return std::format("{}", address);
+  }
+  const auto module = info.dli_fname ? info.dli_fname : "[unknown module]";
+  if (!info.dli_sname) {
+    return std::format("{}!{}", module, address);
+  }
+  return std::format(
+    "{}!{}+{:#x}",
+    module,
+    info.dli_sname,
+    reinterpret_cast<uintptr_t>(address)
+      - reinterpret_cast<uintptr_t>(info.dli_saddr));
+}
+
+void WriteToStderr(std::string_view message) {
+  std::fwrite(message.data(), 1, message.size(), stderr);
+  std::fflush(stderr);
+}
+
+[[noreturn]]
+void OnTerminate() {
+  fatal("std::terminate() called");
+}
+
+}// namespace
+
+std::span<StackFramePointer> StackTrace::GetEntries() const {
+  return std::span {reinterpret_cast<StackFramePointer*>(mData.get()), mSize};
+}
+
+StackTrace StackTrace::Current(std::size_t skip) noexcept {
+  void* buffer[256];
+  const auto frames
+    = static_cast<std::size_t>(backtrace(buffer, std::size(buffer)));
+  // Skip this function too
+  const auto first = std::min(frames, skip + 1);
+
+  static_assert(sizeof(StackFramePointer) == sizeof(void*));
+  StackTrace ret;
+  ret.mSize = frames - first;
+  ret.mData = {std::malloc(sizeof(void*) * ret.mSize), &std::free};
+  std::memcpy(ret.mData.get(), buffer + first, sizeof(void*) * ret.mSize);
+  return ret;
+}
+
+StackTrace StackTrace::GetForMostRecentException() {
+  if (!tNextExceptionStack) {
+    return {};
+  }
+  return *tNextExceptionStack;
+}
+
+void StackTrace::SetForNextException(const StackTrace& v) {
+  tNextExceptionStack = v;
+}
+
+std::ostream& operator<<(std::ostream& lhs, const StackTrace& rhs) {
+  std::size_t counter = 0;
+  for (auto&& entry: rhs.GetEntries()) {
+    lhs << std::format("{}> {}\n", counter++, entry.to_string());
+  }
+  return lhs;
+}
+
+std::string StackFramePointer::to_string() const noexcept {
+  if (!mValue) {
+    return "[nullptr]";
+  }
+  return DescribeAddress(mValue);
+}
+
+void SetDumpType(DumpType) {
+  // No dumps in the portable build
+}
+
+void fatal_with_exception(std::exception_ptr ep) {
+  detail::prepare_to_fatal();
+  if (!ep) {
+    detail::FatalData {"fatal_with_exception() called without an exception"}
+      .fatal();
+  }
+
+  try {
+    std::rethrow_exception(ep);
+  } catch (const std::exception& e) {
+    detail::FatalData {
+      std::format(
+        "Uncaught std::exception ({}): {}", typeid(e).name(), e.what()),
+    }
+      .fatal();
+  } catch (...) {
+  }
+  detail::FatalData {"Uncaught exception of unknown kind"}.fatal();
+}
+
+void divert_process_failure_to_fatal() {
+  static std::atomic_flag sInstalled;
+  if (sInstalled.test_and_set()) {
+    return;
+  }
+  std::set_terminate(&OnTerminate);
+}
+
+FatalOnUncaughtExceptions::FatalOnUncaughtExceptions()
+  : mUncaughtExceptions(std::uncaught_exceptions()) {
+}
+
+FatalOnUncaughtExceptions::~FatalOnUncaughtExceptions() {
+  if (std::uncaught_exceptions() > mUncaughtExceptions) {
+    fatal("Uncaught exceptions");
+  }
+}
+
+}// namespace OpenKneeboard
+
+namespace OpenKneeboard::detail {
+
+SourceLocation::SourceLocation(const std::stacktrace_entry& entry) noexcept
+  : SourceLocation(StackFramePointer {entry}) {
+}
+
+SourceLocation::SourceLocation(const std::source_location& loc) noexcept
+  : mFunctionName(loc.function_name()),
+    mFileName(loc.file_name()),
+    mLine(loc.line()),
+    mColumn(loc.column()) {
+}
+
+SourceLocation::SourceLocation(StackFramePointer frame) noexcept {
+  Dl_info info {};
+  if (frame.mValue && dladdr(frame.mValue, &info)) {
+    mFunctionName = info.dli_sname ? info.dli_sname : frame.to_string();
+    mFileName = info.dli_fname ? info.dli_fname : "";
+    return;
+  }
+  mFunctionName = frame.to_string();
+}
+
+void FatalData::fatal() const noexcept {
+  std::string message = std::format("FATAL: {}\n", mMessage);
+  if (mBlameLocation) {
+    const auto& blame = *mBlameLocation;
+    message += std::format(
+      "Blamed on: {} @ {}:{}:{}\n",
+      blame.mFunctionName,
+      blame.mFileName,
+      blame.mLine,
+      blame.mColumn);
+  }
+  std::ostringstream stack;
+  stack << StackTrace::Current(1);
+  message += stack.str();
+  WriteToStderr(message);
+  std::abort();
+}
+
+}// namespace OpenKneeboard::detail
@@ -22,17 +22,62 @@
 #include <OpenKneeboard/json_fwd.hpp>
 #include <OpenKneeboard/utf8.hpp>
 
+#include <array>
 #include <cstddef>
+#include <cstdint>
 #include <expected>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 namespace OpenKneeboard {
+
+/** IDs for built-in event names.
+ *
+ * These are used in binary packets, and are the `APIEventRegistry` IDs for
+ * built-in events. They are part of the wire format, so only append to this
+ * list.
+ */
+enum class APIEventTypeID : uint16_t {
+  // The name is in the packet instead
+  Inline = 0,
+  RemoteUserAction,
+  SetTabByID,
+  SetTabByName,
+  SetTabByIndex,
+  SetProfileByGUID,
+  SetProfileByName,
+  SetBrightness,
+  PluginTabCustomAction,
+  MultiEvent,
+  OKBExecutableLaunched,
+  // `DCSWorld::EVT_*`
+  DCSAircraft,
+  DCSInstallPath,
+  DCSMission,
+  DCSMissionTime,
+  DCSOrigin,
+  DCSSelfData,
+  DCSMessage,
+  DCSSavedGamesPath,
+  DCSSimulationStart,
+  DCSTerrain,
+};
+
+constexpr APIEventTypeID GetBuiltinAPIEventTypeID(std::string_view name);
+
 struct APIEvent final {
   // These are both required to be UTF-8
   std::string name;
   std::string value;
+  /** `Inline` if not known yet.
+   *
+   * Set by `APIEventView::ToAPIEvent()`; otherwise, use
+   * `APIEventRegistry::Find()`.
+   */
+  APIEventTypeID typeID {APIEventTypeID::Inline};
 
   template <class T>
   T ParsedValue() const {
@@ -60,13 +105,22 @@ struct APIEvent final {
   static APIEvent FromStruct(const T& v) {
     nlohmann::json j;
     j = v;
-    return {T::ID, j.dump()};
+    return {T::ID, j.dump(), GetBuiltinAPIEventTypeID(T::ID)};
   }
 
   operator bool() const;
 
+  /// Accepts both binary and v1.3 text packets; see `APIEventView::Parse()`
   static APIEvent Unserialize(std::string_view packet);
+  /** Binary packet, unless the name is too long.
+   *
+   * Older OpenKneeboard versions can't parse these, so this is only for
+   * in-process use and recordings; `Send()` uses `SerializeText()`.
+   */
   std::vector<std::byte> Serialize() const;
+  /// v1.3 text packet, for compatibility with older OpenKneeboard versions
+  std::vector<std::byte> SerializeText() const;
+  /// Sends a v1.3 text packet
   void Send() const;
 
   static const wchar_t* GetMailslotPath();
@@ -100,11 +154,140 @@ struct APIEvent final {
   // to UTF-8
   static constexpr char EVT_OKB_EXECUTABLE_LAUNCHED[] = "OKBExecutableLaunched";
 
+  // Logs `TaskLatencyTracker` statistics; value is ignored. Not a built-in
+  // event, as it's only for troubleshooting.
+  static constexpr char EVT_DUMP_TASK_LATENCY[] = "Debug/DumpTaskLatency";
+
   inline static void Send(const APIEvent& ev) {
     ev.Send();
   }
 };
 
+namespace Detail {
+// Indexed by `APIEventTypeID`
+inline constexpr std::array<std::string_view, 21> BuiltinAPIEventNames {
+  "",
+  APIEvent::EVT_REMOTE_USER_ACTION,
+  APIEvent::EVT_SET_TAB_BY_ID,
+  APIEvent::EVT_SET_TAB_BY_NAME,
+  APIEvent::EVT_SET_TAB_BY_INDEX,
+  APIEvent::EVT_SET_PROFILE_BY_GUID,
+  APIEvent::EVT_SET_PROFILE_BY_NAME,
+  APIEvent::EVT_SET_BRIGHTNESS,
+  APIEvent::EVT_PLUGIN_TAB_CUSTOM_ACTION,
+  APIEvent::EVT_MULTI_EVENT,
+  APIEvent::EVT_OKB_EXECUTABLE_LAUNCHED,
+  // Checked against `DCSWorld::EVT_*` in DCSTab.cpp
+  "dcs/Aircraft",
+  "dcs/InstallPath",
+  "dcs/Mission",
+  "dcs/MissionTime",
+  "dcs/Origin",
+  "dcs/SelfData",
+  "dcs/Message",
+  "dcs/SavedGamesPath",
+  "dcs/SimulationStart",
+  "dcs/Terrain",
+};
+}// namespace Detail
+
+/// Empty if `id` is `Inline`, or unknown
+constexpr std::string_view GetBuiltinAPIEventName(APIEventTypeID id) {
+  const auto index = std::to_underlying(id);
+  if (index >= Detail::BuiltinAPIEventNames.size()) {
+    return {};
+  }
+  return Detail::BuiltinAPIEventNames[index];
+}
+
+/// `Inline` if `name` is not a built-in event
+constexpr APIEventTypeID GetBuiltinAPIEventTypeID(std::string_view name) {
+  for (std::size_t i = 1; i < Detail::BuiltinAPIEventNames.size(); ++i) {
+    if (Detail::BuiltinAPIEventNames[i] == name) {
+      return static_cast<APIEventTypeID>(i);
+    }
+  }
+  return APIEventTypeID::Inline;
+}
+
+/** Dense IDs for event names, for dispatching through a table.
+ *
+ * Built-in events always have their `APIEventTypeID`; other names are given
+ * IDs after the built-in ones when a handler is registered for them. Names
+ * that no handler has asked for are never interned, so arbitrary senders
+ * can't grow the registry.
+ *
+ * This is thread-safe.
+ */
+class APIEventRegistry final {
+ public:
+  /// `Inline` if the registry is full
+  static APIEventTypeID Intern(std::string_view name);
+  /// `Inline` if the name has not been interned
+  static APIEventTypeID Find(std::string_view name);
+  /// One more than the largest ID
+  static std::size_t GetTypeCount();
+
+ private:
+  class Impl;
+};
+
+/** Handlers indexed by event type ID.
+ *
+ * Looking up a handler is an array index, instead of comparing the name with
+ * every event the receiver is interested in.
+ */
+template <class THandler>
+class APIEventHandlerTable final {
+ public:
+  void Add(std::string_view eventName, THandler handler) {
+    const auto index = std::to_underlying(APIEventRegistry::Intern(eventName));
+    if (index == 0) [[unlikely]] {
+      return;
+    }
+    if (index >= mHandlers.size()) {
+      mHandlers.resize(index + 1);
+    }
+    mHandlers[index] = std::move(handler);
+  }
+
+  /// nullptr if there's no handler
+  const THandler* Find(APIEventTypeID id) const noexcept {
+    const auto index = std::to_underlying(id);
+    if (index >= mHandlers.size() || !mHandlers[index]) {
+      return nullptr;
+    }
+    return &*mHandlers[index];
+  }
+
+  bool Contains(APIEventTypeID id) const noexcept {
+    return this->Find(id) != nullptr;
+  }
+
+ private:
+  std::vector<std::optional<THandler>> mHandlers;
+};
+
+/** An API event that refers to a packet, instead of owning its strings.
+ *
+ * Parsing does not allocate, but the view is only valid as long as the
+ * packet buffer.
+ */
+struct APIEventView final {
+  std::string_view name;
+  std::string_view value;
+  APIEventTypeID typeID {APIEventTypeID::Inline};
+
+  operator bool() const;
+  APIEvent ToAPIEvent() const;
+
+  /** Parse a binary or v1.3 text packet.
+   *
+   * Returns an empty view if the packet is invalid.
+   */
+  static APIEventView Parse(std::string_view packet);
+};
+
 struct BaseSetTabEvent {
   // 0 = no change
   uint64_t mPageNumber {0};
@@ -0,0 +1,94 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#pragma once
+
+#include <OpenKneeboard/APIEvent.hpp>
+#include <OpenKneeboard/APIEventTransport.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stop_token>
+#include <string_view>
+#include <vector>
+
+namespace OpenKneeboard {
+
+/** Reads API events from a transport in batches.
+ *
+ * This is the part of `APIEventServer` that doesn't need the UI thread:
+ * after each packet, packets that are already waiting are read too, so that
+ * a burst becomes a single batch. `EVT_MULTI_EVENT` packets are expanded,
+ * and state events are coalesced - see `IsCoalesced()`.
+ */
+class APIEventBatchReader final {
+ public:
+  // Bounds how long we spend reading before anything sees the events
+  static constexpr std::size_t MaxBatchSize = 256;
+
+  struct Statistics {
+    // After expanding `EVT_MULTI_EVENT`
+    uint64_t mReceived {};
+    // Replaced by a later event with the same name in the same batch
+    uint64_t mCoalesced {};
+    // Dropped because they couldn't be parsed
+    uint64_t mInvalid {};
+    uint64_t mBatches {};
+  };
+
+  APIEventBatchReader() = delete;
+  explicit APIEventBatchReader(std::unique_ptr<APIEventReceiver>);
+  ~APIEventBatchReader();
+
+  /// Wait for the next batch; empty if and only if `stop` was requested
+  std::vector<APIEvent> Read(std::stop_token stop);
+
+  /// Thread-safe
+  Statistics GetStatistics() const;
+
+  /** Whether only the most recent event of this type matters.
+   *
+   * If a batch contains multiple events of this type, only the last one is
+   * kept.
+   */
+  static bool IsCoalesced(APIEventTypeID);
+
+  APIEventBatchReader(const APIEventBatchReader&) = delete;
+  APIEventBatchReader(APIEventBatchReader&&) = delete;
+  APIEventBatchReader& operator=(const APIEventBatchReader&) = delete;
+  APIEventBatchReader& operator=(APIEventBatchReader&&) = delete;
+
+ private:
+  std::unique_ptr<APIEventReceiver> mReceiver;
+  std::vector<char> mBuffer;
+
+  struct {
+    std::atomic<uint64_t> mReceived {};
+    std::atomic<uint64_t> mCoalesced {};
+    std::atomic<uint64_t> mInvalid {};
+    std::atomic<uint64_t> mBatches {};
+  } mStatistics;
+
+  // Parse a packet, and append it to the batch
+  void Append(std::vector<APIEvent>& batch, std::string_view packet);
+  void Coalesce(std::vector<APIEvent>& batch);
+};
+
+}// namespace OpenKneeboard
@@ -0,0 +1,95 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#pragma once
+
+#include <OpenKneeboard/APIEvent.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace OpenKneeboard {
+
+/** A compact binary log of timestamped API events, for replaying later.
+ *
+ * The file starts with a `FileHeader`, followed by records; each record is a
+ * `RecordHeader`, then the event as a binary packet - see
+ * `APIEvent::Serialize()`. Built-in event names are stored as IDs.
+ */
+namespace APIEventLog {
+
+using Clock = std::chrono::steady_clock;
+
+struct FileHeader {
+  static constexpr std::array<char, 4> Magic {'O', 'K', 'B', 'L'};
+  static constexpr uint32_t CurrentVersion = 1;
+
+  std::array<char, 4> mMagic {Magic};
+  uint32_t mVersion {CurrentVersion};
+};
+static_assert(sizeof(FileHeader) == 8);
+
+struct RecordHeader {
+  // Since the log was started
+  uint64_t mNanoseconds {};
+  uint32_t mPacketSize {};
+  uint32_t mReserved {};
+};
+static_assert(sizeof(RecordHeader) == 16);
+
+class Writer final {
+ public:
+  Writer() = delete;
+  explicit Writer(const std::filesystem::path&);
+  ~Writer();
+
+  bool IsValid() const noexcept;
+  void Append(const APIEvent&);
+
+  Writer(const Writer&) = delete;
+  Writer(Writer&&) = delete;
+  Writer& operator=(const Writer&) = delete;
+  Writer& operator=(Writer&&) = delete;
+
+ private:
+  std::ofstream mFile;
+  Clock::time_point mStart {Clock::now()};
+};
+
+struct Record {
+  std::chrono::nanoseconds mTime {};
+  // A binary packet; pass to `APIEventView::Parse()`, or send as-is
+  std::vector<std::byte> mPacket;
+};
+
+/** Read every record from a log.
+ *
+ * Empty if the file couldn't be read; stops at the first truncated record,
+ * or one that claims to be larger than `APIEventReceiver::MaxPacketSize`.
+ */
+std::vector<Record> ReadAll(const std::filesystem::path&);
+
+}// namespace APIEventLog
+
+}// namespace OpenKneeboard
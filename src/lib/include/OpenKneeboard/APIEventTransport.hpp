@@ -0,0 +1,90 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <stop_token>
+#include <vector>
+
+namespace OpenKneeboard {
+
+/** How API event packets get from senders to `APIEventServer`.
+ *
+ * Packets have the same semantics with every transport: each packet is
+ * delivered whole or not at all, packets from a single sender arrive in
+ * order, and sending fails quickly if there's no server.
+ *
+ * - `Mailslot`: Windows only; this is what ships, and what third-party
+ *   senders use
+ * - `LocalSocket`: POSIX only; a Unix-domain datagram socket, so that
+ *   remote-control tools and the event pipeline can be load-tested without
+ *   Windows. Unlike mailslots, senders block if the server is not keeping up.
+ */
+enum class APIEventTransportKind {
+  Mailslot,
+  LocalSocket,
+};
+
+/** The transport to use in this process.
+ *
+ * This is the platform's default, unless the
+ * `OPENKNEEBOARD_APIEVENT_TRANSPORT` environment variable is `mailslot` or
+ * `local-socket`.
+ */
+APIEventTransportKind GetAPIEventTransportKind();
+
+class APIEventSender {
+ public:
+  /// nullptr if the transport isn't available on this platform
+  static std::unique_ptr<APIEventSender> Create(APIEventTransportKind);
+  virtual ~APIEventSender();
+
+  /// false if the packet wasn't sent, e.g. if the server isn't running
+  virtual bool Send(std::span<const std::byte> packet) = 0;
+};
+
+class APIEventReceiver {
+ public:
+  /// nullptr if the transport isn't available on this platform, or couldn't
+  /// be created, e.g. if another process is already receiving
+  static std::unique_ptr<APIEventReceiver> Create(APIEventTransportKind);
+  virtual ~APIEventReceiver();
+
+  /// Larger packets are rejected by the transport, so never reach the server
+  static constexpr std::size_t MaxPacketSize = 1024 * 1024;
+
+  enum class Result {
+    Packet,
+    // Only returned by `TryReceive()`
+    NoPacket,
+    Stopped,
+    // A packet may have been lost, but the receiver can still be used
+    Error,
+  };
+
+  /// Wait for a packet, or for `stop` to be requested
+  virtual Result Receive(std::vector<char>& packet, std::stop_token stop) = 0;
+  /// Read a packet if one is already waiting
+  virtual Result TryReceive(std::vector<char>& packet) = 0;
+};
+
+}// namespace OpenKneeboard
@@ -19,15 +19,20 @@
  */
 #pragma once
 
+#ifdef _WIN32
 #include <d3d11.h>
+#endif
 
 #include <algorithm>
 #include <array>
 #include <cmath>
 #include <compare>
 #include <concepts>
+#include <cstdint>
 
+#ifdef _WIN32
 #include <d2d1.h>
+#endif
 
 namespace OpenKneeboard::Geometry2D {
 
@@ -168,6 +173,7 @@ struct Size {
     };
   }
 
+#ifdef _WIN32
   constexpr operator D2D1_SIZE_U() const
     requires std::integral<T>
   {
@@ -177,6 +183,7 @@ struct Size {
   constexpr operator D2D1_SIZE_F() const {
     return StaticCast<FLOAT, D2D1_SIZE_F>();
   }
+#endif
 };
 
 template <class T>
@@ -242,6 +249,7 @@ struct Point {
     };
   }
 
+#ifdef _WIN32
   constexpr operator D2D1_POINT_2F() const noexcept {
     return StaticCast<FLOAT, D2D1_POINT_2F>();
   }
@@ -251,6 +259,7 @@ struct Point {
   {
     return StaticCast<UINT32, D2D1_POINT_2U>();
   }
+#endif
 };
 
 template <class T>
@@ -397,6 +406,7 @@ struct Rect {
     };
   }
 
+#ifdef _WIN32
   constexpr operator D3D11_RECT() const
     requires std::integral<T>
   {
@@ -412,6 +422,7 @@ struct Rect {
   constexpr operator D2D1_RECT_F() const {
     return StaticCastWithBottomRight<FLOAT, D2D1_RECT_F>();
   }
+#endif
 };
 
 }// namespace OpenKneeboard::Geometry2D
\ No newline at end of file
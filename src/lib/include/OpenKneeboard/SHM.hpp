@@ -24,12 +24,17 @@
 
 #include <OpenKneeboard/Pixels.hpp>
 
+#include <OpenKneeboard/config.hpp>
+
 #include <OpenKneeboard/dprint.hpp>
+#include <OpenKneeboard/task.hpp>
 
 #include <shims/winrt/base.h>
 
 #include <Windows.h>
 
+#include <bitset>
+#include <chrono>
 #include <concepts>
 #include <cstddef>
 #include <cstdint>
@@ -37,12 +42,14 @@
 #include <memory>
 #include <numbers>
 #include <optional>
+#include <stop_token>
 #include <string>
 #include <vector>
 
 namespace OpenKneeboard::SHM {
 
 namespace Detail {
+struct Frame;
 struct FrameMetadata;
 
 struct DeviceResources;
@@ -110,6 +117,10 @@ class IPCTextureCopier {
     HANDLE fence,
     uint64_t fenceValueIn) noexcept
     = 0;
+
+  /// Whether the GPU has finished the most recent `Copy()` to the texture
+  /// with this swapchain index
+  virtual bool IsCopyComplete(uint8_t swapchainIndex) noexcept = 0;
 };
 
 // This needs to be kept in sync with `SHM::ActiveConsumers`
@@ -152,8 +163,58 @@ struct LayerConfig final {
   SHM::VRLayer mVR {};
   bool mNonVREnabled {false};
   SHM::NonVRLayer mNonVR {};
+
+  /** Frame number of the last frame that changed this layer.
+   *
+   * Set by `Writer::SubmitFrame()`; feeders should leave this alone, and
+   * instead set `mDirtyRect`.
+   */
+  uint64_t mContentGeneration {};
+  /** The area of the texture that changed for this layer in this frame.
+   *
+   * Feeders should set this to the layer's location on the texture if the
+   * layer's pixels changed, or leave it empty if they're unchanged. If
+   * anything other than the pixels changes - e.g. layout, or which layers are
+   * present - the writer marks the entire layer as dirty.
+   */
+  PixelRect mDirtyRect {};
 };
 static_assert(std::is_standard_layout_v<LayerConfig>);
+// Shared between 32-bit and 64-bit processes; bump `SHMLayoutVersion` if
+// these change
+static_assert(sizeof(LayerConfig) == 160);
+static_assert(alignof(LayerConfig) == 8);
+static_assert(offsetof(LayerConfig, mVR) == 12);
+static_assert(offsetof(LayerConfig, mNonVREnabled) == 88);
+static_assert(offsetof(LayerConfig, mNonVR) == 92);
+static_assert(offsetof(LayerConfig, mContentGeneration) == 128);
+static_assert(offsetof(LayerConfig, mDirtyRect) == 136);
+
+/** Sizes and offsets of the shared memory layout.
+ *
+ * 32-bit and 64-bit processes share the mapping, so this must be identical in
+ * both; readers ignore feeders with a different layout. Use
+ * `shm-layout-check` to compare builds.
+ */
+struct LayoutInfo final {
+  uint32_t mVersion {};
+  uint32_t mMappingSize {};
+  uint32_t mFrameMetadataSize {};
+  uint32_t mConfigOffset {};
+  uint32_t mConfigSize {};
+  uint32_t mLayerCountOffset {};
+  uint32_t mFeederProcessIDOffset {};
+  uint32_t mLayerTableOffset {};
+  uint32_t mLayerTableCapacity {};
+  uint32_t mLayerConfigSize {};
+
+  bool operator==(const LayoutInfo&) const noexcept = default;
+};
+static_assert(std::is_standard_layout_v<LayoutInfo>);
+static_assert(sizeof(LayoutInfo) == 40);
+
+/// The layout used by this build
+LayoutInfo GetLayoutInfo() noexcept;
 
 enum class WriterState;
 
@@ -174,13 +235,30 @@ class Writer final {
 
   void SubmitEmptyFrame();
 
-  NextFrameInfo BeginFrame() noexcept;
+  /** Pick a texture for the next frame.
+   *
+   * `beginRenderTime` is when the feeder started rendering the frame, for
+   * latency telemetry; see `SHM::ConsumerLatency`.
+   */
+  NextFrameInfo BeginFrame(
+    std::chrono::steady_clock::time_point beginRenderTime
+    = std::chrono::steady_clock::now()) noexcept;
   void SubmitFrame(
     const Config& config,
     const std::vector<LayerConfig>& layers,
     HANDLE texture,
     HANDLE fence);
 
+  /** Record when the GPU signalled `NextFrameInfo::mFenceOut`.
+   *
+   * Unlike the other methods, this does not need the lock, and may be called
+   * from any thread.
+   */
+  void SetFrameReadyTime(
+    uint8_t textureIndex,
+    LONG64 fenceValue,
+    std::chrono::steady_clock::time_point) noexcept;
+
   // "Lockable" C++ named concept: supports std::unique_lock
   void lock();
   bool try_lock();
@@ -216,11 +294,11 @@ class Snapshot final {
   Snapshot(ipc_handle_error_t);
 
   Snapshot(
-    Detail::FrameMetadata*,
+    const std::shared_ptr<Detail::Frame>&,
     IPCTextureCopier* copier,
     Detail::IPCHandles* source,
     const std::shared_ptr<IPCClientTexture>& dest);
-  Snapshot(Detail::FrameMetadata*);
+  Snapshot(const std::shared_ptr<Detail::Frame>&);
   ~Snapshot();
 
   uint64_t GetSessionID() const;
@@ -230,6 +308,20 @@ class Snapshot final {
   uint8_t GetLayerCount() const;
   const LayerConfig* GetLayerConfig(uint8_t layerIndex) const;
 
+  /** Changes whenever the specified layer changes.
+   *
+   * This is the same as the `GetRenderCacheKey()` of the frame that last
+   * changed the layer.
+   */
+  uint64_t GetLayerRenderCacheKey(uint8_t layerIndex) const;
+  /** Which layers have changed since the frame with the given cache key.
+   *
+   * If the cache key is too old, or from another session, all layers are
+   * considered changed.
+   */
+  std::bitset<MaxViewCount> GetLayersChangedSince(
+    uint64_t renderCacheKey) const;
+
   template <std::derived_from<IPCClientTexture> T>
   T* GetTexture() const {
     if (mState != State::ValidWithTexture) [[unlikely]] {
@@ -260,7 +352,7 @@ class Snapshot final {
   Snapshot() = delete;
 
  private:
-  std::shared_ptr<Detail::FrameMetadata> mHeader;
+  std::shared_ptr<Detail::Frame> mFrame;
   std::shared_ptr<IPCClientTexture> mIPCTexture;
 
   State mState;
@@ -288,8 +380,37 @@ class Reader {
 
   uint64_t GetSessionID() const;
 
- protected:
+  /** The layout published by the feeder, even if it's incompatible.
+   *
+   * Returns `std::nullopt` if there is no feeder.
+   */
+  std::optional<LayoutInfo> GetFeederLayoutInfo() const;
+
+  /** Wait until the render cache key is different to `lastRenderCacheKey`.
+   *
+   * The feeder wakes waiting readers whenever it publishes a frame; in case a
+   * wakeup is missed, this also re-checks every few tens of milliseconds.
+   * Returns false if the timeout expired first.
+   *
+   * Unlike `GetRenderCacheKey()`, this does not mark the consumer as active.
+   */
+  bool WaitForFrame(
+    uint64_t lastRenderCacheKey,
+    std::chrono::milliseconds timeout) const;
+  /** Wait until the render cache key is different to `lastRenderCacheKey`.
+   *
+   * Returns false if cancelled.
+   */
+  task<bool> WaitForFrame(uint64_t lastRenderCacheKey, std::stop_token) const;
+
+  /** Fetch a metadata-only snapshot without waiting for the feeder.
+   *
+   * This does not take the SHM lock; if the feeder is mid-update, the read is
+   * retried instead.
+   */
   Snapshot MaybeGetUncached(ConsumerKind);
+
+ protected:
   Snapshot MaybeGetUncached(
     uint64_t gpuLUID,
     IPCTextureCopier* copier,
@@ -330,11 +451,21 @@ class CachedReader : public Reader {
 
   std::vector<std::shared_ptr<IPCClientTexture>> mClientTextures;
 
+  // Copies from the feeder's textures that the GPU may not have finished yet
+  struct PendingCopy {
+    uint8_t mSwapchainIndex {};
+    uint8_t mFeederTextureIndex {};
+  };
+  std::vector<PendingCopy> mPendingCopies;
+
   std::shared_ptr<IPCClientTexture> GetIPCClientTexture(
     const PixelSize&,
     uint8_t swapchainIndex) noexcept;
 
   void UpdateSession();
+  void RecordLatency(const Detail::FrameMetadata&);
+  void ReleaseCompletedCopies();
+  void ReleaseAllCopies();
 };
 
 }// namespace OpenKneeboard::SHM
@@ -0,0 +1,77 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#pragma once
+
+#include <OpenKneeboard/SHM/ConsumerLatency.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+namespace OpenKneeboard {
+enum class APIEventTypeID : uint16_t;
+}
+
+namespace OpenKneeboard::SHM {
+
+/** How long the app takes to process API events.
+ *
+ * This is recorded by `KneeboardState`; like `SHM::ConsumerLatency`, it lives
+ * in its own shared memory, so that `apievent-replay` can report on it while
+ * the app is running.
+ */
+struct APIEventMetrics final {
+  using Clock = std::chrono::steady_clock;
+  using Histogram = ConsumerLatency::Histogram;
+
+  struct HandlerCost final {
+    uint64_t mCount {};
+    uint64_t mTotalNanoseconds {};
+    uint64_t mMaxNanoseconds {};
+  };
+
+  // From being queued by `KneeboardState::OnAPIEvent()`, until its handler
+  // completes
+  Histogram mProcessingLatency {};
+
+  // Queue lengths when `KneeboardState::FlushOrderedEventQueue()` starts
+  uint64_t mFlushCount {};
+  uint64_t mTotalBacklog {};
+  uint64_t mMaxBacklog {};
+
+  // Indexed by `APIEventTypeID`; this must be at least
+  // `Detail::BuiltinAPIEventNames.size()`. Events without a built-in ID should
+  // be recorded as `APIEventTypeID::Inline`.
+  static constexpr std::size_t HandlerCostSlots = 32;
+  std::array<HandlerCost, HandlerCostSlots> mHandlerCosts {};
+
+  static void Clear();
+  static APIEventMetrics Get();
+
+  static void RecordProcessingLatency(Clock::duration);
+  static void RecordBacklog(std::size_t queueLength);
+  static void RecordHandlerCost(APIEventTypeID, Clock::duration);
+
+ private:
+  class Impl;
+};
+static_assert(std::is_standard_layout_v<APIEventMetrics>);
+
+}// namespace OpenKneeboard::SHM
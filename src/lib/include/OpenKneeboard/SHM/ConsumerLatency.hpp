@@ -0,0 +1,77 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#pragma once
+
+#include <OpenKneeboard/SHM.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+namespace OpenKneeboard::SHM {
+
+/** How old frames are when each kind of consumer first reads them.
+ *
+ * The age is measured from when the feeder started rendering the frame;
+ * it's recorded by `CachedReader::MaybeGet()`.
+ *
+ * This lives in its own shared memory, alongside `SHM::ActiveConsumers`, so
+ * that it outlives individual consumers, and can be read by the app or
+ * `shm-latency` while a game is running.
+ */
+struct ConsumerLatency final {
+  using Clock = std::chrono::steady_clock;
+
+  struct Histogram final {
+    static constexpr std::chrono::microseconds BucketWidth {250};
+    // 0-100ms; anything slower goes in the last bucket
+    static constexpr std::size_t BucketCount = 400;
+
+    std::array<uint32_t, BucketCount> mBuckets {};
+
+    void Record(Clock::duration age) noexcept;
+
+    uint64_t GetSampleCount() const noexcept;
+    /** The upper bound of the bucket containing the percentile.
+     *
+     * `percentile` is between 0 and 1; returns 0 if there are no samples.
+     */
+    std::chrono::microseconds GetPercentile(double percentile) const noexcept;
+  };
+
+  // This should be kept in sync with `SHM::ConsumerKind`.
+  Histogram mSteamVR {};
+  Histogram mOpenXR {};
+  Histogram mOculusD3D11 {};
+  Histogram mNonVRD3D11 {};
+  Histogram mViewer {};
+
+  const Histogram& Get(ConsumerKind) const;
+
+  static void Clear();
+  static ConsumerLatency Get();
+  static void Record(ConsumerKind, Clock::duration age);
+
+ private:
+  class Impl;
+};
+static_assert(std::is_standard_layout_v<ConsumerLatency>);
+
+}// namespace OpenKneeboard::SHM
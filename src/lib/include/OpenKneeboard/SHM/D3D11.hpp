@@ -69,6 +69,7 @@ class CachedReader : public SHM::CachedReader, protected SHM::IPCTextureCopier {
     IPCClientTexture* destinationTexture,
     HANDLE fence,
     uint64_t fenceValueIn) noexcept override;
+  virtual bool IsCopyComplete(uint8_t swapchainIndex) noexcept override;
 
   virtual std::shared_ptr<SHM::IPCClientTexture> CreateIPCClientTexture(
     const PixelSize&,
@@ -93,6 +94,8 @@ class CachedReader : public SHM::CachedReader, protected SHM::IPCTextureCopier {
   std::unordered_map<HANDLE, FenceAndValue> mIPCFences;
   std::unordered_map<HANDLE, winrt::com_ptr<ID3D11Texture2D>> mIPCTextures;
   FenceAndValue mCopyFence;
+  // Swapchain index => `mCopyFence` value
+  std::unordered_map<uint8_t, uint64_t> mCopyFenceValues;
 
   FenceAndValue* GetIPCFence(HANDLE) noexcept;
   ID3D11Texture2D* GetIPCTexture(HANDLE) noexcept;
@@ -102,6 +102,7 @@ class CachedReader : public SHM::CachedReader, protected SHM::IPCTextureCopier {
     IPCClientTexture* destinationTexture,
     HANDLE fenceIn,
     uint64_t fenceInValue) noexcept override;
+  virtual bool IsCopyComplete(uint8_t swapchainIndex) noexcept override;
 
   virtual std::shared_ptr<SHM::IPCClientTexture> CreateIPCClientTexture(
     const PixelSize&,
@@ -135,6 +136,8 @@ class CachedReader : public SHM::CachedReader, protected SHM::IPCTextureCopier {
   std::unordered_map<HANDLE, FenceAndValue> mIPCFences;
   std::unordered_map<HANDLE, winrt::com_ptr<ID3D12Resource>> mIPCTextures;
   FenceAndValue mCopyFence;
+  // Swapchain index => `mCopyFence` value
+  std::unordered_map<uint8_t, uint64_t> mCopyFenceValues;
 
   FenceAndValue* GetIPCFence(HANDLE) noexcept;
   ID3D12Resource* GetIPCTexture(HANDLE) noexcept;
@@ -0,0 +1,146 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+namespace OpenKneeboard::SHM {
+
+/** The state of a texture in the SHM swapchain, as seen by the feeder.
+ *
+ * This is separate from `SHM::Writer` so that the scheduling can be
+ * exercised without a GPU; see `shm-swapchain-simulation`.
+ */
+struct SwapchainSlot final {
+  /// The frame that was most recently written to this slot
+  uint64_t mFrameNumber {};
+  /// Copies from this slot that consumers have submitted, but their GPU
+  /// hasn't finished yet
+  uint32_t mPendingCopies {};
+
+  /** Whether the feeder can write to this slot without racing a consumer.
+   *
+   * Frames that were replaced before any consumer read them are consumed
+   * too: consumers only ever read the latest frame.
+   */
+  constexpr bool IsConsumed() const noexcept {
+    return mPendingCopies == 0;
+  }
+};
+
+namespace Detail {
+template <bool ConsumedOnly>
+constexpr std::optional<uint8_t> FindOldestSlot(
+  std::span<const SwapchainSlot> slots,
+  uint8_t currentSlot) noexcept {
+  std::optional<uint8_t> ret;
+  for (uint8_t i = 0; i < slots.size(); ++i) {
+    // Consumers may still be about to read the latest frame
+    if (i == currentSlot) {
+      continue;
+    }
+    if (ConsumedOnly && !slots[i].IsConsumed()) {
+      continue;
+    }
+    if (ret && slots[*ret].mFrameNumber <= slots[i].mFrameNumber) {
+      continue;
+    }
+    ret = i;
+  }
+  return ret;
+}
+}// namespace Detail
+
+/** The least-recently-written slot that no consumer is still copying.
+ *
+ * Returns `std::nullopt` if consumers are still copying from every slot
+ * other than the current one.
+ */
+constexpr std::optional<uint8_t> FindOldestConsumedSlot(
+  std::span<const SwapchainSlot> slots,
+  uint8_t currentSlot) noexcept {
+  return Detail::FindOldestSlot<true>(slots, currentSlot);
+}
+
+/// The least-recently-written slot, whether or not it's been consumed
+constexpr std::optional<uint8_t> FindOldestSlot(
+  std::span<const SwapchainSlot> slots,
+  uint8_t currentSlot) noexcept {
+  return Detail::FindOldestSlot<false>(slots, currentSlot);
+}
+
+enum class SlotChoiceKind {
+  /// No consumer is copying the slot
+  Consumed,
+  /// Consumers are copying every other slot, so the swapchain grows
+  Grow,
+  /** Consumers are copying every other slot, and the swapchain can't grow.
+   *
+   * The consumers' copies from this slot will be torn.
+   */
+  OverwritingPendingCopy,
+};
+
+struct SlotChoice final {
+  uint8_t mSlot {};
+  SlotChoiceKind mKind {};
+};
+
+/** Where the feeder should write its next frame.
+ *
+ * This prefers the oldest consumed slot; if there isn't one, the swapchain
+ * grows until it's `slots.size()` long, then the oldest slot is overwritten
+ * even though it's still being copied.
+ *
+ * @param slots every slot the swapchain could grow to use
+ * @param length how many slots are currently in use
+ */
+constexpr SlotChoice ChooseSlot(
+  std::span<const SwapchainSlot> slots,
+  uint8_t length,
+  uint8_t currentSlot) noexcept {
+  const auto active = slots.first(length);
+  if (const auto consumed = FindOldestConsumedSlot(active, currentSlot)) {
+    return {*consumed, SlotChoiceKind::Consumed};
+  }
+  if (length < slots.size()) {
+    return {length, SlotChoiceKind::Grow};
+  }
+  return {
+    FindOldestSlot(active, currentSlot).value_or(0),
+    SlotChoiceKind::OverwritingPendingCopy,
+  };
+}
+
+/** How long a slot can go without being seen with no pending copies, before
+ * the feeder assumes the copies were abandoned and resets the count.
+ *
+ * Copies take milliseconds. If a consumer crashes between starting a copy and
+ * noticing that it finished, nothing else would ever decrement the count, and
+ * the slot would only be reused by overwriting it.
+ *
+ * The current slot is never reclaimed, as consumers may be about to copy it.
+ */
+constexpr std::chrono::seconds AbandonedCopyTimeout {1};
+
+}// namespace OpenKneeboard::SHM
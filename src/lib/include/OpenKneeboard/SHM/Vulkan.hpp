@@ -135,6 +135,7 @@ class CachedReader : public SHM::CachedReader, protected SHM::IPCTextureCopier {
     IPCClientTexture* destinationTexture,
     HANDLE fence,
     uint64_t fenceValueIn) noexcept override;
+  virtual bool IsCopyComplete(uint8_t swapchainIndex) noexcept override;
 
   virtual std::shared_ptr<SHM::IPCClientTexture> CreateIPCClientTexture(
     const PixelSize&,
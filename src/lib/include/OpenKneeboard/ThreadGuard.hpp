@@ -21,9 +21,13 @@
 
 #include <source_location>
 
+#ifdef _WIN32
 #include <Windows.h>
 
 #include <processthreadsapi.h>
+#else
+#include <thread>
+#endif
 
 namespace OpenKneeboard {
 
@@ -37,7 +41,11 @@ class ThreadGuard final {
     const std::source_location& loc = std::source_location::current()) const;
 
  private:
+#ifdef _WIN32
   DWORD mThreadID;
+#else
+  std::thread::id mThreadID;
+#endif
   std::source_location mLocation;
 };
 
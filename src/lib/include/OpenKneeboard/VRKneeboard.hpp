@@ -41,6 +41,7 @@ class VRKneeboard {
   struct RenderParameters {
     Pose mKneeboardPose;
     Vector2 mKneeboardSize;
+    /// Changes if this layer needs to be re-rendered
     uint64_t mCacheKey;
     float mKneeboardOpacity;
     bool mIsLookingAtKneeboard;
@@ -57,7 +58,7 @@ class VRKneeboard {
  private:
   RenderParameters GetRenderParameters(
     const SHM::Snapshot&,
-    const SHM::LayerConfig&,
+    uint8_t layerIndex,
     const Pose& hmdPose);
 
   struct Sizes {
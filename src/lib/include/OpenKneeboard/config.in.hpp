@@ -26,7 +26,11 @@
 
 #include <string>
 
+#ifdef _WIN32
 #include <intrin.h>
+#else
+#define _ReturnAddress() __builtin_return_address(0)
+#endif
 
 namespace OpenKneeboard::inline Config {
 
@@ -34,10 +38,13 @@ constexpr auto BuildBitness = sizeof(void*) * 8;
 constexpr bool Is32BitBuild = (BuildBitness == 32);
 constexpr bool Is64BitBuild = (BuildBitness == 64);
 
-// As we lock the entire SHM segment before touching the texture, buffering
-// isn't needed; that said, keep a buffer anyway, as seeing frame counters
-// go backwards is a very easy way to diagnose issues :)
-constexpr unsigned int SHMSwapchainLength = 2;
+// Consumers copy the SHM texture on their own GPU queue, which may finish
+// well after they release the SHM lock; the feeder starts with the minimum
+// length, and adds textures if consumers are still reading all the others.
+//
+// See `SHM::FindOldestConsumedSlot()`
+constexpr unsigned int MinSHMSwapchainLength = 2;
+constexpr unsigned int MaxSHMSwapchainLength = 4;
 constexpr PixelSize MaxViewRenderSize {2048, 2048};
 constexpr unsigned char MaxViewCount = 16;
 constexpr unsigned int FramesPerSecond = 90;
@@ -83,8 +90,10 @@ constexpr const wchar_t FixedWidthContentFont[] {L"Consolas"};
 
 }// namespace OpenKneeboard::inline Config
 
-#ifdef DEBUG
+#if defined(DEBUG) && defined(_WIN32)
 #define OPENKNEEBOARD_BREAK __debugbreak()
+#elif defined(DEBUG)
+#define OPENKNEEBOARD_BREAK __builtin_trap()
 #else
 #define OPENKNEEBOARD_BREAK
 #endif
@@ -23,7 +23,9 @@
 #include <OpenKneeboard/fatal.hpp>
 #include <OpenKneeboard/tracing.hpp>
 
+#ifdef _WIN32
 #include <shims/winrt/base.h>
+#endif
 
 #include <format>
 #include <functional>
@@ -82,11 +84,13 @@ class DebugPrinter {
         case BreakWhen::Never:
           break;
         case BreakWhen::Always:
+#ifdef _WIN32
           if (IsDebuggerPresent()) {
             __debugbreak();
-          } else {
-            OPENKNEEBOARD_BREAK;
+            break;
           }
+#endif
+          OPENKNEEBOARD_BREAK;
           break;
         case BreakWhen::DebugBuilds:
           OPENKNEEBOARD_BREAK;
@@ -240,6 +244,7 @@ struct DPrintSettings {
   static void Set(const DPrintSettings&);
 };
 
+#ifdef _WIN32
 /**  If you change this structure, you *MUST* also change the version
  * in `GetDPrintResourceName()`.
  *
@@ -296,4 +301,6 @@ class DPrintReceiver {
   bool mUsable = false;
 };
 
+#endif
+
 }// namespace OpenKneeboard
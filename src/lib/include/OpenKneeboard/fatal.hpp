@@ -21,6 +21,10 @@
 
 #include <OpenKneeboard/config.hpp>
 
+#ifndef _WIN32
+#include <execinfo.h>
+#endif
+
 #include <concepts>
 #include <exception>
 #include <format>
@@ -29,8 +33,11 @@
 #include <stacktrace>
 #include <string>
 #include <variant>
+#include <vector>
 
+#ifdef _WIN32
 typedef LONG HRESULT;
+#endif
 
 namespace std {
 struct source_location;
@@ -71,12 +78,22 @@ struct StackFramePointer {
     if (skip == 0) {
       return StackFramePointer {_ReturnAddress()};
     } else {
+#ifdef _WIN32
       void* ptr {nullptr};
       while (!CaptureStackBackTrace(skip + 1, 1, &ptr, nullptr)) {
         // retry. Undocumented reliability issues:
         // https://github.com/microsoft/STL/issues/3889
       }
       return StackFramePointer {ptr};
+#else
+      // Unlike `CaptureStackBackTrace()`, `backtrace()` can't skip frames
+      std::vector<void*> frames(skip + 2, nullptr);
+      const auto count = backtrace(frames.data(), frames.size());
+      if (count < static_cast<int>(frames.size())) {
+        return nullptr;
+      }
+      return StackFramePointer {frames.back()};
+#endif
     }
   }
 
@@ -133,9 +150,11 @@ struct FatalData {
 };
 
 inline void break_if_debugger_present() {
+#ifdef _WIN32
   if (IsDebuggerPresent()) {
     __debugbreak();
   }
+#endif
 }
 
 inline void prepare_to_fatal() {
@@ -175,7 +194,9 @@ void fatal(
     .fatal();
 }
 
+#ifdef _WIN32
 void fatal_with_hresult(HRESULT);
+#endif
 void fatal_with_exception(std::exception_ptr);
 
 /// Hook std::terminate() and SetUnhandledExceptionFilter()
@@ -20,7 +20,10 @@
 #pragma once
 
 #include <shims/nlohmann/json_fwd.hpp>
+
+#ifdef _WIN32
 #include <shims/winrt/base.h>
+#endif
 
 namespace OpenKneeboard {
 template <class T>
@@ -40,6 +43,7 @@ void to_json_with_default(nlohmann::json& j, const T& parent_v, const T& v);
   void from_json(const nlohmann::json& nlohmann_json_j, T& nlohmann_json_v); \
   void to_json(nlohmann::json& nlohmann_json_j, const T& nlohmann_json_v);
 
+#ifdef _WIN32
 namespace nlohmann {
 template <>
 struct adl_serializer<winrt::guid> {
@@ -47,4 +51,5 @@ struct adl_serializer<winrt::guid> {
   static void from_json(const json&, winrt::guid&);
 };
 
-}// namespace nlohmann
\ No newline at end of file
+}// namespace nlohmann
+#endif
\ No newline at end of file
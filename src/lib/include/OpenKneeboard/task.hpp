@@ -26,14 +26,19 @@
 #include <OpenKneeboard/format/enum.hpp>
 #include <OpenKneeboard/tracing.hpp>
 
-#include <shims/winrt/base.h>
+#include <OpenKneeboard/task/executor.hpp>
+#include <OpenKneeboard/task/frame_allocator.hpp>
+#include <OpenKneeboard/task/latency.hpp>
 
-#include <combaseapi.h>
-#include <ctxtcall.h>
+#ifdef _WIN32
+#include <shims/winrt/base.h>
+#endif
 
 #include <atomic>
 #include <coroutine>
 #include <memory>
+#include <source_location>
+#include <thread>
 
 namespace OpenKneeboard::detail {
 
@@ -71,7 +76,7 @@ union TaskPromiseWaiting {
 static_assert(sizeof(TaskPromiseWaiting) == sizeof(TaskPromiseState));
 static_assert(sizeof(TaskPromiseWaiting) == sizeof(std::coroutine_handle<>));
 
-constexpr auto to_string(TaskPromiseWaiting value) {
+inline auto to_string(TaskPromiseWaiting value) {
   if (magic_enum::enum_contains(value.mState)) {
     return std::format("{}", value.mState);
   }
@@ -90,16 +95,14 @@ constexpr bool operator==(TaskPromiseWaiting a, TaskPromiseWaiting b) noexcept {
   return a.mNext == b.mNext;
 }
 
+template <task_executor TExecutor>
 struct TaskContext {
-  winrt::com_ptr<IContextCallback> mCOMCallback;
   std::thread::id mThreadID = std::this_thread::get_id();
   StackFramePointer mCaller {nullptr};
+  TExecutor mExecutor;
 
-  inline TaskContext(StackFramePointer&& caller) : mCaller(std::move(caller)) {
-    if (!SUCCEEDED(CoGetObjectContext(IID_PPV_ARGS(mCOMCallback.put()))))
-      [[unlikely]] {
-      this->fatal("Attempted to create a task<> from thread without COM");
-    }
+  inline TaskContext(StackFramePointer&& caller)
+    : mCaller(std::move(caller)), mExecutor(this->GetCurrentExecutor()) {
   }
 
   template <class... Ts>
@@ -114,6 +117,15 @@ struct TaskContext {
       mThreadID,
       std::this_thread::get_id());
   }
+
+ private:
+  TExecutor GetCurrentExecutor() const noexcept {
+    if (auto executor = TExecutor::GetCurrent()) [[likely]] {
+      return std::move(*executor);
+    }
+    this->fatal(
+      "Attempted to create a task<> from thread without {}", TExecutor::Name);
+  }
 };
 
 template <class TTraits>
@@ -145,6 +157,7 @@ struct TaskTraits {
   static constexpr auto CompletionThread = TaskCompletionThread::OriginalThread;
 
   using result_type = TResult;
+  using executor_type = DefaultTaskExecutor;
 };
 
 struct FireAndForgetTraits {
@@ -153,6 +166,7 @@ struct FireAndForgetTraits {
   static constexpr auto CompletionThread = TaskCompletionThread::AnyThread;
 
   using result_type = void;
+  using executor_type = DefaultTaskExecutor;
 };
 
 /// Sentinel marker type handled by await_transform
@@ -204,95 +218,18 @@ struct TaskFinalAwaiter {
       oldState.mNext.resume();
       return;
     }
-    const auto& context = mPromise.mContext;
-    if (context.mThreadID == std::this_thread::get_id()) {
+    const auto& executor = mPromise.mContext.mExecutor;
+    if (executor.IsCurrentThread()) {
       oldState.mNext.resume();
       return;
     }
-
-    auto resumeData = new ResumeData {
-      .mContext = context,
-      .mCoro = oldState.mNext,
-    };
-    const auto threadPoolSuccess = TrySubmitThreadpoolCallback(
-      &TaskFinalAwaiter<TTraits>::resume_on_thread_pool, resumeData, nullptr);
-    if (threadPoolSuccess) [[likely]] {
-      return;
-    }
-    const auto threadPoolError = GetLastError();
-    delete resumeData;
-    context.fatal(
-      "Failed to enqueue resumption on thread pool: {:010x}",
-      static_cast<uint32_t>(threadPoolError));
+    // This may resume `oldState.mNext` before returning, which may destroy
+    // `mPromise`; that's fine, as we don't touch it again.
+    executor.Post(oldState.mNext, mPromise.mContext.mCaller);
   }
 
   void await_resume() const noexcept {
   }
-
- private:
-  struct ResumeData {
-    TaskContext mContext;
-    std::coroutine_handle<> mCoro;
-  };
-
-  static void resume_on_thread_pool(
-    PTP_CALLBACK_INSTANCE,
-    void* userData) noexcept {
-    std::unique_ptr<ResumeData> resumeData {
-      reinterpret_cast<ResumeData*>(userData)};
-
-    ComCallData comData {.pUserDefined = resumeData.get()};
-    const auto result = resumeData->mContext.mCOMCallback->ContextCallback(
-      &TaskFinalAwaiter<TTraits>::resume_from_thread_pool,
-      &comData,
-      IID_ICallbackWithNoReentrancyToApplicationSTA,
-      5,
-      NULL);
-    if (SUCCEEDED(result)) [[likely]] {
-      return;
-    }
-    resumeData->mContext.fatal(
-      "Failed to enqueue coroutine resumption for the desired thread: "
-      "{:#010x}",
-      static_cast<uint32_t>(result));
-  }
-
-  static HRESULT resume_from_thread_pool(ComCallData* comData) noexcept {
-    TraceLoggingWrite(
-      gTraceProvider,
-      "TaskFinalAwaiter<>::resume_from_thread_pool()",
-      TraceLoggingKeyword(
-        std::to_underlying(TraceLoggingEventKeywords::TaskCoro)),
-      TraceLoggingPointer(comData, "ComData"));
-
-    const auto& resumeData
-      = *reinterpret_cast<ResumeData*>(comData->pUserDefined);
-    const auto& context = resumeData.mContext;
-
-    TraceLoggingWrite(
-      gTraceProvider,
-      "TaskFinalAwaiter<>::resume_from_thread_pool()/ResumeCoro",
-      TraceLoggingKeyword(
-        std::to_underlying(TraceLoggingEventKeywords::TaskCoro)),
-      TraceLoggingPointer(comData, "ComData"),
-      TraceLoggingCodePointer(context.mCaller.mValue, "Caller"));
-
-    try {
-      resumeData.mCoro.resume();
-    } catch (...) {
-      dprint.Warning("std::coroutine_handle<>::resume() threw an exception");
-      fatal_with_exception(std::current_exception());
-    }
-
-    TraceLoggingWrite(
-      gTraceProvider,
-      "TaskFinalAwaiter<>::resume_from_thread_pool()/CoroComplete",
-      TraceLoggingKeyword(
-        std::to_underlying(TraceLoggingEventKeywords::TaskCoro)),
-      TraceLoggingPointer(comData, "ComData"),
-      TraceLoggingCodePointer(context.mCaller.mValue, "Caller"));
-    return S_OK;
-  }
 };
 
 template <class TTraits>
@@ -323,9 +260,14 @@ struct TaskPromiseBase {
 
   std::atomic<TaskPromiseWaiting> mWaiting {TaskPromiseRunning};
 
-  TaskContext mContext;
+  using context_type = TaskContext<typename TTraits::executor_type>;
+  context_type mContext;
   TaskExceptionBehavior mOnException = TTraits::OnException;
 
+  // Does nothing unless `TaskLatencyTracing` is enabled
+  OPENKNEEBOARD_NO_UNIQUE_ADDRESS
+  TaskLatencyRecord<> mLatency;
+
   TaskPromiseBase() = delete;
   TaskPromiseBase(const TaskPromiseBase<TTraits>&) = delete;
   TaskPromiseBase<TTraits>& operator=(const TaskPromiseBase<TTraits>&) = delete;
@@ -333,8 +275,19 @@ struct TaskPromiseBase {
   TaskPromiseBase(TaskPromiseBase<TTraits>&&) = delete;
   TaskPromiseBase<TTraits>& operator=(TaskPromiseBase<TTraits>&&) = delete;
 
-  TaskPromiseBase(TaskContext&& context) noexcept
-    : mContext(std::move(context)) {
+  // Coroutine frames - which include the promise - come from here
+  static void* operator new(std::size_t size) {
+    return TaskFrameAllocator::Allocate(size);
+  }
+
+  static void operator delete(void* p, std::size_t size) noexcept {
+    TaskFrameAllocator::Deallocate(p, size);
+  }
+
+  TaskPromiseBase(
+    context_type&& context,
+    const std::source_location& location) noexcept
+    : mContext(std::move(context)), mLatency(location) {
     TraceLoggingWrite(
       gTraceProvider,
       "TaskPromiseBase<>::TaskPromiseBase()",
@@ -372,7 +325,7 @@ struct TaskPromiseBase {
     if (mOnException == TaskExceptionBehavior::StoreAndRethrow) [[likely]] {
       mUncaught = std::current_exception();
       mUncaughtStack = StackTrace::GetForMostRecentException();
-      mResultState.Transition<NoResult, HaveException>();
+      mResultState.template Transition<NoResult, HaveException>();
     } else {
       OPENKNEEBOARD_ASSERT(mOnException == TaskExceptionBehavior::Terminate);
       fatal_with_exception(std::current_exception());
@@ -426,12 +379,21 @@ struct TaskPromiseBase {
         std::format("{}", mResultState.Get(std::memory_order_relaxed)).c_str(),
         "ResultState"),
       TraceLoggingValue(std::uncaught_exceptions(), "UncaughtExceptions"));
+    mLatency.OnComplete();
     return {*this};
   }
 
   template <class TAwaitable>
-  TAwaitable&& await_transform(TAwaitable&& it) noexcept {
-    return static_cast<TAwaitable&&>(it);
+  decltype(auto) await_transform(TAwaitable&& it) noexcept(
+    !TaskLatencyTracing) {
+    if constexpr (TaskLatencyTracing) {
+      using awaiter_t
+        = decltype(get_awaiter(static_cast<TAwaitable&&>(it)));
+      return TaskLatencyAwaiter<awaiter_t> {
+        get_awaiter(static_cast<TAwaitable&&>(it)), mLatency};
+    } else {
+      return static_cast<TAwaitable&&>(it);
+    }
   }
 
   auto await_transform(noexcept_task_t) noexcept {
@@ -442,8 +404,14 @@ struct TaskPromiseBase {
 
 template <class TTraits>
 struct TaskPromise : TaskPromiseBase<TTraits> {
-  TaskPromise(std::optional<StackFramePointer> caller = std::nullopt)
-    : TaskPromiseBase<TTraits>(caller.value_or(StackFramePointer::caller(2))) {
+  // If the compiler passes the default for `location`, it's the location of
+  // the coroutine function
+  TaskPromise(
+    std::optional<StackFramePointer> caller = std::nullopt,
+    const std::source_location& location = std::source_location::current())
+    : TaskPromiseBase<TTraits>(
+        caller.value_or(StackFramePointer::caller(2)),
+        location) {
   }
 
   typename TTraits::result_type mResult;
@@ -465,15 +433,19 @@ struct TaskPromise : TaskPromiseBase<TTraits> {
         "ResultState"));
     using enum TaskPromiseResultState;
     mResult = std::move(result);
-    this->mResultState.Transition<NoResult, HaveResult>();
+    this->mResultState.template Transition<NoResult, HaveResult>();
   }
 };
 
 template <class TTraits>
   requires std::same_as<typename TTraits::result_type, void>
 struct TaskPromise<TTraits> : TaskPromiseBase<TTraits> {
-  TaskPromise(std::optional<StackFramePointer> caller = std::nullopt)
-    : TaskPromiseBase<TTraits>(caller.value_or(StackFramePointer::caller(3))) {
+  TaskPromise(
+    std::optional<StackFramePointer> caller = std::nullopt,
+    const std::source_location& location = std::source_location::current())
+    : TaskPromiseBase<TTraits>(
+        caller.value_or(StackFramePointer::caller(3)),
+        location) {
   }
 
   void return_void() noexcept {
@@ -492,7 +464,7 @@ struct TaskPromise<TTraits> : TaskPromiseBase<TTraits> {
           .c_str(),
         "ResultState"));
     using enum TaskPromiseResultState;
-    this->mResultState.Transition<NoResult, HaveVoidResult>();
+    this->mResultState.template Transition<NoResult, HaveVoidResult>();
   }
 };
 
@@ -530,6 +502,9 @@ struct TaskAwaiter {
   using promise_t = TaskPromise<TTraits>;
   using promise_ptr_t = TaskPromisePtr<promise_t>;
   promise_ptr_t mPromise;
+  // Empty unless `TaskLatencyTracing` is enabled
+  OPENKNEEBOARD_NO_UNIQUE_ADDRESS
+  TaskLatencyFlag<> mCallerSuspended;
 
   TaskAwaiter() = delete;
   TaskAwaiter(const TaskAwaiter&) = delete;
@@ -573,8 +548,19 @@ struct TaskAwaiter {
   }
 
   bool await_suspend(std::coroutine_handle<> caller) {
-    auto oldState = mPromise->mWaiting.exchange(
-      {.mNext = caller}, std::memory_order_acq_rel);
+    // Set before the exchange: once `caller` is published, it may be resumed
+    // on another thread before we get another chance
+    mCallerSuspended = true;
+    // Not an exchange: if the task completed on another thread since
+    // `await_ready()`, we must leave the state as `Completed`
+    auto oldState = TaskPromiseRunning;
+    if (!mPromise->mWaiting.compare_exchange_strong(
+          oldState,
+          {.mNext = caller},
+          std::memory_order_acq_rel,
+          std::memory_order_acquire)) {
+      mCallerSuspended = false;
+    }
     TraceLoggingWrite(
       gTraceProvider,
       "TaskAwaiter<>::await_suspend()",
@@ -606,18 +592,24 @@ struct TaskAwaiter {
           .c_str(),
         "ResultState"));
 
+    if (mCallerSuspended) {
+      mPromise->mLatency.OnCallerResumed();
+    }
+
     using enum TaskPromiseResultState;
     if (mPromise->mUncaught) {
-      mPromise->mResultState.Transition<HaveException, ThrownException>();
+      mPromise->mResultState
+        .template Transition<HaveException, ThrownException>();
       StackTrace::SetForNextException(std::move(mPromise->mUncaughtStack));
       std::rethrow_exception(std::move(mPromise->mUncaught));
     }
 
     if constexpr (std::same_as<typename TTraits::result_type, void>) {
-      mPromise->mResultState.Transition<HaveVoidResult, ReturnedVoid>();
+      mPromise->mResultState
+        .template Transition<HaveVoidResult, ReturnedVoid>();
       return;
     } else {
-      mPromise->mResultState.Transition<HaveResult, ReturnedResult>();
+      mPromise->mResultState.template Transition<HaveResult, ReturnedResult>();
       return std::move(mPromise->mResult);
     }
   }
@@ -720,13 +712,38 @@ struct [[nodiscard]] Task {
   promise_ptr_t mPromise;
 };
 
+template <class T>
+struct TaskTraitsOf {};
+
+template <class TTraits>
+struct TaskTraitsOf<Task<TTraits>> {
+  using type = TTraits;
+};
+
+/// A `Task<>` that can be `co_await`ed, e.g. `task<T>`
+template <class T>
+concept awaitable_task = requires { typename TaskTraitsOf<T>::type; }
+  && (TaskTraitsOf<T>::type::Awaiting != TaskAwaiting::NotSupported);
+
+/** Traits for a task that awaits other tasks, e.g. `when_all()`.
+ *
+ * Apart from the result type, it behaves like the tasks it awaits; in
+ * particular, it uses the same executor, and completes on the same thread.
+ */
+template <class TTraits, class TResult>
+struct CombinedTaskTraits : TTraits {
+  using result_type = TResult;
+};
+
 }// namespace OpenKneeboard::detail
 
 namespace OpenKneeboard::inline task_ns {
 /** A coroutine that:
  * - always returns to the same thread it was invoked from
  * - to implement that, requires that it is called from a thread with a COM
- * apartment
+ * apartment; with `OPENKNEEBOARD_PORTABLE_TASK_EXECUTOR` or on other
+ * platforms, it instead requires a `RunLoop` or `ThreadPool` thread (see
+ * `task/executor.hpp`)
  * - calls fatal() if not awaited
  * - statically requires that the reuslt is discarded via [[nodiscard]]
  * - calls fatal() if there is an uncaught exception
@@ -741,8 +758,13 @@ namespace OpenKneeboard::inline task_ns {
  */
 template <class TIgnoredDispatcherQueue, class T>
 using basic_task = detail::Task<detail::TaskTraits<T>>;
+#ifdef _WIN32
 template <class T>
 using task = basic_task<DispatcherQueue, T>;
+#else
+template <class T>
+using task = basic_task<void, T>;
+#endif
 
 namespace this_task {
 /** Call `OpenKneeboard::fatal()` if this task throws an exception.
@@ -773,9 +795,11 @@ struct fire_and_forget : detail::Task<detail::FireAndForgetTraits> {
   }
 };
 
+#ifdef _WIN32
 // Useful as - like all `task<>` - guarantees to return to the original thread
 task<void> resume_after(auto t) {
   co_await winrt::resume_after(std::chrono::seconds(1));
 }
+#endif
 
 }// namespace OpenKneeboard
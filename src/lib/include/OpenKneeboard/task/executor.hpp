@@ -0,0 +1,297 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#pragma once
+
+#include <OpenKneeboard/fatal.hpp>
+
+#include <concepts>
+#include <coroutine>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <thread>
+
+#ifdef _WIN32
+#include <OpenKneeboard/dprint.hpp>
+#include <OpenKneeboard/tracing.hpp>
+
+#include <shims/winrt/base.h>
+
+#include <combaseapi.h>
+#include <ctxtcall.h>
+#endif
+
+namespace OpenKneeboard {
+
+/** Where a `task<>` resumes its caller, if it completes on another thread.
+ *
+ * - `GetCurrent()` captures the executor for the calling thread, or returns
+ *   `std::nullopt` if tasks can't be created on this thread
+ * - `IsCurrentThread()` returns true if the calling thread can resume the
+ *   caller directly, without `Post()`
+ * - `Post()` resumes the coroutine on the captured thread. `caller` is only
+ *   used for diagnostics. The executor may be destroyed by the resumed
+ *   coroutine before `Post()` returns, so `Post()` must not access it after
+ *   it has handed the coroutine over.
+ */
+template <class T>
+concept task_executor = std::copy_constructible<T>
+  && requires(
+                          const T& executor,
+                          std::coroutine_handle<> coro,
+                          StackFramePointer caller) {
+       { T::Name } -> std::convertible_to<std::string_view>;
+       { T::GetCurrent() } -> std::same_as<std::optional<T>>;
+       { executor.IsCurrentThread() } -> std::same_as<bool>;
+       executor.Post(coro, caller);
+     };
+
+/** Something that can resume coroutines: a `RunLoop` or a `ThreadPool`.
+ *
+ * Each thread can belong to at most one scheduler; this is what
+ * `PortableTaskExecutor` captures.
+ */
+class TaskScheduler : public std::enable_shared_from_this<TaskScheduler> {
+ public:
+  TaskScheduler(const TaskScheduler&) = delete;
+  TaskScheduler(TaskScheduler&&) = delete;
+  TaskScheduler& operator=(const TaskScheduler&) = delete;
+  TaskScheduler& operator=(TaskScheduler&&) = delete;
+
+  virtual ~TaskScheduler() = default;
+
+  /// Resume `coro` on one of this scheduler's threads; safe from any thread
+  virtual void Post(std::coroutine_handle<>) = 0;
+
+  bool IsCurrentThread() const noexcept {
+    // If `tCurrent` has expired, we might just be at the same address as a
+    // destroyed scheduler
+    return tCurrentIdentity == this && !tCurrent.expired();
+  }
+
+  static std::shared_ptr<TaskScheduler> GetCurrent() noexcept {
+    return tCurrent.lock();
+  }
+
+  /// `co_await scheduler.Schedule()` to continue on this scheduler
+  auto Schedule() noexcept {
+    struct Awaiter {
+      TaskScheduler& mScheduler;
+
+      bool await_ready() const noexcept {
+        return false;
+      }
+
+      void await_suspend(std::coroutine_handle<> coro) {
+        mScheduler.Post(coro);
+      }
+
+      void await_resume() const noexcept {
+      }
+    };
+    return Awaiter {*this};
+  }
+
+ protected:
+  TaskScheduler() = default;
+
+  // Make `scheduler` the current scheduler for the calling thread
+  static void SetCurrent(const std::weak_ptr<TaskScheduler>& scheduler) {
+    const auto locked = scheduler.lock();
+    if (!tCurrent.expired() && tCurrentIdentity != locked.get()) [[unlikely]] {
+      fatal("Thread already belongs to a different TaskScheduler");
+    }
+    tCurrent = scheduler;
+    tCurrentIdentity = locked.get();
+  }
+
+  // Clear the current scheduler for the calling thread, if it's this one
+  void ClearCurrent() noexcept {
+    if (tCurrentIdentity == this) {
+      tCurrent.reset();
+      tCurrentIdentity = nullptr;
+    }
+  }
+
+ private:
+  static inline thread_local std::weak_ptr<TaskScheduler> tCurrent;
+  // Only used for comparisons; `tCurrent` might have expired
+  static inline thread_local const TaskScheduler* tCurrentIdentity {nullptr};
+};
+
+/** Resumes callers with a `TaskScheduler`.
+ *
+ * This does not depend on COM or any other Windows API.
+ */
+class PortableTaskExecutor final {
+ public:
+  static constexpr std::string_view Name {"a RunLoop or ThreadPool"};
+
+  static std::optional<PortableTaskExecutor> GetCurrent() noexcept {
+    if (auto scheduler = TaskScheduler::GetCurrent()) {
+      return PortableTaskExecutor {std::move(scheduler)};
+    }
+    return std::nullopt;
+  }
+
+  bool IsCurrentThread() const noexcept {
+    return mScheduler->IsCurrentThread();
+  }
+
+  void Post(std::coroutine_handle<> coro, const StackFramePointer&) const {
+    // Keep the scheduler alive even if `this` is destroyed when `coro` is
+    // resumed
+    const auto scheduler = mScheduler;
+    scheduler->Post(coro);
+  }
+
+ private:
+  PortableTaskExecutor(std::shared_ptr<TaskScheduler> scheduler)
+    : mScheduler(std::move(scheduler)) {
+  }
+
+  std::shared_ptr<TaskScheduler> mScheduler;
+};
+static_assert(task_executor<PortableTaskExecutor>);
+
+#ifdef _WIN32
+/** Resumes callers in their original COM context.
+ *
+ * If the task completes on another thread, this hops to the thread pool,
+ * then uses `IContextCallback` to get back to the original context.
+ */
+class COMTaskExecutor final {
+ public:
+  static constexpr std::string_view Name {"COM"};
+
+  static std::optional<COMTaskExecutor> GetCurrent() noexcept {
+    COMTaskExecutor ret;
+    if (!SUCCEEDED(CoGetObjectContext(IID_PPV_ARGS(ret.mCOMCallback.put()))))
+      [[unlikely]] {
+      return std::nullopt;
+    }
+    return ret;
+  }
+
+  bool IsCurrentThread() const noexcept {
+    return mThreadID == std::this_thread::get_id();
+  }
+
+  void Post(std::coroutine_handle<> coro, const StackFramePointer& caller)
+    const {
+    auto resumeData = new ResumeData {
+      .mExecutor = *this,
+      .mCaller = caller,
+      .mCoro = coro,
+    };
+    const auto threadPoolSuccess = TrySubmitThreadpoolCallback(
+      &COMTaskExecutor::resume_on_thread_pool, resumeData, nullptr);
+    if (threadPoolSuccess) [[likely]] {
+      return;
+    }
+    const auto threadPoolError = GetLastError();
+    delete resumeData;
+    fatal(
+      caller,
+      "Failed to enqueue resumption on thread pool: {:010x}",
+      static_cast<uint32_t>(threadPoolError));
+  }
+
+ private:
+  COMTaskExecutor() = default;
+
+  winrt::com_ptr<IContextCallback> mCOMCallback;
+  std::thread::id mThreadID = std::this_thread::get_id();
+
+  struct ResumeData {
+    COMTaskExecutor mExecutor;
+    StackFramePointer mCaller;
+    std::coroutine_handle<> mCoro;
+  };
+
+  static void resume_on_thread_pool(
+    PTP_CALLBACK_INSTANCE,
+    void* userData) noexcept {
+    std::unique_ptr<ResumeData> resumeData {
+      reinterpret_cast<ResumeData*>(userData)};
+
+    ComCallData comData {.pUserDefined = resumeData.get()};
+    const auto result = resumeData->mExecutor.mCOMCallback->ContextCallback(
+      &COMTaskExecutor::resume_from_thread_pool,
+      &comData,
+      IID_ICallbackWithNoReentrancyToApplicationSTA,
+      5,
+      NULL);
+    if (SUCCEEDED(result)) [[likely]] {
+      return;
+    }
+    fatal(
+      resumeData->mCaller,
+      "Failed to enqueue coroutine resumption for the desired thread: "
+      "{:#010x}",
+      static_cast<uint32_t>(result));
+  }
+
+  static HRESULT resume_from_thread_pool(ComCallData* comData) noexcept {
+    TraceLoggingWrite(
+      gTraceProvider,
+      "COMTaskExecutor::resume_from_thread_pool()",
+      TraceLoggingKeyword(
+        std::to_underlying(TraceLoggingEventKeywords::TaskCoro)),
+      TraceLoggingPointer(comData, "ComData"));
+
+    const auto& resumeData
+      = *reinterpret_cast<ResumeData*>(comData->pUserDefined);
+
+    TraceLoggingWrite(
+      gTraceProvider,
+      "COMTaskExecutor::resume_from_thread_pool()/ResumeCoro",
+      TraceLoggingKeyword(
+        std::to_underlying(TraceLoggingEventKeywords::TaskCoro)),
+      TraceLoggingPointer(comData, "ComData"),
+      TraceLoggingCodePointer(resumeData.mCaller.mValue, "Caller"));
+
+    try {
+      resumeData.mCoro.resume();
+    } catch (...) {
+      dprint.Warning("std::coroutine_handle<>::resume() threw an exception");
+      fatal_with_exception(std::current_exception());
+    }
+
+    TraceLoggingWrite(
+      gTraceProvider,
+      "COMTaskExecutor::resume_from_thread_pool()/CoroComplete",
+      TraceLoggingKeyword(
+        std::to_underlying(TraceLoggingEventKeywords::TaskCoro)),
+      TraceLoggingPointer(comData, "ComData"),
+      TraceLoggingCodePointer(resumeData.mCaller.mValue, "Caller"));
+    return S_OK;
+  }
+};
+static_assert(task_executor<COMTaskExecutor>);
+#endif
+
+#if defined(_WIN32) && !defined(OPENKNEEBOARD_PORTABLE_TASK_EXECUTOR)
+using DefaultTaskExecutor = COMTaskExecutor;
+#else
+using DefaultTaskExecutor = PortableTaskExecutor;
+#endif
+
+}// namespace OpenKneeboard
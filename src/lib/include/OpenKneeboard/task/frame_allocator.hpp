@@ -0,0 +1,282 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace OpenKneeboard {
+
+/** Allocates coroutine frames for `task<>` and `fire_and_forget`.
+ *
+ * Render paths create several coroutines per layer per frame; this avoids
+ * a trip to the global allocator for each of them.
+ *
+ * Freed frames are kept in size-classed, thread-local free lists, and reused
+ * by the next allocation of the same size class on that thread. Frames can
+ * be freed on a different thread than they were allocated on; they then
+ * belong to the freeing thread. Each list is capped, so threads that free
+ * more frames than they allocate - e.g. thread pool workers - return the
+ * excess to the global allocator.
+ *
+ * Under AddressSanitizer, every frame goes straight to the global allocator:
+ * a reused frame would hide use-after-free of a destroyed coroutine.
+ */
+class TaskFrameAllocator final {
+ public:
+  static constexpr std::size_t Granularity = 64;
+  static constexpr std::size_t SizeClassCount = 16;
+  /// Larger frames are passed straight to the global allocator
+  static constexpr std::size_t MaxPooledSize = Granularity * SizeClassCount;
+  static constexpr std::size_t MaxCachedPerSizeClass = 32;
+
+#ifdef __SANITIZE_ADDRESS__
+  static constexpr bool PoolingEnabled = false;
+#else
+  static constexpr bool PoolingEnabled = true;
+#endif
+
+  struct Statistics {
+    uint64_t mAllocations {};
+    /// Allocations that reused a cached frame
+    uint64_t mPoolHits {};
+    /// Allocations larger than `MaxPooledSize`
+    uint64_t mOversizedAllocations {};
+    /// Memory from the global allocator: live frames, and cached frames
+    std::size_t mBytesReserved {};
+    std::size_t mPeakBytesReserved {};
+
+    constexpr double GetHitRate() const noexcept {
+      if (mAllocations == 0) {
+        return 0;
+      }
+      return static_cast<double>(mPoolHits) / mAllocations;
+    }
+  };
+
+  TaskFrameAllocator() = delete;
+
+  [[nodiscard]]
+  static void* Allocate(std::size_t size) {
+    if constexpr (!PoolingEnabled) {
+      if (const auto cache = GetThreadCache()) {
+        Increment(cache->mCounters.mAllocations);
+      } else {
+        GetRegistry().mRetiredCounters.mAllocations.fetch_add(
+          1, std::memory_order_relaxed);
+      }
+      return Reserve(size);
+    }
+
+    const auto sizeClass = GetSizeClass(size);
+    const bool oversized = (sizeClass >= SizeClassCount);
+    const auto bytes = oversized ? size : GetSizeClassBytes(sizeClass);
+
+    const auto cache = GetThreadCache();
+    if (!cache) [[unlikely]] {
+      // This thread is exiting
+      auto& retired = GetRegistry().mRetiredCounters;
+      retired.mAllocations.fetch_add(1, std::memory_order_relaxed);
+      if (oversized) {
+        retired.mOversizedAllocations.fetch_add(1, std::memory_order_relaxed);
+      }
+      return Reserve(bytes);
+    }
+
+    auto& counters = cache->mCounters;
+    Increment(counters.mAllocations);
+    if (oversized) [[unlikely]] {
+      Increment(counters.mOversizedAllocations);
+      return Reserve(bytes);
+    }
+
+    if (const auto block = cache->mHeads[sizeClass]) {
+      cache->mHeads[sizeClass] = block->mNext;
+      --cache->mCounts[sizeClass];
+      Increment(counters.mPoolHits);
+      return block;
+    }
+    return Reserve(bytes);
+  }
+
+  static void Deallocate(void* p, std::size_t size) noexcept {
+    if constexpr (!PoolingEnabled) {
+      Release(p, size);
+      return;
+    }
+
+    const auto sizeClass = GetSizeClass(size);
+    if (sizeClass >= SizeClassCount) [[unlikely]] {
+      Release(p, size);
+      return;
+    }
+
+    const auto cache = GetThreadCache();
+    if (cache && cache->mCounts[sizeClass] < MaxCachedPerSizeClass)
+      [[likely]] {
+      cache->mHeads[sizeClass]
+        = new (p) Block {.mNext = cache->mHeads[sizeClass]};
+      ++cache->mCounts[sizeClass];
+      return;
+    }
+    Release(p, GetSizeClassBytes(sizeClass));
+  }
+
+  static Statistics GetStatistics() noexcept {
+    Statistics ret {
+      .mBytesReserved = sBytesReserved.load(std::memory_order_relaxed),
+      .mPeakBytesReserved = sPeakBytesReserved.load(std::memory_order_relaxed),
+    };
+    auto add = [&ret](const Counters& counters) {
+      ret.mAllocations += counters.mAllocations.load(std::memory_order_relaxed);
+      ret.mPoolHits += counters.mPoolHits.load(std::memory_order_relaxed);
+      ret.mOversizedAllocations
+        += counters.mOversizedAllocations.load(std::memory_order_relaxed);
+    };
+
+    auto& registry = GetRegistry();
+    std::unique_lock lock(registry.mMutex);
+    add(registry.mRetiredCounters);
+    for (const auto cache: registry.mCaches) {
+      add(cache->mCounters);
+    }
+    return ret;
+  }
+
+ private:
+  struct Block {
+    Block* mNext {nullptr};
+  };
+  static_assert(sizeof(Block) <= Granularity);
+
+  // Each thread's counters are only modified by that thread; they're atomic
+  // so that `GetStatistics()` can read them from any thread
+  struct Counters {
+    std::atomic_uint64_t mAllocations;
+    std::atomic_uint64_t mPoolHits;
+    std::atomic_uint64_t mOversizedAllocations;
+  };
+
+  struct ThreadCache {
+    std::array<Block*, SizeClassCount> mHeads {};
+    std::array<std::size_t, SizeClassCount> mCounts {};
+    Counters mCounters;
+
+    ThreadCache() {
+      auto& registry = GetRegistry();
+      std::unique_lock lock(registry.mMutex);
+      registry.mCaches.push_back(this);
+    }
+
+    ~ThreadCache() {
+      // Frames freed after this - e.g. by other thread_local destructors -
+      // go straight to the global allocator
+      tThreadCacheDestroyed = true;
+      for (std::size_t i = 0; i < SizeClassCount; ++i) {
+        while (const auto block = mHeads[i]) {
+          mHeads[i] = block->mNext;
+          Release(block, GetSizeClassBytes(i));
+        }
+      }
+
+      auto& registry = GetRegistry();
+      std::unique_lock lock(registry.mMutex);
+      std::erase(registry.mCaches, this);
+      auto& retired = registry.mRetiredCounters;
+      auto retire = [](auto& from, auto& to) {
+        to.fetch_add(from.load(std::memory_order_relaxed));
+      };
+      retire(mCounters.mAllocations, retired.mAllocations);
+      retire(mCounters.mPoolHits, retired.mPoolHits);
+      retire(mCounters.mOversizedAllocations, retired.mOversizedAllocations);
+    }
+  };
+
+  static inline std::atomic_size_t sBytesReserved;
+  static inline std::atomic_size_t sPeakBytesReserved;
+
+  struct Registry {
+    std::mutex mMutex;
+    std::vector<ThreadCache*> mCaches;
+    // From exited threads, and threads that are exiting; unlike the
+    // per-thread counters, these can have multiple writers
+    Counters mRetiredCounters;
+  };
+
+  // Intentionally leaked: detached threads - e.g. from
+  // `ThreadPool::GetBackground()` - can exit during static destruction, and
+  // their `ThreadCache` destructors still need this
+  static Registry& GetRegistry() {
+    static const auto sRegistry = new Registry();
+    return *sRegistry;
+  }
+
+  // Trivially destructible, so still usable after `ThreadCache` is destroyed
+  static inline thread_local bool tThreadCacheDestroyed {false};
+
+  static ThreadCache* GetThreadCache() noexcept {
+    if (tThreadCacheDestroyed) [[unlikely]] {
+      return nullptr;
+    }
+    static thread_local ThreadCache sCache;
+    return &sCache;
+  }
+
+  static void Increment(std::atomic_uint64_t& counter) noexcept {
+    // Not `fetch_add()`, which is much more expensive, as these usually
+    // only have one writer
+    counter.store(
+      counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  static constexpr std::size_t GetSizeClass(std::size_t size) noexcept {
+    // Size 0 can't happen for a coroutine frame, but would be class 0 anyway
+    return (size == 0) ? 0 : ((size - 1) / Granularity);
+  }
+
+  static constexpr std::size_t GetSizeClassBytes(
+    std::size_t sizeClass) noexcept {
+    return (sizeClass + 1) * Granularity;
+  }
+
+  static void* Reserve(std::size_t bytes) {
+    auto ret = ::operator new(bytes);
+    const auto reserved
+      = sBytesReserved.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    auto peak = sPeakBytesReserved.load(std::memory_order_relaxed);
+    while (reserved > peak
+           && !sPeakBytesReserved.compare_exchange_weak(
+             peak, reserved, std::memory_order_relaxed)) {
+    }
+    return ret;
+  }
+
+  static void Release(void* p, std::size_t bytes) noexcept {
+    sBytesReserved.fetch_sub(bytes, std::memory_order_relaxed);
+    ::operator delete(p, bytes);
+  }
+};
+
+}// namespace OpenKneeboard
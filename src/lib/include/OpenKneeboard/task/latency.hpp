@@ -0,0 +1,458 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#pragma once
+
+#include <OpenKneeboard/dprint.hpp>
+
+#include <OpenKneeboard/format/source_location.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <format>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <source_location>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace OpenKneeboard {
+
+/** Whether `task<>` and `fire_and_forget` record latency statistics.
+ *
+ * Enable with the `WITH_TASK_LATENCY_TRACING` CMake option; this changes the
+ * layout of every coroutine promise, so it must be consistent across the
+ * whole build.
+ */
+#ifdef OPENKNEEBOARD_TASK_LATENCY_TRACING
+constexpr bool TaskLatencyTracing = true;
+#else
+constexpr bool TaskLatencyTracing = false;
+#endif
+
+/// For members that are empty unless `TaskLatencyTracing` is enabled
+#ifdef _MSC_VER
+#define OPENKNEEBOARD_NO_UNIQUE_ADDRESS [[msvc::no_unique_address]]
+#else
+#define OPENKNEEBOARD_NO_UNIQUE_ADDRESS [[no_unique_address]]
+#endif
+
+/** A histogram of durations, with power-of-two microsecond buckets.
+ *
+ * Safe to record from any thread.
+ */
+class TaskLatencyHistogram final {
+ public:
+  /** Bucket 0 is under 1us, and bucket `i` is [2^(i - 1), 2^i) us.
+   *
+   * The last bucket also includes anything longer.
+   */
+  static constexpr std::size_t BucketCount = 24;
+
+  struct Snapshot {
+    std::array<uint64_t, BucketCount> mBuckets {};
+    uint64_t mCount {};
+    std::chrono::nanoseconds mTotal {};
+    std::chrono::nanoseconds mMax {};
+
+    constexpr std::chrono::nanoseconds GetMean() const noexcept {
+      if (mCount == 0) {
+        return {};
+      }
+      return mTotal / mCount;
+    }
+
+    /// An upper bound for the given percentile, e.g. `0.99`
+    constexpr std::chrono::nanoseconds GetPercentile(
+      double percentile) const noexcept {
+      const auto target = static_cast<uint64_t>(mCount * percentile);
+      uint64_t seen {};
+      for (std::size_t i = 0; i + 1 < BucketCount; ++i) {
+        seen += mBuckets.at(i);
+        if (seen > target) {
+          return std::min<std::chrono::nanoseconds>(
+            GetBucketUpperBound(i), mMax);
+        }
+      }
+      return mMax;
+    }
+  };
+
+  void Record(std::chrono::nanoseconds duration) noexcept {
+    mBuckets.at(GetBucket(duration)).fetch_add(1, std::memory_order_relaxed);
+    mCount.fetch_add(1, std::memory_order_relaxed);
+    mTotal.fetch_add(duration.count(), std::memory_order_relaxed);
+
+    auto max = mMax.load(std::memory_order_relaxed);
+    while (duration.count() > max
+           && !mMax.compare_exchange_weak(
+             max, duration.count(), std::memory_order_relaxed)) {
+    }
+  }
+
+  Snapshot Get() const noexcept {
+    Snapshot ret {
+      .mCount = mCount.load(std::memory_order_relaxed),
+      .mTotal
+      = std::chrono::nanoseconds {mTotal.load(std::memory_order_relaxed)},
+      .mMax = std::chrono::nanoseconds {mMax.load(std::memory_order_relaxed)},
+    };
+    for (std::size_t i = 0; i < BucketCount; ++i) {
+      ret.mBuckets.at(i) = mBuckets.at(i).load(std::memory_order_relaxed);
+    }
+    return ret;
+  }
+
+  static constexpr std::size_t GetBucket(
+    std::chrono::nanoseconds duration) noexcept {
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                      duration)
+                      .count();
+    if (us <= 0) {
+      return 0;
+    }
+    return std::min<std::size_t>(
+      std::bit_width(static_cast<uint64_t>(us)), BucketCount - 1);
+  }
+
+  static constexpr std::chrono::microseconds GetBucketUpperBound(
+    std::size_t bucket) noexcept {
+    return std::chrono::microseconds {uint64_t {1} << bucket};
+  }
+
+ private:
+  std::array<std::atomic_uint64_t, BucketCount> mBuckets {};
+  std::atomic_uint64_t mCount {};
+  std::atomic_int64_t mTotal {};
+  std::atomic_int64_t mMax {};
+};
+
+/** Per-call-site latency statistics for coroutines.
+ *
+ * A call site is the coroutine function, as seen by `std::source_location`.
+ *
+ * Statistics are only recorded if `TaskLatencyTracing` is true; they can be
+ * retrieved or logged at any time.
+ */
+class TaskLatencyTracker final {
+ public:
+  struct Site {
+    std::source_location mLocation;
+    /// From creation to completion
+    TaskLatencyHistogram mTotal;
+    /// Time spent running, excluding time spent suspended
+    TaskLatencyHistogram mRunning;
+    /** The longest the coroutine ran without suspending.
+     *
+     * For coroutines on the UI thread, this is the longest hitch they caused.
+     */
+    TaskLatencyHistogram mLongestSlice;
+    /// Every suspension, from `co_await` until the coroutine was resumed
+    TaskLatencyHistogram mSuspended;
+    /** From completion until the awaiting coroutine was resumed.
+     *
+     * This includes getting back to the caller's thread, e.g. waiting for
+     * the UI thread to become idle.
+     */
+    TaskLatencyHistogram mResumeCaller;
+  };
+
+  struct SiteStatistics {
+    std::source_location mLocation;
+    TaskLatencyHistogram::Snapshot mTotal;
+    TaskLatencyHistogram::Snapshot mRunning;
+    TaskLatencyHistogram::Snapshot mLongestSlice;
+    TaskLatencyHistogram::Snapshot mSuspended;
+    TaskLatencyHistogram::Snapshot mResumeCaller;
+  };
+
+  TaskLatencyTracker() = delete;
+
+  /// The returned reference is valid for the lifetime of the process
+  static Site& GetSite(const std::source_location& location) {
+    const Key key {
+      .mFile = location.file_name(),
+      .mLine = location.line(),
+      .mColumn = location.column(),
+    };
+    auto& registry = GetRegistry();
+    {
+      std::shared_lock lock(registry.mMutex);
+      if (const auto it = registry.mSites.find(key);
+          it != registry.mSites.end()) {
+        return it->second;
+      }
+    }
+
+    std::unique_lock lock(registry.mMutex);
+    const auto [it, inserted] = registry.mSites.try_emplace(key);
+    if (inserted) {
+      it->second.mLocation = location;
+    }
+    return it->second;
+  }
+
+  static std::vector<SiteStatistics> GetStatistics() {
+    auto& registry = GetRegistry();
+    std::shared_lock lock(registry.mMutex);
+    std::vector<SiteStatistics> ret;
+    ret.reserve(registry.mSites.size());
+    for (const auto& [key, site]: registry.mSites) {
+      ret.push_back({
+        .mLocation = site.mLocation,
+        .mTotal = site.mTotal.Get(),
+        .mRunning = site.mRunning.Get(),
+        .mLongestSlice = site.mLongestSlice.Get(),
+        .mSuspended = site.mSuspended.Get(),
+        .mResumeCaller = site.mResumeCaller.Get(),
+      });
+    }
+    return ret;
+  }
+
+  /// Log statistics for every call site, longest hitches first
+  static void DumpStatistics() {
+    auto sites = GetStatistics();
+    std::ranges::sort(sites, std::greater {}, [](const auto& site) {
+      return site.mLongestSlice.mMax;
+    });
+
+    using std::chrono::duration_cast;
+    using us = std::chrono::microseconds;
+    auto summarize = [](const TaskLatencyHistogram::Snapshot& it) {
+      return std::format(
+        "p50 {}us, p99 {}us, max {}us",
+        duration_cast<us>(it.GetPercentile(0.5)).count(),
+        duration_cast<us>(it.GetPercentile(0.99)).count(),
+        duration_cast<us>(it.mMax).count());
+    };
+
+    dprint("Coroutine latency for {} call sites:", sites.size());
+    for (const auto& site: sites) {
+      dprint("- {}", site.mLocation);
+      dprint("  - completed: {}", site.mTotal.mCount);
+      dprint("  - total: {}", summarize(site.mTotal));
+      dprint("  - running: {}", summarize(site.mRunning));
+      dprint("  - longest slice: {}", summarize(site.mLongestSlice));
+      dprint(
+        "  - suspended ({}x): {}",
+        site.mSuspended.mCount,
+        summarize(site.mSuspended));
+      dprint("  - resuming caller: {}", summarize(site.mResumeCaller));
+    }
+  }
+
+ private:
+  // The file name is compared by value: coroutines defined in headers - e.g.
+  // `when_all()` - can have a different copy of it in each translation unit
+  // or DLL
+  struct Key {
+    std::string_view mFile;
+    uint_least32_t mLine {};
+    uint_least32_t mColumn {};
+
+    bool operator==(const Key&) const noexcept = default;
+  };
+
+  struct KeyHasher {
+    std::size_t operator()(const Key& key) const noexcept {
+      return std::hash<std::string_view> {}(key.mFile)
+        ^ (static_cast<std::size_t>(key.mLine) << 16) ^ key.mColumn;
+    }
+  };
+
+  struct Registry {
+    std::shared_mutex mMutex;
+    // Node-based, so references to sites remain valid
+    std::unordered_map<Key, Site, KeyHasher> mSites;
+  };
+
+  // Intentionally leaked, as tasks can still be completing on detached
+  // threads - e.g. `ThreadPool::GetBackground()` - during static destruction
+  static Registry& GetRegistry() {
+    static const auto sRegistry = new Registry();
+    return *sRegistry;
+  }
+};
+
+}// namespace OpenKneeboard
+
+namespace OpenKneeboard::detail {
+
+/// The timestamps for a single coroutine; does nothing unless `Enabled`
+template <bool Enabled = TaskLatencyTracing>
+class TaskLatencyRecord {
+ public:
+  TaskLatencyRecord(const std::source_location&) noexcept {
+  }
+
+  void OnSuspend() noexcept {
+  }
+
+  void OnResume() noexcept {
+  }
+
+  void OnComplete() noexcept {
+  }
+
+  void OnCallerResumed() const noexcept {
+  }
+};
+
+template <>
+class TaskLatencyRecord<true> {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  TaskLatencyRecord(const std::source_location& location)
+    : mSite(TaskLatencyTracker::GetSite(location)) {
+  }
+
+  void OnSuspend() noexcept {
+    const auto now = Clock::now();
+    this->EndSlice(now);
+    mSuspendedAt = now;
+    mIsSuspended = true;
+  }
+
+  void OnResume() noexcept {
+    // False if the awaitable was ready, so we never suspended
+    if (!std::exchange(mIsSuspended, false)) {
+      return;
+    }
+    const auto now = Clock::now();
+    mSite.mSuspended.Record(now - mSuspendedAt);
+    mSliceStart = now;
+  }
+
+  void OnComplete() noexcept {
+    const auto now = Clock::now();
+    this->EndSlice(now);
+    mCompletedAt = now;
+
+    mSite.mTotal.Record(mCompletedAt - mCreatedAt);
+    mSite.mRunning.Record(mRunning);
+    mSite.mLongestSlice.Record(mLongestSlice);
+  }
+
+  void OnCallerResumed() const noexcept {
+    mSite.mResumeCaller.Record(Clock::now() - mCompletedAt);
+  }
+
+ private:
+  TaskLatencyTracker::Site& mSite;
+
+  Clock::time_point mCreatedAt {Clock::now()};
+  Clock::time_point mSuspendedAt {};
+  Clock::time_point mCompletedAt {};
+
+  Clock::time_point mSliceStart {mCreatedAt};
+  Clock::duration mRunning {};
+  Clock::duration mLongestSlice {};
+
+  bool mIsSuspended {false};
+
+  void EndSlice(Clock::time_point now) noexcept {
+    const auto slice = now - mSliceStart;
+    mRunning += slice;
+    mLongestSlice = std::max(mLongestSlice, slice);
+  }
+};
+
+/// A flag that is always false unless `Enabled`
+template <bool Enabled = TaskLatencyTracing>
+class TaskLatencyFlag {
+ public:
+  constexpr TaskLatencyFlag& operator=(bool) noexcept {
+    return *this;
+  }
+
+  constexpr operator bool() const noexcept {
+    return false;
+  }
+};
+
+template <>
+class TaskLatencyFlag<true> {
+ public:
+  constexpr TaskLatencyFlag& operator=(bool value) noexcept {
+    mValue = value;
+    return *this;
+  }
+
+  constexpr operator bool() const noexcept {
+    return mValue;
+  }
+
+ private:
+  bool mValue {false};
+};
+
+// Apply `operator co_await`, as the compiler would for the result of
+// `await_transform()`
+template <class T>
+decltype(auto) get_awaiter(T&& awaitable) {
+  if constexpr (requires { static_cast<T&&>(awaitable).operator co_await(); }) {
+    return static_cast<T&&>(awaitable).operator co_await();
+  } else if constexpr (requires {
+                         operator co_await(static_cast<T&&>(awaitable));
+                       }) {
+    return operator co_await(static_cast<T&&>(awaitable));
+  } else {
+    return static_cast<T&&>(awaitable);
+  }
+}
+
+/** Wraps an awaiter to record when the coroutine suspends and resumes.
+ *
+ * `TAwaiter` is a reference if the awaitable is its own awaiter; it's part
+ * of the same `co_await` expression, so lives until `await_resume()`.
+ */
+template <class TAwaiter>
+struct TaskLatencyAwaiter {
+  TAwaiter mAwaiter;
+  TaskLatencyRecord<true>& mRecord;
+
+  decltype(auto) await_ready() {
+    return mAwaiter.await_ready();
+  }
+
+  template <class TPromise>
+  decltype(auto) await_suspend(std::coroutine_handle<TPromise> coro) {
+    // Before suspending: once the inner awaiter has the handle, the coroutine
+    // may be resumed - or destroyed - on another thread at any time
+    mRecord.OnSuspend();
+    return mAwaiter.await_suspend(coro);
+  }
+
+  decltype(auto) await_resume() {
+    mRecord.OnResume();
+    return mAwaiter.await_resume();
+  }
+};
+
+}// namespace OpenKneeboard::detail
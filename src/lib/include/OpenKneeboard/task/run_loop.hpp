@@ -0,0 +1,106 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#pragma once
+
+#include <OpenKneeboard/task/executor.hpp>
+
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+
+namespace OpenKneeboard {
+
+/** Resumes coroutines on the thread that created it.
+ *
+ * This is the portable equivalent of a UI thread: `task<>`s created on this
+ * thread resume here, but only while the thread is in `Run()` or
+ * `RunPending()`.
+ */
+class RunLoop final : public TaskScheduler {
+ public:
+  /// Create a `RunLoop` for the calling thread
+  static std::shared_ptr<RunLoop> Create() {
+    std::shared_ptr<RunLoop> ret {new RunLoop()};
+    SetCurrent(ret);
+    return ret;
+  }
+
+  ~RunLoop() override {
+    this->ClearCurrent();
+  }
+
+  void Post(std::coroutine_handle<> coro) override {
+    std::unique_lock lock(mMutex);
+    mQueue.push_back(coro);
+    mWake.notify_one();
+  }
+
+  /// Resume coroutines as they're posted, until a stop is requested
+  void Run(std::stop_token stopToken) {
+    OPENKNEEBOARD_ASSERT(this->IsCurrentThread());
+    while (!stopToken.stop_requested()) {
+      {
+        std::unique_lock lock(mMutex);
+        if (!mWake.wait(
+              lock, stopToken, [this]() { return !mQueue.empty(); })) {
+          return;
+        }
+      }
+      this->RunPending();
+    }
+  }
+
+  /** Resume any coroutines that have already been posted.
+   *
+   * Coroutines that are posted while this is running are left for the next
+   * call.
+   *
+   * @return the number of coroutines resumed
+   */
+  std::size_t RunPending() {
+    OPENKNEEBOARD_ASSERT(this->IsCurrentThread());
+    {
+      std::unique_lock lock(mMutex);
+      // Swap rather than move, so that both deques keep their storage
+      std::swap(mQueue, mRunning);
+    }
+    const auto count = mRunning.size();
+    while (!mRunning.empty()) {
+      const auto coro = mRunning.front();
+      mRunning.pop_front();
+      coro.resume();
+    }
+    return count;
+  }
+
+ private:
+  RunLoop() = default;
+
+  std::mutex mMutex;
+  std::condition_variable_any mWake;
+  std::deque<std::coroutine_handle<>> mQueue;
+  // Only accessed from the owning thread
+  std::deque<std::coroutine_handle<>> mRunning;
+};
+
+}// namespace OpenKneeboard
@@ -0,0 +1,470 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#pragma once
+
+#include <OpenKneeboard/task/executor.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace OpenKneeboard {
+
+/** Lanes for `ThreadPool` work, from most to least urgent.
+ *
+ * Queued work in a more urgent lane is always started first.
+ */
+enum class TaskPriority : uint8_t {
+  /// Work needed to render an upcoming frame
+  RenderPrep,
+  /** File and network access, e.g. copying a file before opening it.
+   *
+   * This work may block, so it is limited to `ThreadPool::GetMaxIOWorkers()`
+   * workers at a time.
+   */
+  IO,
+  /// Large parsing jobs, e.g. PDF navigation or DCS mission extraction
+  BulkParse,
+};
+
+/** Resumes coroutines on a fixed set of worker threads.
+ *
+ * `task<>`s created on a worker thread may resume on any worker thread of
+ * the same pool.
+ *
+ * Each worker has its own queue for each `TaskPriority`; work posted from a
+ * worker goes to its own queue, and idle workers steal from other workers.
+ * Work posted from other threads goes to a shared queue.
+ *
+ * `co_await pool->Schedule(priority)` continues on the pool, in the given
+ * lane. When a coroutine is resumed via `Post()` from a worker - e.g. a caller
+ * whose `task<>` completed - it stays in the lane of the work that resumed
+ * it; from other threads, it uses `DefaultPriority`.
+ *
+ * At most half of the workers - but at least one - run `TaskPriority::IO`
+ * work at the same time, so that blocking IO can't starve the other lanes.
+ *
+ * Destroying the pool stops the workers once the queues are empty;
+ * coroutines that were already posted are still resumed. The destructor
+ * waits for this unless it's called from a `ThreadPool` worker.
+ */
+class ThreadPool final : public TaskScheduler {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr std::size_t PriorityCount = 3;
+  static constexpr auto DefaultPriority = TaskPriority::IO;
+
+  struct LaneStatistics {
+    /// Posted, but not yet resumed
+    std::size_t mDepth {};
+    std::size_t mPeakDepth {};
+    uint64_t mPosted {};
+    uint64_t mResumed {};
+    /// Time between `Post()` and resumption
+    std::chrono::nanoseconds mTotalWait {};
+    std::chrono::nanoseconds mMaxWait {};
+
+    constexpr std::chrono::nanoseconds GetMeanWait() const noexcept {
+      if (mResumed == 0) {
+        return {};
+      }
+      return mTotalWait / mResumed;
+    }
+  };
+
+  struct Statistics {
+    std::array<LaneStatistics, PriorityCount> mLanes;
+    /// Work that was resumed by a different worker than it was posted to
+    uint64_t mSteals {};
+
+    constexpr const LaneStatistics& at(TaskPriority priority) const {
+      return mLanes.at(std::to_underlying(priority));
+    }
+  };
+
+  static std::shared_ptr<ThreadPool> Create(
+    std::size_t threadCount = std::thread::hardware_concurrency()) {
+    threadCount = std::max<std::size_t>(threadCount, 1);
+    std::shared_ptr<ThreadPool> ret {new ThreadPool(
+      threadCount, std::max<std::size_t>(threadCount / 2, 1))};
+    ret->mThreads.reserve(threadCount);
+    for (std::size_t i = 0; i < threadCount; ++i) {
+      ret->mThreads.emplace_back(
+        &ThreadPool::Work, ret->mState, i, std::weak_ptr<TaskScheduler> {ret});
+    }
+    return ret;
+  }
+
+  /** The pool for background work throughout the app.
+   *
+   * It leaves one core for the UI and render threads.
+   *
+   * This is intentionally never destroyed, so that work that is still
+   * running when the process exits doesn't delay the exit.
+   */
+  static std::shared_ptr<ThreadPool> GetBackground() {
+    static const auto sPool = new std::shared_ptr<ThreadPool>(
+      Create(std::max(std::thread::hardware_concurrency(), 2u) - 1));
+    return *sPool;
+  }
+
+  ~ThreadPool() override {
+    for (auto& thread: mThreads) {
+      thread.request_stop();
+    }
+    // If the last reference was released by a coroutine on a worker - of this
+    // pool or any other - joining could deadlock: we could be waiting for
+    // ourselves, or for a pool that's waiting for us. Workers only use
+    // `mState`, which they co-own, so it's safe to let them exit on their own.
+    if (tWorkerState) {
+      for (auto& thread: mThreads) {
+        thread.detach();
+      }
+    }
+  }
+
+  void Post(std::coroutine_handle<> coro) override {
+    this->Post(
+      coro,
+      (tWorkerState == mState.get()) ? tWorkerPriority : DefaultPriority);
+  }
+
+  void Post(std::coroutine_handle<> coro, TaskPriority priority) {
+    auto& state = *mState;
+    const auto lane = std::to_underlying(priority);
+    // Count before queueing, so that the counts never underflow; a worker
+    // may briefly see work that isn't queued yet, and look again.
+    state.mLaneCounters[lane].Posted();
+    state.mPending.fetch_add(1, std::memory_order_seq_cst);
+
+    auto& queues = (tWorkerState == &state)
+      ? *state.mWorkerQueues[tWorkerIndex]
+      : state.mSharedQueues;
+    {
+      std::unique_lock lock(queues.mMutex);
+      queues.mLanes[lane].push_back({coro, Clock::now()});
+    }
+
+    // Pairs with the increment in `Work()`: either we see the sleeper, or it
+    // sees `mPending`
+    if (state.mSleepers.load(std::memory_order_seq_cst) > 0) {
+      std::unique_lock lock(state.mSleepMutex);
+      state.mWake.notify_one();
+    }
+  }
+
+  /// `co_await pool->Schedule(priority)` to continue on this pool
+  auto Schedule(TaskPriority priority) noexcept {
+    struct Awaiter {
+      ThreadPool& mPool;
+      TaskPriority mPriority;
+
+      bool await_ready() const noexcept {
+        return false;
+      }
+
+      void await_suspend(std::coroutine_handle<> coro) {
+        mPool.Post(coro, mPriority);
+      }
+
+      void await_resume() const noexcept {
+      }
+    };
+    return Awaiter {*this, priority};
+  }
+
+  using TaskScheduler::Schedule;
+
+  std::size_t GetThreadCount() const noexcept {
+    return mThreads.size();
+  }
+
+  std::size_t GetMaxIOWorkers() const noexcept {
+    return mState->mMaxIOWorkers;
+  }
+
+  Statistics GetStatistics() const noexcept {
+    Statistics ret {
+      .mSteals = mState->mSteals.load(std::memory_order_relaxed),
+    };
+    for (std::size_t i = 0; i < PriorityCount; ++i) {
+      ret.mLanes[i] = mState->mLaneCounters[i].Get();
+    }
+    return ret;
+  }
+
+ private:
+  struct Item {
+    std::coroutine_handle<> mCoro;
+    Clock::time_point mPostedAt;
+  };
+
+  struct Queues {
+    std::mutex mMutex;
+    std::array<std::deque<Item>, PriorityCount> mLanes;
+  };
+
+  class LaneCounters {
+   public:
+    void Posted() noexcept {
+      mPosted.fetch_add(1, std::memory_order_relaxed);
+      const auto depth = mDepth.fetch_add(1, std::memory_order_relaxed) + 1;
+      auto peak = mPeakDepth.load(std::memory_order_relaxed);
+      while (depth > peak
+             && !mPeakDepth.compare_exchange_weak(
+               peak, depth, std::memory_order_relaxed)) {
+      }
+    }
+
+    void Resumed(Clock::duration wait) noexcept {
+      mDepth.fetch_sub(1, std::memory_order_relaxed);
+      mResumed.fetch_add(1, std::memory_order_relaxed);
+      const int64_t waitNS
+        = std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count();
+      mTotalWaitNS.fetch_add(waitNS, std::memory_order_relaxed);
+      auto max = mMaxWaitNS.load(std::memory_order_relaxed);
+      while (waitNS > max
+             && !mMaxWaitNS.compare_exchange_weak(
+               max, waitNS, std::memory_order_relaxed)) {
+      }
+    }
+
+    bool IsEmpty() const noexcept {
+      return this->GetDepth() == 0;
+    }
+
+    std::size_t GetDepth() const noexcept {
+      return mDepth.load(std::memory_order_relaxed);
+    }
+
+    LaneStatistics Get() const noexcept {
+      return {
+        .mDepth = mDepth.load(std::memory_order_relaxed),
+        .mPeakDepth = mPeakDepth.load(std::memory_order_relaxed),
+        .mPosted = mPosted.load(std::memory_order_relaxed),
+        .mResumed = mResumed.load(std::memory_order_relaxed),
+        .mTotalWait = std::chrono::nanoseconds {
+          mTotalWaitNS.load(std::memory_order_relaxed)},
+        .mMaxWait = std::chrono::nanoseconds {
+          mMaxWaitNS.load(std::memory_order_relaxed)},
+      };
+    }
+
+   private:
+    std::atomic_size_t mDepth;
+    std::atomic_size_t mPeakDepth;
+    std::atomic_uint64_t mPosted;
+    std::atomic_uint64_t mResumed;
+    std::atomic_int64_t mTotalWaitNS;
+    std::atomic_int64_t mMaxWaitNS;
+  };
+
+  static constexpr auto IOLane = std::to_underlying(TaskPriority::IO);
+
+  struct State {
+    State(std::size_t threadCount, std::size_t maxIOWorkers)
+      : mMaxIOWorkers(maxIOWorkers) {
+      mWorkerQueues.reserve(threadCount);
+      for (std::size_t i = 0; i < threadCount; ++i) {
+        mWorkerQueues.push_back(std::make_unique<Queues>());
+      }
+    }
+
+    std::vector<std::unique_ptr<Queues>> mWorkerQueues;
+    Queues mSharedQueues;
+
+    std::array<LaneCounters, PriorityCount> mLaneCounters;
+    std::atomic_uint64_t mSteals;
+
+    const std::size_t mMaxIOWorkers;
+    // Workers that are looking for, or running, `TaskPriority::IO` work
+    std::atomic_size_t mIOWorkers;
+
+    // Posted to any lane, but not yet resumed
+    std::atomic_size_t mPending;
+    std::atomic_size_t mSleepers;
+    std::mutex mSleepMutex;
+    std::condition_variable_any mWake;
+  };
+
+  ThreadPool(std::size_t threadCount, std::size_t maxIOWorkers)
+    : mState(std::make_shared<State>(threadCount, maxIOWorkers)) {
+  }
+
+  static std::optional<Item> TryPop(Queues& queues, std::size_t lane) {
+    std::unique_lock lock(queues.mMutex);
+    auto& queue = queues.mLanes[lane];
+    if (queue.empty()) {
+      return std::nullopt;
+    }
+    const auto ret = queue.front();
+    queue.pop_front();
+    return ret;
+  }
+
+  // Our own queue, then the shared queue, then other workers' queues
+  static std::optional<Item>
+  FindWorkInLane(State& state, std::size_t index, std::size_t lane) {
+    if (const auto item = TryPop(*state.mWorkerQueues[index], lane)) {
+      return item;
+    }
+    if (const auto item = TryPop(state.mSharedQueues, lane)) {
+      return item;
+    }
+    const auto workerCount = state.mWorkerQueues.size();
+    for (std::size_t i = 1; i < workerCount; ++i) {
+      const auto victim = (index + i) % workerCount;
+      if (const auto item = TryPop(*state.mWorkerQueues[victim], lane)) {
+        state.mSteals.fetch_add(1, std::memory_order_relaxed);
+        return item;
+      }
+    }
+    return std::nullopt;
+  }
+
+  // Most urgent lane first, skipping `TaskPriority::IO` if enough workers
+  // are already busy with it.
+  //
+  // If this returns IO work, the caller must call `ReleaseIOWorker()` once
+  // it has finished with it.
+  static std::optional<std::pair<Item, TaskPriority>> FindWork(
+    State& state,
+    std::size_t index) {
+    for (std::size_t lane = 0; lane < PriorityCount; ++lane) {
+      if (state.mLaneCounters[lane].IsEmpty()) {
+        continue;
+      }
+      const bool isIO = (lane == IOLane);
+      if (isIO && !TryAcquireIOWorker(state)) {
+        continue;
+      }
+      if (const auto item = FindWorkInLane(state, index, lane)) {
+        return std::pair {*item, static_cast<TaskPriority>(lane)};
+      }
+      if (isIO) {
+        ReleaseIOWorker(state);
+      }
+    }
+    return std::nullopt;
+  }
+
+  static bool TryAcquireIOWorker(State& state) noexcept {
+    auto count = state.mIOWorkers.load(std::memory_order_relaxed);
+    do {
+      if (count >= state.mMaxIOWorkers) {
+        return false;
+      }
+    } while (!state.mIOWorkers.compare_exchange_weak(
+      count, count + 1, std::memory_order_seq_cst));
+    return true;
+  }
+
+  static void ReleaseIOWorker(State& state) {
+    state.mIOWorkers.fetch_sub(1, std::memory_order_seq_cst);
+    // Pairs with the wait in `Work()`: other workers may have gone to sleep
+    // while we were at the limit, leaving IO work queued
+    if (
+      state.mSleepers.load(std::memory_order_seq_cst) > 0
+      && !state.mLaneCounters[IOLane].IsEmpty()) {
+      std::unique_lock lock(state.mSleepMutex);
+      state.mWake.notify_one();
+    }
+  }
+
+  // Whether there's work that a sleeping worker could pick up
+  static bool HaveRunnableWork(const State& state) noexcept {
+    const auto pending = state.mPending.load(std::memory_order_seq_cst);
+    if (
+      state.mIOWorkers.load(std::memory_order_seq_cst) < state.mMaxIOWorkers) {
+      return pending > 0;
+    }
+    return pending > state.mLaneCounters[IOLane].GetDepth();
+  }
+
+  static void Work(
+    std::stop_token stopToken,
+    std::shared_ptr<State> state,
+    std::size_t index,
+    std::weak_ptr<TaskScheduler> scheduler) {
+#ifdef _WIN32
+    // Let `task<>`s using `COMTaskExecutor` be created on our workers
+    const auto comResult = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+#endif
+    tWorkerState = state.get();
+    tWorkerIndex = index;
+    SetCurrent(scheduler);
+
+    while (true) {
+      if (const auto work = FindWork(*state, index)) {
+        const auto& [item, priority] = *work;
+        // Lane depth first: `HaveRunnableWork()` must not see `mPending`
+        // without this item, but the IO lane depth with it
+        state->mLaneCounters[std::to_underlying(priority)].Resumed(
+          Clock::now() - item.mPostedAt);
+        state->mPending.fetch_sub(1, std::memory_order_seq_cst);
+        tWorkerPriority = priority;
+        item.mCoro.resume();
+        if (priority == TaskPriority::IO) {
+          ReleaseIOWorker(*state);
+        }
+        continue;
+      }
+
+      std::unique_lock lock(state->mSleepMutex);
+      state->mSleepers.fetch_add(1, std::memory_order_seq_cst);
+      const auto haveWork = state->mWake.wait(
+        lock, stopToken, [&state]() { return HaveRunnableWork(*state); });
+      state->mSleepers.fetch_sub(1, std::memory_order_relaxed);
+      if (!haveWork) {
+        break;
+      }
+    }
+
+#ifdef _WIN32
+    if (SUCCEEDED(comResult)) {
+      CoUninitialize();
+    }
+#endif
+  }
+
+  // If the current thread is a worker, the pool it belongs to
+  static inline thread_local const State* tWorkerState {nullptr};
+  static inline thread_local std::size_t tWorkerIndex {};
+  // The lane of the work that's currently running on this worker
+  static inline thread_local TaskPriority tWorkerPriority {DefaultPriority};
+
+  std::shared_ptr<State> mState;
+  std::vector<std::jthread> mThreads;
+};
+
+}// namespace OpenKneeboard
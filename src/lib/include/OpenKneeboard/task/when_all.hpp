@@ -0,0 +1,115 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#pragma once
+
+#include <OpenKneeboard/fatal.hpp>
+#include <OpenKneeboard/task.hpp>
+
+#include <exception>
+#include <ranges>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace OpenKneeboard::detail {
+
+template <std::ranges::input_range R>
+using range_task_traits_t =
+  typename TaskTraitsOf<std::ranges::range_value_t<R>>::type;
+
+template <std::ranges::input_range R>
+using when_all_result_t = std::conditional_t<
+  std::is_void_v<typename range_task_traits_t<R>::result_type>,
+  void,
+  std::vector<typename range_task_traits_t<R>::result_type>>;
+
+}// namespace OpenKneeboard::detail
+
+namespace OpenKneeboard {
+
+/** Wait for every task in `tasks`, and return their results in order.
+ *
+ * `task<>`s start when they're created, so they run concurrently as long as
+ * they're all created before any of them are awaited. This takes ownership
+ * of all of them before awaiting any, so a lazy range such as
+ * `std::views::transform(items, &Load)` also starts every task up front.
+ *
+ * Like any `task<>`, this completes on the thread it was called from.
+ *
+ * If any tasks throw, all tasks are still awaited, then the first exception
+ * - in the order of `tasks` - is rethrown; the others are discarded.
+ *
+ * Usage: `co_await when_all(std::move(tasks))`.
+ */
+template <std::ranges::input_range R>
+  requires detail::awaitable_task<std::ranges::range_value_t<R>>
+detail::Task<detail::CombinedTaskTraits<
+  detail::range_task_traits_t<R>,
+  detail::when_all_result_t<R>>>
+when_all(R tasks) {
+  using task_t = std::ranges::range_value_t<R>;
+  using result_t = detail::when_all_result_t<R>;
+
+  std::vector<task_t> pending;
+  if constexpr (std::ranges::sized_range<R>) {
+    pending.reserve(std::ranges::size(tasks));
+  }
+  for (auto&& it: tasks) {
+    pending.push_back(std::move(it));
+  }
+
+  std::exception_ptr firstException;
+  StackTrace firstExceptionStack;
+
+  // Unused for `void` tasks
+  [[maybe_unused]]
+  std::conditional_t<std::is_void_v<result_t>, std::monostate, result_t>
+    results {};
+  if constexpr (!std::is_void_v<result_t>) {
+    results.reserve(pending.size());
+  }
+
+  for (auto&& it: pending) {
+    try {
+      if constexpr (std::is_void_v<result_t>) {
+        co_await std::move(it);
+      } else {
+        results.push_back(co_await std::move(it));
+      }
+    } catch (...) {
+      if (!firstException) {
+        firstException = std::current_exception();
+        firstExceptionStack = StackTrace::GetForMostRecentException();
+      }
+    }
+  }
+
+  if (firstException) {
+    StackTrace::SetForNextException(firstExceptionStack);
+    std::rethrow_exception(firstException);
+  }
+
+  if constexpr (!std::is_void_v<result_t>) {
+    co_return std::move(results);
+  }
+}
+
+}// namespace OpenKneeboard
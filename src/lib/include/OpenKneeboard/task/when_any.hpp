@@ -0,0 +1,192 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+#pragma once
+
+#include <OpenKneeboard/fatal.hpp>
+#include <OpenKneeboard/task.hpp>
+
+#include <OpenKneeboard/task/when_all.hpp>
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <ranges>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace OpenKneeboard {
+
+template <class T>
+struct when_any_result {
+  /// The position in the range of the task that completed first
+  std::size_t mIndex {};
+  T mResult {};
+};
+
+template <>
+struct when_any_result<void> {
+  std::size_t mIndex {};
+};
+
+}// namespace OpenKneeboard
+
+namespace OpenKneeboard::detail {
+
+template <class TResult>
+struct WhenAnyState {
+  std::atomic_flag mHaveWinner;
+  when_any_result<TResult> mResult;
+  std::exception_ptr mException;
+  StackTrace mExceptionStack;
+
+  std::atomic<TaskPromiseWaiting> mWaiting {TaskPromiseRunning};
+
+  // Called once, by the winner
+  void Complete() noexcept {
+    const auto oldState
+      = mWaiting.exchange(TaskPromiseCompleted, std::memory_order_acq_rel);
+    if (oldState != TaskPromiseRunning) {
+      oldState.mNext.resume();
+    }
+  }
+
+  /// `co_await state.Wait()` to continue once `Complete()` has been called
+  auto Wait() noexcept {
+    struct Awaiter {
+      std::atomic<TaskPromiseWaiting>& mWaiting;
+
+      bool await_ready() const noexcept {
+        return mWaiting.load(std::memory_order_acquire)
+          == TaskPromiseCompleted;
+      }
+
+      bool await_suspend(std::coroutine_handle<> caller) noexcept {
+        // As with `TaskAwaiter`, don't replace `Completed`
+        auto oldState = TaskPromiseRunning;
+        return mWaiting.compare_exchange_strong(
+          oldState,
+          {.mNext = caller},
+          std::memory_order_acq_rel,
+          std::memory_order_acquire);
+      }
+
+      void await_resume() const noexcept {
+      }
+    };
+    return Awaiter {mWaiting};
+  }
+};
+
+template <class TTraits>
+struct WhenAnyWaiterTraits : FireAndForgetTraits {
+  using executor_type = typename TTraits::executor_type;
+};
+
+// Like `fire_and_forget`, but with the executor of the awaited tasks
+template <class TTraits>
+struct WhenAnyWaiter : Task<WhenAnyWaiterTraits<TTraits>> {
+  using Task<WhenAnyWaiterTraits<TTraits>>::Task;
+};
+
+template <class TTraits>
+WhenAnyWaiter<TTraits> AwaitForWhenAny(
+  std::shared_ptr<WhenAnyState<typename TTraits::result_type>> state,
+  std::size_t index,
+  Task<TTraits> task) {
+  using result_t = typename TTraits::result_type;
+
+  std::exception_ptr exception;
+  StackTrace exceptionStack;
+  [[maybe_unused]]
+  std::conditional_t<std::is_void_v<result_t>, std::monostate, result_t>
+    result {};
+  try {
+    if constexpr (std::is_void_v<result_t>) {
+      co_await std::move(task);
+    } else {
+      result = co_await std::move(task);
+    }
+  } catch (...) {
+    exception = std::current_exception();
+    exceptionStack = StackTrace::GetForMostRecentException();
+  }
+
+  if (state->mHaveWinner.test_and_set(std::memory_order_acq_rel)) {
+    co_return;
+  }
+
+  state->mResult.mIndex = index;
+  if constexpr (!std::is_void_v<result_t>) {
+    state->mResult.mResult = std::move(result);
+  }
+  state->mException = std::move(exception);
+  state->mExceptionStack = std::move(exceptionStack);
+  state->Complete();
+}
+
+}// namespace OpenKneeboard::detail
+
+namespace OpenKneeboard {
+
+/** Wait for the first task in `tasks` to complete, and return its result.
+ *
+ * Like `when_all()`, this takes ownership of all the tasks - starting any
+ * lazily-created ones - before waiting.
+ *
+ * Like any `task<>`, this completes on the thread it was called from.
+ *
+ * If the first task to complete throws, the exception is rethrown.
+ *
+ * The other tasks keep running; as `task<>`s must be awaited, they're awaited
+ * in the background, and their results and exceptions are discarded. Anything
+ * they reference must outlive them, not just this call.
+ *
+ * `tasks` must not be empty.
+ *
+ * Usage: `const auto [index, result] = co_await when_any(std::move(tasks))`.
+ */
+template <std::ranges::input_range R>
+  requires detail::awaitable_task<std::ranges::range_value_t<R>>
+detail::Task<detail::CombinedTaskTraits<
+  detail::range_task_traits_t<R>,
+  when_any_result<typename detail::range_task_traits_t<R>::result_type>>>
+when_any(R tasks) {
+  using traits_t = detail::range_task_traits_t<R>;
+
+  const auto state
+    = std::make_shared<detail::WhenAnyState<typename traits_t::result_type>>();
+  std::size_t count = 0;
+  for (auto&& it: tasks) {
+    detail::AwaitForWhenAny<traits_t>(state, count++, std::move(it));
+  }
+  OPENKNEEBOARD_ASSERT(count > 0, "when_any() requires at least one task");
+
+  co_await state->Wait();
+
+  if (state->mException) {
+    StackTrace::SetForNextException(state->mExceptionStack);
+    std::rethrow_exception(state->mException);
+  }
+  co_return std::move(state->mResult);
+}
+
+}// namespace OpenKneeboard
@@ -22,14 +22,18 @@
 #include <OpenKneeboard/macros.hpp>
 #include <OpenKneeboard/scope_exit.hpp>
 
+#ifdef _WIN32
 #include <Windows.h>
 #include <winmeta.h>
+#endif
 
 #include <exception>
 #include <source_location>
 
+#ifdef _WIN32
 #include <TraceLoggingActivity.h>
 #include <TraceLoggingProvider.h>
+#endif
 
 namespace OpenKneeboard {
 
@@ -48,7 +52,9 @@ wchar_t* GetFullPathForCurrentExecutable();
   TraceLoggingValue( \
     ::OpenKneeboard::GetFullPathForCurrentExecutable(), "Executable")
 
+#ifdef _WIN32
 TRACELOGGING_DECLARE_PROVIDER(gTraceProvider);
+#endif
 
 #define OPENKNEEBOARD_TraceLoggingSourceLocation(loc) \
   TraceLoggingValue(loc.file_name(), "File"), \
@@ -64,7 +70,41 @@ TRACELOGGING_DECLARE_PROVIDER(gTraceProvider);
     TraceLoggingValue(pr.Top(), name "/Top"), \
     OPENKNEEBOARD_TraceLoggingSize2D(pr, name)
 
-#if defined(CLANG_TIDY) || defined(__CLANG__) || defined(CLANG_CL)
+#if !defined(_WIN32)
+// TraceLogging is an ETW API; in the portable build (see src/portable.cmake),
+// tracing compiles away entirely, and the arguments are not evaluated.
+namespace NoTraceLogging {
+class Provider final {};
+class ThreadActivity final {};
+
+class ScopedActivity final {
+ public:
+  constexpr void Stop() {
+  }
+  constexpr void CancelAutoStop() {
+  }
+  constexpr void StopWithResult([[maybe_unused]] auto result) {
+  }
+};
+}// namespace NoTraceLogging
+// So that `TraceLoggingThreadActivity<gTraceProvider>` members and locals
+// don't need `#ifdef`s
+inline constexpr NoTraceLogging::Provider gTraceProvider {};
+template <const auto& TProvider, auto... TOptions>
+using TraceLoggingThreadActivity = NoTraceLogging::ThreadActivity;
+#define OPENKNEEBOARD_TraceLoggingScope(...)
+#define OPENKNEEBOARD_TraceLoggingScopedActivity(activity, ...) \
+  ::OpenKneeboard::NoTraceLogging::ScopedActivity activity;
+#define OPENKNEEBOARD_TraceLoggingWrite(...) static_cast<void>(0)
+#define OPENKNEEBOARD_TraceLoggingCoro(...)
+
+#define TraceLoggingProviderEnabled(...) false
+#define TraceLoggingWrite(...) static_cast<void>(0)
+#define TraceLoggingWriteStart(...) static_cast<void>(0)
+#define TraceLoggingWriteStop(...) static_cast<void>(0)
+#define TraceLoggingWriteTagged(...) static_cast<void>(0)
+
+#elif defined(CLANG_TIDY) || defined(__CLANG__) || defined(CLANG_CL)
 // We should be able to switch to the real definitions once
 // we're using `/Zc:preprocessor` and OPENKNEEBOARD_VA_OPT_SUPPORTED is true
 namespace ClangStubs {
@@ -0,0 +1,256 @@
+# Non-Windows build of the components that have portable implementations.
+#
+# This is not a port of OpenKneeboard: it exists so that the platform layers
+# with POSIX backends, and the stress tests and benchmarks for them, can be
+# built and run under sanitizers on Linux and macOS.
+#
+# Requires libstdc++ from GCC 14 or later, for `<format>`, `<print>`, and
+# `<stacktrace>`.
+include_guard(GLOBAL)
+
+include(FetchContent)
+
+find_package(Threads REQUIRED)
+
+# Same release as third-party/magic_enum.cmake; that also installs the license
+# file, which needs the Windows build's output layout
+FetchContent_Declare(
+  magic_enum
+  URL "https://github.com/Neargye/magic_enum/releases/download/v0.9.6/magic_enum-v0.9.6.tar.gz"
+  URL_HASH "SHA256=83C8367F1FF738A32D4D904C46CEE31C643E766848F5112D77DA4A737B1EDD0B"
+  EXCLUDE_FROM_ALL
+  FIND_PACKAGE_ARGS CONFIG
+)
+FetchContent_MakeAvailable(magic_enum)
+
+# Same release as third-party/bindline.cmake; only the `weak_refs` and
+# `bindline` targets are used, not the C++/WinRT or WIL extensions
+FetchContent_Declare(
+  bindline
+  URL "https://github.com/fredemmott/bindline/archive/refs/tags/v0.1.zip"
+  URL_HASH "SHA256=765a1a5251d7901a99cc6663fe08cb751c09deca6740ed99b2d964d0af8ccbc6"
+  EXCLUDE_FROM_ALL
+)
+FetchContent_MakeAvailable(bindline)
+
+# Same archive as third-party/json.cmake; it's just the headers
+FetchContent_Declare(
+  json
+  URL "https://github.com/nlohmann/json/releases/download/v3.11.3/include.zip"
+  URL_HASH "SHA256=a22461d13119ac5c78f205d3df1db13403e58ce1bb1794edc9313677313f4a9d"
+)
+FetchContent_MakeAvailable(json)
+add_library(OpenKneeboard-json INTERFACE)
+target_include_directories(
+  OpenKneeboard-json
+  SYSTEM
+  INTERFACE
+  "${json_SOURCE_DIR}/include"
+)
+target_compile_definitions(
+  OpenKneeboard-json
+  INTERFACE
+  JSON_DISABLE_ENUM_SERIALIZATION=1
+)
+
+set(BUILD_BITNESS 64)
+if(CMAKE_SIZEOF_VOID_P EQUAL 4)
+  set(BUILD_BITNESS 32)
+endif()
+
+set(PORTABLE_LIB_DIR "${CMAKE_CURRENT_LIST_DIR}/lib")
+set(PORTABLE_UTILITIES_DIR "${CMAKE_CURRENT_LIST_DIR}/utilities")
+set(PORTABLE_APP_COMMON_DIR "${CMAKE_CURRENT_LIST_DIR}/app/app-common")
+
+add_library(OpenKneeboard-Lib-Headers INTERFACE)
+target_include_directories(
+  OpenKneeboard-Lib-Headers
+  INTERFACE
+  "${PORTABLE_LIB_DIR}/include"
+)
+
+configure_file(
+  "${PORTABLE_LIB_DIR}/include/OpenKneeboard/config.in.hpp"
+  "${CMAKE_BINARY_DIR}/include/OpenKneeboard/config.hpp"
+  @ONLY
+)
+file(
+  GENERATE
+  OUTPUT
+  "${CMAKE_BINARY_DIR}/$<CONFIG>/include/OpenKneeboard/detail/config.hpp"
+  CONTENT "\
+namespace OpenKneeboard::detail::Config {
+  constexpr auto BuildType = \"$<CONFIG>\";
+}"
+)
+add_library(OpenKneeboard-config INTERFACE)
+target_include_directories(
+  OpenKneeboard-config
+  INTERFACE
+  "${CMAKE_BINARY_DIR}/include"
+  "${CMAKE_BINARY_DIR}/$<CONFIG>/include"
+)
+target_link_libraries(OpenKneeboard-config INTERFACE OpenKneeboard-Lib-Headers)
+
+add_library(OpenKneeboard-dprint STATIC "${PORTABLE_LIB_DIR}/dprint-POSIX.cpp")
+target_link_libraries(OpenKneeboard-dprint PUBLIC OpenKneeboard-config)
+
+add_library(OpenKneeboard-fatal STATIC "${PORTABLE_LIB_DIR}/fatal-POSIX.cpp")
+target_link_libraries(
+  OpenKneeboard-fatal
+  PUBLIC
+  OpenKneeboard-config
+  PRIVATE
+  OpenKneeboard-dprint
+  ${CMAKE_DL_LIBS}
+)
+
+add_library(OpenKneeboard-StateMachine INTERFACE)
+target_link_libraries(
+  OpenKneeboard-StateMachine
+  INTERFACE
+  OpenKneeboard-Lib-Headers
+  magic_enum::magic_enum
+)
+
+# `task<T>`, and the portable executors (`RunLoop` and `ThreadPool`)
+add_library(OpenKneeboard-task INTERFACE)
+target_link_libraries(
+  OpenKneeboard-task
+  INTERFACE
+  OpenKneeboard-StateMachine
+  OpenKneeboard-dprint
+  OpenKneeboard-fatal
+  magic_enum::magic_enum
+  Threads::Threads
+)
+
+add_library(
+  OpenKneeboard-ThreadGuard
+  STATIC
+  "${PORTABLE_LIB_DIR}/ThreadGuard.cpp"
+)
+target_link_libraries(
+  OpenKneeboard-ThreadGuard
+  PUBLIC
+  OpenKneeboard-Lib-Headers
+  PRIVATE
+  OpenKneeboard-dprint
+)
+
+# `Event<>` and `ConcurrentEvent<>`; the rest of app-common needs Windows
+add_library(
+  OpenKneeboard-Events
+  STATIC
+  "${PORTABLE_APP_COMMON_DIR}/Events.cpp"
+  "${PORTABLE_APP_COMMON_DIR}/ConcurrentEvent.cpp"
+)
+target_include_directories(
+  OpenKneeboard-Events
+  PUBLIC
+  "${PORTABLE_APP_COMMON_DIR}/include"
+)
+target_link_libraries(
+  OpenKneeboard-Events
+  PUBLIC
+  OpenKneeboard-config
+  OpenKneeboard-dprint
+  OpenKneeboard-task
+  OpenKneeboard-ThreadGuard
+  FredEmmott::bindline
+  FredEmmott::weak_refs
+  PRIVATE
+  OpenKneeboard-fatal
+)
+
+# Uses the local socket transport; see `APIEventTransportKind`
+add_library(
+  OpenKneeboard-APIEvent
+  STATIC
+  "${PORTABLE_LIB_DIR}/APIEvent.cpp"
+  "${PORTABLE_LIB_DIR}/APIEventBatchReader.cpp"
+  "${PORTABLE_LIB_DIR}/APIEventTransport.cpp"
+  "${PORTABLE_LIB_DIR}/APIEventTransport-POSIX.cpp"
+)
+target_link_libraries(
+  OpenKneeboard-APIEvent
+  PUBLIC
+  OpenKneeboard-config
+  OpenKneeboard-json
+  PRIVATE
+  OpenKneeboard-dprint
+)
+
+add_library(
+  OpenKneeboard-SHM-Platform
+  STATIC
+  "${PORTABLE_LIB_DIR}/SHM/Platform-POSIX.cpp"
+)
+target_include_directories(
+  OpenKneeboard-SHM-Platform
+  PUBLIC
+  "${PORTABLE_LIB_DIR}"
+)
+target_link_libraries(
+  OpenKneeboard-SHM-Platform
+  PUBLIC
+  Threads::Threads
+  PRIVATE
+  OpenKneeboard-dprint
+)
+if(CMAKE_SYSTEM_NAME STREQUAL "Linux")
+  # `shm_open()` is in librt before glibc 2.34
+  target_link_libraries(OpenKneeboard-SHM-Platform PUBLIC rt)
+endif()
+
+add_executable(
+  shm-platform-stress
+  "${PORTABLE_UTILITIES_DIR}/shm-platform-stress.cpp"
+)
+target_link_libraries(
+  shm-platform-stress
+  PRIVATE
+  OpenKneeboard-SHM-Platform
+  OpenKneeboard-dprint
+)
+
+add_executable(
+  shm-swapchain-simulation
+  "${PORTABLE_UTILITIES_DIR}/shm-swapchain-simulation.cpp"
+)
+target_link_libraries(shm-swapchain-simulation PRIVATE OpenKneeboard-config)
+
+add_executable(
+  task-executor-benchmark
+  "${PORTABLE_UTILITIES_DIR}/task-executor-benchmark.cpp"
+)
+target_link_libraries(task-executor-benchmark PRIVATE OpenKneeboard-task)
+
+add_executable(
+  tabs-startup-benchmark
+  "${PORTABLE_UTILITIES_DIR}/tabs-startup-benchmark.cpp"
+)
+target_link_libraries(tabs-startup-benchmark PRIVATE OpenKneeboard-task)
+
+add_executable(
+  events-concurrent-stress
+  "${PORTABLE_UTILITIES_DIR}/events-concurrent-stress.cpp"
+)
+target_link_libraries(events-concurrent-stress PRIVATE OpenKneeboard-Events)
+
+add_executable(
+  apievent-benchmark
+  "${PORTABLE_UTILITIES_DIR}/apievent-benchmark.cpp"
+)
+target_link_libraries(apievent-benchmark PRIVATE OpenKneeboard-APIEvent)
+
+add_executable(
+  apievent-throughput
+  "${PORTABLE_UTILITIES_DIR}/apievent-throughput.cpp"
+)
+target_link_libraries(
+  apievent-throughput
+  PRIVATE
+  OpenKneeboard-APIEvent
+  OpenKneeboard-Events
+)
@@ -0,0 +1,257 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+// Compares the cost of the v1.3 text and binary API event packet formats.
+//
+// Only the text format is sent between processes - see `APIEvent::Send()`;
+// the binary format is only used for recordings (`APIEventLog`), so it's
+// reported separately, and isn't an alternative send path.
+//
+// The message mix is roughly what DCS sends during a mission: mostly
+// `dcs/SelfData` and `dcs/MissionTime`, with occasional radio messages,
+// remote control actions, and plugin events with names that aren't built-in.
+//
+// It also compares dispatching each event to 50 DCS tabs by comparing names
+// against dispatching through an `APIEventHandlerTable`.
+//
+// Usage: apievent-benchmark [events] [rounds]
+
+#include <OpenKneeboard/APIEvent.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <format>
+#include <functional>
+#include <initializer_list>
+#include <print>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace OpenKneeboard;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::vector<APIEvent> CreateEvents(std::size_t count) {
+  std::mt19937 random {42};
+  std::uniform_real_distribution<double> coordinate {-1000, 1000};
+  std::uniform_int_distribution<int> kind {0, 99};
+
+  std::vector<APIEvent> ret;
+  ret.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    const auto k = kind(random);
+    if (k < 45) {
+      ret.push_back({
+        "dcs/SelfData",
+        std::format(
+          R"({{"Coalition":"Enemies","Country":2,"Heading":{},)"
+          R"("LatLongAlt":{{"Lat":{},"Long":{},"Alt":{}}},)"
+          R"("Name":"FA-18C_hornet","Type":{{"level1":1,"level2":1}}}})",
+          coordinate(random),
+          coordinate(random),
+          coordinate(random),
+          coordinate(random)),
+      });
+    } else if (k < 90) {
+      ret.push_back({
+        "dcs/MissionTime",
+        std::format(
+          R"({{"currentTime":{},"utcOffset":14400}})", coordinate(random)),
+      });
+    } else if (k < 95) {
+      ret.push_back({
+        "dcs/Message",
+        R"({"message":"Enfield 1-1, Texaco, cleared to pre-contact",)"
+        R"("messageType":1})",
+      });
+    } else if (k < 99) {
+      ret.push_back({"RemoteUserAction", "NEXT_PAGE"});
+    } else {
+      ret.push_back({
+        "com.example.myplugin/CustomEvent",
+        R"({"ActionID":"com.example.myplugin/refresh","ExtraData":null})",
+      });
+    }
+  }
+  return ret;
+}
+
+// A model of a DCS tab, without the tab: the events it reacts to, and a
+// table from those events to their position in `mEventNames`
+struct DispatchReceiver {
+  std::vector<std::string_view> mEventNames;
+  APIEventHandlerTable<std::size_t> mHandlers;
+
+  DispatchReceiver(std::initializer_list<std::string_view> eventNames)
+    : mEventNames(eventNames) {
+    for (std::size_t i = 0; i < mEventNames.size(); ++i) {
+      mHandlers.Add(mEventNames.at(i), i + 1);
+    }
+  }
+};
+
+// 10 each of the aircraft, terrain, mission, radio log, and briefing tabs
+std::vector<DispatchReceiver> CreateDispatchReceivers() {
+  std::vector<DispatchReceiver> ret;
+  for (std::size_t i = 0; i < 10; ++i) {
+    ret.push_back({"dcs/Aircraft"});
+    ret.push_back({"dcs/Terrain"});
+    ret.push_back({"dcs/Mission", "dcs/Aircraft"});
+    ret.push_back({"dcs/SimulationStart", "dcs/Message"});
+    ret.push_back({"dcs/Mission", "dcs/SelfData", "dcs/Origin"});
+  }
+  return ret;
+}
+
+std::string_view AsStringView(const std::vector<std::byte>& packet) {
+  return {reinterpret_cast<const char*>(packet.data()), packet.size()};
+}
+
+// Best of `rounds`, in nanoseconds per event
+double Measure(
+  std::size_t eventCount,
+  std::size_t rounds,
+  const std::function<std::size_t()>& fn) {
+  auto best = Clock::duration::max();
+  // Stop the compiler optimizing away the work
+  volatile std::size_t sink {};
+  for (std::size_t i = 0; i < rounds; ++i) {
+    const auto start = Clock::now();
+    sink = sink + fn();
+    best = std::min(best, Clock::now() - start);
+  }
+  return std::chrono::duration<double, std::nano>(best).count() / eventCount;
+}
+
+}// namespace
+
+int main(int argc, char** argv) {
+  const std::size_t eventCount = (argc > 1) ? std::atoi(argv[1]) : 100000;
+  const std::size_t rounds = (argc > 2) ? std::atoi(argv[2]) : 10;
+
+  const auto events = CreateEvents(eventCount);
+
+  std::vector<std::vector<std::byte>> textPackets;
+  std::vector<std::vector<std::byte>> binaryPackets;
+  std::size_t textBytes {};
+  std::size_t binaryBytes {};
+  for (const auto& event: events) {
+    textBytes += textPackets.emplace_back(event.SerializeText()).size();
+    binaryBytes += binaryPackets.emplace_back(event.Serialize()).size();
+  }
+
+  const auto serialize = [&](auto method) {
+    return [&events, method]() {
+      std::size_t ret {};
+      for (const auto& event: events) {
+        ret += std::invoke(method, event).size();
+      }
+      return ret;
+    };
+  };
+  const auto unserialize = [](const auto& packets) {
+    return [&packets]() {
+      std::size_t ret {};
+      for (const auto& packet: packets) {
+        ret += APIEvent::Unserialize(AsStringView(packet)).value.size();
+      }
+      return ret;
+    };
+  };
+  const auto parseView = [](const auto& packets) {
+    return [&packets]() {
+      std::size_t ret {};
+      for (const auto& packet: packets) {
+        ret += APIEventView::Parse(AsStringView(packet)).value.size();
+      }
+      return ret;
+    };
+  };
+
+  std::println("{} events, best of {} rounds", eventCount, rounds);
+
+  const auto print = [&](std::string_view label, const auto& fn) {
+    std::println(
+      "  {:<28}: {:>8.1f}ns/event", label, Measure(eventCount, rounds, fn));
+  };
+  std::println(
+    "Send path - v1.3 text packets, average {:.1f} bytes:",
+    static_cast<double>(textBytes) / eventCount);
+  print("SerializeText", serialize(&APIEvent::SerializeText));
+  print("Unserialize", unserialize(textPackets));
+  print("APIEventView::Parse", parseView(textPackets));
+  std::println(
+    "Recordings only - binary packets, average {:.1f} bytes:",
+    static_cast<double>(binaryBytes) / eventCount);
+  print("Serialize", serialize(&APIEvent::Serialize));
+  print("Unserialize", unserialize(binaryPackets));
+  print("APIEventView::Parse", parseView(binaryPackets));
+
+  auto resolvedEvents = events;
+  for (auto& event: resolvedEvents) {
+    event.typeID = APIEventRegistry::Find(event.name);
+  }
+  const auto receivers = CreateDispatchReceivers();
+
+  // Each tab checks for the install and saved games paths, then for each of
+  // its own events
+  const auto dispatchByName = [&]() {
+    std::size_t ret {};
+    for (const auto& event: resolvedEvents) {
+      for (const auto& receiver: receivers) {
+        if (
+          event.name == "dcs/InstallPath"
+          || event.name == "dcs/SavedGamesPath") {
+          ++ret;
+          continue;
+        }
+        for (std::size_t i = 0; i < receiver.mEventNames.size(); ++i) {
+          if (event.name == receiver.mEventNames.at(i)) {
+            ret += i + 1;
+            break;
+          }
+        }
+      }
+    }
+    return ret;
+  };
+  const auto dispatchByTable = [&]() {
+    std::size_t ret {};
+    for (const auto& event: resolvedEvents) {
+      for (const auto& receiver: receivers) {
+        if (const auto handler = receiver.mHandlers.Find(event.typeID)) {
+          ret += *handler;
+        }
+      }
+    }
+    return ret;
+  };
+
+  std::println("Dispatching to {} tabs:", receivers.size());
+  print("Comparing names", dispatchByName);
+  print("APIEventHandlerTable", dispatchByTable);
+
+  return EXIT_SUCCESS;
+}
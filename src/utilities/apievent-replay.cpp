@@ -0,0 +1,219 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+// Replays API events recorded by OpenKneeboard into a running copy of
+// OpenKneeboard, then reports how long the app took to process them.
+//
+// To record events, set the `RecordAPIEvents` DWORD registry value to 1 in
+// the same key as `MaxLogFiles`; the logs are written to the `APIEvents`
+// folder in the logs directory.
+//
+// The events are sent through the normal transport and `APIEventServer`, so
+// they are coalesced and dispatched exactly as they would be if they were
+// coming from DCS. Recordings store binary packets, but the mailslot is
+// shared with older OpenKneeboard versions, so they're re-encoded as v1.3
+// text packets - like `APIEvent::Send()` - before replaying.
+//
+// The report comes from `SHM::APIEventMetrics`, which is cleared before
+// replaying.
+//
+// Usage: apievent-replay LOG_FILE [speed]
+//
+// `speed` is a multiplier - e.g. `1` (the default) for real time, `10` for
+// 10x - or `max` to send events as fast as possible.
+
+#include <OpenKneeboard/APIEvent.hpp>
+#include <OpenKneeboard/APIEventLog.hpp>
+#include <OpenKneeboard/APIEventTransport.hpp>
+#include <OpenKneeboard/SHM/APIEventMetrics.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <optional>
+#include <print>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace OpenKneeboard;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using Metrics = SHM::APIEventMetrics;
+
+// How long the app must be idle after the last event is sent before we
+// report
+constexpr std::chrono::seconds SettleTime {2};
+
+void PrintReport(const Metrics& metrics) {
+  const auto& latency = metrics.mProcessingLatency;
+  std::println(
+    "Processing latency: {} events; p50 {}, p95 {}, p99 {}",
+    latency.GetSampleCount(),
+    latency.GetPercentile(0.50),
+    latency.GetPercentile(0.95),
+    latency.GetPercentile(0.99));
+
+  if (metrics.mFlushCount) {
+    std::println(
+      "Ordered event queue backlog: {} flushes; average {:.1f}, max {}",
+      metrics.mFlushCount,
+      static_cast<double>(metrics.mTotalBacklog) / metrics.mFlushCount,
+      metrics.mMaxBacklog);
+  }
+
+  std::vector<std::size_t> types;
+  for (std::size_t i = 0; i < metrics.mHandlerCosts.size(); ++i) {
+    if (metrics.mHandlerCosts.at(i).mCount) {
+      types.push_back(i);
+    }
+  }
+  std::ranges::sort(types, std::greater {}, [&](const auto i) {
+    return metrics.mHandlerCosts.at(i).mTotalNanoseconds;
+  });
+
+  std::println("Handler cost, by total:");
+  for (const auto i: types) {
+    const auto& cost = metrics.mHandlerCosts.at(i);
+    auto name = GetBuiltinAPIEventName(static_cast<APIEventTypeID>(i));
+    if (name.empty()) {
+      name = "(other events)";
+    }
+    using ms = std::chrono::duration<double, std::milli>;
+    using us = std::chrono::duration<double, std::micro>;
+    const auto total = std::chrono::nanoseconds(cost.mTotalNanoseconds);
+    std::println(
+      "  {:<40} {:>8} events; total {:.1%Q%q}, mean {:.1%Q%q}, "
+      "max {:.1%Q%q}",
+      name,
+      cost.mCount,
+      std::chrono::duration_cast<ms>(total),
+      std::chrono::duration_cast<us>(total / cost.mCount),
+      std::chrono::duration_cast<us>(
+        std::chrono::nanoseconds(cost.mMaxNanoseconds)));
+  }
+}
+
+}// namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2 || argc > 3) {
+    std::println(stderr, "Usage: apievent-replay LOG_FILE [speed|max]");
+    return EXIT_FAILURE;
+  }
+
+  // `std::nullopt` for max speed
+  std::optional<double> speed {1.0};
+  if (argc > 2) {
+    if (std::string_view {argv[2]} == "max") {
+      speed = std::nullopt;
+    } else {
+      speed = std::atof(argv[2]);
+      if (*speed <= 0) {
+        std::println(stderr, "Speed must be a positive number, or `max`");
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  const auto records = APIEventLog::ReadAll(argv[1]);
+  if (records.empty()) {
+    std::println(stderr, "No events in {}", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  // Re-encode up front, so it doesn't affect the replay timing
+  std::vector<std::vector<std::byte>> packets;
+  packets.reserve(records.size());
+  for (const auto& record: records) {
+    const std::string_view packet {
+      reinterpret_cast<const char*>(record.mPacket.data()),
+      record.mPacket.size()};
+    packets.push_back(APIEvent::Unserialize(packet).SerializeText());
+  }
+
+  const auto sender = APIEventSender::Create(GetAPIEventTransportKind());
+  if (!sender) {
+    std::println(stderr, "No API event transport is available");
+    return EXIT_FAILURE;
+  }
+
+  using seconds = std::chrono::duration<double>;
+  const auto recordedDuration = records.back().mTime;
+  if (speed) {
+    std::println(
+      "Replaying {} events from {:.1%Q%q} at {}x",
+      records.size(),
+      std::chrono::duration_cast<seconds>(recordedDuration),
+      *speed);
+  } else {
+    std::println(
+      "Replaying {} events from {:.1%Q%q} at max speed",
+      records.size(),
+      std::chrono::duration_cast<seconds>(recordedDuration));
+  }
+
+  Metrics::Clear();
+
+  const auto start = Clock::now();
+  std::size_t failures = 0;
+  for (std::size_t i = 0; i < records.size(); ++i) {
+    if (speed) {
+      std::this_thread::sleep_until(
+        start
+        + std::chrono::duration_cast<Clock::duration>(
+          records.at(i).mTime / *speed));
+    }
+    if (!sender->Send(packets.at(i))) {
+      ++failures;
+    }
+  }
+  const auto sendDuration = Clock::now() - start;
+
+  std::println(
+    "Sent {} events in {:.2%Q%q} ({:.0f} events/s); {} failed",
+    records.size() - failures,
+    std::chrono::duration_cast<seconds>(sendDuration),
+    records.size() / std::chrono::duration_cast<seconds>(sendDuration).count(),
+    failures);
+  if (failures == records.size()) {
+    std::println(stderr, "Is OpenKneeboard running?");
+    return EXIT_FAILURE;
+  }
+
+  // Wait for the app to catch up; we can't wait for a specific count, as
+  // some events are coalesced
+  auto processed = Metrics::Get().mProcessingLatency.GetSampleCount();
+  auto lastProgress = Clock::now();
+  while (Clock::now() - lastProgress < SettleTime) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    const auto now = Metrics::Get().mProcessingLatency.GetSampleCount();
+    if (std::exchange(processed, now) != now) {
+      lastProgress = Clock::now();
+    }
+  }
+
+  PrintReport(Metrics::Get());
+
+  return EXIT_SUCCESS;
+}
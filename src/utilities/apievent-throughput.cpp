@@ -0,0 +1,369 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+// Pushes API events through the transport and `APIEventServer` to an
+// `evAPIEvent` listener that just counts them.
+//
+// The message mix is roughly what DCS sends during a mission, so most events
+// are coalesced; the report includes how many events reached the listener.
+//
+// This uses the transport from `GetAPIEventTransportKind()`. On Windows, the
+// server is a real `APIEventServer` on a `DispatcherQueue` thread; elsewhere,
+// it's a headless stand-in that emits `evAPIEvent` from the reader thread, so
+// the local socket transport can be load-tested on Linux.
+//
+// Don't run this while OpenKneeboard is running, as it needs to create the
+// server end of the transport.
+//
+// Usage: apievent-throughput [events] [senders]
+
+#include <OpenKneeboard/APIEvent.hpp>
+#include <OpenKneeboard/APIEventBatchReader.hpp>
+#include <OpenKneeboard/APIEventTransport.hpp>
+#include <OpenKneeboard/Events.hpp>
+
+#ifdef _WIN32
+#include <OpenKneeboard/APIEventServer.hpp>
+#include <OpenKneeboard/ProcessShutdownBlock.hpp>
+
+#include <shims/winrt/base.h>
+
+#include <winrt/Microsoft.UI.Dispatching.h>
+
+#include <Windows.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <format>
+#include <functional>
+#include <memory>
+#include <print>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace OpenKneeboard;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Sent by each sender after its last event; this isn't coalesced, so it's
+// never dropped
+constexpr char EVT_SENDER_DONE[]
+  = "com.fredemmott.openkneeboard.apievent-throughput/SenderDone";
+
+std::vector<std::vector<std::byte>> CreatePackets() {
+  std::vector<std::vector<std::byte>> ret;
+  for (std::size_t i = 0; i < 100; ++i) {
+    APIEvent event;
+    if (i < 45) {
+      event = {
+        "dcs/SelfData",
+        std::format(
+          R"({{"Coalition":"Enemies","Country":2,"Heading":{},)"
+          R"("LatLongAlt":{{"Lat":{},"Long":{},"Alt":{}}},)"
+          R"("Name":"FA-18C_hornet","Type":{{"level1":1,"level2":1}}}})",
+          i * 3.6,
+          42.0 + (i / 1000.0),
+          41.0 + (i / 1000.0),
+          1000 + i),
+      };
+    } else if (i < 90) {
+      event = {
+        "dcs/MissionTime",
+        std::format(R"({{"currentTime":{},"utcOffset":14400}})", i),
+      };
+    } else if (i < 95) {
+      event = {
+        "dcs/Message",
+        R"({"message":"Enfield 1-1, Texaco, cleared to pre-contact",)"
+        R"("messageType":1})",
+      };
+    } else {
+      event = {"RemoteUserAction", "NEXT_PAGE"};
+    }
+    // Matches `APIEvent::Send()`
+    ret.push_back(event.SerializeText());
+  }
+  return ret;
+}
+
+// Lives on the thread that emits `evAPIEvent`
+class Sink final : private EventReceiver {
+ public:
+  Sink() = delete;
+  Sink(Event<APIEvent>& event, std::size_t senderCount)
+    : mSenderCount(senderCount) {
+    AddEventListener(event, std::bind_front(&Sink::OnAPIEvent, this));
+  }
+
+  ~Sink() {
+    this->RemoveAllEventListeners();
+  }
+
+  void WaitForAllSenders() const {
+    mAllSendersDone.wait(false);
+  }
+
+  uint64_t mDelivered {};
+  uint64_t mBytes {};
+
+ private:
+  std::size_t mSenderCount {};
+  std::size_t mSendersDone {};
+  std::atomic_flag mAllSendersDone;
+
+  void OnAPIEvent(const APIEvent& event) {
+    if (event.name != EVT_SENDER_DONE) {
+      ++mDelivered;
+      mBytes += event.value.size();
+      return;
+    }
+    if (++mSendersDone == mSenderCount) {
+      mAllSendersDone.test_and_set();
+      mAllSendersDone.notify_all();
+    }
+  }
+};
+
+struct Results {
+  APIEventBatchReader::Statistics mReader;
+  uint64_t mDelivered {};
+  uint64_t mDeliveredBytes {};
+};
+
+#ifdef _WIN32
+// Run `fn` on `dq`'s thread, and wait for it
+void RunOn(const DispatcherQueue& dq, auto&& fn) {
+  std::atomic_flag done;
+  winrt::check_bool(dq.TryEnqueue([&]() {
+    fn();
+    done.test_and_set();
+    done.notify_all();
+  }));
+  done.wait(false);
+}
+
+class Server final {
+ public:
+  Server() = delete;
+  explicit Server(std::size_t senderCount) {
+    RunOn(mDQ, [&]() {
+      mServer = APIEventServer::Create();
+      mSink = std::make_unique<Sink>(mServer->evAPIEvent, senderCount);
+    });
+  }
+
+  void WaitForAllSenders() const {
+    mSink->WaitForAllSenders();
+  }
+
+  Results Stop() {
+    Results ret;
+    RunOn(mDQ, [&]() {
+      const auto stats = mServer->GetStatistics();
+      ret = {
+        .mReader = {
+          .mReceived = stats.mReceived,
+          .mCoalesced = stats.mCoalesced,
+          .mInvalid = stats.mInvalid,
+          .mBatches = stats.mBatches,
+        },
+        .mDelivered = mSink->mDelivered,
+        .mDeliveredBytes = mSink->mBytes,
+      };
+      mSink.reset();
+      mServer.reset();
+    });
+
+    {
+      // Wait for `APIEventServer::final_release()`
+      winrt::handle event {CreateEventW(nullptr, TRUE, FALSE, nullptr)};
+      ProcessShutdownBlock::SetEventOnCompletion(event.get());
+      if (WaitForSingleObject(event.get(), 5000) != WAIT_OBJECT_0) {
+        std::println(stderr, "Timed out waiting for the server to stop");
+        ProcessShutdownBlock::DumpActiveBlocks();
+      }
+    }
+    mDQC.ShutdownQueueAsync().get();
+    return ret;
+  }
+
+ private:
+  // `APIEventServer` dispatches on the thread that created it, which must
+  // have a `DispatcherQueue`; this stands in for the app's UI thread.
+  DispatcherQueueController mDQC {
+    DispatcherQueueController::CreateOnDedicatedThread()};
+  DispatcherQueue mDQ {mDQC.DispatcherQueue()};
+
+  std::shared_ptr<APIEventServer> mServer;
+  std::unique_ptr<Sink> mSink;
+};
+#else
+// `APIEventServer` needs WinRT for its UI thread; this is the same reader,
+// but each batch is emitted straight from the reader thread
+class Server final {
+ public:
+  Server() = delete;
+  Server(std::unique_ptr<APIEventReceiver> receiver, std::size_t senderCount)
+    : mSink(mEvent, senderCount),
+      mReader(std::make_unique<APIEventBatchReader>(std::move(receiver))) {
+    // After `mSink` is listening, as `Event<>` is not thread-safe
+    mReaderThread = std::jthread {std::bind_front(&Server::Run, this)};
+  }
+
+  void WaitForAllSenders() const {
+    mSink.WaitForAllSenders();
+  }
+
+  Results Stop() {
+    mReaderThread.request_stop();
+    mReaderThread.join();
+    return {
+      .mReader = mReader->GetStatistics(),
+      .mDelivered = mSink.mDelivered,
+      .mDeliveredBytes = mSink.mBytes,
+    };
+  }
+
+ private:
+  Event<APIEvent> mEvent;
+  Sink mSink;
+  std::unique_ptr<APIEventBatchReader> mReader;
+  std::jthread mReaderThread;
+
+  void Run(std::stop_token stop) {
+    while (!stop.stop_requested()) {
+      // Back-to-back, like `APIEventServer::DispatchBatch()`
+      for (const auto& event: mReader->Read(stop)) {
+        mEvent.Emit(event);
+      }
+    }
+  }
+};
+#endif
+
+}// namespace
+
+int main(int argc, char** argv) {
+  const std::size_t eventCount = (argc > 1) ? std::atoi(argv[1]) : 1000000;
+  const std::size_t senderCount
+    = std::max(1, (argc > 2) ? std::atoi(argv[2]) : 1);
+
+#ifdef _WIN32
+  winrt::init_apartment(winrt::apartment_type::multi_threaded);
+#endif
+
+#ifdef _WIN32
+  Server server {senderCount};
+#else
+  auto receiver = APIEventReceiver::Create(GetAPIEventTransportKind());
+  if (!receiver) {
+    std::println(stderr, "Failed to create the API event receiver");
+    return EXIT_FAILURE;
+  }
+  Server server {std::move(receiver), senderCount};
+#endif
+
+  const auto packets = CreatePackets();
+  const auto donePacket
+    = APIEvent {EVT_SENDER_DONE, "done"}.SerializeText();
+
+  std::vector<std::unique_ptr<APIEventSender>> senders;
+  for (std::size_t i = 0; i < senderCount; ++i) {
+    senders.push_back(APIEventSender::Create(GetAPIEventTransportKind()));
+    if (!senders.back()) {
+      std::println(stderr, "Failed to create an API event sender");
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::println(
+    "Sending {} events from {} senders...", eventCount, senderCount);
+  const auto start = Clock::now();
+  std::atomic<uint64_t> failedSends;
+  {
+    std::vector<std::jthread> threads;
+    for (std::size_t i = 0; i < senderCount; ++i) {
+      threads.emplace_back([&, i, sender = senders.at(i).get()]() {
+        for (std::size_t j = i; j < eventCount; j += senderCount) {
+          if (!sender->Send(packets.at(j % packets.size()))) {
+            ++failedSends;
+          }
+        }
+        while (!sender->Send(donePacket)) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+      });
+    }
+  }
+  const auto sent = Clock::now();
+
+  // Anything that hasn't been dispatched by now has been lost
+  server.WaitForAllSenders();
+  const auto received = Clock::now();
+
+  const auto [stats, delivered, deliveredBytes] = server.Stop();
+
+  const auto seconds = [start](auto end) {
+    return std::chrono::duration<double>(end - start).count();
+  };
+  std::println(
+    "Sent in {:.2f}s ({:.0f} events/s); dispatched in {:.2f}s ({:.0f} "
+    "events/s)",
+    seconds(sent),
+    eventCount / seconds(sent),
+    seconds(received),
+    eventCount / seconds(received));
+  std::println(
+    "  {} failed sends, {} invalid packets",
+    failedSends.load(),
+    stats.mInvalid);
+  std::println(
+    "  {} events received in {} batches (average {:.1f})",
+    stats.mReceived - senderCount,
+    stats.mBatches,
+    static_cast<double>(stats.mReceived) / stats.mBatches);
+  std::println(
+    "  {} coalesced, {} emitted by evAPIEvent ({:.1f} MiB of values)",
+    stats.mCoalesced,
+    delivered,
+    deliveredBytes / (1024.0 * 1024.0));
+
+  const auto lost
+    = eventCount - failedSends - (stats.mReceived - senderCount);
+  if (lost != 0) {
+    std::println(stderr, "{} events were lost", lost);
+    return EXIT_FAILURE;
+  }
+  const auto undispatched
+    = (stats.mReceived - senderCount) - stats.mCoalesced - delivered;
+  if (undispatched != 0) {
+    std::println(
+      stderr, "{} events were received but not dispatched", undispatched);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
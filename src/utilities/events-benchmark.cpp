@@ -0,0 +1,655 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+// Benchmarks for the events system: `Event<>`, `EventHandler`,
+// `EventDelay`, hooks, forwarding, and `EventReceiver` teardown.
+//
+// Every benchmark reports the mean time per operation, and how many heap
+// allocations each operation made.
+//
+// It also compares `EventHandler` against the previous implementation, an
+// `std::function` that was copied for every call.
+//
+// Usage: events-benchmark [iterations [filter]]
+//
+// If `filter` is specified, only benchmarks with names containing it are run,
+// e.g. `events-benchmark 100000 Forward/`
+
+#include <OpenKneeboard/ConcurrentEvent.hpp>
+#include <OpenKneeboard/Events.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <functional>
+#include <memory>
+#include <new>
+#include <optional>
+#include <print>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace OpenKneeboard;
+
+namespace {
+
+std::atomic_uint64_t gAllocationCount;
+
+}// namespace
+
+void* operator new(std::size_t size) {
+  gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+  if (auto ret = std::malloc(size ? size : 1)) {
+    return ret;
+  }
+  throw std::bad_alloc {};
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::string_view gFilter;
+
+bool IsEnabled(std::string_view name) {
+  return gFilter.empty() || name.find(gFilter) != std::string_view::npos;
+}
+
+void Report(
+  std::string_view name,
+  Clock::duration elapsed,
+  uint64_t allocations,
+  std::size_t operations) {
+  const auto count = static_cast<double>(operations);
+  std::println(
+    "{:<48} {:>10.1f}ns/op {:>7.2f} allocations/op",
+    name,
+    std::chrono::duration<double, std::nano>(elapsed).count() / count,
+    static_cast<double>(allocations) / count);
+}
+
+void Require(bool condition, std::string_view name, std::string_view what) {
+  if (!condition) {
+    std::println(stderr, "{}: {}", name, what);
+    std::exit(EXIT_FAILURE);
+  }
+}
+
+/** Time `calls` calls to `fn()`, as one block.
+ *
+ * Each call to `fn()` performs `operationsPerCall` operations.
+ *
+ * `fn()` is called once first, to warm up any lazily-initialized state, e.g.
+ * thread-locals.
+ */
+template <std::invocable TFn>
+void Measure(
+  std::string_view name,
+  std::size_t calls,
+  TFn&& fn,
+  std::size_t operationsPerCall = 1) {
+  fn();
+
+  const auto allocationsBefore = gAllocationCount.load();
+  const auto start = Clock::now();
+  for (std::size_t i = 0; i < calls; ++i) {
+    fn();
+  }
+  const auto elapsed = Clock::now() - start;
+  Report(
+    name,
+    elapsed,
+    gAllocationCount.load() - allocationsBefore,
+    calls * operationsPerCall);
+}
+
+/** Time only `fn(state)`, for a new `state = setup()` each time.
+ *
+ * This is for operations that need a fresh starting point, e.g. teardown;
+ * it's less precise than `Measure()`, as each operation is timed separately.
+ */
+template <std::invocable TSetup, class TFn>
+  requires std::invocable<TFn, std::invoke_result_t<TSetup>&>
+void MeasureWithSetup(
+  std::string_view name,
+  std::size_t operations,
+  TSetup&& setup,
+  TFn&& fn) {
+  {
+    auto state = setup();
+    fn(state);
+  }
+
+  Clock::duration elapsed {};
+  uint64_t allocations {};
+  for (std::size_t i = 0; i < operations; ++i) {
+    auto state = setup();
+    const auto allocationsBefore = gAllocationCount.load();
+    const auto start = Clock::now();
+    fn(state);
+    elapsed += Clock::now() - start;
+    allocations += gAllocationCount.load() - allocationsBefore;
+  }
+  Report(name, elapsed, allocations, operations);
+}
+
+class Receivers final : private EventReceiver {
+ public:
+  Receivers() = default;
+
+  template <class... Args>
+  Receivers(Event<Args...>& event, std::size_t count) {
+    this->Add(event, count);
+  }
+
+  ~Receivers() {
+    this->RemoveAllEventListeners();
+  }
+
+  template <class... Args>
+  void Add(Event<Args...>& event, std::size_t count) {
+    for (std::size_t i = 0; i < count; ++i) {
+      AddEventListener(event, [this](Args...) { ++mCalls; });
+    }
+  }
+
+  template <class... Args>
+  void Add(ConcurrentEvent<Args...>& event, std::size_t count) {
+    for (std::size_t i = 0; i < count; ++i) {
+      AddEventListener(event, [this](Args...) { ++mCalls; });
+    }
+  }
+
+  void Teardown() {
+    this->RemoveAllEventListeners();
+  }
+
+  uint64_t GetCallCount() const noexcept {
+    return mCalls;
+  }
+
+ private:
+  uint64_t mCalls {};
+};
+
+template <class... Args>
+void BenchmarkEmit(
+  std::string_view eventName,
+  std::size_t receiverCount,
+  std::size_t emits,
+  Args... args) {
+  const auto name
+    = std::format("Emit/{}/{} receivers", eventName, receiverCount);
+  if (!IsEnabled(name)) {
+    return;
+  }
+  Event<Args...> event;
+  Receivers receivers {event, receiverCount};
+
+  Measure(name, emits, [&]() { event.Emit(args...); });
+  Require(
+    receivers.GetCallCount() == (emits + 1) * receiverCount,
+    name,
+    "handlers were not called");
+}
+
+// Each emit is in its own `EventDelay`, so is queued then flushed.
+//
+// Delayed events are expected to allocate, as they must be queued.
+void BenchmarkDelayedEmit(std::size_t receiverCount, std::size_t emits) {
+  const auto name = std::format("Emit/delayed/{} receivers", receiverCount);
+  if (!IsEnabled(name)) {
+    return;
+  }
+  Event<> event;
+  Receivers receivers {event, receiverCount};
+
+  Measure(name, emits, [&]() {
+    const EventDelay delay;
+    event.Emit();
+  });
+  Require(
+    receivers.GetCallCount() == (emits + 1) * receiverCount,
+    name,
+    "handlers were not called");
+}
+
+// Several emits inside nested `EventDelay`s, as in a bulk update that calls
+// other functions that also use `EventDelay`; the queue is only flushed
+// when the outermost one is destroyed.
+void BenchmarkNestedDelay(std::size_t depth, std::size_t emits) {
+  constexpr std::size_t EmitsPerLevel = 4;
+  constexpr std::size_t MaxDepth = 8;
+  const auto name = std::format("EventDelay/depth {}", depth);
+  if (depth > MaxDepth || !IsEnabled(name)) {
+    return;
+  }
+  Event<int> event;
+  Receivers receivers {event, 1};
+
+  const auto iterations
+    = std::max<std::size_t>(1, emits / (depth * EmitsPerLevel));
+  std::array<std::optional<EventDelay>, MaxDepth> delays;
+  Measure(
+    name,
+    iterations,
+    [&]() {
+      for (std::size_t level = 0; level < depth; ++level) {
+        delays.at(level).emplace();
+        for (std::size_t i = 0; i < EmitsPerLevel; ++i) {
+          event.Emit(123);
+        }
+      }
+      for (std::size_t level = depth; level > 0; --level) {
+        delays.at(level - 1).reset();
+      }
+    },
+    depth * EmitsPerLevel);
+  Require(
+    receivers.GetCallCount() == (iterations + 1) * depth * EmitsPerLevel,
+    name,
+    "handlers were not called");
+}
+
+// Many emits inside one `EventDelay`, as in a bulk update; once the
+// per-thread ring buffer is full, queued calls are heap-allocated.
+void BenchmarkDelayedBurst(std::size_t burstSize, std::size_t emits) {
+  const auto name = std::format("EventDelay/burst of {}", burstSize);
+  if (!IsEnabled(name)) {
+    return;
+  }
+  Event<int> event;
+  Receivers receivers {event, 1};
+
+  const auto iterations = std::max<std::size_t>(1, emits / burstSize);
+  Measure(
+    name,
+    iterations,
+    [&]() {
+      const EventDelay delay;
+      for (std::size_t i = 0; i < burstSize; ++i) {
+        event.Emit(123);
+      }
+    },
+    burstSize);
+  Require(
+    receivers.GetCallCount() == (iterations + 1) * burstSize,
+    name,
+    "handlers were not called");
+}
+
+// A handler that emits another event; the second event is queued until the
+// first handler returns.
+void BenchmarkReentrantEmit(std::size_t emits) {
+  constexpr auto name = "Emit/re-entrant";
+  if (!IsEnabled(name)) {
+    return;
+  }
+  struct Chained final : EventReceiver {
+    Event<> mOuter;
+    Event<> mInner;
+    uint64_t mInnerCalls {};
+
+    Chained() {
+      AddEventListener(mOuter, [this]() { mInner.Emit(); });
+      AddEventListener(mInner, [this]() { ++mInnerCalls; });
+    }
+
+    ~Chained() {
+      this->RemoveAllEventListeners();
+    }
+  };
+  Chained chained;
+
+  Measure(name, emits, [&]() { chained.mOuter.Emit(); });
+  Require(chained.mInnerCalls == emits + 1, name, "handlers were not called");
+}
+
+void BenchmarkHook(
+  std::string_view name,
+  Event<>::HookResult result,
+  std::size_t receiverCount,
+  std::size_t emits) {
+  if (!IsEnabled(name)) {
+    return;
+  }
+  Event<> event;
+  Receivers receivers {event, receiverCount};
+  uint64_t hookCalls = 0;
+  event.AddHook([&hookCalls, result]() {
+    ++hookCalls;
+    return result;
+  });
+
+  Measure(name, emits, [&]() { event.Emit(); });
+
+  Require(hookCalls == emits + 1, name, "hook was not called");
+  const auto expectedCalls
+    = (result == Event<>::HookResult::STOP_PROPAGATION)
+    ? 0
+    : (emits + 1) * receiverCount;
+  Require(
+    receivers.GetCallCount() == expectedCalls,
+    name,
+    "handlers were called incorrectly");
+}
+
+// A chain of `AddEventListener(event, forwardTo)`, e.g. a tab containing a
+// `PageSourceWithDelegates` containing another
+void BenchmarkForwardingChain(std::size_t depth, std::size_t emits) {
+  const auto name = std::format("Forward/chain depth {}", depth);
+  if (!IsEnabled(name)) {
+    return;
+  }
+  struct Forwarder final : EventReceiver {
+    Forwarder(Event<int>& from, Event<int>& to) {
+      AddEventListener(from, to);
+    }
+
+    ~Forwarder() {
+      this->RemoveAllEventListeners();
+    }
+  };
+
+  std::vector<std::unique_ptr<Event<int>>> events;
+  std::vector<std::unique_ptr<Forwarder>> forwarders;
+  events.push_back(std::make_unique<Event<int>>());
+  for (std::size_t i = 0; i < depth; ++i) {
+    events.push_back(std::make_unique<Event<int>>());
+    forwarders.push_back(
+      std::make_unique<Forwarder>(*events.at(i), *events.at(i + 1)));
+  }
+  Receivers receivers {*events.back(), 1};
+
+  Measure(name, emits, [&]() { events.front()->Emit(123); });
+  Require(
+    receivers.GetCallCount() == emits + 1, name, "handlers were not called");
+}
+
+// Mirrors `PageSourceWithDelegates::SetDelegates()`: remove the forwarding
+// listeners for the previous delegates, then forward each event from each
+// new delegate.
+void BenchmarkSetDelegates(std::size_t delegateCount, std::size_t iterations) {
+  const auto name
+    = std::format("Forward/SetDelegates/{} delegates", delegateCount);
+  if (!IsEnabled(name)) {
+    return;
+  }
+  struct PageSource {
+    Event<> evNeedsRepaintEvent;
+    Event<int> evPageAppendedEvent;
+    Event<> evContentChangedEvent;
+    Event<> evAvailableFeaturesChangedEvent;
+    Event<int> evPageChangeRequestedEvent;
+  };
+
+  struct WithDelegates final : PageSource, EventReceiver {
+    std::vector<EventHandlerToken> mDelegateEvents;
+
+    ~WithDelegates() {
+      this->RemoveAllEventListeners();
+    }
+
+    void SetDelegates(std::vector<std::unique_ptr<PageSource>>& delegates) {
+      for (const auto& token: mDelegateEvents) {
+        this->RemoveEventListener(token);
+      }
+      mDelegateEvents.clear();
+      for (const auto& delegate: delegates) {
+        mDelegateEvents.push_back(AddEventListener(
+          delegate->evNeedsRepaintEvent, this->evNeedsRepaintEvent));
+        mDelegateEvents.push_back(AddEventListener(
+          delegate->evPageAppendedEvent, this->evPageAppendedEvent));
+        mDelegateEvents.push_back(AddEventListener(
+          delegate->evContentChangedEvent, this->evContentChangedEvent));
+        mDelegateEvents.push_back(AddEventListener(
+          delegate->evAvailableFeaturesChangedEvent,
+          this->evAvailableFeaturesChangedEvent));
+        mDelegateEvents.push_back(AddEventListener(
+          delegate->evPageChangeRequestedEvent,
+          this->evPageChangeRequestedEvent));
+      }
+    }
+  };
+
+  std::vector<std::unique_ptr<PageSource>> delegates;
+  for (std::size_t i = 0; i < delegateCount; ++i) {
+    delegates.push_back(std::make_unique<PageSource>());
+  }
+  WithDelegates withDelegates;
+
+  Measure(name, iterations, [&]() { withDelegates.SetDelegates(delegates); });
+  Require(
+    withDelegates.mDelegateEvents.size() == delegateCount * 5,
+    name,
+    "wrong number of listeners");
+}
+
+// `RemoveAllEventListeners()` for a receiver with `listenerCount` listeners
+// on each of 4 events
+void BenchmarkTeardown(std::size_t listenerCount, std::size_t iterations) {
+  constexpr std::size_t EventCount = 4;
+  const auto name = std::format(
+    "Teardown/{} listeners x {} events", listenerCount, EventCount);
+  if (!IsEnabled(name)) {
+    return;
+  }
+  std::array<Event<int>, EventCount> events;
+
+  MeasureWithSetup(
+    name,
+    iterations,
+    [&]() {
+      auto receivers = std::make_unique<Receivers>();
+      for (auto& event: events) {
+        receivers->Add(event, listenerCount);
+      }
+      return receivers;
+    },
+    [](auto& receivers) { receivers->Teardown(); });
+}
+
+// Emit from the current thread, then deliver with `DrainAll()`, as the
+// frame loop does
+void BenchmarkConcurrentEmit(std::size_t receiverCount, std::size_t emits) {
+  constexpr std::size_t EmitsPerDrain = 16;
+  const auto name
+    = std::format("ConcurrentEvent/{} receivers", receiverCount);
+  if (!IsEnabled(name)) {
+    return;
+  }
+  ConcurrentEvent<int> event;
+  Receivers receivers;
+  receivers.Add(event, receiverCount);
+
+  const auto drains = std::max<std::size_t>(1, emits / EmitsPerDrain);
+  Measure(
+    name,
+    drains,
+    [&]() {
+      for (std::size_t i = 0; i < EmitsPerDrain; ++i) {
+        event.Emit(123);
+      }
+      ConcurrentEventBase::DrainAll();
+    },
+    EmitsPerDrain);
+  Require(
+    receivers.GetCallCount() == (drains + 1) * EmitsPerDrain * receiverCount,
+    name,
+    "handlers were not called");
+}
+
+// The shape of a typical `bind_refs_front()` handler: a weak reference to the
+// receiver, and a member function pointer
+class Target final : public std::enable_shared_from_this<Target> {
+ public:
+  void OnValue(int value) {
+    mSum += value;
+  }
+
+  auto GetHandler() {
+    return [weak = weak_from_this(), fn = &Target::OnValue](int value) {
+      if (auto self = weak.lock()) {
+        std::invoke(fn, self, value);
+      }
+    };
+  }
+
+  uint64_t GetSum() const noexcept {
+    return mSum;
+  }
+
+ private:
+  uint64_t mSum {};
+};
+
+// The previous `EventHandler`
+class StdFunctionHandler final {
+ public:
+  template <class T>
+  StdFunctionHandler(T&& fn) : mImpl(std::forward<T>(fn)) {
+  }
+
+  void operator()(int value) const {
+    // The previous `EventConnection::Call()` copied the handler in case it
+    // was invalidated while running
+    auto copy = mImpl;
+    copy(value);
+  }
+
+ private:
+  std::function<void(int)> mImpl;
+};
+
+template <class THandler>
+void BenchmarkHandlers(
+  std::string_view handlerName,
+  std::size_t handlerCount,
+  std::size_t calls) {
+  const auto target = std::make_shared<Target>();
+
+  const auto createName = std::format("Handler/{}/create", handlerName);
+  if (handlerCount == 1 && IsEnabled(createName)) {
+    Measure(createName, calls, [&]() { THandler {target->GetHandler()}; });
+  }
+
+  const auto name
+    = std::format("Handler/{}/call {} handlers", handlerName, handlerCount);
+  if (!IsEnabled(name)) {
+    return;
+  }
+  std::vector<THandler> handlers;
+  handlers.reserve(handlerCount);
+  for (std::size_t i = 0; i < handlerCount; ++i) {
+    handlers.emplace_back(target->GetHandler());
+  }
+
+  const auto iterations = std::max<std::size_t>(1, calls / handlerCount);
+  Measure(
+    name,
+    iterations,
+    [&]() {
+      for (const auto& handler: handlers) {
+        handler(1);
+      }
+    },
+    handlerCount);
+  Require(
+    target->GetSum() == (iterations + 1) * handlerCount,
+    name,
+    "handlers were not called");
+}
+
+}// namespace
+
+int main(int argc, char** argv) {
+  const std::size_t iterations = (argc > 1) ? std::atoi(argv[1]) : 1000000;
+  if (argc > 2) {
+    gFilter = argv[2];
+  }
+
+  for (const auto receivers: {0, 1, 10, 100}) {
+    BenchmarkEmit("Event<>", receivers, iterations);
+    BenchmarkEmit("Event<int>", receivers, iterations, 123);
+  }
+  BenchmarkEmit(
+    "Event<std::string>", 10, iterations, std::string(64, 'x'));
+  BenchmarkDelayedEmit(10, iterations);
+  BenchmarkReentrantEmit(iterations);
+  for (const auto depth: {1, 2, 4, 8}) {
+    BenchmarkNestedDelay(depth, iterations);
+  }
+  for (const auto burst: {16, 64, 256}) {
+    BenchmarkDelayedBurst(burst, iterations);
+  }
+  const auto delayStatistics = EventDelay::GetStatistics();
+  std::println(
+    "EventDelay queue: peak depth {}, {} calls overflowed the ring buffer",
+    delayStatistics.mPeakDepth,
+    delayStatistics.mOverflowCount);
+
+  BenchmarkHook(
+    "Hook/stop propagation/100 receivers",
+    Event<>::HookResult::STOP_PROPAGATION,
+    100,
+    iterations);
+  BenchmarkHook(
+    "Hook/allow propagation/100 receivers",
+    Event<>::HookResult::ALLOW_PROPAGATION,
+    100,
+    iterations);
+
+  for (const auto depth: {1, 2, 4, 8}) {
+    BenchmarkForwardingChain(depth, iterations);
+  }
+  for (const auto delegates: {1, 4, 16}) {
+    BenchmarkSetDelegates(delegates, iterations / (delegates * 10));
+  }
+
+  for (const auto listeners: {1, 10, 100}) {
+    BenchmarkTeardown(listeners, iterations / (listeners * 10));
+  }
+
+  for (const auto receivers: {1, 10}) {
+    BenchmarkConcurrentEmit(receivers, iterations);
+  }
+
+  for (const auto handlers: {1, 10, 100}) {
+    BenchmarkHandlers<StdFunctionHandler>(
+      "std::function", handlers, iterations);
+    BenchmarkHandlers<EventHandler<int>>(
+      "EventHandler", handlers, iterations);
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,192 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+// Stress test for `ConcurrentEvent`.
+//
+// Several threads emit at once, while other threads repeatedly add and
+// remove handlers, and the main thread drains - like the UI thread's frame
+// loop. It checks that every event that was accepted is delivered exactly
+// once and in order per producer, and that every handler is destroyed.
+//
+// This is most useful with a sanitizer, e.g. ThreadSanitizer; it's also in
+// the portable build (src/portable.cmake), for `-fsanitize=thread` on Linux.
+//
+// Usage: events-concurrent-stress [events per producer]
+
+#include <OpenKneeboard/ConcurrentEvent.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <print>
+#include <thread>
+#include <vector>
+
+using namespace OpenKneeboard;
+
+namespace {
+
+constexpr std::size_t ProducerCount = 4;
+constexpr std::size_t ChurnThreadCount = 2;
+// Small, so that the queue is frequently full
+constexpr std::size_t QueueCapacity = 64;
+
+using TestEvent = ConcurrentEvent<uint32_t, uint64_t>;
+
+class OrderedReceiver final : private EventReceiver {
+ public:
+  OrderedReceiver(TestEvent& event) {
+    AddEventListener(event, [this](uint32_t producer, uint64_t sequence) {
+      auto& next = mNextSequence.at(producer);
+      if (sequence != next) {
+        std::println(
+          stderr,
+          "Producer {}: expected event {}, got {}",
+          producer,
+          next,
+          sequence);
+        ++mErrors;
+      }
+      next = sequence + 1;
+      ++mReceived;
+    });
+  }
+
+  ~OrderedReceiver() {
+    this->RemoveAllEventListeners();
+  }
+
+  std::array<uint64_t, ProducerCount> mNextSequence {};
+  uint64_t mReceived {};
+  uint64_t mErrors {};
+};
+
+// Tracks whether handlers are destroyed
+struct HandlerState {
+  static inline std::atomic_int64_t sLiveCount;
+
+  HandlerState() {
+    ++sLiveCount;
+  }
+  ~HandlerState() {
+    --sLiveCount;
+  }
+
+  uint64_t mCalls {};
+};
+
+class ChurningReceiver final : private EventReceiver {
+ public:
+  ~ChurningReceiver() {
+    this->RemoveAllEventListeners();
+  }
+
+  void Run(TestEvent& event, const std::atomic_flag& done) {
+    std::vector<EventHandlerToken> tokens;
+    uint64_t iteration = 0;
+    while (!done.test()) {
+      auto state = std::make_shared<HandlerState>();
+      tokens.push_back(AddEventListener(
+        event, [state](uint32_t, uint64_t) { ++state->mCalls; }));
+      // Sometimes remove the newest, sometimes the oldest
+      if (tokens.size() > 8) {
+        const auto it = (++iteration % 2) ? tokens.begin() : tokens.end() - 1;
+        this->RemoveEventListener(*it);
+        tokens.erase(it);
+      }
+    }
+    this->RemoveAllEventListeners();
+  }
+};
+
+}// namespace
+
+int main(int argc, char** argv) {
+  const uint64_t eventsPerProducer
+    = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 100000;
+
+  std::atomic_uint64_t dropped;
+  std::atomic_flag done;
+  {
+    TestEvent event {QueueCapacity};
+    OrderedReceiver ordered {event};
+
+    std::atomic_size_t producersRemaining {ProducerCount};
+    std::vector<std::jthread> producers;
+    for (uint32_t i = 0; i < ProducerCount; ++i) {
+      producers.emplace_back([&, i]() {
+        for (uint64_t sequence = 0; sequence < eventsPerProducer;) {
+          if (event.Emit(i, sequence)) {
+            ++sequence;
+            continue;
+          }
+          ++dropped;
+          std::this_thread::yield();
+        }
+        --producersRemaining;
+      });
+    }
+
+    std::vector<std::jthread> churners;
+    for (std::size_t i = 0; i < ChurnThreadCount; ++i) {
+      churners.emplace_back([&]() { ChurningReceiver().Run(event, done); });
+    }
+
+    // Drain until all producers have finished, then once more for anything
+    // they emitted after our last drain
+    while (producersRemaining > 0) {
+      ConcurrentEventBase::DrainAll();
+      std::this_thread::yield();
+    }
+    producers.clear();
+    ConcurrentEventBase::DrainAll();
+
+    done.test_and_set();
+    churners.clear();
+
+    const auto expected = eventsPerProducer * ProducerCount;
+    std::println(
+      "Delivered {} of {} events; {} emits were rejected as the queue was "
+      "full, and {} were counted by the event",
+      ordered.mReceived,
+      expected,
+      dropped.load(),
+      event.GetDroppedCount());
+
+    if (ordered.mErrors || ordered.mReceived != expected) {
+      std::println(stderr, "FAILED: events lost, duplicated, or reordered");
+      return EXIT_FAILURE;
+    }
+    if (event.GetDroppedCount() != dropped) {
+      std::println(stderr, "FAILED: drop count mismatch");
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (const auto live = HandlerState::sLiveCount.load()) {
+    std::println(stderr, "FAILED: {} handlers were not destroyed", live);
+    return EXIT_FAILURE;
+  }
+
+  std::println("OK");
+  return EXIT_SUCCESS;
+}
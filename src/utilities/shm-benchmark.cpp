@@ -0,0 +1,187 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+// Measures SHM metadata read latency while a writer saturates the SHM lock.
+//
+// This does not need a GPU: frames are submitted without textures, and readers
+// only fetch metadata.
+//
+// Usage: shm-benchmark [seconds] [reader threads] [lock hold microseconds]
+
+#include <OpenKneeboard/SHM.hpp>
+
+#include <OpenKneeboard/config.hpp>
+
+#include <Windows.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <format>
+#include <mutex>
+#include <print>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace OpenKneeboard;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  std::chrono::seconds mDuration {5};
+  unsigned int mReaderCount {4};
+  std::chrono::microseconds mLockHoldTime {500};
+};
+
+Options ParseOptions(int argc, char** argv) {
+  Options ret;
+  if (argc > 1) {
+    ret.mDuration = std::chrono::seconds {std::atoi(argv[1])};
+  }
+  if (argc > 2) {
+    ret.mReaderCount = static_cast<unsigned int>(std::atoi(argv[2]));
+  }
+  if (argc > 3) {
+    ret.mLockHoldTime = std::chrono::microseconds {std::atoi(argv[3])};
+  }
+  return ret;
+}
+
+// Spin rather than sleep, as we want the lock hold time to be precise
+void BusyWait(Clock::duration duration) {
+  const auto until = Clock::now() + duration;
+  while (Clock::now() < until) {
+    YieldProcessor();
+  }
+}
+
+void PrintPercentiles(
+  std::string_view label,
+  std::vector<Clock::duration>& samples) {
+  if (samples.empty()) {
+    std::println("{}: no samples", label);
+    return;
+  }
+  std::ranges::sort(samples);
+  const auto at = [&](double percentile) {
+    const auto index = static_cast<std::size_t>(
+      percentile * static_cast<double>(samples.size() - 1));
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      samples.at(index));
+  };
+  std::println(
+    "{}: {} samples; p50 {}, p95 {}, p99 {}, max {}",
+    label,
+    samples.size(),
+    at(0.50),
+    at(0.95),
+    at(0.99),
+    at(1.0));
+}
+
+}// namespace
+
+int main(int argc, char** argv) {
+  const auto options = ParseOptions(argc, argv);
+  std::println(
+    "Running for {} with {} reader threads; writer holds the lock for {} per "
+    "frame",
+    options.mDuration,
+    options.mReaderCount,
+    options.mLockHoldTime);
+
+  SHM::Writer writer {/* gpuLUID = */ 0};
+  if (!writer) {
+    std::println(stderr, "Failed to initialize SHM writer");
+    return EXIT_FAILURE;
+  }
+
+  std::vector<SHM::LayerConfig> layers(MaxViewCount);
+  for (uint64_t i = 0; i < layers.size(); ++i) {
+    layers.at(i).mLayerID = i + 1;
+  }
+
+  std::atomic_flag stop;
+  std::vector<Clock::duration> lockHoldTimes;
+
+  std::jthread writerThread {[&]() {
+    while (!stop.test()) {
+      const auto lockedAt = [&] {
+        const std::unique_lock lock(writer);
+        const auto ret = Clock::now();
+        writer.BeginFrame();
+        BusyWait(options.mLockHoldTime);
+        writer.SubmitFrame({}, layers, nullptr, nullptr);
+        return ret;
+      }();
+      lockHoldTimes.push_back(Clock::now() - lockedAt);
+    }
+  }};
+
+  std::mutex readerSamplesMutex;
+  std::vector<Clock::duration> readerSamples;
+  uint64_t cacheKeyChanges {};
+
+  std::vector<std::jthread> readerThreads;
+  for (unsigned int i = 0; i < options.mReaderCount; ++i) {
+    readerThreads.emplace_back([&]() {
+      SHM::Reader reader;
+      std::vector<Clock::duration> samples;
+      uint64_t lastCacheKey {};
+      uint64_t changes {};
+      while (!stop.test()) {
+        const auto start = Clock::now();
+        const auto snapshot
+          = reader.MaybeGetUncached(SHM::ConsumerKind::Viewer);
+        samples.push_back(Clock::now() - start);
+
+        if (snapshot.HasMetadata()) {
+          const auto cacheKey = snapshot.GetRenderCacheKey();
+          if (cacheKey != lastCacheKey) {
+            lastCacheKey = cacheKey;
+            ++changes;
+          }
+        }
+      }
+
+      const std::unique_lock lock(readerSamplesMutex);
+      readerSamples.insert(readerSamples.end(), samples.begin(), samples.end());
+      cacheKeyChanges += changes;
+    });
+  }
+
+  std::this_thread::sleep_for(options.mDuration);
+  stop.test_and_set();
+  writerThread.join();
+  readerThreads.clear();
+
+  std::println(
+    "Writer submitted {} frames; readers saw {} new frames",
+    lockHoldTimes.size(),
+    cacheKeyChanges);
+  PrintPercentiles("Writer lock hold time", lockHoldTimes);
+  PrintPercentiles("Reader metadata latency", readerSamples);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+// Prints how old kneeboard frames are when each kind of consumer first reads
+// them, measured from when OpenKneeboard started rendering the frame.
+//
+// Usage: shm-latency [--clear]
+
+#include <OpenKneeboard/SHM/ConsumerLatency.hpp>
+
+#include <cstdlib>
+#include <print>
+#include <string_view>
+
+using namespace OpenKneeboard;
+
+int main(int argc, char** argv) {
+  if (argc > 1 && std::string_view {argv[1]} == "--clear") {
+    SHM::ConsumerLatency::Clear();
+    std::println("Cleared latency histograms");
+    return EXIT_SUCCESS;
+  }
+
+  const auto latency = SHM::ConsumerLatency::Get();
+  const auto print = [](std::string_view name, const auto& histogram) {
+    const auto count = histogram.GetSampleCount();
+    if (count == 0) {
+      std::println("{:<12}: no frames", name);
+      return;
+    }
+    std::println(
+      "{:<12}: {} frames; p50 {}, p95 {}, p99 {}",
+      name,
+      count,
+      histogram.GetPercentile(0.50),
+      histogram.GetPercentile(0.95),
+      histogram.GetPercentile(0.99));
+  };
+
+  print("SteamVR", latency.mSteamVR);
+  print("OpenXR", latency.mOpenXR);
+  print("Oculus-D3D11", latency.mOculusD3D11);
+  print("NonVR-D3D11", latency.mNonVRD3D11);
+  print("Viewer", latency.mViewer);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,74 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+// Checks that this build uses the same SHM layout as the running feeder.
+//
+// This is built for both 32-bit and 64-bit; run the 32-bit version while the
+// 64-bit OpenKneeboard app is running (or vice versa) to check that 32-bit
+// games will be able to read the kneeboard.
+//
+// Usage: shm-layout-check
+
+#include <OpenKneeboard/SHM.hpp>
+
+#include <cstdlib>
+#include <print>
+
+using namespace OpenKneeboard;
+
+namespace {
+
+void PrintLayout(const SHM::LayoutInfo& layout) {
+  std::println("  Version: {}", layout.mVersion);
+  std::println("  Mapping size: {}", layout.mMappingSize);
+  std::println("  Frame metadata size: {}", layout.mFrameMetadataSize);
+  std::println("  Config offset: {}", layout.mConfigOffset);
+  std::println("  Config size: {}", layout.mConfigSize);
+  std::println("  Layer count offset: {}", layout.mLayerCountOffset);
+  std::println("  Feeder PID offset: {}", layout.mFeederProcessIDOffset);
+  std::println("  Layer table offset: {}", layout.mLayerTableOffset);
+  std::println("  Layer table capacity: {}", layout.mLayerTableCapacity);
+  std::println("  Layer config size: {}", layout.mLayerConfigSize);
+}
+
+}// namespace
+
+int main() {
+  const auto layout = SHM::GetLayoutInfo();
+  std::println("This build ({}-bit):", sizeof(void*) * 8);
+  PrintLayout(layout);
+
+  const SHM::Reader reader;
+  const auto feederLayout = reader.GetFeederLayoutInfo();
+  if (!feederLayout) {
+    std::println("\nNo feeder is attached; start OpenKneeboard to compare.");
+    return EXIT_SUCCESS;
+  }
+
+  std::println("\nFeeder:");
+  PrintLayout(*feederLayout);
+
+  if (*feederLayout != layout) {
+    std::println("\nFAIL: layouts differ; this build can't read the feeder");
+    return EXIT_FAILURE;
+  }
+  std::println("\nOK: layouts match");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,457 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+// Load-tests SHM with a synthetic feeder and consumers in separate processes.
+//
+// This does not need a GPU: frames are submitted without textures, and
+// consumers only fetch metadata. Half the consumers use `SHM::Reader`, the
+// other half use `SHM::CachedReader`.
+//
+// Half way through, the feeder kills itself mid-frame while holding the SHM
+// lock, and is replaced by a new feeder; this measures how long consumers
+// take to see the new session.
+//
+// Don't run this while OpenKneeboard is running: it uses the same SHM.
+//
+// Usage: shm-load-test [seconds] [fps] [layers] [consumers]
+
+#include <OpenKneeboard/SHM.hpp>
+
+#include <OpenKneeboard/config.hpp>
+
+#include <shims/winrt/base.h>
+
+#include <Windows.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <format>
+#include <print>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace OpenKneeboard;
+
+namespace {
+
+// `QueryPerformanceCounter()` on Windows, so comparable across processes
+using Clock = std::chrono::steady_clock;
+
+constexpr std::size_t MaxConsumers = MAXIMUM_WAIT_OBJECTS;
+
+struct Options {
+  std::chrono::seconds mDuration {10};
+  unsigned int mFramesPerSecond {FramesPerSecond};
+  uint8_t mLayerCount {MaxViewCount};
+  unsigned int mConsumerCount {4};
+};
+
+// All in `Clock::duration` ticks
+struct Percentiles {
+  Clock::rep mP50 {};
+  Clock::rep mP99 {};
+  Clock::rep mMax {};
+};
+
+struct FeederResults {
+  uint64_t mFramesSubmitted {};
+  Clock::rep mRunTime {};
+  Percentiles mLockHoldTime {};
+};
+
+struct ConsumerResults {
+  uint64_t mSnapshots {};
+  // Cache key changes
+  uint64_t mNewFrames {};
+  // When the consumer first saw a frame from the replacement feeder
+  Clock::rep mRecoveredAt {};
+  Percentiles mReadTime {};
+};
+
+// Shared between the coordinator and the feeder and consumer processes
+struct SharedResults {
+  std::atomic<uint32_t> mStop;
+  Clock::rep mFeederKilledAt;
+  std::array<FeederResults, 2> mFeeders;
+  std::array<ConsumerResults, MaxConsumers> mConsumers;
+};
+static_assert(std::is_standard_layout_v<SharedResults>);
+
+class SharedResultsMapping final {
+ public:
+  SharedResultsMapping() = delete;
+  SharedResultsMapping(DWORD coordinatorPID, bool create) {
+    const auto name
+      = std::format(L"Local\\OpenKneeboard-shm-load-test-{}", coordinatorPID);
+    if (create) {
+      mHandle.attach(CreateFileMappingW(
+        INVALID_HANDLE_VALUE,
+        nullptr,
+        PAGE_READWRITE,
+        0,
+        sizeof(SharedResults),
+        name.c_str()));
+    } else {
+      mHandle.attach(OpenFileMappingW(FILE_MAP_WRITE, FALSE, name.c_str()));
+    }
+    winrt::check_bool(mHandle);
+    mView = reinterpret_cast<SharedResults*>(MapViewOfFile(
+      mHandle.get(), FILE_MAP_WRITE, 0, 0, sizeof(SharedResults)));
+    winrt::check_bool(mView);
+  }
+
+  ~SharedResultsMapping() {
+    UnmapViewOfFile(mView);
+  }
+
+  SharedResults* operator->() const noexcept {
+    return mView;
+  }
+
+  SharedResultsMapping(const SharedResultsMapping&) = delete;
+  SharedResultsMapping(SharedResultsMapping&&) = delete;
+  SharedResultsMapping& operator=(const SharedResultsMapping&) = delete;
+  SharedResultsMapping& operator=(SharedResultsMapping&&) = delete;
+
+ private:
+  winrt::file_handle mHandle;
+  SharedResults* mView {nullptr};
+};
+
+// Metadata-only; `InitializeCache()` is never called, so there are never any
+// textures
+class MetadataOnlyCachedReader final : public SHM::CachedReader {
+ public:
+  MetadataOnlyCachedReader()
+    : SHM::CachedReader(nullptr, SHM::ConsumerKind::Viewer) {
+  }
+
+ protected:
+  std::shared_ptr<SHM::IPCClientTexture> CreateIPCClientTexture(
+    const PixelSize&,
+    uint8_t) noexcept override {
+    return nullptr;
+  }
+
+  void ReleaseIPCHandles() override {
+  }
+};
+
+Percentiles GetPercentiles(std::vector<Clock::duration>& samples) {
+  if (samples.empty()) {
+    return {};
+  }
+  std::ranges::sort(samples);
+  const auto at = [&](double percentile) {
+    return samples
+      .at(static_cast<std::size_t>(
+        percentile * static_cast<double>(samples.size() - 1)))
+      .count();
+  };
+  return {at(0.50), at(0.99), at(1.0)};
+}
+
+std::vector<SHM::LayerConfig> CreateLayers(uint8_t count) {
+  std::vector<SHM::LayerConfig> ret(count);
+  for (uint8_t i = 0; i < count; ++i) {
+    auto& layer = ret.at(i);
+    layer.mLayerID = i + 1;
+    layer.mNonVREnabled = true;
+    layer.mNonVR.mLocationOnTexture = {{0, i * 768u}, {1024, 768}};
+  }
+  return ret;
+}
+
+int RunFeeder(
+  DWORD coordinatorPID,
+  std::size_t index,
+  const Options& options,
+  bool killMidFrame) {
+  const SharedResultsMapping results {coordinatorPID, false};
+
+  SHM::Writer writer {/* gpuLUID = */ 0};
+  if (!writer) {
+    std::println(stderr, "Failed to initialize SHM writer");
+    return EXIT_FAILURE;
+  }
+
+  auto layers = CreateLayers(options.mLayerCount);
+  const auto frameInterval = std::chrono::duration_cast<Clock::duration>(
+    std::chrono::seconds {1}) / options.mFramesPerSecond;
+
+  std::vector<Clock::duration> lockHoldTimes;
+  const auto start = Clock::now();
+  const auto end = start + options.mDuration;
+  auto nextFrame = start;
+  uint64_t frameCount = 0;
+  const auto publishResults = [&]() {
+    auto& ret = results->mFeeders.at(index);
+    ret.mFramesSubmitted = frameCount;
+    ret.mRunTime = (Clock::now() - start).count();
+    ret.mLockHoldTime = GetPercentiles(lockHoldTimes);
+  };
+
+  while (Clock::now() < end) {
+    // Like a real feeder, only one view changes at a time
+    for (auto& layer: layers) {
+      layer.mDirtyRect = {};
+    }
+    auto& changed = layers.at(frameCount % layers.size());
+    changed.mDirtyRect = changed.mNonVR.mLocationOnTexture;
+
+    {
+      const std::unique_lock lock(writer);
+      const auto lockedAt = Clock::now();
+      writer.BeginFrame();
+      if (killMidFrame && (lockedAt + frameInterval) >= end) {
+        publishResults();
+        // Leaves the SHM mutex abandoned, with the frame half-built
+        results->mFeederKilledAt = Clock::now().time_since_epoch().count();
+        TerminateProcess(GetCurrentProcess(), EXIT_FAILURE);
+      }
+      writer.SubmitFrame({}, layers, nullptr, nullptr);
+      lockHoldTimes.push_back(Clock::now() - lockedAt);
+    }
+    ++frameCount;
+
+    nextFrame += frameInterval;
+    std::this_thread::sleep_until(nextFrame);
+  }
+
+  publishResults();
+  return EXIT_SUCCESS;
+}
+
+int RunConsumer(DWORD coordinatorPID, std::size_t index) {
+  const SharedResultsMapping results {coordinatorPID, false};
+
+  const auto useCachedReader = (index % 2) == 1;
+  SHM::Reader reader;
+  MetadataOnlyCachedReader cachedReader;
+  const auto getSnapshot = [&]() {
+    if (useCachedReader) {
+      return cachedReader.MaybeGetMetadata();
+    }
+    return reader.MaybeGetUncached(SHM::ConsumerKind::Viewer);
+  };
+
+  std::vector<Clock::duration> readTimes;
+  uint64_t snapshots {};
+  uint64_t newFrames {};
+  uint64_t cacheKey {};
+  uint64_t sessionID {};
+  Clock::time_point recoveredAt {};
+
+  while (!results->mStop.load(std::memory_order_acquire)) {
+    const auto start = Clock::now();
+    const auto snapshot = getSnapshot();
+    const auto now = Clock::now();
+    readTimes.push_back(now - start);
+    ++snapshots;
+
+    if (!snapshot.HasMetadata()) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    const auto snapshotSession = snapshot.GetSessionID();
+    if (
+      sessionID && snapshotSession != sessionID
+      && recoveredAt == Clock::time_point {}) {
+      recoveredAt = now;
+    }
+    sessionID = snapshotSession;
+
+    if (snapshot.GetRenderCacheKey() != cacheKey) {
+      cacheKey = snapshot.GetRenderCacheKey();
+      ++newFrames;
+    }
+    std::this_thread::yield();
+  }
+
+  auto& ret = results->mConsumers.at(index);
+  ret.mSnapshots = snapshots;
+  ret.mNewFrames = newFrames;
+  ret.mRecoveredAt = recoveredAt.time_since_epoch().count();
+  ret.mReadTime = GetPercentiles(readTimes);
+  return EXIT_SUCCESS;
+}
+
+winrt::handle SpawnSelf(std::wstring_view args) {
+  wchar_t path[MAX_PATH];
+  GetModuleFileNameW(nullptr, path, MAX_PATH);
+  auto commandLine = std::format(L"\"{}\" {}", path, args);
+
+  STARTUPINFOW startupInfo {.cb = sizeof(STARTUPINFOW)};
+  PROCESS_INFORMATION processInfo {};
+  winrt::check_bool(CreateProcessW(
+    path,
+    commandLine.data(),
+    nullptr,
+    nullptr,
+    FALSE,
+    0,
+    nullptr,
+    nullptr,
+    &startupInfo,
+    &processInfo));
+  CloseHandle(processInfo.hThread);
+  return winrt::handle {processInfo.hProcess};
+}
+
+std::wstring FormatOptions(const Options& options) {
+  return std::format(
+    L"{} {} {}",
+    options.mDuration.count(),
+    options.mFramesPerSecond,
+    options.mLayerCount);
+}
+
+template <class T>
+auto ToMicroseconds(T ticks) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    Clock::duration {ticks});
+}
+
+void PrintFeeder(std::string_view label, const FeederResults& feeder) {
+  const std::chrono::duration<double> runTime {
+    Clock::duration {feeder.mRunTime}};
+  std::println(
+    "{}: {} frames in {:.1f}s ({:.1f}fps); lock hold p50 {}, p99 {}, max {}",
+    label,
+    feeder.mFramesSubmitted,
+    runTime.count(),
+    feeder.mFramesSubmitted / std::max(runTime.count(), 0.001),
+    ToMicroseconds(feeder.mLockHoldTime.mP50),
+    ToMicroseconds(feeder.mLockHoldTime.mP99),
+    ToMicroseconds(feeder.mLockHoldTime.mMax));
+}
+
+int RunCoordinator(const Options& options) {
+  const auto pid = GetCurrentProcessId();
+  const SharedResultsMapping results {pid, true};
+
+  std::println(
+    "Running for {} at {}fps with {} layers and {} consumer processes",
+    options.mDuration,
+    options.mFramesPerSecond,
+    options.mLayerCount,
+    options.mConsumerCount);
+
+  std::vector<winrt::handle> consumers;
+  for (unsigned int i = 0; i < options.mConsumerCount; ++i) {
+    consumers.push_back(SpawnSelf(std::format(L"--consumer {} {}", pid, i)));
+  }
+
+  // First feeder kills itself mid-frame half way through...
+  auto halfOptions = options;
+  halfOptions.mDuration /= 2;
+  const auto feederArgs = FormatOptions(halfOptions);
+  {
+    const auto feeder
+      = SpawnSelf(std::format(L"--feeder {} 0 kill {}", pid, feederArgs));
+    WaitForSingleObject(feeder.get(), INFINITE);
+  }
+  // ... and is immediately replaced
+  {
+    const auto feeder
+      = SpawnSelf(std::format(L"--feeder {} 1 clean {}", pid, feederArgs));
+    WaitForSingleObject(feeder.get(), INFINITE);
+  }
+
+  results->mStop.store(1, std::memory_order_release);
+  for (const auto& consumer: consumers) {
+    WaitForSingleObject(consumer.get(), INFINITE);
+  }
+
+  PrintFeeder("Feeder (killed mid-frame)", results->mFeeders.at(0));
+  PrintFeeder("Replacement feeder", results->mFeeders.at(1));
+
+  const auto killedAt = results->mFeederKilledAt;
+  for (unsigned int i = 0; i < options.mConsumerCount; ++i) {
+    const auto& consumer = results->mConsumers.at(i);
+    std::println(
+      "Consumer {} ({}): {} snapshots, {} new frames; read p50 {}, p99 {}, "
+      "max {}",
+      i,
+      (i % 2) ? "CachedReader" : "Reader",
+      consumer.mSnapshots,
+      consumer.mNewFrames,
+      ToMicroseconds(consumer.mReadTime.mP50),
+      ToMicroseconds(consumer.mReadTime.mP99),
+      ToMicroseconds(consumer.mReadTime.mMax));
+    if (consumer.mRecoveredAt && killedAt) {
+      std::println(
+        "  saw the replacement feeder {} after the kill",
+        ToMicroseconds(consumer.mRecoveredAt - killedAt));
+    } else {
+      std::println("  never saw the replacement feeder");
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
+
+Options ParseOptions(int argc, char** argv) {
+  Options ret;
+  if (argc > 1) {
+    ret.mDuration = std::chrono::seconds {std::atoi(argv[1])};
+  }
+  if (argc > 2) {
+    ret.mFramesPerSecond = static_cast<unsigned int>(std::atoi(argv[2]));
+  }
+  if (argc > 3) {
+    ret.mLayerCount = static_cast<uint8_t>(
+      std::clamp<int>(std::atoi(argv[3]), 1, MaxViewCount));
+  }
+  if (argc > 4) {
+    ret.mConsumerCount = static_cast<unsigned int>(
+      std::clamp<int>(std::atoi(argv[4]), 0, MaxConsumers));
+  }
+  return ret;
+}
+
+}// namespace
+
+int main(int argc, char** argv) {
+  const std::string_view mode {(argc > 1) ? argv[1] : ""};
+
+  // shm-load-test --feeder COORDINATOR_PID INDEX kill|clean SECONDS FPS LAYERS
+  if (mode == "--feeder" && argc == 8) {
+    return RunFeeder(
+      static_cast<DWORD>(std::atoi(argv[2])),
+      static_cast<std::size_t>(std::atoi(argv[3])),
+      ParseOptions(argc - 4, argv + 4),
+      std::string_view {argv[4]} == "kill");
+  }
+
+  // shm-load-test --consumer COORDINATOR_PID INDEX
+  if (mode == "--consumer" && argc == 4) {
+    return RunConsumer(
+      static_cast<DWORD>(std::atoi(argv[2])),
+      static_cast<std::size_t>(std::atoi(argv[3])));
+  }
+
+  return RunCoordinator(ParseOptions(argc, argv));
+}
@@ -0,0 +1,294 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+// Multi-process stress test for the POSIX implementation of the SHM platform
+// layer (`SharedMapping`, `SharedMutex`, and `SharedEvent`).
+//
+// This is built by the portable build (see src/portable.cmake), and is
+// intended to be run under ASan or TSan.
+//
+// It checks:
+// - mutual exclusion between processes
+// - that a lock held by a process that is killed is recovered as
+//   `LockedAbandoned`
+// - that a segment whose creator died before initializing it is initialized
+//   by the next process to open it, instead of being unusable
+// - that `SharedEvent` wakes waiters in other processes, and times out
+//
+// Usage: shm-platform-stress [processes [iterations]]
+//
+// Exits with 0 if every check passed.
+
+#include <SHM/Platform.hpp>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <format>
+#include <functional>
+#include <print>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace OpenKneeboard::SHM::Detail;
+
+namespace {
+
+using namespace std::chrono_literals;
+
+int gFailures = 0;
+
+void Check(bool condition, std::string_view what) {
+  std::println("{} {}", condition ? "PASS" : "FAIL", what);
+  if (!condition) {
+    ++gFailures;
+  }
+}
+
+std::wstring GetName(std::wstring_view suffix) {
+  return std::format(L"okb-shm-platform-stress-{}-{}", getpid(), suffix);
+}
+
+// Matches `GetPOSIXName()` in Platform-POSIX.cpp for the names we use
+std::string GetPOSIXName(std::wstring_view name) {
+  std::string ret {"/"};
+  for (const auto c: name) {
+    ret.push_back(static_cast<char>(c));
+  }
+  return ret;
+}
+
+void Unlink(std::wstring_view name) {
+  shm_unlink(GetPOSIXName(name).c_str());
+}
+
+/// Run `child` in a forked process, returning its pid
+pid_t Spawn(const std::function<int()>& child) {
+  // Otherwise, anything buffered is printed by both processes
+  std::fflush(stdout);
+  const auto pid = fork();
+  if (pid == 0) {
+    _exit(child());
+  }
+  return pid;
+}
+
+/// @returns the exit code, or -1 if the process was killed by a signal
+int Join(pid_t pid) {
+  int status {};
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      return -1;
+    }
+  }
+  if (!WIFEXITED(status)) {
+    return -1;
+  }
+  return WEXITSTATUS(status);
+}
+
+void TestMutualExclusion(int processes, int iterations) {
+  const auto mappingName = GetName(L"counter");
+  const auto mutexName = GetName(L"counter-mutex");
+
+  {
+    // Keep the mapping alive so the children don't recreate it
+    SharedMapping mapping(mappingName, sizeof(uint64_t));
+    std::vector<pid_t> children;
+    for (int i = 0; i < processes; ++i) {
+      children.push_back(Spawn([&]() {
+        SharedMapping mapping(mappingName, sizeof(uint64_t));
+        SharedMutex mutex(mutexName);
+        if (!(mapping.IsValid() && mutex.IsValid())) {
+          return EXIT_FAILURE;
+        }
+        // Deliberately not atomic: the mutex is all that protects it
+        auto counter = reinterpret_cast<volatile uint64_t*>(mapping.GetView());
+        for (int j = 0; j < iterations; ++j) {
+          if (mutex.Lock() != LockResult::Locked) {
+            return EXIT_FAILURE;
+          }
+          *counter = *counter + 1;
+          mutex.Unlock();
+        }
+        return EXIT_SUCCESS;
+      }));
+    }
+
+    bool childrenSucceeded = true;
+    for (const auto pid: children) {
+      childrenSucceeded &= (Join(pid) == EXIT_SUCCESS);
+    }
+    Check(childrenSucceeded, "mutual exclusion: all workers locked");
+
+    const auto count = *reinterpret_cast<uint64_t*>(mapping.GetView());
+    const auto expected = static_cast<uint64_t>(processes) * iterations;
+    Check(
+      count == expected,
+      std::format("mutual exclusion: counted {} of {}", count, expected));
+  }
+
+  Unlink(mappingName);
+  Unlink(mutexName);
+}
+
+void TestAbandonedLock() {
+  const auto name = GetName(L"abandoned-mutex");
+
+  const auto child = Spawn([&]() {
+    SharedMutex mutex(name);
+    if (mutex.Lock() != LockResult::Locked) {
+      return EXIT_FAILURE;
+    }
+    raise(SIGKILL);
+    return EXIT_SUCCESS;
+  });
+  Check(Join(child) == -1, "abandoned lock: holder was killed");
+
+  {
+    SharedMutex mutex(name);
+    Check(
+      mutex.TryLock() == LockResult::LockedAbandoned,
+      "abandoned lock: recovered as LockedAbandoned");
+    mutex.Unlock();
+    Check(
+      mutex.TryLock() == LockResult::Locked,
+      "abandoned lock: usable after recovery");
+    mutex.Unlock();
+  }
+
+  Unlink(name);
+}
+
+/** Simulate a process that created a segment, then died before initializing
+ * it.
+ *
+ * @param size how far the creator got: 0 if it died before `ftruncate()`
+ * @param killWhileLocked if true, die while holding the initialization lock
+ */
+void TestAbandonedInitialization(off_t size, bool killWhileLocked) {
+  const auto name = GetName(std::format(L"uninitialized-{}", size));
+  const auto label = std::format(
+    "abandoned initialization (size {}, {}): ",
+    size,
+    killWhileLocked ? "killed while locked" : "exited");
+
+  int pipeFDs[2] {};
+  if (pipe(pipeFDs) != 0) {
+    Check(false, label + "pipe()");
+    return;
+  }
+
+  const auto child = Spawn([&]() {
+    const auto fd
+      = shm_open(GetPOSIXName(name).c_str(), O_RDWR | O_CREAT, 0600);
+    if (fd < 0 || flock(fd, LOCK_EX) != 0) {
+      return EXIT_FAILURE;
+    }
+    if (size && ftruncate(fd, size) != 0) {
+      return EXIT_FAILURE;
+    }
+    if (killWhileLocked) {
+      write(pipeFDs[1], "x", 1);
+      while (true) {
+        pause();
+      }
+    }
+    return EXIT_SUCCESS;
+  });
+
+  if (killWhileLocked) {
+    char buf {};
+    read(pipeFDs[0], &buf, 1);
+    // Kill it once we're blocked on its lock
+    std::jthread killer([child]() {
+      std::this_thread::sleep_for(100ms);
+      kill(child, SIGKILL);
+    });
+    SharedMutex mutex(name);
+    Check(mutex.IsValid(), label + "opened after creator died");
+    Check(mutex.TryLock() == LockResult::Locked, label + "lockable");
+    mutex.Unlock();
+    Join(child);
+  } else {
+    Join(child);
+    const auto start = std::chrono::steady_clock::now();
+    SharedEvent event(name);
+    Check(event.IsValid(), label + "opened after creator died");
+    Check(
+      std::chrono::steady_clock::now() - start < 100ms,
+      label + "opened without waiting for a timeout");
+    event.Set();
+    Check(event.Wait(0ms), label + "usable");
+  }
+
+  close(pipeFDs[0]);
+  close(pipeFDs[1]);
+  Unlink(name);
+}
+
+void TestEvent() {
+  const auto name = GetName(L"event");
+  SharedEvent event(name);
+  Check(!event.Wait(10ms), "event: wait times out when unset");
+
+  const auto child = Spawn([&]() {
+    SharedEvent event(name);
+    return event.Wait(5s) ? EXIT_SUCCESS : EXIT_FAILURE;
+  });
+  std::this_thread::sleep_for(50ms);
+  event.Set();
+  Check(Join(child) == EXIT_SUCCESS, "event: waiter in another process woken");
+
+  event.Reset();
+  Check(!event.Wait(0ms), "event: reset");
+
+  Unlink(name);
+}
+
+}// namespace
+
+int main(int argc, char** argv) {
+  const int processes = (argc > 1) ? std::atoi(argv[1]) : 8;
+  const int iterations = (argc > 2) ? std::atoi(argv[2]) : 10000;
+
+  TestMutualExclusion(processes, iterations);
+  TestAbandonedLock();
+  TestAbandonedInitialization(0, false);
+  TestAbandonedInitialization(64, false);
+  TestAbandonedInitialization(0, true);
+  TestEvent();
+
+  if (gFailures) {
+    std::println("{} checks failed", gFailures);
+    return EXIT_FAILURE;
+  }
+  std::println("All checks passed");
+  return EXIT_SUCCESS;
+}
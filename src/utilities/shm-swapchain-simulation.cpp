@@ -0,0 +1,320 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+// Simulates SHM swapchain scheduling with consumers of different speeds,
+// using the same policy as `SHM::Writer`: the swapchain starts at
+// `MinSHMSwapchainLength`, grows while consumers are copying every other
+// texture, and once it's `MaxSHMSwapchainLength` long, the feeder overwrites
+// textures that are still being copied.
+//
+// For each scenario, this reports how long the swapchain grew, and how many
+// frames overwrote a pending copy - i.e. how many copies were torn.
+//
+// Consumers can also crash with a copy pending, to exercise
+// `SHM::AbandonedCopyTimeout`.
+//
+// This uses simulated time; it does not need a GPU, or a running feeder.
+//
+// Usage: shm-swapchain-simulation [simulated seconds]
+
+#include <OpenKneeboard/SHM/SwapchainSlots.hpp>
+
+#include <OpenKneeboard/config.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <print>
+#include <queue>
+#include <string_view>
+#include <vector>
+
+using namespace OpenKneeboard;
+
+namespace {
+
+using Duration = std::chrono::duration<double, std::milli>;
+
+struct ConsumerModel {
+  std::string_view mName;
+  // How often the consumer checks for a new frame, e.g. the game's frame
+  // interval
+  Duration mInterval;
+  // How long the consumer's GPU takes to finish copying a texture
+  Duration mCopyDuration;
+  // If set, the consumer exits without releasing its pending copies, e.g.
+  // because the game crashed
+  std::optional<Duration> mCrashAfter;
+};
+
+struct Scenario {
+  std::string_view mName;
+  std::vector<ConsumerModel> mConsumers;
+};
+
+struct ConsumerResults {
+  uint64_t mFramesRead {};
+  // Copies that the feeder overwrote before they finished
+  uint64_t mTornCopies {};
+};
+
+struct Results {
+  uint64_t mFramesWritten {};
+  // Frames written to a texture that a consumer was still copying
+  uint64_t mOverwrites {};
+  uint64_t mReclaimedCopies {};
+  uint8_t mSwapchainLength {};
+  // When the swapchain grew to each length
+  std::vector<Duration> mGrowthTimes;
+  std::vector<ConsumerResults> mConsumers;
+};
+
+class Simulation final {
+ public:
+  Simulation(const Scenario& scenario) : mScenario(scenario) {
+    mConsumers.resize(scenario.mConsumers.size());
+    mResults.mConsumers.resize(scenario.mConsumers.size());
+  }
+
+  Results Run(Duration duration) {
+    mEvents.push({Duration {}, WriterEvent});
+    for (std::size_t i = 0; i < mConsumers.size(); ++i) {
+      // Stagger the consumers so they don't all tick in lockstep
+      mEvents.push({mScenario.mConsumers.at(i).mInterval / (i + 2), i});
+    }
+
+    while (!mEvents.empty()) {
+      const auto event = mEvents.top();
+      mEvents.pop();
+      if (event.mTime > duration) {
+        break;
+      }
+      mNow = event.mTime;
+      if (event.mSource == WriterEvent) {
+        this->OnWriterTick();
+      } else {
+        this->OnConsumerTick(event.mSource);
+      }
+    }
+    mResults.mSwapchainLength = mLength;
+    return mResults;
+  }
+
+ private:
+  static constexpr std::size_t WriterEvent = ~std::size_t {0};
+  static constexpr Duration WriterInterval {1000.0 / FramesPerSecond};
+
+  struct Event {
+    Duration mTime;
+    std::size_t mSource;
+
+    bool operator>(const Event& other) const {
+      return mTime > other.mTime;
+    }
+  };
+
+  struct PendingCopy {
+    Duration mCompletionTime;
+    uint8_t mSlot;
+    bool mTorn {false};
+  };
+
+  struct ConsumerState {
+    uint64_t mLastFrameRead {};
+    std::deque<PendingCopy> mPendingCopies;
+  };
+
+  const Scenario& mScenario;
+
+  Duration mNow {};
+  std::priority_queue<Event, std::vector<Event>, std::greater<>> mEvents;
+
+  std::array<SHM::SwapchainSlot, MaxSHMSwapchainLength> mSlots {};
+  std::array<Duration, MaxSHMSwapchainLength> mLastConsumedAt {};
+  uint8_t mLength {MinSHMSwapchainLength};
+  uint8_t mCurrentSlot {};
+  uint64_t mFrameNumber {};
+
+  std::vector<ConsumerState> mConsumers;
+  Results mResults;
+
+  // Matches `SHM::Writer::Impl::ReclaimAbandonedCopies()`
+  void ReclaimAbandonedCopies() {
+    for (uint8_t i = 0; i < mLength; ++i) {
+      auto& slot = mSlots.at(i);
+      if (slot.mPendingCopies == 0) {
+        mLastConsumedAt.at(i) = mNow;
+        continue;
+      }
+      if (
+        i == mCurrentSlot
+        || mNow - mLastConsumedAt.at(i) < SHM::AbandonedCopyTimeout) {
+        continue;
+      }
+      mResults.mReclaimedCopies += slot.mPendingCopies;
+      slot.mPendingCopies = 0;
+      mLastConsumedAt.at(i) = mNow;
+    }
+  }
+
+  void OnWriterTick() {
+    this->ReclaimAbandonedCopies();
+
+    const auto choice = SHM::ChooseSlot(mSlots, mLength, mCurrentSlot);
+    if (choice.mKind == SHM::SlotChoiceKind::Grow) {
+      ++mLength;
+      mResults.mGrowthTimes.push_back(mNow);
+    }
+
+    // Not just `OverwritingPendingCopy`: a reclaimed copy may still be in
+    // progress
+    bool overwrote = false;
+    for (std::size_t i = 0; i < mConsumers.size(); ++i) {
+      for (auto& copy: mConsumers.at(i).mPendingCopies) {
+        if (copy.mSlot != choice.mSlot || copy.mCompletionTime <= mNow) {
+          continue;
+        }
+        overwrote = true;
+        if (!copy.mTorn) {
+          copy.mTorn = true;
+          ++mResults.mConsumers.at(i).mTornCopies;
+        }
+      }
+    }
+    if (overwrote) {
+      ++mResults.mOverwrites;
+    }
+
+    mCurrentSlot = choice.mSlot;
+    mSlots.at(mCurrentSlot).mFrameNumber = ++mFrameNumber;
+    ++mResults.mFramesWritten;
+    mEvents.push({mNow + WriterInterval, WriterEvent});
+  }
+
+  void OnConsumerTick(std::size_t index) {
+    const auto& model = mScenario.mConsumers.at(index);
+    auto& consumer = mConsumers.at(index);
+
+    // Like `SHM::CachedReader`, consumers only notice that their copies are
+    // complete when they next check for a frame
+    while ((!consumer.mPendingCopies.empty())
+           && consumer.mPendingCopies.front().mCompletionTime <= mNow) {
+      // Like `SHM::Reader::Impl::EndCopy()`, this doesn't underflow if the
+      // feeder reclaimed the copy
+      auto& pending = mSlots.at(consumer.mPendingCopies.front().mSlot)
+                        .mPendingCopies;
+      if (pending > 0) {
+        --pending;
+      }
+      consumer.mPendingCopies.pop_front();
+    }
+
+    if (mFrameNumber > consumer.mLastFrameRead) {
+      consumer.mLastFrameRead = mFrameNumber;
+      ++mSlots.at(mCurrentSlot).mPendingCopies;
+      consumer.mPendingCopies.push_back(
+        {mNow + model.mCopyDuration, mCurrentSlot});
+      ++mResults.mConsumers.at(index).mFramesRead;
+    }
+
+    if (model.mCrashAfter && mNow >= *model.mCrashAfter) {
+      // Never ticks again, so never releases its pending copies
+      return;
+    }
+    mEvents.push({mNow + model.mInterval, index});
+  }
+};
+
+}// namespace
+
+int main(int argc, char** argv) {
+  const Duration duration = std::chrono::seconds {
+    (argc > 1) ? std::atoi(argv[1]) : 60,
+  };
+
+  using namespace std::chrono_literals;
+  const std::vector<Scenario> scenarios {
+    {
+      "Fast consumers",
+      {
+        {"OpenXR @ 90Hz", 11.1ms, 2ms},
+        {"Non-VR @ 144Hz", 6.9ms, 1ms},
+      },
+    },
+    {
+      "One GPU-bound consumer",
+      {
+        {"OpenXR @ 90Hz", 11.1ms, 2ms},
+        {"SteamVR @ 45Hz", 22.2ms, 30ms},
+      },
+    },
+    {
+      "Very slow consumer",
+      {
+        {"Viewer @ 20Hz", 50ms, 120ms},
+      },
+    },
+    {
+      "Consumer crashes with copies pending",
+      {
+        {"OpenXR @ 90Hz", 11.1ms, 2ms},
+        {"Viewer @ 20Hz, crashes after 5s", 50ms, 120ms, 5s},
+      },
+    },
+  };
+
+  std::println(
+    "Simulating {} per scenario, feeder at {}fps, swapchain length {}-{}",
+    duration,
+    FramesPerSecond,
+    MinSHMSwapchainLength,
+    MaxSHMSwapchainLength);
+  for (const auto& scenario: scenarios) {
+    const auto results = Simulation(scenario).Run(duration);
+    std::println("\n{}:", scenario.mName);
+    std::println(
+      "  swapchain length {}; {} frames written, {} overwrote a pending copy, "
+      "{} abandoned copies reclaimed",
+      results.mSwapchainLength,
+      results.mFramesWritten,
+      results.mOverwrites,
+      results.mReclaimedCopies);
+    for (std::size_t i = 0; i < results.mGrowthTimes.size(); ++i) {
+      std::println(
+        "  grew to length {} at {:.1%Q%q}",
+        MinSHMSwapchainLength + i + 1,
+        results.mGrowthTimes.at(i));
+    }
+    for (std::size_t i = 0; i < scenario.mConsumers.size(); ++i) {
+      const auto& consumer = results.mConsumers.at(i);
+      std::println(
+        "    {}: read {} frames, {} copies torn",
+        scenario.mConsumers.at(i).mName,
+        consumer.mFramesRead,
+        consumer.mTornCopies);
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,308 @@
+/*
+ * OpenKneeboard
+ *
+ * Copyright (C) 2022 Fred Emmott <fred@fredemmott.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+// Models loading a profile with many configured tabs, as
+// `TabsList::LoadSettings()` does at startup.
+//
+// Each simulated tab:
+// 1. copies its file on the background pool's IO lane; this blocks, like a
+//    copy that's being scanned by antivirus
+// 2. parses it on the BulkParse lane; this is CPU-bound
+// 3. returns to the UI thread, like any `task<>`
+//
+// This compares:
+// - awaiting each tab before creating the next; `FolderPageSource` did this
+// - creating every tab, then awaiting each in turn; `TabsList` did this, so
+//   its tabs already loaded concurrently, and this is the baseline for
+//   `when_all()`
+// - `when_all()`
+// - `when_any()`, which is timed until the first tab is ready
+//
+// It then checks that if a tab throws, `when_all()` still awaits the others
+// before rethrowing.
+//
+// Usage: tabs-startup-benchmark [tabs [ioMilliseconds [parseMilliseconds]]]
+
+#include <OpenKneeboard/task.hpp>
+
+#include <OpenKneeboard/format/enum.hpp>
+#include <OpenKneeboard/task/executor.hpp>
+#include <OpenKneeboard/task/run_loop.hpp>
+#include <OpenKneeboard/task/thread_pool.hpp>
+#include <OpenKneeboard/task/when_all.hpp>
+#include <OpenKneeboard/task/when_any.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <functional>
+#include <memory>
+#include <print>
+#include <stdexcept>
+#include <stop_token>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace OpenKneeboard;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Always use the portable executor, so that this can run without a COM
+// apartment, and with a private `ThreadPool`
+template <class T>
+struct BenchmarkTaskTraits : detail::TaskTraits<T> {
+  using executor_type = PortableTaskExecutor;
+};
+
+struct BenchmarkDriverTraits : detail::FireAndForgetTraits {
+  using executor_type = PortableTaskExecutor;
+};
+
+template <class T = void>
+using benchmark_task = detail::Task<BenchmarkTaskTraits<T>>;
+
+using benchmark_driver = detail::Task<BenchmarkDriverTraits>;
+
+struct Parameters {
+  std::size_t mTabCount {100};
+  std::chrono::milliseconds mIOTime {5};
+  std::chrono::milliseconds mParseTime {2};
+};
+
+struct FakeTab {
+  std::size_t mIndex {};
+  uint64_t mChecksum {};
+};
+
+uint64_t BusyWork(std::chrono::milliseconds duration) {
+  const auto end = Clock::now() + duration;
+  uint64_t ret {};
+  while (Clock::now() < end) {
+    for (int i = 0; i < 1000; ++i) {
+      ret = (ret * 6364136223846793005ull) + 1442695040888963407ull;
+    }
+  }
+  return ret;
+}
+
+struct TabLoadFailure : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+// Everything is passed by value, as tabs that lose a `when_any()` outlive
+// their caller.
+//
+// `finished` is incremented on the pool, when the tab has loaded or failed.
+benchmark_task<std::shared_ptr<FakeTab>> LoadTab(
+  std::shared_ptr<ThreadPool> pool,
+  Parameters params,
+  std::size_t index,
+  std::shared_ptr<std::atomic_size_t> finished,
+  bool fail = false) {
+  co_await pool->Schedule(TaskPriority::IO);
+  std::this_thread::sleep_for(params.mIOTime);
+
+  co_await pool->Schedule(TaskPriority::BulkParse);
+  const auto checksum = BusyWork(params.mParseTime);
+
+  finished->fetch_add(1);
+  if (fail) {
+    throw TabLoadFailure {std::format("Failed to load tab {}", index)};
+  }
+  co_return std::make_shared<FakeTab>(index, checksum);
+}
+
+// Increments `awaited` once `tab` has returned to the caller's thread
+benchmark_task<std::shared_ptr<FakeTab>> CountWhenAwaited(
+  benchmark_task<std::shared_ptr<FakeTab>> tab,
+  std::shared_ptr<std::size_t> awaited) {
+  auto ret = co_await std::move(tab);
+  ++*awaited;
+  co_return ret;
+}
+
+void Report(
+  std::string_view name,
+  Clock::duration elapsed,
+  const std::vector<std::shared_ptr<FakeTab>>& tabs) {
+  std::println(
+    "{:<24} {:>10.1f}ms for {} tabs",
+    name,
+    std::chrono::duration<double, std::milli>(elapsed).count(),
+    tabs.size());
+}
+
+benchmark_driver RunBenchmarks(
+  std::shared_ptr<ThreadPool> pool,
+  Parameters params,
+  std::function<void(bool success)> onComplete) {
+  const auto count = params.mTabCount;
+  auto newCounter = []() { return std::make_shared<std::atomic_size_t>(); };
+
+  {
+    const auto finished = newCounter();
+    const auto start = Clock::now();
+    std::vector<std::shared_ptr<FakeTab>> tabs;
+    for (std::size_t i = 0; i < count; ++i) {
+      tabs.push_back(co_await LoadTab(pool, params, i, finished));
+    }
+    Report("Create and await each", Clock::now() - start, tabs);
+  }
+
+  {
+    const auto finished = newCounter();
+    const auto start = Clock::now();
+    std::vector<benchmark_task<std::shared_ptr<FakeTab>>> pending;
+    for (std::size_t i = 0; i < count; ++i) {
+      pending.push_back(LoadTab(pool, params, i, finished));
+    }
+    std::vector<std::shared_ptr<FakeTab>> tabs;
+    for (auto&& it: pending) {
+      tabs.push_back(co_await std::move(it));
+    }
+    Report("Create all, await each", Clock::now() - start, tabs);
+  }
+
+  {
+    const auto finished = newCounter();
+    const auto start = Clock::now();
+    std::vector<benchmark_task<std::shared_ptr<FakeTab>>> pending;
+    for (std::size_t i = 0; i < count; ++i) {
+      pending.push_back(LoadTab(pool, params, i, finished));
+    }
+    const auto tabs = co_await when_all(std::move(pending));
+    Report("when_all", Clock::now() - start, tabs);
+  }
+
+  {
+    const auto finished = newCounter();
+    const auto awaited = std::make_shared<std::size_t>();
+    const auto start = Clock::now();
+    std::vector<benchmark_task<std::shared_ptr<FakeTab>>> pending;
+    for (std::size_t i = 0; i < count; ++i) {
+      pending.push_back(
+        CountWhenAwaited(LoadTab(pool, params, i, finished), awaited));
+    }
+    const auto [index, tab] = co_await when_any(std::move(pending));
+    Report("when_any (first tab)", Clock::now() - start, {tab});
+    if (!(tab && tab->mIndex == index)) {
+      std::println(stderr, "when_any() returned the wrong tab for #{}", index);
+      onComplete(false);
+      co_return;
+    }
+
+    // The other tabs are awaited in the background, on this thread; wait for
+    // them before continuing, so that they don't compete with the next test
+    const auto thisThread = TaskScheduler::GetCurrent();
+    while (*awaited < count) {
+      co_await thisThread->Schedule();
+    }
+  }
+
+  {
+    // The first tab fails while the others are still loading
+    const auto finished = newCounter();
+    std::vector<benchmark_task<std::shared_ptr<FakeTab>>> pending;
+    for (std::size_t i = 0; i < count; ++i) {
+      const bool fail = (i == 0);
+      pending.push_back(LoadTab(pool, params, i, finished, fail));
+    }
+    bool threw = false;
+    try {
+      co_await when_all(std::move(pending));
+    } catch (const TabLoadFailure&) {
+      threw = true;
+    }
+    const auto finishedCount = finished->load();
+    std::println(
+      "when_all with a failing tab: {}; {} of {} tabs finished",
+      threw ? "threw" : "did not throw",
+      finishedCount,
+      count);
+    if (!(threw && finishedCount == count)) {
+      onComplete(false);
+      co_return;
+    }
+  }
+
+  onComplete(true);
+}
+
+}// namespace
+
+int main(int argc, char** argv) {
+  Parameters params;
+  if (argc > 1) {
+    // `when_any()` needs at least one
+    params.mTabCount
+      = std::max<std::size_t>(std::strtoull(argv[1], nullptr, 10), 1);
+  }
+  if (argc > 2) {
+    params.mIOTime
+      = std::chrono::milliseconds {std::strtoull(argv[2], nullptr, 10)};
+  }
+  if (argc > 3) {
+    params.mParseTime
+      = std::chrono::milliseconds {std::strtoull(argv[3], nullptr, 10)};
+  }
+
+  const auto loop = RunLoop::Create();
+  // Same size as `ThreadPool::GetBackground()`
+  const auto pool
+    = ThreadPool::Create(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+  std::println(
+    "{} tabs; {} IO + {} parse per tab; {} pool threads ({} for IO)",
+    params.mTabCount,
+    params.mIOTime,
+    params.mParseTime,
+    pool->GetThreadCount(),
+    pool->GetMaxIOWorkers());
+
+  std::stop_source stop;
+  int exitCode = EXIT_SUCCESS;
+  auto driver
+    = RunBenchmarks(pool, params, [&stop, &exitCode](bool success) {
+        if (!success) {
+          exitCode = EXIT_FAILURE;
+        }
+        stop.request_stop();
+      });
+  loop->Run(stop.get_token());
+
+  const auto stats = pool->GetStatistics();
+  for (const auto priority: {TaskPriority::IO, TaskPriority::BulkParse}) {
+    const auto& lane = stats.at(priority);
+    std::println(
+      "{} lane: {} resumed, peak depth {}, mean wait {}, max wait {}",
+      priority,
+      lane.mResumed,
+      lane.mPeakDepth,
+      std::chrono::duration_cast<std::chrono::microseconds>(lane.GetMeanWait()),
+      std::chrono::duration_cast<std::chrono::microseconds>(lane.mMaxWait));
+  }
+
+  return exitCode;
+}
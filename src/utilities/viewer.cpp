@@ -38,6 +38,7 @@
 #include <OpenKneeboard/dprint.hpp>
 #include <OpenKneeboard/hresult.hpp>
 #include <OpenKneeboard/scope_exit.hpp>
+#include <OpenKneeboard/task.hpp>
 #include <OpenKneeboard/tracing.hpp>
 #include <OpenKneeboard/version.hpp>
 
@@ -49,6 +50,7 @@
 
 #include <format>
 #include <memory>
+#include <stop_token>
 #include <type_traits>
 
 #include <D2d1.h>
@@ -88,7 +90,9 @@ struct Pixel {
 };
 #pragma pack(pop)
 
-class TestViewerWindow final : private D3D11Resources {
+class TestViewerWindow final
+  : private D3D11Resources,
+    public std::enable_shared_from_this<TestViewerWindow> {
  private:
   std::optional<D2DResources> mD2D;
 
@@ -133,6 +137,7 @@ class TestViewerWindow final : private D3D11Resources {
   uint64_t mLayerID = 0;
   bool mSetInputFocus = false;
   size_t mRenderCacheKey = 0;
+  std::stop_source mStopWaitingForFrames;
 
   std::optional<RECT> mWindowRect {};
   ViewerSettings mSettings {ViewerSettings::Load()};
@@ -225,7 +230,7 @@ class TestViewerWindow final : private D3D11Resources {
     SetWindowLongPtrW(mHwnd, GWL_STYLE, style);
   }
 
- public:
+ private:
   TestViewerWindow(HINSTANCE instance) {
     gInstance = this;
     const wchar_t CLASS_NAME[] = L"OpenKneeboard Test Viewer";
@@ -263,7 +268,9 @@ class TestViewerWindow final : private D3D11Resources {
       NULL,
       instance,
       nullptr);
-    SetTimer(mHwnd, /* id = */ 1, 1000 / 60, nullptr);
+    // New frames are picked up by `WaitForFrames()`; this is just to keep us
+    // marked as an active consumer, and to notice if the feeder goes away
+    SetTimer(mHwnd, /* id = */ 1, 250, nullptr);
 
     this->InitializeShaders();
     this->InitializeDirect2D();
@@ -299,6 +306,35 @@ class TestViewerWindow final : private D3D11Resources {
     }
   }
 
+ public:
+  // Split out from the constructor so that `weak_from_this()` is valid
+  static std::shared_ptr<TestViewerWindow> Create(HINSTANCE instance) {
+    std::shared_ptr<TestViewerWindow> ret {new TestViewerWindow(instance)};
+    WaitForFrames(
+      ret->weak_from_this(), ret->mStopWaitingForFrames.get_token());
+    return ret;
+  }
+
+  ~TestViewerWindow() {
+    mStopWaitingForFrames.request_stop();
+  }
+
+  static OpenKneeboard::fire_and_forget WaitForFrames(
+    std::weak_ptr<TestViewerWindow> weak,
+    std::stop_token stopToken) {
+    SHM::Reader reader;
+    uint64_t renderCacheKey {};
+    // `task<>` resumes on this (the UI) thread
+    while (co_await reader.WaitForFrame(renderCacheKey, stopToken)) {
+      auto self = weak.lock();
+      if (!self) {
+        co_return;
+      }
+      renderCacheKey = reader.GetRenderCacheKey(SHM::ConsumerKind::Viewer);
+      self->CheckForUpdate();
+    }
+  }
+
   bool HaveDirectComposition() {
     // Incompatible due to Direct2D using undocumented
     // DXGIAdapterInternal1 interface
@@ -1163,8 +1199,8 @@ int WINAPI wWinMain(
   SetProcessDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
   winrt::init_apartment(winrt::apartment_type::single_threaded);
 
-  TestViewerWindow window(hInstance);
-  ShowWindow(window.GetHWND(), nCmdShow);
+  const auto window = TestViewerWindow::Create(hInstance);
+  ShowWindow(window->GetHWND(), nCmdShow);
 
   MSG msg = {};
   while (GetMessage(&msg, NULL, 0, 0) > 0) {